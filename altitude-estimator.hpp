@@ -0,0 +1,181 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <array>
+#include <cmath>
+
+namespace deets::estimation {
+
+// Altitude in meters above the reference pressure, both
+// pressures in the same unit.
+template<typename F>
+F barometric_altitude(F pressure, F reference_pressure)
+{
+  return static_cast<F>(44330.0) * (static_cast<F>(1.0) - std::pow(pressure / reference_pressure, static_cast<F>(1.0 / 5.255)));
+}
+
+// barometric_altitude without pow, so it also works for
+// Fixed and costs five multiplications: the binomial series
+// of (1 + x)^(1/5.255) around the reference pressure, up to
+// x^5. Within 2mm up to 1000m, 0.1m at 2000m, 1m at 3000m.
+template<typename F>
+F fast_barometric_altitude(F pressure, F reference_pressure)
+{
+  constexpr double k = 1.0 / 5.255;
+  const F x = pressure / reference_pressure - static_cast<F>(1.0);
+  // (1 + x)^k - 1, each term from the previous one
+  F series = static_cast<F>(1.0) + static_cast<F>((k - 4) / 5) * x;
+  series = static_cast<F>(1.0) + static_cast<F>((k - 3) / 4) * x * series;
+  series = static_cast<F>(1.0) + static_cast<F>((k - 2) / 3) * x * series;
+  series = static_cast<F>(1.0) + static_cast<F>((k - 1) / 2) * x * series;
+  return static_cast<F>(-44330.0 * k) * x * series;
+}
+
+template<typename F>
+struct altitude_estimate_t
+{
+  F altitude;
+  F velocity;
+  F acceleration;
+};
+
+// A three state (altitude, vertical velocity, vertical acceleration)
+// Kalman filter using a constant acceleration model driven by
+// white jerk noise.
+//
+// Measurements are processed one scalar at a time, so no matrix
+// inversion is needed and every call runs in constant time without
+// touching the heap.
+template<typename F>
+class AltitudeKalmanFilter
+{
+  static constexpr int N = 3;
+  using vector_t = std::array<F, N>;
+  using matrix_t = std::array<vector_t, N>;
+
+  enum { ALTITUDE, VELOCITY, ACCELERATION };
+
+public:
+  using estimate_t = altitude_estimate_t<F>;
+
+  // The variances are those of the respective measurements,
+  // the jerk spectral density determines how quickly the
+  // filter follows changes in acceleration.
+  AltitudeKalmanFilter(F altitude_variance, F acceleration_variance, F jerk_spectral_density)
+    : _x{}
+    , _P{}
+    , _altitude_variance(altitude_variance)
+    , _acceleration_variance(acceleration_variance)
+    , _q(jerk_spectral_density)
+  {
+    // We start out on the ground, at rest, but with
+    // some uncertainty about that.
+    _P[ALTITUDE][ALTITUDE] = altitude_variance;
+    _P[VELOCITY][VELOCITY] = static_cast<F>(1.0);
+    _P[ACCELERATION][ACCELERATION] = static_cast<F>(1.0);
+  }
+
+  // Advance the state by dt seconds
+  void predict(F dt)
+  {
+    const auto dt2 = dt * dt;
+    const auto dt3 = dt2 * dt;
+    const matrix_t A = {{
+        { static_cast<F>(1.0), dt, dt2 / static_cast<F>(2.0) },
+        { static_cast<F>(0.0), static_cast<F>(1.0), dt },
+        { static_cast<F>(0.0), static_cast<F>(0.0), static_cast<F>(1.0) },
+      }};
+
+    vector_t x{};
+    for(int i = 0; i < N; ++i)
+    {
+      for(int j = 0; j < N; ++j)
+      {
+        x[i] += A[i][j] * _x[j];
+      }
+    }
+    _x = x;
+
+    // P = A P A^T + Q
+    matrix_t AP{};
+    for(int i = 0; i < N; ++i)
+    {
+      for(int j = 0; j < N; ++j)
+      {
+        for(int k = 0; k < N; ++k)
+        {
+          AP[i][j] += A[i][k] * _P[k][j];
+        }
+      }
+    }
+    const matrix_t Q = {{
+        { dt3 * dt2 / static_cast<F>(20.0), dt2 * dt2 / static_cast<F>(8.0), dt3 / static_cast<F>(6.0) },
+        { dt2 * dt2 / static_cast<F>(8.0), dt3 / static_cast<F>(3.0), dt2 / static_cast<F>(2.0) },
+        { dt3 / static_cast<F>(6.0), dt2 / static_cast<F>(2.0), dt },
+      }};
+    for(int i = 0; i < N; ++i)
+    {
+      for(int j = 0; j < N; ++j)
+      {
+        F p = _q * Q[i][j];
+        for(int k = 0; k < N; ++k)
+        {
+          p += AP[i][k] * A[j][k];
+        }
+        _P[i][j] = p;
+      }
+    }
+  }
+
+  void update_altitude(F altitude)
+  {
+    update(ALTITUDE, altitude, _altitude_variance);
+  }
+
+  void update_acceleration(F acceleration)
+  {
+    update(ACCELERATION, acceleration, _acceleration_variance);
+  }
+
+  estimate_t estimate() const
+  {
+    return { _x[ALTITUDE], _x[VELOCITY], _x[ACCELERATION] };
+  }
+
+  // Carries on from an earlier estimate, e.g. after a
+  // reset. The uncertainty stays as it is.
+  void restore(const estimate_t& estimate)
+  {
+    _x = { estimate.altitude, estimate.velocity, estimate.acceleration };
+  }
+
+private:
+  void update(int index, F measurement, F variance)
+  {
+    const auto innovation = measurement - _x[index];
+    const auto s = _P[index][index] + variance;
+    vector_t gain;
+    for(int i = 0; i < N; ++i)
+    {
+      gain[i] = _P[i][index] / s;
+    }
+    // We need the unmodified row while updating P
+    const vector_t row = _P[index];
+    for(int i = 0; i < N; ++i)
+    {
+      _x[i] += gain[i] * innovation;
+      for(int j = 0; j < N; ++j)
+      {
+        _P[i][j] -= gain[i] * row[j];
+      }
+    }
+  }
+
+  vector_t _x;
+  matrix_t _P;
+  F _altitude_variance;
+  F _acceleration_variance;
+  F _q;
+};
+
+} // namespace deets::estimation
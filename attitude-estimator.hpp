@@ -0,0 +1,173 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cmath>
+
+namespace deets::estimation {
+
+// Mahony's complementary filter on a quaternion: the gyro
+// is integrated, the accelerometer pulls the estimate back
+// towards gravity with a proportional and an integral term,
+// the latter learning the gyro bias while on the pad.
+//
+// The accelerometer only tells where down is while nothing
+// but gravity and the ground act on us. Under thrust, drag
+// or in free fall the filter integrates the gyro alone.
+//
+// Only the tilt is of interest, so the magnetometer isn't
+// used and the heading is left to drift.
+//
+// Works with float and Fixed, without sqrt or division in
+// the update, and without the heap.
+// Accelerations are in g, angular velocities in rad/s, the
+// body z axis is the axis of the rocket.
+template<typename F>
+class MahonyFilter
+{
+public:
+  using vector_t = F[3];
+  using quaternion_t = F[4];
+
+  // What it takes to carry on after a reset
+  struct snapshot_t
+  {
+    quaternion_t q;
+    vector_t error;
+  };
+
+  // tolerance is how far (in g) the acceleration
+  // may be from 1g to still be taken as gravity
+  MahonyFilter(F kp, F ki, F tolerance)
+    : _kp(kp)
+    , _ki(ki)
+    , _lower(square(static_cast<F>(1.0) - tolerance))
+    , _upper(square(static_cast<F>(1.0) + tolerance))
+  {}
+
+  void update(const vector_t& acceleration, const vector_t& omega, F dt)
+  {
+    F wx = omega[0], wy = omega[1], wz = omega[2];
+    const F ax = acceleration[0], ay = acceleration[1], az = acceleration[2];
+    const F norm2 = ax * ax + ay * ay + az * az;
+    if(norm2 > _lower && norm2 < _upper)
+    {
+      // Within the tolerance around 1g one Newton step
+      // from 1 is close enough to 1/|a|, off by 1.5% at
+      // 0.1g, which only scales the gains a little
+      const F inverse_norm = (static_cast<F>(3.0) - norm2) * static_cast<F>(0.5);
+      // The error between measured and estimated up
+      // is their cross product
+      const F ex = (ay * _vz - az * _vy) * inverse_norm;
+      const F ey = (az * _vx - ax * _vz) * inverse_norm;
+      const F ez = (ax * _vy - ay * _vx) * inverse_norm;
+      _error[0] += ex;
+      _error[1] += ey;
+      _error[2] += ez;
+      wx += _kp * ex;
+      wy += _kp * ey;
+      wz += _kp * ez;
+    }
+    // The integral of the error is kept as a sum, scaled
+    // by the sample period only here. Each step alone is
+    // below the resolution of Q15.16. The IMU runs at a
+    // fixed rate, so this is the same.
+    wx += _ki * _error[0] * dt;
+    wy += _ki * _error[1] * dt;
+    wz += _ki * _error[2] * dt;
+
+    // q' = q + q * (0, w) * dt / 2
+    const F h = dt * static_cast<F>(0.5);
+    wx *= h;
+    wy *= h;
+    wz *= h;
+    const F q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+    _q[0] = q0 - q1 * wx - q2 * wy - q3 * wz;
+    _q[1] = q1 + q0 * wx + q2 * wz - q3 * wy;
+    _q[2] = q2 + q0 * wy - q1 * wz + q3 * wx;
+    _q[3] = q3 + q0 * wz + q1 * wy - q2 * wx;
+
+    // One Newton step back to unit length is enough
+    // for the tiny steps between samples
+    const F n2 = _q[0] * _q[0] + _q[1] * _q[1] + _q[2] * _q[2] + _q[3] * _q[3];
+    const F scale = (static_cast<F>(3.0) - n2) * static_cast<F>(0.5);
+    for(auto& q : _q)
+    {
+      q *= scale;
+    }
+
+    update_up();
+  }
+
+  // The cosine of the angle between the rocket axis
+  // and the vertical, 1 when upright
+  F cos_tilt() const
+  {
+    return _vz;
+  }
+
+  // The acceleration projected onto the vertical, in the
+  // unit it is given in. Sitting on the pad this is 1g.
+  F vertical_acceleration(const vector_t& acceleration) const
+  {
+    return acceleration[0] * _vx + acceleration[1] * _vy + acceleration[2] * _vz;
+  }
+
+  // w, x, y, z, rotating body into world coordinates
+  const quaternion_t& quaternion() const
+  {
+    return _q;
+  }
+
+  snapshot_t snapshot() const
+  {
+    snapshot_t snapshot;
+    for(int i = 0; i < 4; ++i)
+    {
+      snapshot.q[i] = _q[i];
+    }
+    for(int i = 0; i < 3; ++i)
+    {
+      snapshot.error[i] = _error[i];
+    }
+    return snapshot;
+  }
+
+  void restore(const snapshot_t& snapshot)
+  {
+    for(int i = 0; i < 4; ++i)
+    {
+      _q[i] = snapshot.q[i];
+    }
+    for(int i = 0; i < 3; ++i)
+    {
+      _error[i] = snapshot.error[i];
+    }
+    update_up();
+  }
+
+private:
+  // Up in body coordinates, the last row of the rotation
+  void update_up()
+  {
+    _vx = static_cast<F>(2.0) * (_q[1] * _q[3] - _q[0] * _q[2]);
+    _vy = static_cast<F>(2.0) * (_q[0] * _q[1] + _q[2] * _q[3]);
+    _vz = _q[0] * _q[0] - _q[1] * _q[1] - _q[2] * _q[2] + _q[3] * _q[3];
+  }
+
+  static F square(F value)
+  {
+    return value * value;
+  }
+
+  F _kp;
+  F _ki;
+  F _lower;
+  F _upper;
+  quaternion_t _q = { static_cast<F>(1.0), F{}, F{}, F{} };
+  vector_t _error = {};
+  F _vx = {};
+  F _vy = {};
+  F _vz = static_cast<F>(1.0);
+};
+
+} // namespace deets::estimation
@@ -0,0 +1,158 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <Arduino.h>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace far::junior {
+
+enum class board
+{
+  MAPLE_V1,
+  MAPLE_V2,
+  MAPLE_V3,
+  PICO,
+};
+
+enum class imu
+{
+  MPU9250,
+  BNO055,
+};
+
+// What the firmware needs to know about a board: its
+// pins, its sensors and how to scale their raw readings,
+// and how much RAM to spend on buffers. Code for a sensor
+// the board doesn't have is discarded with if constexpr.
+// Whether the samples are fixed point is decided by the
+// MCU, see value_t.
+template<board B>
+struct BoardTraits;
+
+#ifdef RASPBERRYPI_PICO
+
+template<>
+struct BoardTraits<board::PICO>
+{
+  using pin_t = decltype(p2);
+
+  static constexpr const char* NAME = "FARduino Pico";
+
+  static constexpr imu IMU = imu::BNO055;
+  // The BNO055 reads are already in m/s^2 and deg/s
+  static constexpr double ONE_G = 9.81;
+  static constexpr double ONE_DEG_PER_SECOND = 1.0;
+
+  static constexpr pin_t PYRO_PINS[4] = { p14, p13, p12, p11 };
+  static constexpr pin_t TONE_PIN = p2;
+  static constexpr pin_t NRF24_CE_PIN = p8;
+  static constexpr pin_t NRF24_CS_PIN = p4;
+  // No IMU_INT_PIN: INT1 and INT2 of the BMI160 (IC6) aren't
+  // routed in eagle/farduino_pico.sch, GP15 is CAN_INT\ of
+  // the MCP2518FD (IC14).
+
+  static constexpr bool SD_CARD = false;
+
+  static constexpr size_t RADIO_BUFFER = 256;
+  static constexpr size_t GPS_SENTENCE = 128;
+};
+
+#else
+
+template<>
+struct BoardTraits<board::MAPLE_V1>
+{
+  using pin_t = decltype(PA2);
+
+  static constexpr const char* NAME = "FARduino Maple v0.1";
+
+  // Without a data ready line
+  static constexpr imu IMU = imu::MPU9250;
+  // The LSBs at +/-16g and +/-2000deg/s, see setup_mpu9250
+  static constexpr double ONE_G = 2048.0;
+  static constexpr double ONE_DEG_PER_SECOND = 16.4;
+
+  static constexpr pin_t PYRO_PINS[4] = { PA14, PA13, PA12, PA11 };
+  static constexpr pin_t TONE_PIN = PA2;
+  static constexpr pin_t NRF24_CE_PIN = PA8;
+  static constexpr pin_t NRF24_CS_PIN = PA4;
+
+  // On SPI2
+  static constexpr bool SD_CARD = true;
+  static constexpr pin_t SD_CS_PIN = PB12;
+
+  static constexpr size_t RADIO_BUFFER = 256;
+  static constexpr size_t GPS_SENTENCE = 128;
+};
+
+template<>
+struct BoardTraits<board::MAPLE_V2>
+{
+  using pin_t = decltype(PA2);
+
+  static constexpr const char* NAME = "FARduino Maple v0.2";
+
+  static constexpr imu IMU = imu::BNO055;
+  static constexpr double ONE_G = 9.81;
+  static constexpr double ONE_DEG_PER_SECOND = 1.0;
+
+  static constexpr pin_t PYRO_PINS[4] = { PB5, PB4, PB3, PA15 };
+  static constexpr pin_t TONE_PIN = PA2;
+  static constexpr pin_t NRF24_CE_PIN = PC15;
+  static constexpr pin_t NRF24_CS_PIN = PA4;
+  // The schematics of the v0.2 and v0.3 aren't in this
+  // repository, and neither routes the INT of the BNO055
+  // breakout that we know of. PB8 is where the firmware
+  // expects a wire from it: an EXTI line not taken by I2C1
+  // (PB6/PB7), SPI2 or the pins above.
+  static constexpr pin_t IMU_INT_PIN = PB8;
+
+  static constexpr bool SD_CARD = true;
+  static constexpr pin_t SD_CS_PIN = PB12;
+
+  static constexpr size_t RADIO_BUFFER = 256;
+  static constexpr size_t GPS_SENTENCE = 128;
+};
+
+// Wired like the v2, as far as the firmware is concerned
+template<>
+struct BoardTraits<board::MAPLE_V3> : BoardTraits<board::MAPLE_V2>
+{
+  static constexpr const char* NAME = "FARduino Maple v0.3";
+};
+
+#endif
+
+// The Arduino IDE can't pass defines to a sketch, so the
+// Maple revision is picked here. Uncomment for the v0.1,
+// FARDUINO_MPU9250 then pulls in its driver.
+//#define FARDUINO_MAPLE_V1
+#ifdef RASPBERRYPI_PICO
+using Board = BoardTraits<board::PICO>;
+#elif defined(FARDUINO_MAPLE_V1)
+using Board = BoardTraits<board::MAPLE_V1>;
+#define FARDUINO_MPU9250
+#else
+using Board = BoardTraits<board::MAPLE_V2>;
+#endif
+
+#ifdef FARDUINO_MPU9250
+static_assert(Board::IMU == imu::MPU9250, "FARDUINO_MPU9250 on a board without the MPU9250");
+#else
+static_assert(Board::IMU != imu::MPU9250, "define FARDUINO_MPU9250 along with the board");
+#endif
+
+// Whether the data ready line of the IMU reaches the MCU
+template<typename Traits, typename = void>
+struct has_imu_int_pin : std::false_type
+{
+};
+
+template<typename Traits>
+struct has_imu_int_pin<Traits, std::void_t<decltype(Traits::IMU_INT_PIN)>> : std::true_type
+{
+};
+
+} // namespace far::junior
@@ -0,0 +1,156 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace deets::boot {
+
+// What a step of a boot phase asks for
+struct step_t
+{
+  enum status_t : uint8_t
+  {
+    // Run step next after wait_ms
+    WAIT,
+    DONE,
+    FAILED,
+  };
+
+  status_t status;
+  uint8_t next;
+  uint16_t wait_ms;
+
+  static constexpr step_t done() { return { DONE, 0, 0 }; }
+  static constexpr step_t failed() { return { FAILED, 0, 0 }; }
+  static constexpr step_t wait(uint8_t next, uint16_t ms) { return { WAIT, next, ms }; }
+};
+
+template<typename Duration>
+struct phase_statistics_t
+{
+  // WAIT as long as the phase isn't over
+  step_t::status_t status = step_t::WAIT;
+  uint8_t steps = 0;
+  // From the start of the sequence to the end of the phase
+  Duration end{};
+  // In the steps themselves, the rest was waiting
+  Duration busy{};
+};
+
+// Brings the devices up side by side.
+//
+// A phase is a state machine, called with the step to
+// run, starting at 0. A step does its bus transactions
+// and returns how long the device needs before the next
+// one. Whichever phase is due runs, so the time one
+// device takes to reset is spent on the others.
+template<typename Clock, size_t N>
+class BootSequence
+{
+public:
+  using time_point = typename Clock::time_point;
+  using duration = typename Clock::duration;
+  using function_t = step_t (*)(uint8_t step);
+  using statistics_t = phase_statistics_t<duration>;
+
+  // False if all N slots are taken
+  bool add(const char* name, function_t function)
+  {
+    if(_count == N)
+    {
+      return false;
+    }
+    _phases[_count++] = { name, function, 0, {}, {} };
+    return true;
+  }
+
+  // Until all phases are done or failed. When none is
+  // due, wait(duration) is called with the time to the
+  // next one.
+  template<typename Wait>
+  void run(Wait wait)
+  {
+    _start = Clock::now();
+    for(auto& phase : in_use())
+    {
+      phase.due = _start;
+    }
+    while(true)
+    {
+      auto next = time_point::max();
+      for(auto& phase : in_use())
+      {
+        auto& statistics = phase.statistics;
+        const auto start = Clock::now();
+        if(statistics.status == step_t::WAIT && phase.due <= start)
+        {
+          const auto step = phase.function(phase.step);
+          const auto end = Clock::now();
+          ++statistics.steps;
+          statistics.busy += end - start;
+          statistics.status = step.status;
+          statistics.end = end - _start;
+          phase.step = step.next;
+          phase.due = end + std::chrono::milliseconds(step.wait_ms);
+        }
+        if(statistics.status == step_t::WAIT)
+        {
+          next = std::min(next, phase.due);
+        }
+      }
+      if(next == time_point::max())
+      {
+        break;
+      }
+      const auto now = Clock::now();
+      if(next > now)
+      {
+        wait(next - now);
+      }
+    }
+    _total = Clock::now() - _start;
+  }
+
+  size_t size() const { return _count; }
+
+  // In the order they were added
+  const char* name(size_t i) const { return _phases[i].name; }
+  const statistics_t& statistics(size_t i) const { return _phases[i].statistics; }
+
+  // Of the last run
+  duration total() const { return _total; }
+
+private:
+  struct phase_t
+  {
+    const char* name;
+    function_t function;
+    uint8_t step;
+    time_point due;
+    statistics_t statistics;
+  };
+
+  struct range_t
+  {
+    phase_t* first;
+    phase_t* last;
+    phase_t* begin() const { return first; }
+    phase_t* end() const { return last; }
+  };
+
+  range_t in_use()
+  {
+    return { _phases.data(), _phases.data() + _count };
+  }
+
+  std::array<phase_t, N> _phases;
+  size_t _count = 0;
+  time_point _start{};
+  duration _total{};
+};
+
+} // namespace deets::boot
@@ -0,0 +1,86 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Places a variable outside of .data and .bss, so neither
+// the startup code nor a reset touch it. Since GCC 10 a
+// noinit variable goes into .noinit, a section without
+// contents. Neither the ldscript.ld of STM32duino nor the
+// memmap_default.ld of the Pico SDK names .noinit, so ld
+// places it as an orphan right after .bss on both cores:
+// past _ebss and __bss_end__, where the startup code stops
+// zeroing, and before end, where ._user_heap_stack and
+// .heap start the heap.
+#if defined(ARDUINO) && defined(__arm__)
+#if __GNUC__ < 10
+#error "DEETS_NOINIT needs the noinit attribute of GCC 10"
+#endif
+#define DEETS_NOINIT __attribute__((noinit))
+#else
+#define DEETS_NOINIT
+#endif
+
+namespace deets::checkpoint {
+
+// CRC-32 as in zlib, a nibble at a time, so the
+// table is only 64 bytes
+inline uint32_t crc32(const void* data, size_t size, uint32_t crc = 0)
+{
+  static constexpr uint32_t TABLE[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+  };
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for(size_t i = 0; i < size; ++i)
+  {
+    crc ^= bytes[i];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+// A copy of a T that survives a reset, as long as the
+// power stays on. Declare it DEETS_NOINIT and without an
+// initializer. After power on it holds garbage, which the
+// CRC tells apart.
+template<typename T>
+class Checkpoint
+{
+  static_assert(std::is_trivially_copyable_v<T>, "a checkpoint is copied byte by byte");
+
+public:
+  void save(const T& value)
+  {
+    std::memcpy(_bytes, &value, sizeof(T));
+    _crc = crc32(_bytes, sizeof(T), SEED);
+  }
+
+  // False if there is nothing valid to load
+  bool load(T& value) const
+  {
+    if(crc32(_bytes, sizeof(T), SEED) != _crc)
+    {
+      return false;
+    }
+    std::memcpy(&value, _bytes, sizeof(T));
+    return true;
+  }
+
+private:
+  // So a firmware with a different T doesn't take
+  // what the previous one left
+  static constexpr uint32_t SEED = uint32_t(sizeof(T));
+
+  // Raw bytes, T might have a constructor, which
+  // would run at startup
+  unsigned char _bytes[sizeof(T)];
+  uint32_t _crc;
+};
+
+} // namespace deets::checkpoint
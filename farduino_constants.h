@@ -4,14 +4,6 @@
 //all times in microseconds
 #define MIN_ACCELERATION_TIME 400000
 
-#ifdef farduino_maple_v1
-#define ONE_G 2048.0
-#define ONE_DEG_PER_SECOND 16.4
-#else
-#define ONE_G 1000.0
-#define ONE_DEG_PER_SECOND 16.0
-#endif
-
 #define ONE_SECOND 1000000
 #define MIN_FLIGHT_TIME 5000000
 #define MAX_TIME_TO_PEAK 7000000
@@ -21,33 +13,53 @@
 #define STAGE_DELAY 1000000
 #define MIN_PRESSURE_DROP -0.8
 
-#ifdef farduino_maple_v1
-//#define USE_SD_CARD
-#define PYRO0 PA14
-#define PYRO1 PA13
-#define PYRO2 PA12
-#define PYRO3 PA11
-#define TONE_PIN PA2
-#define NRF24_CE_PIN PA8
-#define NRF24_CS_PIN PA4
-#elif defined(RASPBERRYPI_PICO)
-#define PYRO0 p14
-#define PYRO1 p13
-#define PYRO2 p12
-#define PYRO3 p11
-#define TONE_PIN p2
-#define NRF24_CE_PIN p8
-#define NRF24_CS_PIN p4
-#else
-//#define USE_SD_CARD
-#define PYRO0 PB5
-#define PYRO1 PB4
-#define PYRO2 PB3
-#define PYRO3 PA15
-#define TONE_PIN PA2
-#define NRF24_CE_PIN PC15
-#define NRF24_CS_PIN PA4
+//task periods of the scheduler. The sensors are read at
+//their output data rates, telemetry and logging slower.
+//125Hz, the accelerometer output data rate
+#define IMU_PERIOD 8000
+//conversion time of the BMP280 sampling set up in setup()
+#define MET_PERIOD 26000
+#define IMU_TELEMETRY_PERIOD 40000
+#define MET_TELEMETRY_PERIOD 100000
+//often enough to not overflow the serial buffer at 9600 baud
+#define GPS_PERIOD 20000
+#define SD_SYNC_PERIOD 1000000
+
+//time the stages of the loop and send $RQPERF sentences,
+//compiles out completely when not defined
+//#define USE_PERF_COUNTERS
+#define PERF_PERIOD 5000000
+//a note lasts 37ms at the shortest in our songs
+#define SONG_PERIOD 10000
+
+//record what the state machine does and log it as $RQTRACE
+//sentences on landing, 8 bytes of RAM per record. The
+//emulator is built with it for trace-decode.
+//#define USE_TRANSITION_TRACE
+#define TRANSITION_TRACE_RECORDS 128
 
+#ifdef RASPBERRYPI_PICO
+//sensors are read on core 1, control and telemetry on core 0
+#define FARDUINO_DUAL_CORE
 #endif
 
+//read the sensors when they signal new data instead of polling,
+//needs the BNO055 INT line wired to the IMU_INT_PIN of the board,
+//the Pico has none
+//#define USE_DATA_READY_INTERRUPTS
+
+//fast mode, which the BMP280, BNO055 and MPU9250 all support
+#define I2C_CLOCK 400000
+
+//BNO055 registers and bits to clear the data ready interrupt,
+//the driver sets it up
+#define BNO055_ADDRESS 0x28
+#define BNO055_SYS_TRIGGER 0x3F
+#define BNO055_RST_INT 0x40
+#define BNO055_CLK_SEL 0x80
+
+//log to the SD card, needs SdFat and a board with a slot,
+//see BoardTraits
+//#define USE_SD_CARD
+
 #endif
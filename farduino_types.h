@@ -29,4 +29,18 @@ typedef enum {
 
 
 
+//stages of the loop we measure with USE_PERF_COUNTERS
+typedef enum {
+  perf_IMU_READ,
+  perf_MET_READ,
+  perf_GPS,
+  perf_ENCODE,
+  perf_SEND,
+  perf_SD_SYNC,
+  perf_DRIVE,
+  perf_STAGES
+} perf_stage_t;
+
+
+
 #endif
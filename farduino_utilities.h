@@ -1,6 +1,11 @@
 #ifndef __FARDUINO_UTILITIES__
 #define __FARDUINO_UTILITIES__
 
+#include "junior-rocket-state.hpp"
+#ifdef USE_PERF_COUNTERS
+#include "profiling.hpp"
+#endif
+
 #ifdef RASPBERRYPI_PICO
 char *dtostrf(double val, signed char width, unsigned char prec, char *sout)
 {
@@ -12,34 +17,58 @@ char *dtostrf(double val, signed char width, unsigned char prec, char *sout)
 }
 #endif
 
-unsigned long base_seconds = 0;
-unsigned long base_fraction = 0;
-unsigned long last_micros = 0;
-
-
-unsigned long get_timestamp(){
-
-  unsigned long current_micros = micros();
-  if (current_micros<last_micros){
-    base_seconds += 4294;
-    base_fraction += 967295;
+#ifdef FARDUINO_FIXED_POINT
+//same output as dtostrf, but without going through soft-float
+char *dtostrf(far::junior::value_t val, signed char width, unsigned char prec, char *sout)
+{
+  constexpr int fraction_bits = far::junior::value_t::FRACTION;
+  char digits[24];
+  char *digit = digits + sizeof(digits);
+
+  const bool negative = val.raw() < 0;
+  uint64_t magnitude = negative ? -int64_t(val.raw()) : val.raw();
+  uint32_t scale = 1;
+  for (int i = 0; i < prec; i++) {
+    scale *= 10;
   }
-  last_micros = current_micros;
-
-  return current_micros;
-}
+  //round to prec decimals, ties to even like printf. The result fits into 32 bits
+  const uint64_t exact = magnitude * scale;
+  const uint64_t half = uint64_t(1) << (fraction_bits - 1);
+  const uint64_t remainder = exact & ((half << 1) - 1);
+  uint32_t scaled = exact >> fraction_bits;
+  if (remainder > half || (remainder == half && (scaled & 1))) {
+    scaled++;
+  }
+  uint32_t integer = scaled / scale;
+  uint32_t fraction = scaled % scale;
 
-unsigned long timestamp_difference(unsigned long start_time, unsigned long stop_time) {
-  // Assures that our assumption about 32 bits
-  // for unsigned longs holds
-  static_assert(sizeof(unsigned long) == 4);
+  for (int i = 0; i < prec; i++) {
+    *--digit = '0' + fraction % 10;
+    fraction /= 10;
+  }
+  if (prec) {
+    *--digit = '.';
+  }
+  do {
+    *--digit = '0' + integer % 10;
+    integer /= 10;
+  } while (integer);
+  if (negative) {
+    *--digit = '-';
+  }
 
-  if (start_time <= stop_time) {
-    return stop_time - start_time;
-  } else {
-    return (4294967295 - start_time) + stop_time;
+  const int length = digits + sizeof(digits) - digit;
+  char *destination = sout;
+  for (int i = length; i < width; i++) {
+    *destination++ = ' ';
   }
+  memcpy(destination, digit, length);
+  destination[length] = 0;
+  return sout;
 }
+#endif
+
+far::junior::TimeOfDayFormatter time_of_day_formatter;
 
 
 void remove_spaces(char* my_buffer){
@@ -62,37 +91,26 @@ void remove_spaces(char* my_buffer){
 }
 
 //writes time of day into given buffer, always 11 chars long
-void time_of_day(unsigned long timestamp, char *destination) {
-
-  int current_hour;
-  int current_minute;
-  int current_second;
-
-  unsigned long timestamp_seconds = timestamp/1000000;
-  unsigned long timestamp_fraction = timestamp%1000000;
+void time_of_day(far::junior::timestamp_t timestamp, char *destination) {
+  time_of_day_formatter.format(timestamp, destination);
+}
 
-  unsigned long current_fraction = base_fraction + timestamp_fraction;
-  current_second = base_seconds + timestamp_seconds + current_fraction/1000000;
-  current_fraction = (current_fraction%1000000)/100;
 
 
-  current_hour =  current_second / 3600;
-  current_second = current_second % 3600;
-  current_minute = current_second / 60;
-  current_second %= 60;
+#ifdef USE_PERF_COUNTERS
+deets::profiling::Histogram<> perf_histograms[perf_STAGES];
 
-  sprintf(&destination[0], "%02i", current_hour);
-  sprintf(&destination[2], "%02i", current_minute);
-  sprintf(&destination[4], "%02i", current_second);
-  destination[6] = '.';
-  sprintf(&destination[7], "%04i", current_fraction);
-  destination[11] = 0;
+const char* const perf_stage_names[perf_STAGES] = { "IMU", "MET", "GPS", "ENCODE", "SEND", "SD", "DRIVE" };
 
-}
+//times the rest of the enclosing scope
+#define PERF_PROBE(stage) deets::profiling::ScopedProbe<deets::profiling::Histogram<>> perf_probe_##stage(perf_histograms[stage])
+#else
+#define PERF_PROBE(stage)
+#endif
 
 
 
-void construct_IMU_sentence (unsigned long timestamp, double my_acc[3], double my_gyro[3], double my_magn[3], char* sentence_buffer) {
+void construct_IMU_sentence (far::junior::timestamp_t timestamp, const far::junior::value_t my_acc[3], const far::junior::value_t my_gyro[3], const far::junior::value_t my_magn[3], char* sentence_buffer) {
 
   char *buffer_start;                          //pointer to timestamp string
 
@@ -149,7 +167,7 @@ void construct_IMU_sentence (unsigned long timestamp, double my_acc[3], double m
 
 
 
-void construct_MET_sentence(unsigned long timestamp, double p, double T, double h, char* sentence_buffer) {
+void construct_MET_sentence(far::junior::timestamp_t timestamp, far::junior::value_t p, far::junior::value_t T, far::junior::value_t h, char* sentence_buffer) {
 
   char *buffer_start;                          //pointer to timestamp string
   char *time_string;
@@ -193,7 +211,7 @@ void construct_MET_sentence(unsigned long timestamp, double p, double T, double
 }
 
 
-void construct_state_sentence(unsigned long timestamp, double pressure_0, double pressure, stage_state_t my_state, char* sentence_buffer) {
+void construct_state_sentence(far::junior::timestamp_t timestamp, far::junior::value_t pressure_0, far::junior::value_t pressure, stage_state_t my_state, char* sentence_buffer) {
 
   char *time_string;
   unsigned char xor_checksum;
@@ -301,4 +319,74 @@ void construct_state_sentence(unsigned long timestamp, double pressure_0, double
 }
 
 
+
+//one record of the transition trace, index counting from the oldest
+//still there, recorded the records since boot. The record goes as
+//16 hex digits: at, from, to, trigger and kind
+void construct_trace_sentence(far::junior::timestamp_t timestamp, size_t index, uint32_t recorded, const tfa::trace_record_t& record, char* sentence_buffer) {
+
+  unsigned char xor_checksum;
+  char *checksum_pointer;
+
+  checksum_pointer = sentence_buffer + 1;
+  sprintf(sentence_buffer, "$RQTRACE,");
+  sentence_buffer += 9;
+  time_of_day(timestamp, sentence_buffer);
+  sentence_buffer += 11;
+
+  sentence_buffer += sprintf(sentence_buffer, ",%u,%lu,%08lX%02X%02X%02X%02X",
+                             unsigned(index),
+                             (unsigned long)recorded,
+                             (unsigned long)record.at,
+                             record.from,
+                             record.to,
+                             record.trigger,
+                             unsigned(record.kind));
+
+  xor_checksum = 0;
+  while (checksum_pointer != sentence_buffer) {
+    xor_checksum ^= *checksum_pointer++;
+  }
+
+  sprintf(sentence_buffer, "*%02X", xor_checksum);
+  sentence_buffer += 3;
+  *sentence_buffer++ = 0x0d;
+  *sentence_buffer++ = 0x0a;
+  *sentence_buffer = 0;  //terminate string
+}
+
+#ifdef USE_PERF_COUNTERS
+//summary of one stage since boot: samples, mean, 99th percentile and max in microseconds
+void construct_perf_sentence(far::junior::timestamp_t timestamp, perf_stage_t stage, char* sentence_buffer) {
+
+  unsigned char xor_checksum;
+  char *checksum_pointer;
+  const deets::profiling::Histogram<>& histogram = perf_histograms[stage];
+
+  checksum_pointer = sentence_buffer + 1;
+  sprintf(sentence_buffer, "$RQPERF,");
+  sentence_buffer += 8;
+  time_of_day(timestamp, sentence_buffer);
+  sentence_buffer += 11;
+
+  sentence_buffer += sprintf(sentence_buffer, ",%s,%lu,%lu,%lu,%lu",
+                             perf_stage_names[stage],
+                             (unsigned long)histogram.count(),
+                             (unsigned long)histogram.mean(),
+                             (unsigned long)histogram.percentile(99),
+                             (unsigned long)histogram.max());
+
+  xor_checksum = 0;
+  while (checksum_pointer != sentence_buffer) {
+    xor_checksum ^= *checksum_pointer++;
+  }
+
+  sprintf(sentence_buffer, "*%02X", xor_checksum);
+  sentence_buffer += 3;
+  *sentence_buffer++ = 0x0d;
+  *sentence_buffer++ = 0x0a;
+  *sentence_buffer = 0;  //terminate string
+}
+#endif
+
 #endif
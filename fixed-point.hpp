@@ -0,0 +1,123 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <cmath>
+#ifdef USE_IOSTREAM
+#include <ostream>
+#endif
+
+namespace deets::fixed {
+
+// Integer square root, bit by bit.
+inline uint64_t isqrt(uint64_t value)
+{
+  uint64_t result = 0;
+  uint64_t bit = uint64_t(1) << 62;
+  while(bit > value)
+  {
+    bit >>= 2;
+  }
+  while(bit)
+  {
+    if(value >= result + bit)
+    {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    }
+    else
+    {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result;
+}
+
+// Signed Q-format number with Fraction fractional bits.
+//
+// Products and quotients go through the Wide type, so
+// on a Cortex-M3 a multiplication is a single SMULL
+// plus a shift. Conversions from and to floating point
+// are explicit, so soft-float math can't sneak in.
+template<int Fraction, typename Storage=int32_t, typename Wide=int64_t>
+class Fixed
+{
+public:
+  using storage_t = Storage;
+  static constexpr int FRACTION = Fraction;
+  static constexpr Storage ONE = Storage(1) << Fraction;
+
+  constexpr Fixed() : _raw(0) {}
+  constexpr explicit Fixed(int value) : _raw(Storage(value) * ONE) {}
+  constexpr explicit Fixed(long value) : _raw(Storage(value) * ONE) {}
+  constexpr explicit Fixed(double value)
+    : _raw(Storage(value * ONE + (value >= 0 ? 0.5 : -0.5)))
+  {}
+  constexpr explicit Fixed(float value) : Fixed(double(value)) {}
+
+  static constexpr Fixed from_raw(Storage raw)
+  {
+    Fixed result;
+    result._raw = raw;
+    return result;
+  }
+
+  constexpr Storage raw() const { return _raw; }
+
+  constexpr explicit operator float() const { return float(_raw) / float(ONE); }
+  constexpr explicit operator double() const { return double(_raw) / double(ONE); }
+
+  constexpr Fixed operator-() const { return from_raw(-_raw); }
+
+  constexpr Fixed& operator+=(Fixed other) { _raw += other._raw; return *this; }
+  constexpr Fixed& operator-=(Fixed other) { _raw -= other._raw; return *this; }
+  constexpr Fixed& operator*=(Fixed other)
+  {
+    _raw = Storage((Wide(_raw) * other._raw) >> Fraction);
+    return *this;
+  }
+  constexpr Fixed& operator/=(Fixed other)
+  {
+    _raw = Storage((Wide(_raw) * ONE) / other._raw);
+    return *this;
+  }
+
+  friend constexpr Fixed operator+(Fixed a, Fixed b) { return a += b; }
+  friend constexpr Fixed operator-(Fixed a, Fixed b) { return a -= b; }
+  friend constexpr Fixed operator*(Fixed a, Fixed b) { return a *= b; }
+  friend constexpr Fixed operator/(Fixed a, Fixed b) { return a /= b; }
+
+  friend constexpr bool operator==(Fixed a, Fixed b) { return a._raw == b._raw; }
+  friend constexpr bool operator!=(Fixed a, Fixed b) { return a._raw != b._raw; }
+  friend constexpr bool operator<(Fixed a, Fixed b) { return a._raw < b._raw; }
+  friend constexpr bool operator<=(Fixed a, Fixed b) { return a._raw <= b._raw; }
+  friend constexpr bool operator>(Fixed a, Fixed b) { return a._raw > b._raw; }
+  friend constexpr bool operator>=(Fixed a, Fixed b) { return a._raw >= b._raw; }
+
+private:
+  Storage _raw;
+};
+
+// Negative values yield zero.
+template<int Fraction, typename Storage, typename Wide>
+Fixed<Fraction, Storage, Wide> sqrt(Fixed<Fraction, Storage, Wide> value)
+{
+  using fixed_t = Fixed<Fraction, Storage, Wide>;
+  if(value.raw() <= 0)
+  {
+    return fixed_t{};
+  }
+  return fixed_t::from_raw(Storage(isqrt(uint64_t(value.raw()) << Fraction)));
+}
+
+#ifdef USE_IOSTREAM
+template<int Fraction, typename Storage, typename Wide>
+std::ostream& operator<<(std::ostream& os, const Fixed<Fraction, Storage, Wide>& value)
+{
+  os << double(value);
+  return os;
+}
+#endif
+
+} // namespace deets::fixed
@@ -0,0 +1,252 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// When the apogee is detected, by the velocity of the
+// altitude estimator or by the pressure passing its peak.
+//
+// Flies simulated flights of different motors and levels
+// of barometer noise, over several seeds. The samples come
+// at the rates of the IMU and the barometer and through the
+// filters of the firmware, as in the sketch. The velocity
+// of the estimator is to take COASTING to FALLING_.
+// PRESSURE_PEAK_REACHED only fires once the peak held for
+// PEAK_PRESSURE_FALLBACK, see junior-rocket-state.hpp.
+// Reports, relative to the true apogee, when each first
+// fires after COASTING was entered and when FALLING_ was
+// reached, averaged over the seeds, and which event took
+// the transition how often.
+//
+// The motors stay within what APOGEE_TIME was set for, so
+// EXPECTED_APOGEE_TIME_REACHED is only the fallback.
+//
+// Exits non-zero if a flight reaches FALLING_ by anything
+// but VELOCITY_BELOW_ZERO or not at all, or the velocity
+// falls below zero more than half a second before the
+// apogee or a second after it.
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "state-names.hpp"
+#include "emulator/flight.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+
+using namespace far::junior;
+using far::junior::host::name;
+
+namespace {
+
+constexpr unsigned SEEDS = 8;
+
+struct motor_t
+{
+  const char* name;
+  // m/s^2 above gravity while the motor burns
+  double thrust;
+  double burntime;
+};
+
+const motor_t MOTORS[] = {
+  { "short burn", 25, 2.0 },
+  { "nominal", 15, 2.5 },
+  { "long burn", 20, 3.0 },
+};
+
+// mbar
+constexpr double NOISES[] = { 0.05, 0.2, 0.8 };
+
+struct Recorder : StateObserver
+{
+  void data(timestamp_t, std::optional<value_t>, value_t) override
+  {
+    trigger = std::nullopt;
+  }
+
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    if(to == state::FALLING_ && !falling)
+    {
+      falling = seconds(timestamp);
+      falling_by = trigger;
+    }
+    current = to;
+  }
+
+  // The transition is reported after all events of the
+  // sample, the first one leaving COASTING took it
+  void event_produced(timestamp_t timestamp, event e) override
+  {
+    if(current != state::COASTING && !falling)
+    {
+      return;
+    }
+    if(current == state::COASTING && !trigger
+       && (e == event::PRESSURE_PEAK_REACHED || e == event::VELOCITY_BELOW_ZERO
+           || e == event::EXPECTED_APOGEE_TIME_REACHED))
+    {
+      trigger = e;
+    }
+    if(e == event::VELOCITY_BELOW_ZERO && !velocity)
+    {
+      velocity = seconds(timestamp);
+    }
+    if(e == event::PRESSURE_PEAK_REACHED && !peak)
+    {
+      peak = seconds(timestamp);
+    }
+  }
+
+  static double seconds(timestamp_t timestamp)
+  {
+    return std::chrono::duration<double>(timestamp.time_since_epoch()).count();
+  }
+
+  state current = state::IDLE;
+  std::optional<double> velocity, peak, falling;
+  std::optional<event> trigger, falling_by;
+};
+
+struct outcome_t
+{
+  // Seconds after the apogee, summed over the flights
+  double velocity = 0, peak = 0, falling = 0;
+  size_t velocities = 0, peaks = 0, fallings = 0;
+  size_t by_velocity = 0, by_peak = 0;
+  bool passed = true;
+};
+
+void fly(const motor_t& motor, double noise, unsigned seed, outcome_t& outcome)
+{
+  far::emulator::flight_profile_t profile;
+  profile.launch = 10.0;
+  profile.thrust = motor.thrust;
+  profile.burntime = motor.burntime;
+  profile.pressure_noise = noise;
+  profile.seed = seed;
+  far::emulator::SimulatedFlight flight(profile);
+
+  Recorder recorder;
+  JuniorRocketState machine(recorder);
+  auto acceleration_filter = make_acceleration_filter(1e6f / IMU_PERIOD);
+  auto pressure_filter = make_pressure_filter();
+  value_t acceleration{}, pressure{};
+  double apogee = 0, highest = 0;
+
+  // The greatest common divisor of the sample periods
+  const int64_t step = 2000;
+  static_assert(IMU_PERIOD % step == 0 && MET_PERIOD % step == 0);
+  for(int64_t us = 0;; us += step)
+  {
+    const double t = us * 1e-6;
+    if(flight.over(t))
+    {
+      break;
+    }
+    const bool imu = us % IMU_PERIOD == 0;
+    const bool met = us % MET_PERIOD == 0;
+    if(!imu && !met)
+    {
+      continue;
+    }
+    const auto environment = flight.at(t);
+    if(environment.altitude > highest)
+    {
+      highest = environment.altitude;
+      apogee = t;
+    }
+    if(imu)
+    {
+      acceleration = acceleration_filter.update(value_t(environment.acceleration[2]));
+    }
+    if(met)
+    {
+      pressure = pressure_filter.update(value_t(environment.pressure / 100.0));
+    }
+    machine.drive(timestamp_t(std::chrono::microseconds(us)), met ? std::optional(pressure) : std::nullopt,
+                  acceleration);
+  }
+
+  if(recorder.velocity)
+  {
+    const auto after = *recorder.velocity - apogee;
+    outcome.velocity += after;
+    ++outcome.velocities;
+    if(after < -0.5 || after > 1.0)
+    {
+      std::printf("seed %u: VELOCITY_BELOW_ZERO %.2fs after the apogee\n", seed, after);
+      outcome.passed = false;
+    }
+  }
+  else
+  {
+    std::printf("seed %u: never VELOCITY_BELOW_ZERO\n", seed);
+    outcome.passed = false;
+  }
+  if(recorder.peak)
+  {
+    outcome.peak += *recorder.peak - apogee;
+    ++outcome.peaks;
+  }
+  if(!recorder.falling)
+  {
+    std::printf("seed %u: never reached FALLING_, stuck in %s\n", seed, name(recorder.current));
+    outcome.passed = false;
+    return;
+  }
+  outcome.falling += *recorder.falling - apogee;
+  ++outcome.fallings;
+  outcome.by_velocity += recorder.falling_by == event::VELOCITY_BELOW_ZERO;
+  outcome.by_peak += recorder.falling_by == event::PRESSURE_PEAK_REACHED;
+  if(recorder.falling_by != event::VELOCITY_BELOW_ZERO)
+  {
+    std::printf("seed %u: FALLING_ by %s, not the altitude estimator\n", seed,
+                recorder.falling_by == event::PRESSURE_PEAK_REACHED ? "the pressure peak" : "the apogee time");
+    outcome.passed = false;
+  }
+}
+
+} // namespace
+
+int main()
+{
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %u flights each, seconds after the apogee\n\n", SEEDS);
+  std::printf("%-14s %8s %10s %10s %10s %9s %6s\n", "motor", "noise", "velocity", "peak", "FALLING_", "velocity",
+              "peak");
+  bool passed = true;
+  for(const auto& motor : MOTORS)
+  {
+    for(const auto noise : NOISES)
+    {
+      outcome_t outcome;
+      for(unsigned seed = 1; seed <= SEEDS; ++seed)
+      {
+        fly(motor, noise, seed, outcome);
+      }
+      const auto mean = [](double sum, size_t count) {
+        return count ? sum / double(count) : 0.0;
+      };
+      char peak[16] = "-";
+      if(outcome.peaks)
+      {
+        std::snprintf(peak, sizeof(peak), "%.2fs", mean(outcome.peak, outcome.peaks));
+      }
+      std::printf("%-14s %6.2fmb %9.2fs %10s %9.2fs %9zu %6zu\n", motor.name, noise,
+                  mean(outcome.velocity, outcome.velocities), peak, mean(outcome.falling, outcome.fallings),
+                  outcome.by_velocity, outcome.by_peak);
+      passed &= outcome.passed;
+    }
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
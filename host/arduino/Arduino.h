@@ -0,0 +1,38 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Just enough of the Arduino API to build the portable
+// parts of the firmware on the host.
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using byte = uint8_t;
+
+#define F(string) (string)
+
+inline unsigned long micros()
+{
+  using namespace std::chrono;
+  return static_cast<unsigned long>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+inline unsigned long millis()
+{
+  return micros() / 1000;
+}
+
+inline void delay(unsigned long)
+{
+}
+
+// From avr-libc, which the ARM cores provide as well
+inline char* dtostrf(double val, signed char width, unsigned char prec, char* sout)
+{
+  sprintf(sout, "%*.*f", width, prec, val);
+  return sout;
+}
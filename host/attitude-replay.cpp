@@ -0,0 +1,262 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Replays a simulated flight through the attitude
+// estimator, in float and in Q15.16, and compares its
+// tilt and vertical acceleration with the truth.
+//
+// The rocket sits tilted on the rail, pitches over during
+// the burn and coasting while spinning up to a turn per
+// second. The IMU samples carry a gyro bias, noise and the
+// resolution of the BNO055.
+//
+// A number type that counts the arithmetic gives the
+// operations of one update, which the cost of each on a
+// 72MHz Cortex-M3 turns into cycles, see op-count.hpp.
+// Fails if an update doesn't fit into IMU_PERIOD or the
+// tilt is off by more than a degree and a half.
+#include "attitude-estimator.hpp"
+#include "junior-rocket-state.hpp"
+#include "farduino_constants.h"
+#include "microbench.hpp"
+#include "op-count.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using deets::bench::do_not_optimize;
+using fixed_t = deets::fixed::Fixed<16>;
+using far::junior::host::Counted;
+using far::junior::host::counted;
+using far::junior::host::cycles;
+using far::junior::host::operations_t;
+using far::junior::host::Q15_16_CYCLES;
+using far::junior::host::SOFT_FLOAT_CYCLES;
+using far::junior::host::total;
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr double DEGREE = PI / 180;
+constexpr double DT = IMU_PERIOD * 1e-6;
+constexpr double PAD_TIME = 30.0;
+constexpr double BURNTIME = 2.5;
+constexpr double COASTING_TIME = 5.0;
+// Until the filter found the tilt of the rail
+constexpr double SETTLING_TIME = 10.0;
+constexpr double MAX_TILT_ERROR = 1.5;
+
+constexpr double CPU_HZ = 72e6;
+
+struct sample_t
+{
+  double time;
+  double acceleration[3];
+  double omega[3];
+  double tilt;
+  // In g
+  double vertical_acceleration;
+};
+
+std::vector<sample_t> simulated_flight()
+{
+  std::mt19937 rng(1);
+  std::normal_distribution<double> gyro_noise(0, 0.1 * DEGREE), acceleration_noise(0, 0.003);
+  const double bias[3] = { 0.4 * DEGREE, -0.3 * DEGREE, 0.2 * DEGREE };
+  const double rail = 5 * DEGREE;
+  // The BNO055 resolution, 1/100m/s^2 and 1/16deg/s
+  const auto quantize = [](double value, double lsb) { return std::round(value / lsb) * lsb; };
+
+  std::vector<sample_t> samples;
+  double psi = 0.3;
+  for(double t = 0; t < PAD_TIME + BURNTIME + COASTING_TIME; t += DT)
+  {
+    // Pitch angle and rate, spin rate, specific force
+    // along the axis in g
+    double theta = rail, theta_dot = 0, psi_dot = 0, axial = 0;
+    const double flight = t - PAD_TIME;
+    if(flight >= 0 && flight < BURNTIME)
+    {
+      theta = rail + 10 * DEGREE * (flight / BURNTIME) * (flight / BURNTIME);
+      theta_dot = 20 * DEGREE * flight / (BURNTIME * BURNTIME);
+      psi_dot = 2 * PI * flight / BURNTIME;
+      axial = 2.5;
+    }
+    else if(flight >= BURNTIME)
+    {
+      const double coasting = flight - BURNTIME;
+      theta = rail + 10 * DEGREE + 3 * DEGREE * coasting;
+      theta_dot = 3 * DEGREE;
+      psi_dot = 2 * PI;
+      axial = -0.3 * (1 - coasting / COASTING_TIME);
+    }
+
+    // Up in body coordinates
+    const double up[3] = { std::sin(theta) * std::sin(psi), std::sin(theta) * std::cos(psi), std::cos(theta) };
+    const double omega[3] = { theta_dot * std::cos(psi), -theta_dot * std::sin(psi), psi_dot };
+    sample_t sample;
+    sample.time = t;
+    sample.tilt = theta;
+    for(size_t i = 0; i < 3; ++i)
+    {
+      // On the rail the ground holds us against gravity,
+      // in the air everything but gravity acts along the axis
+      const double specific_force = flight < 0 ? up[i] : (i == 2 ? axial : 0);
+      sample.acceleration[i] = quantize(specific_force + acceleration_noise(rng), 0.01 / 9.81);
+      sample.omega[i] = quantize(omega[i] + bias[i] + gyro_noise(rng), DEGREE / 16);
+    }
+    sample.vertical_acceleration = flight < 0 ? 1.0 : axial * std::cos(theta);
+    samples.push_back(sample);
+    psi += psi_dot * DT;
+  }
+  return samples;
+}
+
+struct accuracy_t
+{
+  // Degrees
+  double pad_tilt;
+  double flight_tilt;
+  // m/s^2
+  double vertical_acceleration;
+  // Degrees, the tilt at the end of the replay
+  double final_tilt;
+};
+
+template<typename F>
+accuracy_t replay(const std::vector<sample_t>& samples)
+{
+  deets::estimation::MahonyFilter<F> filter(static_cast<F>(far::junior::ATTITUDE_KP), static_cast<F>(far::junior::ATTITUDE_KI),
+    static_cast<F>(far::junior::ATTITUDE_GRAVITY_TOLERANCE));
+  accuracy_t accuracy = {};
+  for(const auto& sample : samples)
+  {
+    F acceleration[3], omega[3];
+    for(size_t i = 0; i < 3; ++i)
+    {
+      acceleration[i] = static_cast<F>(sample.acceleration[i]);
+      omega[i] = static_cast<F>(sample.omega[i]);
+    }
+    filter.update(acceleration, omega, static_cast<F>(DT));
+    const double cos_tilt = std::clamp(double(filter.cos_tilt()), -1.0, 1.0);
+    const double tilt = std::abs(std::acos(cos_tilt) - sample.tilt) / DEGREE;
+    const double vertical = std::abs(double(filter.vertical_acceleration(acceleration)) - sample.vertical_acceleration) * 9.81;
+    accuracy.final_tilt = std::acos(cos_tilt) / DEGREE;
+    if(sample.time < SETTLING_TIME)
+    {
+      continue;
+    }
+    auto& worst = sample.time < PAD_TIME ? accuracy.pad_tilt : accuracy.flight_tilt;
+    worst = std::max(worst, tilt);
+    accuracy.vertical_acceleration = std::max(accuracy.vertical_acceleration, vertical);
+  }
+  return accuracy;
+}
+
+// The operations of an update with and without the
+// accelerometer, from a filter that has seen the pad
+template<typename F>
+std::pair<operations_t, operations_t> count_operations(const std::vector<sample_t>& samples)
+{
+  using counted_t = Counted<F>;
+  deets::estimation::MahonyFilter<counted_t> filter{ counted_t(far::junior::ATTITUDE_KP), counted_t(far::junior::ATTITUDE_KI),
+    counted_t(far::junior::ATTITUDE_GRAVITY_TOLERANCE) };
+  const auto update = [&](const sample_t& sample) {
+    counted_t acceleration[3], omega[3];
+    for(size_t i = 0; i < 3; ++i)
+    {
+      acceleration[i] = counted_t(sample.acceleration[i]);
+      omega[i] = counted_t(sample.omega[i]);
+    }
+    counted = {};
+    filter.update(acceleration, omega, counted_t(DT));
+    filter.vertical_acceleration(acceleration);
+    filter.cos_tilt();
+    return counted;
+  };
+  operations_t on_pad = {}, in_flight = {};
+  for(const auto& sample : samples)
+  {
+    (sample.time < PAD_TIME ? on_pad : in_flight) = update(sample);
+  }
+  return { on_pad, in_flight };
+}
+
+template<typename F>
+void benchmark(deets::bench::Suite& suite, const char* name, const std::vector<sample_t>& samples)
+{
+  std::vector<std::pair<std::array<F, 3>, std::array<F, 3>>> converted;
+  for(const auto& sample : samples)
+  {
+    converted.push_back({});
+    for(size_t i = 0; i < 3; ++i)
+    {
+      converted.back().first[i] = static_cast<F>(sample.acceleration[i]);
+      converted.back().second[i] = static_cast<F>(sample.omega[i]);
+    }
+  }
+  deets::estimation::MahonyFilter<F> filter(static_cast<F>(far::junior::ATTITUDE_KP), static_cast<F>(far::junior::ATTITUDE_KI),
+    static_cast<F>(far::junior::ATTITUDE_GRAVITY_TOLERANCE));
+  size_t index = 0;
+  suite.run(name, [&] {
+    F acceleration[3], omega[3];
+    const auto& sample = converted[index];
+    index = (index + 1) % converted.size();
+    std::copy(sample.first.begin(), sample.first.end(), acceleration);
+    std::copy(sample.second.begin(), sample.second.end(), omega);
+    filter.update(acceleration, omega, static_cast<F>(DT));
+    do_not_optimize(filter.vertical_acceleration(acceleration));
+  });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const auto samples = simulated_flight();
+
+  const accuracy_t accuracies[2] = { replay<float>(samples), replay<fixed_t>(samples) };
+  const std::pair<operations_t, operations_t> operations[2] = {
+    count_operations<float>(samples), count_operations<fixed_t>(samples),
+  };
+  const operations_t costs[2] = { SOFT_FLOAT_CYCLES, Q15_16_CYCLES };
+  const char* names[2] = { "float", "Q15.16" };
+
+  deets::bench::Suite suite("attitude", argc > 1 ? argv[1] : "");
+  benchmark<float>(suite, "float", samples);
+  benchmark<fixed_t>(suite, "Q15.16", samples);
+
+  const double budget = IMU_PERIOD * 1e-6 * CPU_HZ;
+  std::printf("%zu samples, %.0fs on the pad, %.1fs of flight\n\n", samples.size(), PAD_TIME, BURNTIME + COASTING_TIME);
+  std::printf("%-8s %10s %10s %12s %9s %9s %10s %9s\n", "type", "pad tilt", "tilt", "vertical", "ops", "cycles",
+              "of budget", "host");
+  int result = EXIT_SUCCESS;
+  for(size_t i = 0; i < 2; ++i)
+  {
+    const auto& accuracy = accuracies[i];
+    const auto& pad = operations[i].first;
+    const double worst = std::max(cycles(pad, costs[i]), cycles(operations[i].second, costs[i]));
+    const double ops = total(pad);
+    std::printf("%-8s %8.2fdeg %8.2fdeg %8.3fm/s^2 %9.0f %9.0f %9.2f%% %7.0fns\n", names[i], accuracy.pad_tilt,
+                accuracy.flight_tilt, accuracy.vertical_acceleration, ops, worst, 100 * worst / budget,
+                i < suite.results().size() ? suite.results()[i].median_ns : 0.0);
+    if(worst > budget)
+    {
+      std::printf("FAIL: %s takes %.0f of %.0f cycles\n", names[i], worst, budget);
+      result = EXIT_FAILURE;
+    }
+    if(std::max(accuracy.pad_tilt, accuracy.flight_tilt) > MAX_TILT_ERROR)
+    {
+      std::printf("FAIL: %s is off by more than %.1f degrees\n", names[i], MAX_TILT_ERROR);
+      result = EXIT_FAILURE;
+    }
+  }
+  std::printf("\ntilt at the end %.1fdeg, truth %.1fdeg\n", accuracies[0].final_tilt, samples.back().tilt / DEGREE);
+  std::printf("cycles on a %.0fMHz Cortex-M3 in the worst path, IMU_PERIOD is %.0f cycles\n", CPU_HZ / 1e6, budget);
+  return result;
+}
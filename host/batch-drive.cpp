@@ -0,0 +1,185 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Many flights through JuniorRocketBatch at once, and
+// each of them through a JuniorRocketState of its own.
+//
+// Every lane flies a simulated flight of its own: thrust,
+// burn time, drouge, barometer noise, launch time and how
+// quickly the rocket tilts are drawn at random. After
+// each sample the state, whether it changed, the ground
+// pressure, the flight time and the altitude estimate of
+// every lane are compared with its JuniorRocketState.
+// Reports the time per sample and lane of either, and how
+// many lanes went through each state.
+//
+// Exits non-zero if any lane differs from its
+// JuniorRocketState in any of the above.
+#include "junior-rocket-batch.hpp"
+#include "state-names.hpp"
+#include "emulator/flight.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace far::junior;
+using far::junior::host::JuniorRocketBatch;
+using far::junior::host::name;
+using far::junior::host::STATES;
+
+namespace {
+
+constexpr double SAMPLE_PERIOD = 0.01;
+constexpr double PI = 3.14159265358979323846;
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t, state to) override
+  {
+    current = to;
+    changed = true;
+    visited[size_t(to)] = true;
+  }
+
+  state current = state::IDLE;
+  bool changed = false;
+  std::vector<bool> visited = std::vector<bool>(STATES);
+};
+
+struct lane_t
+{
+  std::unique_ptr<far::emulator::SimulatedFlight> flight;
+  // Degrees per second the axis turns after launch
+  double tilt_rate;
+  double launch;
+  Recorder recorder;
+  std::unique_ptr<JuniorRocketState> machine;
+};
+
+template<typename T>
+bool same(const std::optional<T>& a, const std::optional<T>& b)
+{
+  return a.has_value() == b.has_value() && (!a || *a == *b);
+}
+
+bool same(const std::optional<JuniorRocketBatch::altitude_estimator_t::estimate_t>& a,
+          const std::optional<JuniorRocketBatch::altitude_estimator_t::estimate_t>& b)
+{
+  return a.has_value() == b.has_value()
+    && (!a || (a->altitude == b->altitude && a->velocity == b->velocity && a->acceleration == b->acceleration));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const size_t lanes = argc > 1 ? size_t(std::max(1, std::atoi(argv[1]))) : 1024;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::vector<lane_t> flights(lanes);
+  for(size_t i = 0; i < lanes; ++i)
+  {
+    auto& lane = flights[i];
+    far::emulator::flight_profile_t profile;
+    profile.launch = 3.0 + 7.0 * uniform(rng);
+    profile.thrust = 12.0 + 18.0 * uniform(rng);
+    profile.burntime = 2.0 + 2.0 * uniform(rng);
+    const double drouges[] = { -1.0, 0.0, 2.5, 5.0 };
+    profile.drouge_delay = drouges[i % 4];
+    profile.pressure_noise = 0.05 + 0.75 * uniform(rng);
+    profile.seed = unsigned(i + 1);
+    lane.flight = std::make_unique<far::emulator::SimulatedFlight>(profile);
+    lane.tilt_rate = uniform(rng) < 0.25 ? 10.0 * uniform(rng) : 0.0;
+    lane.launch = profile.launch;
+    lane.machine = std::make_unique<JuniorRocketState>(lane.recorder);
+  }
+  JuniorRocketBatch batch(lanes);
+
+  std::vector<value_t> pressure(lanes), acceleration(lanes), cos_tilt(lanes), temperature(lanes);
+  std::chrono::steady_clock::duration scalar{}, batched{};
+  size_t samples = 0, mismatches = 0;
+  for(double t = 0;; t += SAMPLE_PERIOD)
+  {
+    bool over = true;
+    for(size_t i = 0; i < lanes; ++i)
+    {
+      auto& lane = flights[i];
+      over &= lane.flight->over(t);
+      const auto environment = lane.flight->at(t);
+      pressure[i] = value_t(environment.pressure / 100.0);
+      acceleration[i] = value_t(environment.acceleration[2]);
+      cos_tilt[i] = value_t(std::cos(std::max(0.0, t - lane.launch) * lane.tilt_rate * PI / 180));
+      temperature[i] = value_t(environment.temperature);
+    }
+    if(over)
+    {
+      break;
+    }
+    const auto timestamp = timestamp_t(duration_t(int64_t(std::llround(t * 1e6))));
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < lanes; ++i)
+    {
+      flights[i].recorder.changed = false;
+      flights[i].machine->drive(timestamp, pressure[i], acceleration[i], cos_tilt[i], temperature[i]);
+    }
+    scalar += std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    batch.drive(timestamp, pressure.data(), acceleration.data(), cos_tilt.data(), temperature.data());
+    batched += std::chrono::steady_clock::now() - start;
+    ++samples;
+
+    for(size_t i = 0; i < lanes; ++i)
+    {
+      auto& lane = flights[i];
+      const auto& machine = *lane.machine;
+      if(lane.recorder.current == batch.current(i) && lane.recorder.changed == batch.changed(i)
+         && same(machine.ground_pressure(), batch.ground_pressure(i))
+         && same(machine.flighttime(), batch.flighttime(i))
+         && same(machine.altitude_estimate(), batch.altitude_estimate(i)))
+      {
+        continue;
+      }
+      if(mismatches++ < 10)
+      {
+        std::printf("lane %zu at %.2fs: %s%s, batch %s%s\n", i, t, name(lane.recorder.current),
+                    lane.recorder.changed ? " (changed)" : "", name(batch.current(i)),
+                    batch.changed(i) ? " (changed)" : "");
+      }
+    }
+  }
+
+  const auto per_lane = [&](std::chrono::steady_clock::duration total) {
+    return std::chrono::duration<double, std::nano>(total).count() / double(samples * lanes);
+  };
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %zu lanes, %zu samples each\n", lanes, samples);
+  std::printf("JuniorRocketState %8.1fns per sample and lane\n", per_lane(scalar));
+  std::printf("JuniorRocketBatch %8.1fns per sample and lane, %.1f times as fast\n\n", per_lane(batched),
+              per_lane(scalar) / per_lane(batched));
+  std::printf("%-28s %8s\n", "state", "lanes");
+  for(size_t s = 0; s < STATES; ++s)
+  {
+    const auto visited = std::count_if(flights.begin(), flights.end(), [&](const lane_t& lane) {
+      return lane.recorder.visited[s];
+    });
+    std::printf("%-28s %8zu\n", name(state(s)), size_t(visited));
+  }
+  if(mismatches)
+  {
+    std::printf("%zu samples of a lane differ\nFAIL\n", mismatches);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
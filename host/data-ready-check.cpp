@@ -0,0 +1,144 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The DataReadyQueue of the sketch when micros() wraps.
+//
+// A MockInterruptSource fires the IMU and barometer
+// channels at their periods into a DataReadyQueue, starting
+// a few seconds before the 32 bit microseconds wrap and
+// going on for as long after it. The loop drains the queue
+// every POLL_PERIOD, as USE_DATA_READY_INTERRUPTS does, and
+// stalls once: for longer than the queue holds, before the
+// wrap and across it, and shortly across it, so records of
+// both channels from either side of it are pending. Every
+// record has to come out oldest first over both channels,
+// each one period after the last of its channel unless the
+// queue had to drop some, and dropped() has to count
+// those.
+//
+// Exits non-zero on a record out of order, one lost
+// without being counted, or one too many.
+#include "farduino_constants.h"
+#include "sensor-interrupts.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr size_t QUEUE_SIZE = 8;
+constexpr uint32_t START = uint32_t(0) - 3000000;
+constexpr uint32_t DURATION = 6000000;
+constexpr uint32_t POLL_PERIOD = 1000;
+constexpr uint32_t WRAP = uint32_t(0) - START;
+
+struct stall_t
+{
+  const char* name;
+  // After the start
+  uint32_t at;
+  uint32_t length;
+};
+
+const stall_t STALLS[] = {
+  { "keeps up", DURATION + 1, 0 },
+  { "stalls before the wrap", 1000000, 20 * IMU_PERIOD },
+  { "stalls across the wrap", WRAP - 10 * IMU_PERIOD, 20 * IMU_PERIOD },
+  { "briefly across the wrap", WRAP - 3 * IMU_PERIOD, 6 * IMU_PERIOD },
+};
+
+struct outcome_t
+{
+  std::array<uint32_t, SENSOR_CHANNELS> received = {};
+  std::array<uint32_t, SENSOR_CHANNELS> missing = {};
+  uint32_t out_of_order = 0;
+  uint32_t off_period = 0;
+};
+
+outcome_t run(const stall_t& stall, std::array<uint32_t, SENSOR_CHANNELS>& dropped)
+{
+  const std::array<uint32_t, SENSOR_CHANNELS> periods = { IMU_PERIOD, MET_PERIOD };
+  DataReadyQueue<QUEUE_SIZE> queue;
+  MockInterruptSource<QUEUE_SIZE> source(queue, periods, START);
+  outcome_t outcome;
+  std::array<bool, SENSOR_CHANNELS> seen = {};
+  std::array<uint32_t, SENSOR_CHANNELS> last = {};
+  bool any = false;
+  uint32_t previous = 0;
+
+  for(uint32_t elapsed = 0; elapsed <= DURATION; elapsed += POLL_PERIOD)
+  {
+    if(elapsed == stall.at)
+    {
+      elapsed += stall.length;
+    }
+    source.advance_to(START + elapsed);
+    data_ready_t record;
+    while(queue.next(record))
+    {
+      const auto channel = size_t(record.channel);
+      outcome.out_of_order += any && int32_t(record.timestamp - previous) < 0;
+      if(seen[channel])
+      {
+        const auto gap = record.timestamp - last[channel];
+        if(gap % periods[channel] != 0 || gap == 0)
+        {
+          ++outcome.off_period;
+        }
+        else
+        {
+          outcome.missing[channel] += gap / periods[channel] - 1;
+        }
+      }
+      seen[channel] = true;
+      last[channel] = record.timestamp;
+      previous = record.timestamp;
+      any = true;
+      ++outcome.received[channel];
+    }
+  }
+  for(size_t i = 0; i < SENSOR_CHANNELS; ++i)
+  {
+    dropped[i] = queue.dropped(sensor_channel(i));
+  }
+  return outcome;
+}
+
+} // namespace
+
+int main()
+{
+  const char* names[SENSOR_CHANNELS] = { "IMU", "MET" };
+  const uint32_t periods[SENSOR_CHANNELS] = { IMU_PERIOD, MET_PERIOD };
+  std::printf("from %lu to %lu, micros() wraps in between\n\n", (unsigned long)START,
+              (unsigned long)(START + DURATION));
+  std::printf("%-23s %-8s %9s %9s %8s %8s %7s\n", "loop", "channel", "expected", "received", "dropped", "missing",
+              "order");
+  bool passed = true;
+  for(const auto& stall : STALLS)
+  {
+    std::array<uint32_t, SENSOR_CHANNELS> dropped;
+    const auto outcome = run(stall, dropped);
+    for(size_t i = 0; i < SENSOR_CHANNELS; ++i)
+    {
+      const uint32_t expected = DURATION / periods[i] + 1;
+      std::printf("%-23s %-8s %9lu %9lu %8lu %8lu %7lu\n", stall.name, names[i], (unsigned long)expected,
+                  (unsigned long)outcome.received[i], (unsigned long)dropped[i], (unsigned long)outcome.missing[i],
+                  (unsigned long)(outcome.out_of_order + outcome.off_period));
+      passed &= outcome.received[i] + dropped[i] == expected && outcome.missing[i] == dropped[i];
+      // What fits into the queue must not be dropped
+      passed &= stall.length > QUEUE_SIZE * periods[i] || !dropped[i];
+    }
+    passed &= !outcome.out_of_order && !outcome.off_period;
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
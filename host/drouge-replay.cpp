@@ -0,0 +1,180 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Whether the pressure drop fit tells an open drouge from
+// a failed one.
+//
+// Flies simulated flights with a drouge opening at the
+// apogee, and without one, over several seeds and levels
+// of barometer noise. The samples come at the rates of the
+// IMU and the barometer and through the filters of the
+// firmware, as in the sketch. Counts the false verdicts, a
+// DROUGE_FAILED although the drouge opened, and the missed
+// ones, no DROUGE_FAILED without a drouge. Reports how long
+// after the apogee the verdict comes, and how many were
+// made early, before MEASURE_FALLING_PRESSURE3.
+//
+// Exits non-zero on any false or missed verdict.
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "emulator/flight.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr unsigned SEEDS = 20;
+// mbar
+constexpr double NOISES[] = { 0.05, 0.1, 0.2 };
+
+struct drouge_t
+{
+  const char* name;
+  // See flight_profile_t::drouge_delay
+  double delay;
+};
+
+const drouge_t DROUGES[] = {
+  { "opens", 0.0 },
+  { "fails", -1.0 },
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    transitions.push_back({ std::chrono::duration<double>(timestamp.time_since_epoch()).count(), to });
+  }
+
+  struct transition_t
+  {
+    double at;
+    state to;
+  };
+  std::vector<transition_t> transitions;
+};
+
+struct outcome_t
+{
+  size_t flights = 0;
+  size_t false_verdicts = 0;
+  size_t missed = 0;
+  size_t early = 0;
+  // Seconds after the apogee, summed over the verdicts
+  double verdict = 0;
+  size_t verdicts = 0;
+};
+
+void fly(const drouge_t& drouge, double noise, unsigned seed, outcome_t& outcome)
+{
+  far::emulator::flight_profile_t profile;
+  profile.launch = 10.0;
+  profile.drouge_delay = drouge.delay;
+  profile.pressure_noise = noise;
+  profile.seed = seed;
+  far::emulator::SimulatedFlight flight(profile);
+
+  Recorder recorder;
+  JuniorRocketState machine(recorder);
+  auto acceleration_filter = make_acceleration_filter(1e6f / IMU_PERIOD);
+  auto pressure_filter = make_pressure_filter();
+  value_t acceleration{}, pressure{};
+  double apogee = 0, highest = 0;
+
+  // The greatest common divisor of the sample periods
+  const int64_t step = 2000;
+  static_assert(IMU_PERIOD % step == 0 && MET_PERIOD % step == 0);
+  for(int64_t us = 0;; us += step)
+  {
+    const double t = us * 1e-6;
+    if(flight.over(t))
+    {
+      break;
+    }
+    const bool imu = us % IMU_PERIOD == 0;
+    const bool met = us % MET_PERIOD == 0;
+    if(!imu && !met)
+    {
+      continue;
+    }
+    const auto environment = flight.at(t);
+    if(environment.altitude > highest)
+    {
+      highest = environment.altitude;
+      apogee = t;
+    }
+    if(imu)
+    {
+      acceleration = acceleration_filter.update(value_t(environment.acceleration[2]));
+    }
+    if(met)
+    {
+      pressure = pressure_filter.update(value_t(environment.pressure / 100.0));
+    }
+    machine.drive(timestamp_t(std::chrono::microseconds(us)), met ? std::optional(pressure) : std::nullopt,
+                  acceleration);
+  }
+
+  ++outcome.flights;
+  const bool opens = drouge.delay >= 0;
+  bool measured3 = false;
+  for(const auto& transition : recorder.transitions)
+  {
+    measured3 |= transition.to == state::MEASURE_FALLING_PRESSURE3;
+    if(transition.to != state::DROUGE_OPENED && transition.to != state::DROUGE_FAILED)
+    {
+      continue;
+    }
+    // The first verdict counts, a failed drouge is
+    // measured again afterwards
+    const bool failed = transition.to == state::DROUGE_FAILED;
+    outcome.false_verdicts += opens && failed;
+    outcome.missed += !opens && !failed;
+    outcome.early += !measured3;
+    outcome.verdict += transition.at - apogee;
+    ++outcome.verdicts;
+    return;
+  }
+  ++outcome.missed;
+}
+
+} // namespace
+
+int main()
+{
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %u flights each\n\n", SEEDS);
+  std::printf("%-8s %8s %6s %7s %6s %14s\n", "drouge", "noise", "false", "missed", "early", "after apogee");
+  bool passed = true;
+  for(const auto& drouge : DROUGES)
+  {
+    for(const auto noise : NOISES)
+    {
+      outcome_t outcome;
+      for(unsigned seed = 1; seed <= SEEDS; ++seed)
+      {
+        fly(drouge, noise, seed, outcome);
+      }
+      std::printf("%-8s %6.2fmb %6zu %7zu %6zu %12.0fms\n", drouge.name, noise, outcome.false_verdicts,
+                  outcome.missed, outcome.early,
+                  outcome.verdicts ? outcome.verdict / double(outcome.verdicts) * 1e3 : 0.0);
+      passed &= !outcome.false_verdicts && !outcome.missed;
+    }
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The virtual time and the Arduino core on top of it
+#include "board.hpp"
+
+#include <algorithm>
+
+namespace far::emulator {
+
+const char* name(cost what)
+{
+  static const char* names[size_t(cost::COSTS)] = {
+    "cpu", "delay", "i2c", "spi", "radio", "sd card",
+  };
+  return names[size_t(what)];
+}
+
+Board& Board::instance()
+{
+  static Board board;
+  return board;
+}
+
+Board::Board()
+{
+  // The Maple v2 has the BNO055 instead
+  mpu9250.present = false;
+  every(Bno055::DATA_READY_PERIOD, [this] { bno055.sample(); });
+}
+
+void Board::spend(nanoseconds duration, cost what)
+{
+  const auto until = _now + duration;
+  _costs[size_t(what)] += duration;
+  // Interrupts don't nest, and an ISR waiting for
+  // something has to be looked at anyway.
+  while(!_in_interrupt)
+  {
+    timer_t* next = nullptr;
+    for(auto& timer : _timers)
+    {
+      if(timer.active && timer.due <= until && (!next || timer.due < next->due))
+      {
+        next = &timer;
+      }
+    }
+    if(!next)
+    {
+      break;
+    }
+    _now = std::max(_now, next->due);
+    next->due += next->period;
+    _in_interrupt = true;
+    // The handler may add timers, so next can't be used after
+    const auto handler = next->handler;
+    handler();
+    _in_interrupt = false;
+  }
+  _now = until;
+}
+
+size_t Board::every(nanoseconds period, std::function<void()> handler)
+{
+  _timers.push_back({ _now + period, period, std::move(handler), true });
+  return _timers.size() - 1;
+}
+
+void Board::cancel(size_t timer)
+{
+  _timers[timer].active = false;
+}
+
+void Board::attach_interrupt(uint32_t pin, isr_t isr, uint32_t mode)
+{
+  _interrupts[pin] = { isr, mode };
+}
+
+void Board::detach_interrupt(uint32_t pin)
+{
+  _interrupts[pin] = {};
+}
+
+void Board::rising_edge(uint32_t pin)
+{
+  const auto& interrupt = _interrupts[pin];
+  if(interrupt.isr && (interrupt.mode == RISING || interrupt.mode == CHANGE))
+  {
+    interrupt.isr();
+  }
+}
+
+void Board::pin_mode(uint32_t pin, uint32_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void Board::digital_write(uint32_t pin, uint32_t value)
+{
+  if(_pins[pin] != value)
+  {
+    _pins[pin] = value;
+    _pin_changes.push_back({ _now, pin, value });
+  }
+}
+
+int Board::digital_read(uint32_t pin) const
+{
+  return _pins[pin];
+}
+
+void Board::i2c_bits(size_t bits)
+{
+  spend(nanoseconds(bits * 1000000000ull / i2c_frequency), cost::I2C);
+}
+
+I2cDevice* Board::i2c_device(uint8_t address)
+{
+  I2cDevice* device = nullptr;
+  switch(address)
+  {
+  case 0x28:
+    device = &bno055;
+    break;
+  case 0x68:
+    device = &mpu9250;
+    break;
+  case 0x76:
+    device = &bmp280;
+    break;
+  default:
+    break;
+  }
+  return device && device->present ? device : nullptr;
+}
+
+void Board::spi_transfer(size_t bytes, uint32_t frequency, cost what)
+{
+  spend(nanoseconds(bytes * 8 * 1000000000ull / frequency), what);
+}
+
+const environment_t& Board::environment()
+{
+  if(_sensed != _now)
+  {
+    _sensed = _now;
+    _environment = flight->at(std::chrono::duration<double>(_now).count());
+  }
+  return _environment;
+}
+
+} // namespace far::emulator
+
+using far::emulator::Board;
+using far::emulator::cost;
+using far::emulator::nanoseconds;
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+TIM_TypeDef* TIM2 = nullptr;
+TIM_TypeDef* TIM4 = nullptr;
+
+unsigned long micros()
+{
+  return static_cast<unsigned long>(
+    uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(Board::instance().now()).count()));
+}
+
+unsigned long millis()
+{
+  return static_cast<unsigned long>(
+    uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(Board::instance().now()).count()));
+}
+
+void delay(unsigned long ms)
+{
+  Board::instance().spend(std::chrono::milliseconds(ms), cost::DELAY);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  Board::instance().spend(std::chrono::microseconds(us), cost::DELAY);
+}
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+  Board::instance().pin_mode(pin, mode);
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+  Board::instance().digital_write(pin, value);
+}
+
+int digitalRead(uint32_t pin)
+{
+  return Board::instance().digital_read(pin);
+}
+
+// The buzzer runs off a timer, it doesn't block
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration)
+{
+  (void)pin;
+  (void)frequency;
+  (void)duration;
+  ++Board::instance().tones;
+}
+
+void noTone(uint8_t pin)
+{
+  (void)pin;
+}
+
+void attachInterrupt(uint32_t pin, void (*isr)(), uint32_t mode)
+{
+  Board::instance().attach_interrupt(pin, isr, mode);
+}
+
+void detachInterrupt(uint32_t pin)
+{
+  Board::instance().detach_interrupt(pin);
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  if(_port == 1)
+  {
+    Board::instance().gps.baud = baud;
+  }
+}
+
+int HardwareSerial::available()
+{
+  return _port == 1 ? Board::instance().gps.available() : 0;
+}
+
+int HardwareSerial::read()
+{
+  return _port == 1 ? Board::instance().gps.read() : -1;
+}
+
+// USB is fast enough to not matter
+size_t HardwareSerial::write(const char* data, size_t size)
+{
+  auto& board = Board::instance();
+  if(_port == 0 && board.serial)
+  {
+    std::fwrite(data, 1, size, board.serial);
+  }
+  return size;
+}
+
+size_t HardwareSerial::print(long value, int base)
+{
+  char buffer[24];
+  std::snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%ld", value);
+  return print(buffer);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+  char buffer[24];
+  std::snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", value);
+  return print(buffer);
+}
+
+size_t HardwareSerial::print(double value, int digits)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return print(buffer);
+}
+
+void HardwareTimer::setOverflow(uint32_t value, TimerFormat_t format)
+{
+  // Ticks of the 72MHz timer clock without a prescaler
+  _period_us = format == MICROSEC_FORMAT ? value : format == HERTZ_FORMAT ? 1000000 / value : value / 72;
+}
+
+void HardwareTimer::attachInterrupt(void (*isr)())
+{
+  _isr = isr;
+}
+
+void HardwareTimer::resume()
+{
+  if(_timer < 0 && _isr)
+  {
+    _timer = int(Board::instance().every(std::chrono::microseconds(_period_us), _isr));
+  }
+}
+
+void HardwareTimer::pause()
+{
+  if(_timer >= 0)
+  {
+    Board::instance().cancel(size_t(_timer));
+    _timer = -1;
+  }
+}
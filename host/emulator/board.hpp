@@ -0,0 +1,288 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The emulated Maple v2: an STM32F103 with a BMP280 and a
+// BNO055 on I2C, an nRF24L01+ and an SD card on SPI and a
+// GPS on Serial1.
+//
+// Time only passes when the firmware waits: in delay(), for
+// the bits on the I2C and SPI buses, for the radio and for
+// the SD card. Each wait is booked on a cost, so a slow pass
+// through loop() can be explained. Timers and data ready
+// lines interrupt those waits at the virtual time they are
+// due.
+#pragma once
+#include "flight.hpp"
+
+#include <Arduino.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace far::emulator {
+
+using nanoseconds = std::chrono::nanoseconds;
+using std::chrono_literals::operator""us;
+using std::chrono_literals::operator""ms;
+using std::chrono_literals::operator""s;
+
+enum class cost : uint8_t
+{
+  // Passes that waited for nothing, and the scaled
+  // host time with --cpu-scale
+  CPU,
+  DELAY,
+  I2C,
+  SPI,
+  // Waiting for packets to leave
+  RADIO,
+  // Waiting for the card to program blocks
+  SD_CARD,
+  COSTS,
+};
+
+const char* name(cost);
+
+using costs_t = std::array<nanoseconds, size_t(cost::COSTS)>;
+
+// Register writes end up here, reads continue at the
+// last register written and auto increment.
+class I2cDevice
+{
+public:
+  virtual ~I2cDevice() = default;
+
+  virtual void write(const uint8_t* data, size_t size)
+  {
+    if(size)
+    {
+      _register = data[0];
+    }
+  }
+
+  virtual uint8_t read()
+  {
+    return 0;
+  }
+
+  bool present = true;
+
+protected:
+  uint8_t _register = 0;
+};
+
+class Bno055 : public I2cDevice
+{
+public:
+  // The accelerometer data ready rate in the fusion modes
+  static constexpr nanoseconds DATA_READY_PERIOD = 10ms;
+
+  void write(const uint8_t* data, size_t size) override;
+  uint8_t read() override;
+  // Latches INT on a new sample, if enabled
+  void sample();
+
+  // The MCU pin INT is wired to
+  uint32_t int_pin = PB8;
+  uint8_t mode = 0;
+  uint32_t data_ready = 0;
+  // Samples that came while INT was still latched
+  uint32_t overrun = 0;
+
+private:
+  uint8_t _page = 0;
+  // After a reset the chip needs 650ms to boot
+  nanoseconds _ready{};
+  bool _int_enabled = false;
+  bool _latched = false;
+  // Accelerometer, magnetometer and gyroscope as of the
+  // last register write, so a burst is consistent
+  std::array<uint8_t, 18> _data{};
+};
+
+// Has the calibration of the datasheet's example and
+// ADC readings that compensate to the environment
+class Bmp280 : public I2cDevice
+{
+public:
+  Bmp280();
+
+  void write(const uint8_t* data, size_t size) override;
+  uint8_t read() override;
+
+private:
+  std::array<uint8_t, 24> _calibration;
+  // press_msb to temp_xlsb as of the last register write
+  std::array<uint8_t, 6> _data{};
+};
+
+// The nRF24L01+ at 1Mbps with auto acknowledgement
+class Radio
+{
+public:
+  // From the end of one packet to the end of the next
+  // when the ground station acknowledges: TX settling,
+  // 329 bits on air, RX settling and the ACK packet.
+  static constexpr nanoseconds ACKNOWLEDGED_PACKET = 662us;
+  // 15 retransmits with 1500us delay, as RF24::begin
+  // sets them up, then MAX_RT
+  static constexpr nanoseconds UNACKNOWLEDGED_PACKET = 16 * (459us + 1500us);
+
+  // False if the driver has to give up on the FIFO
+  bool write(const void* payload, size_t size);
+  // Waits for the FIFO to drain, false on MAX_RT
+  bool standby();
+
+  bool present = true;
+  // Is there a ground station?
+  bool acknowledged = true;
+  // Receives what the ground station gets
+  std::FILE* log = nullptr;
+  uint8_t power_level = 0;
+  uint32_t sent = 0;
+  uint32_t lost = 0;
+
+private:
+  void retire();
+
+  // When the packets in the TX FIFO are done
+  std::deque<nanoseconds> _fifo;
+  bool _max_retries = false;
+};
+
+class SdCard
+{
+public:
+  // SPI2 at 18MHz, a block with command, token and CRC
+  static constexpr nanoseconds BLOCK_TRANSFER = 233us;
+  static constexpr nanoseconds PROGRAMMING = 800us;
+  // Cards stop for housekeeping every now and then
+  static constexpr nanoseconds STALL = 100ms;
+  static constexpr uint32_t BLOCKS_PER_STALL = 256;
+
+  void read_block();
+  void write_block();
+
+  bool present = true;
+  // By name, with what was written to them
+  std::map<std::string, std::string> files;
+  uint32_t blocks_written = 0;
+  uint32_t stalls = 0;
+};
+
+// Sends GGA and RMC once a second at 9600 baud into the
+// 64 byte receive buffer of Serial1
+class Gps
+{
+public:
+  static constexpr size_t RX_BUFFER = 64;
+
+  int available();
+  int read();
+
+  uint32_t baud = 9600;
+  uint32_t sentences = 0;
+  // Overflowed the receive buffer
+  uint32_t dropped = 0;
+
+private:
+  void receive();
+  void fix();
+
+  std::string _transmitting;
+  size_t _position = 0;
+  nanoseconds _next_byte{};
+  nanoseconds _next_fix = 1s;
+  std::deque<char> _rx;
+};
+
+struct pin_change_t
+{
+  nanoseconds at;
+  uint32_t pin;
+  uint32_t value;
+};
+
+class Board
+{
+public:
+  using isr_t = void (*)();
+
+  static Board& instance();
+
+  Board();
+
+  nanoseconds now() const { return _now; }
+  // Lets time pass, firing due timers on the way
+  void spend(nanoseconds duration, cost what);
+  const costs_t& costs() const { return _costs; }
+
+  // Calls the handler every period, starting in one
+  size_t every(nanoseconds period, std::function<void()> handler);
+  void cancel(size_t timer);
+
+  void attach_interrupt(uint32_t pin, isr_t isr, uint32_t mode);
+  void detach_interrupt(uint32_t pin);
+  void rising_edge(uint32_t pin);
+
+  void pin_mode(uint32_t pin, uint32_t mode);
+  void digital_write(uint32_t pin, uint32_t value);
+  int digital_read(uint32_t pin) const;
+  const std::vector<pin_change_t>& pin_changes() const { return _pin_changes; }
+
+  // Clock cycles on the I2C bus, START and STOP included
+  void i2c_bits(size_t bits);
+  I2cDevice* i2c_device(uint8_t address);
+  void spi_transfer(size_t bytes, uint32_t frequency, cost what);
+
+  // What the sensors see now
+  const environment_t& environment();
+
+  Flight* flight = nullptr;
+  uint32_t i2c_frequency = 100000;
+  // What the sketch prints on USB
+  std::FILE* serial = nullptr;
+  uint32_t tones = 0;
+
+  Bno055 bno055;
+  Bmp280 bmp280;
+  I2cDevice mpu9250;
+  Radio radio;
+  SdCard sd_card;
+  Gps gps;
+
+private:
+  struct timer_t
+  {
+    nanoseconds due;
+    nanoseconds period;
+    std::function<void()> handler;
+    bool active;
+  };
+
+  struct interrupt_t
+  {
+    isr_t isr;
+    uint32_t mode;
+  };
+
+  nanoseconds _now{};
+  costs_t _costs{};
+  bool _in_interrupt = false;
+  std::vector<timer_t> _timers;
+  std::array<interrupt_t, NUM_DIGITAL_PINS> _interrupts{};
+  std::array<uint8_t, NUM_DIGITAL_PINS> _pins{};
+  std::vector<pin_change_t> _pin_changes;
+  environment_t _environment{};
+  nanoseconds _sensed{ -1 };
+};
+
+} // namespace far::emulator
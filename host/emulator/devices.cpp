@@ -0,0 +1,729 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The emulated devices and the drivers the sketch uses
+// for them. The drivers do the bus transactions and
+// delays of the libraries they stand in for.
+#include "board.hpp"
+#include "sensor-drivers.hpp"
+
+#include <MPU9250.h>
+#include <RF24.h>
+#include <SdFat.h>
+#include <Wire.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace far::emulator;
+
+namespace {
+
+// BNO055 registers, page 0
+constexpr uint8_t BNO055_CHIP_ID = 0x00;
+constexpr uint8_t BNO055_PAGE_ID = 0x07;
+constexpr uint8_t BNO055_OPR_MODE = 0x3D;
+constexpr uint8_t BNO055_SYS_TRIGGER = 0x3F;
+constexpr uint8_t BNO055_DATA = 0x08;
+// Page 1
+constexpr uint8_t BNO055_INT_EN = 0x10;
+constexpr uint8_t BNO055_ID = 0xA0;
+constexpr uint8_t BNO055_MODE_CONFIG = 0x00;
+
+constexpr uint8_t BMP280_CHIP_ID = 0xD0;
+constexpr uint8_t BMP280_CALIBRATION = 0x88;
+constexpr uint8_t BMP280_DATA = 0xF7;
+constexpr uint8_t BMP280_ID = 0x58;
+// T1 to T3 and P1 to P9 from the datasheet's example
+constexpr uint16_t BMP280_EXAMPLE_CALIBRATION[12] = {
+  27504, 26435, uint16_t(-1000), 36477, uint16_t(-10685), 3024, 2855, 140, uint16_t(-7), 15500, uint16_t(-14600), 6000,
+};
+
+constexpr uint8_t MPU9250_WHO_AM_I = 0x75;
+constexpr uint8_t MPU9250_ACCEL_XOUT_H = 0x3B;
+
+// The RF24 library's default SPI clock
+constexpr uint32_t NRF24_SPI_FREQUENCY = 10000000;
+// How long stopListening waits at 1Mbps
+constexpr auto NRF24_TX_DELAY = 250us;
+
+// Little endian, as the sensors deliver them
+void store(uint8_t* data, double value, double lsb_per_unit)
+{
+  const auto raw = int16_t(std::clamp(std::lround(value * lsb_per_unit), -32768l, 32767l));
+  data[0] = uint8_t(raw);
+  data[1] = uint8_t(raw >> 8);
+}
+
+// The 20 bit ADC readings the compensation turns into the
+// temperature in degrees Celsius and the pressure in Pa.
+// Both compensations are monotonic, so a bisection finds
+// them.
+void bmp280_adc(const deets::sensors::Bmp280Calibration& calibration, double temperature, double pressure,
+                int32_t& adc_T, int32_t& adc_P)
+{
+  const auto centidegrees = int32_t(std::lround(temperature * 100));
+  int32_t low = 0, high = 1 << 20;
+  while(low < high)
+  {
+    const auto middle = (low + high) / 2;
+    if(calibration.temperature(calibration.t_fine(middle)) < centidegrees)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  adc_T = low;
+
+  const auto t_fine = calibration.t_fine(adc_T);
+  const auto q24_8 = uint32_t(std::llround(pressure * 256));
+  // The pressure falls with the reading
+  low = 0;
+  high = 1 << 20;
+  while(low < high)
+  {
+    const auto middle = (low + high) / 2;
+    if(calibration.pressure(middle, t_fine) > q24_8)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  adc_P = low;
+}
+
+// What a register read through the given bus returns
+uint8_t read8(TwoWire& wire, uint8_t address, uint8_t reg)
+{
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.endTransmission(false);
+  wire.requestFrom(address, uint8_t(1));
+  return uint8_t(wire.read());
+}
+
+void read_registers(TwoWire& wire, uint8_t address, uint8_t reg, uint8_t* data, uint8_t size)
+{
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.endTransmission(false);
+  wire.requestFrom(address, size);
+  for(uint8_t i = 0; i < size; ++i)
+  {
+    data[i] = uint8_t(wire.available() ? wire.read() : 0);
+  }
+}
+
+void write8(TwoWire& wire, uint8_t address, uint8_t reg, uint8_t value)
+{
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.write(value);
+  wire.endTransmission();
+}
+
+void append_checksum(std::string& sentence)
+{
+  uint8_t checksum = 0;
+  for(size_t i = 1; i < sentence.size(); ++i)
+  {
+    checksum ^= uint8_t(sentence[i]);
+  }
+  char tail[8];
+  std::snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+  sentence += tail;
+}
+
+} // namespace
+
+namespace far::emulator {
+
+void Bno055::write(const uint8_t* data, size_t size)
+{
+  I2cDevice::write(data, size);
+  if(size == 1 && _page == 0 && _register >= BNO055_DATA && _register < BNO055_DATA + _data.size())
+  {
+    const auto& environment = Board::instance().environment();
+    for(size_t i = 0; i < 3; ++i)
+    {
+      store(&_data[2 * i], environment.acceleration[i], 100);
+      store(&_data[6 + 2 * i], environment.magnetic[i], 16);
+      store(&_data[12 + 2 * i], environment.angular_velocity[i], 16);
+    }
+  }
+  if(size < 2)
+  {
+    return;
+  }
+  const uint8_t value = data[1];
+  if(_register == BNO055_PAGE_ID)
+  {
+    _page = value;
+  }
+  else if(_page == 0 && _register == BNO055_OPR_MODE)
+  {
+    mode = value;
+  }
+  else if(_page == 0 && _register == BNO055_SYS_TRIGGER)
+  {
+    // RST_SYS
+    if(value & 0x20)
+    {
+      _page = 0;
+      mode = BNO055_MODE_CONFIG;
+      _int_enabled = false;
+      _latched = false;
+      _ready = Board::instance().now() + 650ms;
+    }
+    // RST_INT
+    if(value & 0x40)
+    {
+      _latched = false;
+    }
+  }
+  else if(_page == 1 && _register == BNO055_INT_EN)
+  {
+    // ACC_BSX_DRDY
+    _int_enabled = value & 0x01;
+  }
+}
+
+uint8_t Bno055::read()
+{
+  const uint8_t reg = _register++;
+  if(_page != 0)
+  {
+    return 0;
+  }
+  if(reg == BNO055_CHIP_ID && Board::instance().now() >= _ready)
+  {
+    return BNO055_ID;
+  }
+  if(reg >= BNO055_DATA && reg < BNO055_DATA + _data.size())
+  {
+    return _data[reg - BNO055_DATA];
+  }
+  return 0;
+}
+
+void Bno055::sample()
+{
+  if(!present || mode == BNO055_MODE_CONFIG)
+  {
+    return;
+  }
+  ++data_ready;
+  if(!_int_enabled)
+  {
+    return;
+  }
+  if(_latched)
+  {
+    ++overrun;
+    return;
+  }
+  _latched = true;
+  Board::instance().rising_edge(int_pin);
+}
+
+Bmp280::Bmp280()
+{
+  for(size_t i = 0; i < 12; ++i)
+  {
+    _calibration[2 * i] = uint8_t(BMP280_EXAMPLE_CALIBRATION[i]);
+    _calibration[2 * i + 1] = uint8_t(BMP280_EXAMPLE_CALIBRATION[i] >> 8);
+  }
+}
+
+void Bmp280::write(const uint8_t* data, size_t size)
+{
+  I2cDevice::write(data, size);
+  if(size == 1 && _register >= BMP280_DATA && _register < BMP280_DATA + _data.size())
+  {
+    const auto& environment = Board::instance().environment();
+    int32_t adc_T, adc_P;
+    bmp280_adc(deets::sensors::Bmp280Calibration::from_registers(_calibration.data()),
+               environment.temperature, environment.pressure, adc_T, adc_P);
+    const int32_t readings[2] = { adc_P, adc_T };
+    for(size_t i = 0; i < 2; ++i)
+    {
+      _data[3 * i] = uint8_t(readings[i] >> 12);
+      _data[3 * i + 1] = uint8_t(readings[i] >> 4);
+      _data[3 * i + 2] = uint8_t(readings[i] << 4);
+    }
+  }
+}
+
+uint8_t Bmp280::read()
+{
+  const uint8_t reg = _register++;
+  if(reg == BMP280_CHIP_ID)
+  {
+    return BMP280_ID;
+  }
+  if(reg >= BMP280_CALIBRATION && reg < BMP280_CALIBRATION + _calibration.size())
+  {
+    return _calibration[reg - BMP280_CALIBRATION];
+  }
+  if(reg >= BMP280_DATA && reg < BMP280_DATA + _data.size())
+  {
+    return _data[reg - BMP280_DATA];
+  }
+  return 0;
+}
+
+void Radio::retire()
+{
+  const auto now = Board::instance().now();
+  while(!_max_retries && !_fifo.empty() && _fifo.front() <= now)
+  {
+    _fifo.pop_front();
+    if(!acknowledged)
+    {
+      // The radio stops until the driver flushes
+      _max_retries = true;
+      ++lost;
+    }
+  }
+}
+
+bool Radio::write(const void* payload, size_t size)
+{
+  auto& board = Board::instance();
+  retire();
+  while(!_max_retries && _fifo.size() == 3)
+  {
+    board.spend(_fifo.front() - board.now(), cost::RADIO);
+    retire();
+  }
+  if(_max_retries)
+  {
+    return false;
+  }
+  const auto start = _fifo.empty() ? board.now() : _fifo.back();
+  _fifo.push_back(start + (acknowledged ? ACKNOWLEDGED_PACKET : UNACKNOWLEDGED_PACKET));
+  if(acknowledged)
+  {
+    ++sent;
+    if(log)
+    {
+      std::fwrite(payload, 1, size, log);
+    }
+  }
+  return true;
+}
+
+bool Radio::standby()
+{
+  auto& board = Board::instance();
+  while(true)
+  {
+    retire();
+    if(_max_retries)
+    {
+      lost += _fifo.size();
+      _fifo.clear();
+      _max_retries = false;
+      return false;
+    }
+    if(_fifo.empty())
+    {
+      return true;
+    }
+    board.spend(_fifo.front() - board.now(), cost::RADIO);
+  }
+}
+
+void SdCard::read_block()
+{
+  auto& board = Board::instance();
+  board.spend(BLOCK_TRANSFER, cost::SPI);
+  board.spend(100us, cost::SD_CARD);
+}
+
+void SdCard::write_block()
+{
+  auto& board = Board::instance();
+  board.spend(BLOCK_TRANSFER, cost::SPI);
+  board.spend(PROGRAMMING, cost::SD_CARD);
+  if(++blocks_written % BLOCKS_PER_STALL == 0)
+  {
+    ++stalls;
+    board.spend(STALL, cost::SD_CARD);
+  }
+}
+
+int Gps::available()
+{
+  receive();
+  return int(_rx.size());
+}
+
+int Gps::read()
+{
+  receive();
+  if(_rx.empty())
+  {
+    return -1;
+  }
+  const char c = _rx.front();
+  _rx.pop_front();
+  return c;
+}
+
+// Catches up with everything the GPS sent until now
+void Gps::receive()
+{
+  const auto now = Board::instance().now();
+  // 8N1
+  const nanoseconds byte_time(10 * 1000000000ull / baud);
+  while(true)
+  {
+    if(_position == _transmitting.size())
+    {
+      if(_next_fix > now)
+      {
+        return;
+      }
+      fix();
+      _position = 0;
+      _next_byte = _next_fix;
+      _next_fix += 1s;
+    }
+    if(_next_byte > now)
+    {
+      return;
+    }
+    if(_rx.size() < RX_BUFFER)
+    {
+      _rx.push_back(_transmitting[_position]);
+    }
+    else
+    {
+      ++dropped;
+    }
+    ++_position;
+    _next_byte += byte_time;
+  }
+}
+
+void Gps::fix()
+{
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(_next_fix).count() + 12 * 3600;
+  char time[16];
+  std::snprintf(time, sizeof(time), "%02lld%02lld%02lld.00",
+                (long long)(seconds / 3600 % 24), (long long)(seconds / 60 % 60), (long long)(seconds % 60));
+  const double altitude = 520.0 + Board::instance().environment().altitude;
+
+  char buffer[96];
+  std::snprintf(buffer, sizeof(buffer), "$GPGGA,%s,4807.0380,N,01131.0000,E,1,08,0.9,%.1f,M,47.0,M,,", time, altitude);
+  std::string gga(buffer);
+  append_checksum(gga);
+  std::snprintf(buffer, sizeof(buffer), "$GPRMC,%s,A,4807.0380,N,01131.0000,E,0.0,0.0,190623,,,A", time);
+  std::string rmc(buffer);
+  append_checksum(rmc);
+  _transmitting = gga + rmc;
+  sentences += 2;
+}
+
+} // namespace far::emulator
+
+TwoWire Wire;
+
+void TwoWire::begin()
+{
+}
+
+void TwoWire::setClock(uint32_t frequency)
+{
+  Board::instance().i2c_frequency = frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  _address = address;
+  _size = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+  if(_size == sizeof(_buffer))
+  {
+    return 0;
+  }
+  _buffer[_size++] = value;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t size)
+{
+  size_t written = 0;
+  while(written < size && write(data[written]))
+  {
+    ++written;
+  }
+  return written;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+  auto& board = Board::instance();
+  auto* device = board.i2c_device(_address);
+  if(!device)
+  {
+    // START, the address without ACK and STOP
+    board.i2c_bits(1 + 9 + 1);
+    return 2;
+  }
+  board.i2c_bits(1 + 9 + 9 * _size + (stop ? 1 : 0));
+  device->write(_buffer, _size);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t size, bool stop)
+{
+  auto& board = Board::instance();
+  auto* device = board.i2c_device(address);
+  _size = 0;
+  _position = 0;
+  if(!device)
+  {
+    board.i2c_bits(1 + 9 + 1);
+    return 0;
+  }
+  board.i2c_bits(1 + 9 + 9 * size + (stop ? 1 : 0));
+  for(; _size < size && _size < sizeof(_buffer); ++_size)
+  {
+    _buffer[_size] = device->read();
+  }
+  return uint8_t(_size);
+}
+
+int TwoWire::available()
+{
+  return int(_size - _position);
+}
+
+int TwoWire::read()
+{
+  return _position < _size ? _buffer[_position++] : -1;
+}
+
+bool MPU9250::testConnection()
+{
+  return read8(Wire, _address, MPU9250_WHO_AM_I) == 0x71;
+}
+
+void MPU9250::initialize()
+{
+  setFullScaleGyroRange(MPU9250_GYRO_FS_250);
+  setFullScaleAccelRange(MPU9250_ACCEL_FS_2);
+}
+
+void MPU9250::setFullScaleGyroRange(uint8_t range)
+{
+  write8(Wire, _address, 0x1B, uint8_t(range << 3));
+}
+
+void MPU9250::setFullScaleAccelRange(uint8_t range)
+{
+  write8(Wire, _address, 0x1C, uint8_t(range << 3));
+}
+
+void MPU9250::getMotion9(int16_t* ax, int16_t* ay, int16_t* az,
+                         int16_t* gx, int16_t* gy, int16_t* gz,
+                         int16_t* mx, int16_t* my, int16_t* mz)
+{
+  uint8_t data[14];
+  read_registers(Wire, _address, MPU9250_ACCEL_XOUT_H, data, sizeof(data));
+  *ax = *ay = *az = *gx = *gy = *gz = *mx = *my = *mz = 0;
+}
+
+bool RF24::begin()
+{
+  auto& board = Board::instance();
+  pinMode(_ce_pin, OUTPUT);
+  pinMode(_cs_pin, OUTPUT);
+  // Power on reset
+  delay(5);
+  // Setting up the registers
+  for(int i = 0; i < 16; ++i)
+  {
+    board.spi_transfer(2, NRF24_SPI_FREQUENCY, cost::SPI);
+  }
+  return board.radio.present;
+}
+
+void RF24::setPayloadSize(uint8_t size)
+{
+  _payload_size = std::min<uint8_t>(size, 32);
+  Board::instance().spi_transfer(2 * 6, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+void RF24::setAutoAck(bool enable)
+{
+  (void)enable;
+  Board::instance().spi_transfer(2, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+void RF24::setPALevel(uint8_t level, bool lna_enable)
+{
+  (void)lna_enable;
+  auto& board = Board::instance();
+  board.spi_transfer(4, NRF24_SPI_FREQUENCY, cost::SPI);
+  board.radio.power_level = level;
+}
+
+void RF24::openWritingPipe(const uint8_t* address)
+{
+  (void)address;
+  Board::instance().spi_transfer(2 * 6 + 2, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+void RF24::openReadingPipe(uint8_t number, const uint8_t* address)
+{
+  (void)number;
+  (void)address;
+  Board::instance().spi_transfer(6 + 2 + 2, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+void RF24::startListening()
+{
+  Board::instance().spi_transfer(8, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+void RF24::stopListening()
+{
+  auto& board = Board::instance();
+  board.spend(NRF24_TX_DELAY, cost::RADIO);
+  board.spi_transfer(4, NRF24_SPI_FREQUENCY, cost::SPI);
+}
+
+bool RF24::writeFast(const void* buffer, uint8_t size)
+{
+  auto& board = Board::instance();
+  // W_TX_PAYLOAD and the padded payload
+  board.spi_transfer(1 + _payload_size, NRF24_SPI_FREQUENCY, cost::SPI);
+  return board.radio.write(buffer, std::min(size, _payload_size));
+}
+
+bool RF24::txStandBy()
+{
+  return Board::instance().radio.standby();
+}
+
+bool SdFat::begin(uint8_t cs_pin, uint8_t divisor)
+{
+  (void)cs_pin;
+  (void)divisor;
+  auto& board = Board::instance();
+  if(!board.sd_card.present)
+  {
+    // Waits for an answer until the init timeout
+    board.spend(2s, cost::SD_CARD);
+    return false;
+  }
+  // ACMD41 until the card is ready, then the MBR, the
+  // volume boot record and the root directory
+  board.spend(100ms, cost::SD_CARD);
+  for(int i = 0; i < 3; ++i)
+  {
+    board.sd_card.read_block();
+  }
+  return true;
+}
+
+bool SdFat::exists(const char* path)
+{
+  auto& card = Board::instance().sd_card;
+  card.read_block();
+  return card.files.count(path) > 0;
+}
+
+bool SdFile::open(const char* path, int flags)
+{
+  auto& card = Board::instance().sd_card;
+  card.read_block();
+  const bool exists = card.files.count(path) > 0;
+  if((exists && (flags & O_CREAT) && (flags & O_EXCL)) || (!exists && !(flags & O_CREAT)))
+  {
+    return false;
+  }
+  if(!exists)
+  {
+    card.files[path];
+    card.write_block();
+  }
+  _path = path;
+  _position = 0;
+  _open = true;
+  _write_error = false;
+  _cached = 0;
+  return true;
+}
+
+int SdFile::read(void* data, size_t size)
+{
+  if(!_open)
+  {
+    return -1;
+  }
+  auto& card = Board::instance().sd_card;
+  card.read_block();
+  const auto& contents = card.files[_path];
+  size = std::min(size, contents.size() - std::min(_position, contents.size()));
+  std::memcpy(data, contents.data() + _position, size);
+  _position += size;
+  return int(size);
+}
+
+size_t SdFile::write(const void* data, size_t size)
+{
+  if(!_open)
+  {
+    _write_error = true;
+    return 0;
+  }
+  auto& card = Board::instance().sd_card;
+  auto& contents = card.files[_path];
+  contents.resize(std::max(contents.size(), _position + size));
+  std::memcpy(&contents[_position], data, size);
+  _position += size;
+  _cached += size;
+  for(; _cached >= 512; _cached -= 512)
+  {
+    card.write_block();
+  }
+  return size;
+}
+
+bool SdFile::sync()
+{
+  if(!_open)
+  {
+    return false;
+  }
+  auto& card = Board::instance().sd_card;
+  // The partial data block, then the directory entry
+  if(_cached)
+  {
+    card.write_block();
+  }
+  card.read_block();
+  card.write_block();
+  return true;
+}
+
+bool SdFile::close()
+{
+  const bool synced = sync();
+  _open = false;
+  return synced;
+}
@@ -0,0 +1,402 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Runs junior_lower.ino on the emulated board through a
+// simulated or recorded flight and reports how long the
+// passes through loop() took in virtual time, what they
+// waited for, the statistics of the scheduler and the
+// states the firmware went through.
+#include "board.hpp"
+#include "sketch.hpp"
+#include "state-names.hpp"
+#include "profiling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace far::emulator;
+using far::junior::state;
+
+namespace {
+
+// A pass that waited for nothing still runs the scheduler
+constexpr auto IDLE_PASS = 5us;
+// Should the flight never end
+constexpr auto LIMIT = std::chrono::hours(1);
+constexpr size_t LONGEST_PASSES = 8;
+
+struct options_t
+{
+  flight_profile_t profile;
+  const char* recording = nullptr;
+  double duration = 0;
+  const char* serial = nullptr;
+  const char* radio = nullptr;
+  bool ground_station = true;
+  bool bno055 = true;
+  bool nrf24 = true;
+  bool sd_card = true;
+  unsigned sd_logs = 0;
+  double cpu_scale = 0;
+};
+
+struct pass_t
+{
+  nanoseconds start;
+  nanoseconds duration;
+  costs_t costs;
+  state in;
+};
+
+struct state_change_t
+{
+  nanoseconds at;
+  state to;
+  double altitude;
+};
+
+void usage(const char* program)
+{
+  std::fprintf(stderr,
+               "usage: %s [options]\n"
+               "  --launch S           seconds on the pad (30)\n"
+               "  --thrust A           m/s^2 above gravity while the motor burns (15)\n"
+               "  --burn S             burn time (2.5)\n"
+               "  --drouge S           drouge opens S seconds after apogee (0)\n"
+               "  --no-drouge          ballistic descent\n"
+               "  --noise MBAR         barometer noise (0.05)\n"
+               "  --seed N             of the noise (1)\n"
+               "  --recording FILE     replay time,pressure,temperature,acc_x,acc_y,acc_z\n"
+               "  --duration S         stop after S seconds instead of after the flight\n"
+               "  --serial FILE        write what the sketch prints on USB\n"
+               "  --radio FILE         write what the ground station receives\n"
+               "  --no-ground-station  nobody acknowledges the radio packets\n"
+               "  --no-bno055 --no-radio --no-sd\n"
+               "                       leave the device off the board\n"
+               "  --sd-logs N          the card holds N logs of earlier flights\n"
+               "  --cpu-scale X        also charge X times the host time of each pass\n",
+               program);
+}
+
+bool parse(int argc, char** argv, options_t& options)
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    const std::string option = argv[i];
+    const auto value = [&]() -> const char* {
+      if(i + 1 >= argc)
+      {
+        std::fprintf(stderr, "%s needs a value\n", option.c_str());
+        std::exit(EXIT_FAILURE);
+      }
+      return argv[++i];
+    };
+    if(option == "--launch")
+    {
+      options.profile.launch = std::atof(value());
+    }
+    else if(option == "--thrust")
+    {
+      options.profile.thrust = std::atof(value());
+    }
+    else if(option == "--burn")
+    {
+      options.profile.burntime = std::atof(value());
+    }
+    else if(option == "--drouge")
+    {
+      options.profile.drouge_delay = std::atof(value());
+    }
+    else if(option == "--no-drouge")
+    {
+      options.profile.drouge_delay = -1;
+    }
+    else if(option == "--noise")
+    {
+      options.profile.pressure_noise = std::atof(value());
+    }
+    else if(option == "--seed")
+    {
+      options.profile.seed = unsigned(std::atoi(value()));
+    }
+    else if(option == "--recording")
+    {
+      options.recording = value();
+    }
+    else if(option == "--duration")
+    {
+      options.duration = std::atof(value());
+    }
+    else if(option == "--serial")
+    {
+      options.serial = value();
+    }
+    else if(option == "--radio")
+    {
+      options.radio = value();
+    }
+    else if(option == "--no-ground-station")
+    {
+      options.ground_station = false;
+    }
+    else if(option == "--no-bno055")
+    {
+      options.bno055 = false;
+    }
+    else if(option == "--no-radio")
+    {
+      options.nrf24 = false;
+    }
+    else if(option == "--no-sd")
+    {
+      options.sd_card = false;
+    }
+    else if(option == "--sd-logs")
+    {
+      options.sd_logs = unsigned(std::atoi(value()));
+    }
+    else if(option == "--cpu-scale")
+    {
+      options.cpu_scale = std::atof(value());
+    }
+    else
+    {
+      usage(argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+double seconds(nanoseconds t)
+{
+  return std::chrono::duration<double>(t).count();
+}
+
+double milliseconds(nanoseconds t)
+{
+  return std::chrono::duration<double, std::milli>(t).count();
+}
+
+void print_costs(const costs_t& costs)
+{
+  const char* separator = "";
+  for(size_t i = 0; i < costs.size(); ++i)
+  {
+    if(costs[i] > nanoseconds::zero())
+    {
+      std::printf("%s%s %.3fms", separator, name(cost(i)), milliseconds(costs[i]));
+      separator = ", ";
+    }
+  }
+  std::printf("\n");
+}
+
+costs_t operator-(const costs_t& a, const costs_t& b)
+{
+  costs_t result;
+  for(size_t i = 0; i < a.size(); ++i)
+  {
+    result[i] = a[i] - b[i];
+  }
+  return result;
+}
+
+std::FILE* open(const char* path)
+{
+  if(!path)
+  {
+    return nullptr;
+  }
+  auto* file = std::fopen(path, "w");
+  if(!file)
+  {
+    std::fprintf(stderr, "can't write %s\n", path);
+    std::exit(EXIT_FAILURE);
+  }
+  return file;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  options_t options;
+  if(!parse(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<Flight> flight;
+  if(options.recording)
+  {
+    flight = RecordedFlight::load(options.recording);
+    if(!flight)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    flight = std::make_unique<SimulatedFlight>(options.profile);
+  }
+
+  auto& board = Board::instance();
+  board.flight = flight.get();
+  board.serial = open(options.serial);
+  board.radio.log = open(options.radio);
+  board.radio.acknowledged = options.ground_station;
+  board.radio.present = options.nrf24;
+  board.bno055.present = options.bno055;
+  board.sd_card.present = options.sd_card;
+  // And the counter, as the sketch leaves it
+  for(unsigned i = 0; i < options.sd_logs; ++i)
+  {
+    char log[24];
+    std::snprintf(log, sizeof(log), "data%04u.txt", i);
+    board.sd_card.files[log];
+  }
+  if(options.sd_logs)
+  {
+    char counter[16];
+    std::snprintf(counter, sizeof(counter), "%04u\n", options.sd_logs);
+    board.sd_card.files["counter.txt"] = counter;
+  }
+
+  setup();
+  const auto boot = board.now();
+  const auto boot_costs = board.costs();
+
+  deets::profiling::Histogram<24> passes;
+  std::vector<pass_t> longest;
+  std::vector<state_change_t> states;
+  auto current = sketch::current_state();
+  states.push_back({ board.now(), current, board.environment().altitude });
+
+  const auto over = [&] {
+    const auto now = board.now();
+    if(options.duration > 0)
+    {
+      return seconds(now) >= options.duration;
+    }
+    return flight->over(seconds(now)) || now >= LIMIT;
+  };
+
+  while(!over())
+  {
+    const auto start = board.now();
+    const auto costs = board.costs();
+    const auto host_start = std::chrono::steady_clock::now();
+    loop();
+    if(options.cpu_scale > 0)
+    {
+      const auto host = std::chrono::steady_clock::now() - host_start;
+      board.spend(std::chrono::duration_cast<nanoseconds>(host * options.cpu_scale), cost::CPU);
+    }
+    if(board.now() == start)
+    {
+      board.spend(IDLE_PASS, cost::CPU);
+    }
+
+    const pass_t pass = { start, board.now() - start, board.costs() - costs, current };
+    passes.record(uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(pass.duration).count()));
+    if(longest.size() < LONGEST_PASSES || pass.duration > longest.back().duration)
+    {
+      longest.push_back(pass);
+      std::sort(longest.begin(), longest.end(), [](const auto& a, const auto& b) { return a.duration > b.duration; });
+      if(longest.size() > LONGEST_PASSES)
+      {
+        longest.pop_back();
+      }
+    }
+
+    const auto now_in = sketch::current_state();
+    if(now_in != current)
+    {
+      current = now_in;
+      states.push_back({ board.now(), current, board.environment().altitude });
+    }
+  }
+
+#ifdef FARDUINO_FIXED_POINT
+  const char* numbers = "Q15.16";
+#else
+  const char* numbers = "float";
+#endif
+  std::printf("junior_lower.ino on the emulated Maple v2 (%s), I2C at %ukHz\n", numbers, board.i2c_frequency / 1000);
+  if(options.recording)
+  {
+    std::printf("flight: %s\n\n", options.recording);
+  }
+  else
+  {
+    std::printf("flight: simulated, launch at %.1fs\n\n", options.profile.launch);
+  }
+
+  std::printf("setup() took %.3fs: ", seconds(boot));
+  print_costs(boot_costs);
+  for(size_t i = 0; i < sketch::boot_phases(); ++i)
+  {
+    const auto& statistics = sketch::boot_phase_statistics(i);
+    std::printf("  %-10s %-7s after %8.3fms, %3u steps busy %8.3fms\n", sketch::boot_phase_name(i),
+                statistics.status == deets::boot::step_t::DONE ? "up" : "absent",
+                statistics.end.count() / 1000.0, statistics.steps, statistics.busy.count() / 1000.0);
+  }
+  std::printf("then %.3fs in %u passes through loop(): ", seconds(board.now() - boot), passes.count());
+  print_costs(board.costs() - boot_costs);
+
+  std::printf("\npass duration: mean %uus, p99 <= %uus, max %uus\n",
+              passes.mean(), passes.percentile(99), passes.max());
+  std::printf("\nlongest passes:\n");
+  for(const auto& pass : longest)
+  {
+    std::printf("  %9.3fs %10.3fms %-27s ", seconds(pass.start), milliseconds(pass.duration), far::junior::host::name(pass.in));
+    print_costs(pass.costs);
+  }
+
+  std::printf("\n%-14s %8s %8s %8s %12s %12s\n", "task", "runs", "misses", "shed", "max exec", "max late");
+  for(size_t i = 0; i < sketch::tasks(); ++i)
+  {
+    const auto& statistics = sketch::task_statistics(i);
+    std::printf("%-14s %8u %8u %8u %10lldus %10lldus\n", sketch::task_name(i), statistics.runs,
+                statistics.deadline_misses, statistics.shed,
+                (long long)statistics.max_execution.count(), (long long)statistics.max_lateness.count());
+  }
+
+  std::printf("\nbno055: %u samples, %u overran a latched INT\n", board.bno055.data_ready, board.bno055.overrun);
+  std::printf("radio: %u packets sent, %u lost\n", board.radio.sent, board.radio.lost);
+  std::printf("gps: %u sentences, %u bytes dropped by the receive buffer\n", board.gps.sentences, board.gps.dropped);
+  if(options.sd_card)
+  {
+    std::printf("sd card: %u blocks written, %u stalls\n", board.sd_card.blocks_written, board.sd_card.stalls);
+  }
+
+  std::printf("\nstates:\n");
+  for(const auto& change : states)
+  {
+    std::printf("  %9.3fs %-27s %8.1fm\n", seconds(change.at), far::junior::host::name(change.to), change.altitude);
+  }
+  if(!board.pin_changes().empty())
+  {
+    std::printf("\npins:\n");
+    for(const auto& change : board.pin_changes())
+    {
+      std::printf("  %9.3fs pin %u %s\n", seconds(change.at), change.pin, change.value ? "HIGH" : "LOW");
+    }
+  }
+
+  for(auto* file : { board.serial, board.radio.log })
+  {
+    if(file)
+    {
+      std::fclose(file);
+    }
+  }
+  return EXIT_SUCCESS;
+}
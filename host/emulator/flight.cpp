@@ -0,0 +1,184 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#include "flight.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace far::emulator {
+
+namespace {
+
+constexpr double G = 9.81;
+constexpr double GROUND_PRESSURE = 101325.0;
+constexpr double GROUND_TEMPERATURE = 15.0;
+constexpr double STEP = 0.001;
+// Roughly the field in central Europe
+constexpr std::array<double, 3> MAGNETIC_FIELD = { 20.0, 0.0, -44.0 };
+
+double pressure_at(double h)
+{
+  return GROUND_PRESSURE * std::pow(1.0 - h / 44330.0, 5.255);
+}
+
+} // namespace
+
+double altitude(double pressure, double ground_pressure)
+{
+  return 44330.0 * (1.0 - std::pow(pressure / ground_pressure, 1.0 / 5.255));
+}
+
+SimulatedFlight::SimulatedFlight(const flight_profile_t& profile)
+  : _profile(profile)
+  , _rng(profile.seed)
+  , _pressure_noise(0, profile.pressure_noise * 100.0)
+  , _vibration(0, 0.05)
+{}
+
+void SimulatedFlight::step(double dt)
+{
+  const auto& p = _profile;
+  const double t = _t;
+  double a = 0;
+  _measured = G;
+  if(t >= p.launch && t < p.launch + p.burntime)
+  {
+    a = p.thrust;
+    _measured = G + p.thrust;
+  }
+  else if(t >= p.launch && _touchdown < 0)
+  {
+    const double drag = 0.0005 * _v * _v;
+    a = -G - (_v > 0 ? drag : -drag);
+    // Everything but gravity, drag works against the motion
+    _measured = a + G;
+    if(_apogee >= 0 && p.drouge_delay >= 0 && t >= _apogee + p.drouge_delay)
+    {
+      const double chute = G / (15.0 * 15.0) * _v * _v;
+      a = -G + chute;
+      _measured = chute;
+    }
+  }
+  if(_apogee < 0 && t > p.launch + p.burntime && _v + a * dt < 0)
+  {
+    _apogee = t;
+  }
+  _v += a * dt;
+  _h += _v * dt;
+  if(t > p.launch + p.burntime && _h <= 0 && _touchdown < 0)
+  {
+    _touchdown = t;
+  }
+  if(_touchdown >= 0)
+  {
+    _h = 0;
+    _v = 0;
+    _measured = G;
+  }
+  _t += dt;
+}
+
+environment_t SimulatedFlight::at(double t)
+{
+  while(_t + STEP <= t)
+  {
+    step(STEP);
+  }
+  environment_t environment;
+  environment.altitude = _h;
+  environment.pressure = pressure_at(_h) + _pressure_noise(_rng);
+  environment.temperature = GROUND_TEMPERATURE - 0.0065 * _h;
+  environment.acceleration = { _vibration(_rng), _vibration(_rng), _measured + _vibration(_rng) };
+  environment.angular_velocity = { 0.0, 0.0, 0.0 };
+  environment.magnetic = MAGNETIC_FIELD;
+  return environment;
+}
+
+bool SimulatedFlight::over(double t) const
+{
+  return _touchdown >= 0 && t > _touchdown + 10.0;
+}
+
+std::unique_ptr<RecordedFlight> RecordedFlight::load(const std::string& path)
+{
+  std::ifstream file(path);
+  if(!file)
+  {
+    std::fprintf(stderr, "can't open %s\n", path.c_str());
+    return nullptr;
+  }
+  std::unique_ptr<RecordedFlight> flight(new RecordedFlight);
+  std::string line;
+  size_t number = 0;
+  while(std::getline(file, line))
+  {
+    ++number;
+    if(line.empty() || line[0] == '#')
+    {
+      continue;
+    }
+    std::istringstream fields(line);
+    row_t row;
+    char separator;
+    fields >> row.time >> separator >> row.pressure >> separator >> row.temperature
+           >> separator >> row.acceleration[0] >> separator >> row.acceleration[1]
+           >> separator >> row.acceleration[2];
+    if(!fields)
+    {
+      // The header
+      if(flight->_rows.empty() && number == 1)
+      {
+        continue;
+      }
+      std::fprintf(stderr, "%s:%zu: expected time,pressure,temperature,acc_x,acc_y,acc_z\n", path.c_str(), number);
+      return nullptr;
+    }
+    if(!flight->_rows.empty() && row.time <= flight->_rows.back().time)
+    {
+      std::fprintf(stderr, "%s:%zu: time must increase\n", path.c_str(), number);
+      return nullptr;
+    }
+    flight->_rows.push_back(row);
+  }
+  if(flight->_rows.empty())
+  {
+    std::fprintf(stderr, "%s: no data\n", path.c_str());
+    return nullptr;
+  }
+  return flight;
+}
+
+environment_t RecordedFlight::at(double t)
+{
+  while(_current + 1 < _rows.size() && _rows[_current + 1].time <= t)
+  {
+    ++_current;
+  }
+  const auto& from = _rows[_current];
+  const auto& to = _current + 1 < _rows.size() ? _rows[_current + 1] : from;
+  const double span = to.time - from.time;
+  const double k = span > 0 ? std::min(std::max((t - from.time) / span, 0.0), 1.0) : 0.0;
+  const auto mix = [k](double a, double b) { return a + (b - a) * k; };
+
+  environment_t environment;
+  environment.pressure = mix(from.pressure, to.pressure);
+  environment.temperature = mix(from.temperature, to.temperature);
+  for(size_t i = 0; i < 3; ++i)
+  {
+    environment.acceleration[i] = mix(from.acceleration[i], to.acceleration[i]);
+  }
+  environment.angular_velocity = { 0.0, 0.0, 0.0 };
+  environment.magnetic = MAGNETIC_FIELD;
+  environment.altitude = altitude(environment.pressure, _rows.front().pressure);
+  return environment;
+}
+
+bool RecordedFlight::over(double t) const
+{
+  return t > _rows.back().time;
+}
+
+} // namespace far::emulator
@@ -0,0 +1,116 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace far::emulator {
+
+// What the sensors of the board are exposed to
+struct environment_t
+{
+  // Pa
+  double pressure;
+  // degrees Celsius
+  double temperature;
+  // m/s^2 as an accelerometer sees it, gravity included.
+  // z is the axis of the rocket, pointing up on the pad.
+  std::array<double, 3> acceleration;
+  // degrees/s
+  std::array<double, 3> angular_velocity;
+  // uT
+  std::array<double, 3> magnetic;
+  // m above the pad
+  double altitude;
+};
+
+// A flight as the board lives through it
+class Flight
+{
+public:
+  virtual ~Flight() = default;
+  // Seconds since power on, never decreasing
+  virtual environment_t at(double t) = 0;
+  // Nothing interesting happens after this
+  virtual bool over(double t) const = 0;
+};
+
+struct flight_profile_t
+{
+  // Seconds on the pad after power on
+  double launch = 30.0;
+  // m/s^2 above gravity while the motor burns
+  double thrust = 15.0;
+  double burntime = 2.5;
+  // The drouge opens this many seconds after apogee,
+  // negative for none
+  double drouge_delay = 0.0;
+  // mbar
+  double pressure_noise = 0.05;
+  unsigned seed = 1;
+};
+
+// A vertical flight, integrated in 1ms steps: motor,
+// quadratic drag and a drouge with 15m/s terminal
+// velocity. Over ten seconds after touchdown.
+class SimulatedFlight : public Flight
+{
+public:
+  explicit SimulatedFlight(const flight_profile_t& profile);
+
+  environment_t at(double t) override;
+  bool over(double t) const override;
+
+private:
+  void step(double dt);
+
+  flight_profile_t _profile;
+  std::mt19937 _rng;
+  std::normal_distribution<double> _pressure_noise;
+  std::normal_distribution<double> _vibration;
+  double _t = 0;
+  double _h = 0;
+  double _v = 0;
+  // The specific force along the rocket axis
+  double _measured = 9.81;
+  double _apogee = -1;
+  double _touchdown = -1;
+};
+
+// Replays a CSV with the columns
+//
+//   time,pressure,temperature,acc_x,acc_y,acc_z
+//
+// in s, Pa, degrees Celsius and m/s^2, interpolating
+// linearly between the rows. Lines starting with # and
+// a header line are skipped.
+class RecordedFlight : public Flight
+{
+public:
+  // Empty on errors, which are reported on stderr
+  static std::unique_ptr<RecordedFlight> load(const std::string& path);
+
+  environment_t at(double t) override;
+  bool over(double t) const override;
+
+private:
+  struct row_t
+  {
+    double time;
+    double pressure;
+    double temperature;
+    std::array<double, 3> acceleration;
+  };
+
+  std::vector<row_t> _rows;
+  size_t _current = 0;
+};
+
+// The standard atmosphere below 11km
+double altitude(double pressure, double ground_pressure);
+
+} // namespace far::emulator
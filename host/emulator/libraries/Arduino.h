@@ -0,0 +1,134 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The Arduino core of the emulated Maple board. Time is
+// the virtual time of far::emulator::Board, so delay()
+// returns immediately but the clock moved on.
+#pragma once
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using byte = uint8_t;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 2
+#define RISING 3
+#define FALLING 4
+
+// The pins of the STM32F103 we use, numbered like the
+// STM32 core does: port * 16 + pin
+enum : uint8_t {
+  PA2 = 2, PA4 = 4, PA8 = 8, PA11 = 11, PA12 = 12, PA13 = 13, PA14 = 14, PA15 = 15,
+  PB3 = 19, PB4 = 20, PB5 = 21, PB6 = 22, PB7 = 23, PB8 = 24, PB12 = 28,
+  PC15 = 47,
+  NUM_DIGITAL_PINS = 48,
+};
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+inline uint32_t digitalPinToInterrupt(uint32_t pin)
+{
+  return pin;
+}
+void attachInterrupt(uint32_t pin, void (*isr)(), uint32_t mode);
+void detachInterrupt(uint32_t pin);
+// Interrupts only happen while time passes, there is
+// nothing to hold off
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// From avr-libc, which the ARM cores provide as well
+inline char* dtostrf(double val, signed char width, unsigned char prec, char* sout)
+{
+  sprintf(sout, "%*.*f", width, prec, val);
+  return sout;
+}
+
+#define DEC 10
+#define HEX 16
+
+// Serial is the USB port, Serial1 the GPS at 9600 baud
+class HardwareSerial
+{
+public:
+  explicit HardwareSerial(int port)
+    : _port(port)
+  {}
+
+  void begin(unsigned long baud);
+  int available();
+  int read();
+
+  size_t write(const char* data, size_t size);
+  size_t print(const char* text) { return write(text, strlen(text)); }
+  size_t print(const __FlashStringHelper* text) { return print(reinterpret_cast<const char*>(text)); }
+  size_t print(char c) { return write(&c, 1); }
+  size_t print(long value, int base = DEC);
+  size_t print(int value, int base = DEC) { return print(long(value), base); }
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(double value, int digits = 2);
+
+  template<typename T>
+  size_t println(T value)
+  {
+    return print(value) + println();
+  }
+  template<typename T>
+  size_t println(T value, int format)
+  {
+    return print(value, format) + println();
+  }
+  size_t println() { return write("\r\n", 2); }
+
+private:
+  int _port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+// STM32duino's timers, only what the sketch uses
+struct TIM_TypeDef;
+extern TIM_TypeDef* TIM2;
+extern TIM_TypeDef* TIM4;
+
+enum TimerFormat_t { TICK_FORMAT, MICROSEC_FORMAT, HERTZ_FORMAT };
+
+class HardwareTimer
+{
+public:
+  explicit HardwareTimer(TIM_TypeDef*) {}
+  void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT);
+  void attachInterrupt(void (*isr)());
+  void resume();
+  void pause();
+  // The counter starts over on resume() anyway
+  void refresh() {}
+
+private:
+  uint32_t _period_us = 0;
+  void (*_isr)() = nullptr;
+  int _timer = -1;
+};
@@ -0,0 +1,7 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The MPU9250 library includes it, the emulated one
+// talks to the bus itself.
+#pragma once
+#include <Wire.h>
@@ -0,0 +1,36 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The I2Cdevlib MPU9250 driver on the emulated bus. The
+// Maple v2 has no MPU9250, so it is never acknowledged.
+#pragma once
+#include <I2Cdev.h>
+
+#define MPU9250_DEFAULT_ADDRESS 0x68
+#define MPU9250_GYRO_FS_250 0x00
+#define MPU9250_GYRO_FS_500 0x01
+#define MPU9250_GYRO_FS_1000 0x02
+#define MPU9250_GYRO_FS_2000 0x03
+#define MPU9250_ACCEL_FS_2 0x00
+#define MPU9250_ACCEL_FS_4 0x01
+#define MPU9250_ACCEL_FS_8 0x02
+#define MPU9250_ACCEL_FS_16 0x03
+
+class MPU9250
+{
+public:
+  explicit MPU9250(uint8_t address = MPU9250_DEFAULT_ADDRESS)
+    : _address(address)
+  {}
+
+  bool testConnection();
+  void initialize();
+  void setFullScaleGyroRange(uint8_t range);
+  void setFullScaleAccelRange(uint8_t range);
+  void getMotion9(int16_t* ax, int16_t* ay, int16_t* az,
+                  int16_t* gx, int16_t* gy, int16_t* gz,
+                  int16_t* mx, int16_t* my, int16_t* mz);
+
+private:
+  uint8_t _address;
+};
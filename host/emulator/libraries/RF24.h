@@ -0,0 +1,37 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// TMRh20's nRF24L01+ driver against the emulated radio,
+// which has the three deep TX FIFO, the time on air and
+// the auto acknowledgement of the real one.
+#pragma once
+#include <Arduino.h>
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX, RF24_PA_ERROR } rf24_pa_dbm_e;
+
+class RF24
+{
+public:
+  RF24(uint16_t ce_pin, uint16_t cs_pin)
+    : _ce_pin(ce_pin)
+    , _cs_pin(cs_pin)
+  {}
+
+  bool begin();
+  void setPayloadSize(uint8_t size);
+  void setAutoAck(bool enable);
+  void setPALevel(uint8_t level, bool lna_enable = true);
+  void openWritingPipe(const uint8_t* address);
+  void openReadingPipe(uint8_t number, const uint8_t* address);
+  void startListening();
+  void stopListening();
+  // Blocks while the TX FIFO is full
+  bool writeFast(const void* buffer, uint8_t size);
+  // Blocks until the TX FIFO is empty
+  bool txStandBy();
+
+private:
+  uint16_t _ce_pin;
+  uint16_t _cs_pin;
+  uint8_t _payload_size = 32;
+};
@@ -0,0 +1,13 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <Arduino.h>
+
+// The devices know their SPI clock, the emulated bus
+// only needs to exist.
+class SPIClass
+{
+public:
+  SPIClass() = default;
+  void begin() {}
+};
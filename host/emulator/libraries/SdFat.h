@@ -0,0 +1,53 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Bill Greiman's SdFat against an emulated card: writes
+// go through the 512 byte block cache, each block takes
+// the SPI transfer plus the busy time of the card.
+#pragma once
+#include <SPI.h>
+
+#include <string>
+
+#define O_READ 0x00
+#define O_WRITE 0x01
+#define O_RDWR 0x02
+#define O_CREAT 0x40
+#define O_EXCL 0x80
+#define SPI_FULL_SPEED 1
+#define SPI_HALF_SPEED 2
+
+class SdFat
+{
+public:
+  explicit SdFat(SPIClass* spi = nullptr)
+    : _spi(spi)
+  {}
+
+  bool begin(uint8_t cs_pin, uint8_t divisor = SPI_FULL_SPEED);
+  bool exists(const char* path);
+
+private:
+  SPIClass* _spi;
+};
+
+class SdFile
+{
+public:
+  bool open(const char* path, int flags = O_READ);
+  int read(void* data, size_t size);
+  void rewind() { _position = 0; }
+  bool sync();
+  bool close();
+  bool getWriteError() const { return _write_error; }
+  size_t write(const void* data, size_t size);
+  size_t print(const char* text) { return write(text, strlen(text)); }
+
+private:
+  std::string _path;
+  size_t _position = 0;
+  bool _open = false;
+  bool _write_error = false;
+  // Bytes in the block cache
+  size_t _cached = 0;
+};
@@ -0,0 +1,33 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The I2C bus of the emulated board. Transactions are
+// delivered to the emulated devices and take the time
+// the bits need at the configured clock.
+#pragma once
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+  void begin();
+  void setClock(uint32_t frequency);
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  size_t write(const uint8_t* data, size_t size);
+  // 0 on success, 2 if nobody acknowledged the address
+  uint8_t endTransmission(bool stop = true);
+
+  uint8_t requestFrom(uint8_t address, uint8_t size, bool stop = true);
+  int available();
+  int read();
+
+private:
+  uint8_t _address = 0;
+  uint8_t _buffer[32];
+  size_t _size = 0;
+  size_t _position = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# (c) Diez Roggisch, 2023
+# SPDX-License-Identifier: MIT
+#
+# Turns the sketch into C++ the way the Arduino builder
+# does: Arduino.h first, then prototypes of all functions
+# in front of the first definition, so they can be used
+# before they are defined.
+#
+# usage: make-sketch.py SKETCH OUTPUT [APPENDED...]
+import re
+import sys
+
+DEFINITION = re.compile(
+    r'^([A-Za-z_][\w:<>\*& ]*?[\s\*&])([A-Za-z_]\w*)\s*\(([^;{}]*?)\)\s*\{',
+    re.M)
+KEYWORDS = {'if', 'while', 'for', 'switch', 'return', 'else'}
+
+
+def main(sketch, output, appended):
+    with open(sketch) as f:
+        source = f.read()
+
+    definitions = [m for m in DEFINITION.finditer(source) if m.group(2) not in KEYWORDS]
+    if not definitions:
+        sys.exit('%s: no functions found' % sketch)
+
+    prototypes = []
+    for m in definitions:
+        # Default arguments only go into the prototype
+        arguments = re.sub(r'\s+', ' ', m.group(3)).strip()
+        prototypes.append('%s%s(%s);' % (m.group(1).strip() + ' ', m.group(2), arguments))
+
+    first = definitions[0].start()
+    line = source.count('\n', 0, first) + 1
+    name = sketch.replace('\\', '/')
+    parts = [
+        '#include <Arduino.h>',
+        '#line 1 "%s"' % name,
+        source[:first],
+        '\n'.join(prototypes),
+        '#line %d "%s"' % (line, name),
+        source[first:],
+    ]
+    for path in appended:
+        parts.append('#line 1 "%s"' % path.replace('\\', '/'))
+        with open(path) as f:
+            parts.append(f.read())
+
+    with open(output, 'w') as f:
+        f.write('\n'.join(parts))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        sys.exit('usage: make-sketch.py SKETCH OUTPUT [APPENDED...]')
+    main(sys.argv[1], sys.argv[2], sys.argv[3:])
@@ -0,0 +1,31 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// What the emulator looks at inside the sketch. Defined in
+// sketch-access.inc, which is appended to the generated
+// sketch so it sees the globals.
+#pragma once
+#include "boot-sequence.hpp"
+#include "junior-rocket-state.hpp"
+#include "scheduler.hpp"
+
+void setup();
+void loop();
+
+namespace far::emulator::sketch {
+
+using task_statistics_t = deets::scheduling::task_statistics_t<far::junior::duration_t>;
+using phase_statistics_t = deets::boot::phase_statistics_t<far::junior::duration_t>;
+
+far::junior::state current_state();
+
+size_t tasks();
+const char* task_name(size_t task);
+const task_statistics_t& task_statistics(size_t task);
+
+// Of a cold boot, none after a warm one
+size_t boot_phases();
+const char* boot_phase_name(size_t phase);
+const phase_statistics_t& boot_phase_statistics(size_t phase);
+
+} // namespace far::emulator::sketch
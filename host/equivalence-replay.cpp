@@ -0,0 +1,239 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Whether the Q15.16 build takes the same decisions as the
+// float one.
+//
+// Flies simulated flights with random motors, drouges,
+// barometer noise and launch times, and the recordings
+// given, see RecordedFlight. The samples come at the rates
+// of the IMU and the barometer and go through the attitude
+// estimator and the filters, as in the sketch. Prints every
+// transition the state machine takes. Given the transitions
+// of another build, from a file or - for stdin, compares
+// its own with those instead:
+//
+//   equivalence-replay | equivalence-replay-fixed --against -
+//   equivalence-replay data.csv | equivalence-replay-fixed --against - data.csv
+//
+// Exits non-zero if a flight goes through other states, or
+// takes a transition more than MAX_DELAY apart.
+#include "attitude-estimator.hpp"
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "state-names.hpp"
+#include "emulator/flight.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace far::junior;
+using far::junior::host::name;
+
+namespace {
+
+constexpr size_t SIMULATED_FLIGHTS = 64;
+// The rounding of Q15.16 may tip a threshold a sample
+// later or earlier, but not more
+constexpr int64_t MAX_DELAY = 2 * MET_PERIOD;
+
+struct transition_t
+{
+  size_t flight;
+  int64_t at;
+  std::string to;
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    const auto at = std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count();
+    transitions->push_back({ flight, int64_t(at), name(to) });
+  }
+
+  size_t flight = 0;
+  std::vector<transition_t>* transitions = nullptr;
+};
+
+void fly(far::emulator::Flight& flight, Recorder& recorder)
+{
+  JuniorRocketState machine(recorder);
+  deets::estimation::MahonyFilter<value_t> attitude{ value_t(ATTITUDE_KP), value_t(ATTITUDE_KI),
+                                                    value_t(ATTITUDE_GRAVITY_TOLERANCE) };
+  auto acceleration_filter = make_acceleration_filter(1e6f / IMU_PERIOD);
+  auto pressure_filter = make_pressure_filter();
+  const value_t dt = value_t(IMU_PERIOD / 1000) / value_t(1000);
+  const value_t gravity = value_t(GRAVITY);
+  value_t vertical{}, pressure{}, temperature = REFERENCE_TEMPERATURE;
+
+  // The greatest common divisor of the sample periods
+  const int64_t step = 2000;
+  static_assert(IMU_PERIOD % step == 0 && MET_PERIOD % step == 0);
+  for(int64_t us = 0;; us += step)
+  {
+    const double t = us * 1e-6;
+    if(flight.over(t))
+    {
+      break;
+    }
+    const bool imu = us % IMU_PERIOD == 0;
+    const bool met = us % MET_PERIOD == 0;
+    if(!imu && !met)
+    {
+      continue;
+    }
+    const auto environment = flight.at(t);
+    if(imu)
+    {
+      value_t acc[3], omega[3];
+      for(int i = 0; i < 3; ++i)
+      {
+        acc[i] = value_t(environment.acceleration[i] / GRAVITY);
+        omega[i] = value_t(environment.angular_velocity[i] * 0.0174533);
+      }
+      attitude.update(acc, omega, dt);
+      vertical = acceleration_filter.update(attitude.vertical_acceleration(acc) * gravity);
+    }
+    if(met)
+    {
+      pressure = pressure_filter.update(value_t(environment.pressure / 100.0));
+      temperature = value_t(environment.temperature);
+    }
+    machine.drive(timestamp_t(std::chrono::microseconds(us)), met ? std::optional(pressure) : std::nullopt,
+                  vertical, attitude.cos_tilt(), temperature);
+  }
+}
+
+std::vector<transition_t> read(std::istream& in)
+{
+  std::vector<transition_t> result;
+  std::string line;
+  while(std::getline(in, line))
+  {
+    unsigned long flight = 0;
+    long long at = 0;
+    char to[64];
+    if(std::sscanf(line.c_str(), "%lu %lld %63s", &flight, &at, to) == 3)
+    {
+      result.push_back({ size_t(flight), int64_t(at), to });
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const char* against = nullptr;
+  std::vector<std::unique_ptr<far::emulator::Flight>> flights;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  for(size_t i = 0; i < SIMULATED_FLIGHTS; ++i)
+  {
+    far::emulator::flight_profile_t profile;
+    profile.launch = 3.0 + 7.0 * uniform(rng);
+    profile.thrust = 15.0 + 10.0 * uniform(rng);
+    profile.burntime = 2.5 + 1.0 * uniform(rng);
+    const double drouges[] = { -1.0, 0.0, 2.5, 5.0 };
+    profile.drouge_delay = drouges[i % 4];
+    profile.pressure_noise = 0.05 + 0.75 * uniform(rng);
+    profile.seed = unsigned(i + 1);
+    flights.push_back(std::make_unique<far::emulator::SimulatedFlight>(profile));
+  }
+  for(int i = 1; i < argc; ++i)
+  {
+    if(std::strcmp(argv[i], "--against") == 0 && i + 1 < argc)
+    {
+      against = argv[++i];
+      continue;
+    }
+    auto recorded = far::emulator::RecordedFlight::load(argv[i]);
+    if(!recorded)
+    {
+      return EXIT_FAILURE;
+    }
+    flights.push_back(std::move(recorded));
+  }
+
+  std::vector<transition_t> transitions;
+  Recorder recorder;
+  recorder.transitions = &transitions;
+  for(size_t i = 0; i < flights.size(); ++i)
+  {
+    recorder.flight = i;
+    fly(*flights[i], recorder);
+  }
+
+  if(!against)
+  {
+    for(const auto& transition : transitions)
+    {
+      std::printf("%zu %lld %s\n", transition.flight, (long long)transition.at, transition.to.c_str());
+    }
+    return EXIT_SUCCESS;
+  }
+
+  std::vector<transition_t> theirs;
+  if(std::strcmp(against, "-") == 0)
+  {
+    theirs = read(std::cin);
+  }
+  else
+  {
+    std::ifstream in(against);
+    if(!in)
+    {
+      std::fprintf(stderr, "can't open %s\n", against);
+      return EXIT_FAILURE;
+    }
+    theirs = read(in);
+  }
+
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %zu flights, %zu transitions, the other build took %zu\n", flights.size(), transitions.size(),
+              theirs.size());
+  size_t differences = 0;
+  int64_t largest = 0;
+  for(size_t i = 0; i < std::max(transitions.size(), theirs.size()); ++i)
+  {
+    if(i >= transitions.size() || i >= theirs.size() || transitions[i].flight != theirs[i].flight
+       || transitions[i].to != theirs[i].to)
+    {
+      const auto& some = i < transitions.size() ? transitions[i] : theirs[i];
+      std::printf("flight %zu: the transitions differ from %.3fs on\n", some.flight, some.at * 1e-6);
+      ++differences;
+      break;
+    }
+    const auto delay = std::abs(transitions[i].at - theirs[i].at);
+    largest = std::max(largest, delay);
+    if(delay > MAX_DELAY)
+    {
+      std::printf("flight %zu: %s %.3fs, the other build %.3fs\n", transitions[i].flight,
+                  transitions[i].to.c_str(), transitions[i].at * 1e-6, theirs[i].at * 1e-6);
+      ++differences;
+    }
+  }
+  std::printf("transitions at most %.0fms apart\n", largest * 1e-3);
+  if(differences)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
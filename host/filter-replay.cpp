@@ -0,0 +1,250 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// What the filters between the sensors and the state
+// machine buy, and what they cost in detection latency.
+//
+// Flies simulated flights with the vibration of the
+// motor, bumps against the rocket on the pad and pressure
+// spikes on the way up added on top. The samples come at
+// the rates of the IMU and the barometer and go into
+// JuniorRocketState once as they are and once through
+// the filters the firmware configures. Counts the false
+// triggers: a launch detected on the pad or given up in
+// flight, a burnout while the motor still burns and an
+// apogee more than APOGEE_MARGIN early. And how much
+// later than the truth launch, burnout and apogee are
+// detected.
+//
+// Exits non-zero if a filtered flight has a false
+// trigger or misses the launch, apogee or landing, or the
+// filters delay a clean flight by more than MAX_DELAY.
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "emulator/flight.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <vector>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr unsigned SEEDS = 20;
+constexpr double APOGEE_MARGIN = 0.5;
+constexpr double MAX_DELAY = 0.1;
+// Hz, aliased by the 125Hz of the IMU
+constexpr double VIBRATION_FREQUENCY = 40.0;
+constexpr double BUMP_INTERVAL = 1.3;
+constexpr double SPIKE_INTERVAL = 0.3;
+
+struct disturbance_t
+{
+  const char* name;
+  // m/s^2 amplitude at VIBRATION_FREQUENCY, and half
+  // that as noise, while the motor burns
+  double vibration;
+  // m/s^2 for one IMU sample, every BUMP_INTERVAL on
+  // the pad
+  double bumps;
+  // mbar for one barometer sample, every SPIKE_INTERVAL
+  // from the launch up to the apogee
+  double spikes;
+};
+
+const disturbance_t DISTURBANCES[] = {
+  { "clean", 0, 0, 0 },
+  { "motor vibration", 8, 0, 0 },
+  { "bumps on the pad", 0, 25, 0 },
+  { "pressure spikes", 0, 0, 3 },
+  { "all of them", 8, 25, 3 },
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    transitions.push_back({ std::chrono::duration<double>(timestamp.time_since_epoch()).count(), to });
+  }
+
+  std::optional<double> first(state s, double after = 0) const
+  {
+    for(const auto& transition : transitions)
+    {
+      if(transition.to == s && transition.at >= after)
+      {
+        return transition.at;
+      }
+    }
+    return std::nullopt;
+  }
+
+  struct transition_t
+  {
+    double at;
+    state to;
+  };
+  std::vector<transition_t> transitions;
+};
+
+struct outcome_t
+{
+  size_t flights = 0;
+  size_t false_triggers = 0;
+  size_t missed = 0;
+  // Seconds after the truth, summed over the flights
+  double launch = 0;
+  double burnout = 0;
+  double apogee = 0;
+};
+
+void fly(const disturbance_t& disturbance, unsigned seed, bool filtered, outcome_t& outcome)
+{
+  far::emulator::flight_profile_t profile;
+  profile.launch = 10.0;
+  profile.seed = seed;
+  far::emulator::SimulatedFlight flight(profile);
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0, 1);
+
+  Recorder recorder;
+  JuniorRocketState machine(recorder);
+  auto acceleration_filter = make_acceleration_filter(1e6f / IMU_PERIOD);
+  auto pressure_filter = make_pressure_filter();
+  value_t acceleration{}, pressure{};
+
+  const double burnout = profile.launch + profile.burntime;
+  double apogee = 0, highest = 0;
+  double next_bump = 2.0, next_spike = profile.launch;
+  // The greatest common divisor of the sample periods
+  const int64_t step = 2000;
+  static_assert(IMU_PERIOD % step == 0 && MET_PERIOD % step == 0);
+  for(int64_t us = 0;; us += step)
+  {
+    const double t = us * 1e-6;
+    if(flight.over(t))
+    {
+      break;
+    }
+    const bool imu = us % IMU_PERIOD == 0;
+    const bool met = us % MET_PERIOD == 0;
+    if(!imu && !met)
+    {
+      continue;
+    }
+    const auto environment = flight.at(t);
+    if(environment.altitude > highest)
+    {
+      highest = environment.altitude;
+      apogee = t;
+    }
+    if(imu)
+    {
+      double measured = environment.acceleration[2];
+      if(t >= profile.launch && t < burnout)
+      {
+        measured += disturbance.vibration * (std::sin(2 * PI * VIBRATION_FREQUENCY * t) + noise(rng) / 2);
+      }
+      if(disturbance.bumps && t < profile.launch && t >= next_bump)
+      {
+        measured += disturbance.bumps;
+        next_bump += BUMP_INTERVAL;
+      }
+      acceleration = filtered ? acceleration_filter.update(value_t(measured)) : value_t(measured);
+    }
+    if(met)
+    {
+      double measured = environment.pressure / 100.0;
+      if(disturbance.spikes && t >= next_spike && (t < apogee + 0.1 || t < burnout))
+      {
+        measured += disturbance.spikes;
+        next_spike += SPIKE_INTERVAL;
+      }
+      pressure = filtered ? pressure_filter.update(value_t(measured)) : value_t(measured);
+    }
+    machine.drive(timestamp_t(std::chrono::microseconds(us)), met ? std::optional(pressure) : std::nullopt,
+                  acceleration);
+  }
+
+  ++outcome.flights;
+  for(const auto& transition : recorder.transitions)
+  {
+    outcome.false_triggers += transition.to == state::ACCELERATION_DETECTED && transition.at < profile.launch;
+    outcome.false_triggers += transition.to == state::WAIT_FOR_LAUNCH && transition.at >= profile.launch;
+    outcome.false_triggers += transition.to == state::BURNOUT && transition.at < burnout;
+    outcome.false_triggers += transition.to == state::FALLING_ && transition.at < apogee - APOGEE_MARGIN;
+  }
+  const auto accelerating = recorder.first(state::ACCELERATING, profile.launch);
+  const auto burnt_out = recorder.first(state::BURNOUT);
+  const auto falling = recorder.first(state::FALLING_);
+  if(!accelerating || !burnt_out || !falling || !recorder.first(state::LANDED))
+  {
+    ++outcome.missed;
+    return;
+  }
+  outcome.launch += *accelerating - profile.launch;
+  outcome.burnout += *burnt_out - burnout;
+  outcome.apogee += *falling - apogee;
+}
+
+} // namespace
+
+int main()
+{
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %u flights each, mean detection after the truth\n\n", SEEDS);
+  std::printf("%-18s %-10s %6s %7s %9s %9s %9s\n", "flight", "samples", "false", "missed", "launch", "burnout",
+              "apogee");
+  bool passed = true;
+  outcome_t clean[2];
+  for(const auto& disturbance : DISTURBANCES)
+  {
+    for(const bool filtered : { false, true })
+    {
+      outcome_t outcome;
+      for(unsigned seed = 1; seed <= SEEDS; ++seed)
+      {
+        fly(disturbance, seed, filtered, outcome);
+      }
+      const auto detected = double(outcome.flights - outcome.missed);
+      std::printf("%-18s %-10s %6zu %7zu %8.0fms %8.0fms %8.0fms\n", filtered ? "" : disturbance.name,
+                  filtered ? "filtered" : "raw", outcome.false_triggers, outcome.missed,
+                  outcome.launch / detected * 1e3, outcome.burnout / detected * 1e3,
+                  outcome.apogee / detected * 1e3);
+      if(&disturbance == &DISTURBANCES[0])
+      {
+        clean[filtered] = outcome;
+      }
+      if(filtered && (outcome.false_triggers || outcome.missed))
+      {
+        passed = false;
+      }
+    }
+  }
+
+  const auto delay = [&](double outcome_t::*detection) {
+    return (clean[1].*detection - clean[0].*detection) / clean[0].flights;
+  };
+  std::printf("\nthe filters delay a clean flight's launch by %.0fms, burnout by %.0fms, apogee by %.0fms\n",
+              delay(&outcome_t::launch) * 1e3, delay(&outcome_t::burnout) * 1e3, delay(&outcome_t::apogee) * 1e3);
+  for(const auto detection : { &outcome_t::launch, &outcome_t::burnout, &outcome_t::apogee })
+  {
+    passed &= delay(detection) <= MAX_DELAY;
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "decoder.hpp"
+#include "profiling.hpp"
+#include "spsc-queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace far::ground {
+
+struct pool_statistics_t
+{
+  uint64_t decoded = 0;
+  uint64_t undecodable = 0;
+  // The queue of the worker was full
+  uint64_t dropped = 0;
+  // From the payload coming in to the record being
+  // written, in microseconds
+  deets::profiling::Histogram<24> latency;
+};
+
+// Decodes sentences on a pool of threads. The sentences
+// of a vehicle all go to the same worker, so its records
+// come out in order. Output(const record_t&) is called
+// on the workers and has to be thread safe.
+//
+// submit() doesn't block, a radio doesn't wait either:
+// when a worker falls behind by a whole queue, sentences
+// are dropped and counted. Unless the pool replays, e.g.
+// a file, then it waits for the worker.
+template<typename Output, size_t QueueSize = 1024>
+class DecoderPool
+{
+public:
+  DecoderPool(size_t workers, Output output, bool replay = false)
+    : _output(output)
+    , _replay(replay)
+  {
+    for(size_t i = 0; i < workers; ++i)
+    {
+      _workers.emplace_back(std::make_unique<worker_t>());
+    }
+    for(auto& worker : _workers)
+    {
+      worker->thread = std::thread([this, &worker = *worker] { run(worker); });
+    }
+  }
+
+  DecoderPool(const DecoderPool&) = delete;
+  DecoderPool& operator=(const DecoderPool&) = delete;
+
+  ~DecoderPool()
+  {
+    stop();
+  }
+
+  // From the one thread feeding the receiver. The workers
+  // only wake up on flush().
+  void submit(const sentence_t& sentence)
+  {
+    auto& worker = *_workers[sentence.vehicle % _workers.size()];
+    while(_replay && worker.queue.size() == QueueSize)
+    {
+      flush();
+      std::this_thread::yield();
+    }
+    if(worker.queue.push(sentence))
+    {
+      worker.pending = true;
+    }
+  }
+
+  // After each read from the bridge
+  void flush()
+  {
+    for(auto& worker : _workers)
+    {
+      if(worker->pending)
+      {
+        worker->pending = false;
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->wake = true;
+        worker->condition.notify_one();
+      }
+    }
+  }
+
+  // Drains the queues and joins the workers
+  void stop()
+  {
+    for(auto& worker : _workers)
+    {
+      {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stop = true;
+      }
+      worker->condition.notify_one();
+    }
+    for(auto& worker : _workers)
+    {
+      if(worker->thread.joinable())
+      {
+        worker->thread.join();
+      }
+    }
+  }
+
+  size_t workers() const { return _workers.size(); }
+
+  // Consistent once stopped, a snapshot while running
+  pool_statistics_t statistics() const
+  {
+    pool_statistics_t result;
+    for(const auto& worker : _workers)
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      result.decoded += worker->statistics.decoded;
+      result.undecodable += worker->statistics.undecodable;
+      result.dropped += worker->queue.dropped();
+      result.latency.merge(worker->statistics.latency);
+    }
+    return result;
+  }
+
+private:
+  struct worker_t
+  {
+    deets::concurrency::SpscQueue<sentence_t, QueueSize> queue;
+    // Only touched by the submitting thread
+    bool pending = false;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    bool wake = false;
+    bool stop = false;
+    // Under the mutex
+    pool_statistics_t statistics;
+    std::thread thread;
+  };
+
+  void run(worker_t& worker)
+  {
+    sentence_t sentence;
+    record_t record;
+    while(true)
+    {
+      while(worker.queue.pop(sentence))
+      {
+        const bool decoded = decode(sentence, record);
+        if(decoded)
+        {
+          _output(record);
+        }
+        const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - sentence.received).count();
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(decoded)
+        {
+          ++worker.statistics.decoded;
+          worker.statistics.latency.record(uint32_t(latency));
+        }
+        else
+        {
+          ++worker.statistics.undecodable;
+        }
+      }
+      std::unique_lock<std::mutex> lock(worker.mutex);
+      if(worker.stop && !worker.queue.size())
+      {
+        return;
+      }
+      // flush() sets wake under the mutex, so a sentence
+      // pushed after the queue ran empty isn't missed
+      worker.condition.wait(lock, [&] { return worker.wake || worker.stop; });
+      worker.wake = false;
+    }
+  }
+
+  Output _output;
+  bool _replay;
+  std::vector<std::unique_ptr<worker_t>> _workers;
+};
+
+} // namespace far::ground
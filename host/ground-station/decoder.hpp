@@ -0,0 +1,218 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "receiver.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string_view>
+
+namespace far::ground {
+
+enum class kind : uint8_t
+{
+  IMU,
+  MET,
+  STATE,
+  PERF,
+  GPS,
+};
+
+constexpr size_t MAX_VALUES = 9;
+
+// What a sentence says, in integers like gps_fix_t
+struct record_t
+{
+  uint8_t vehicle;
+  uint32_t sequence;
+  Clock::time_point received;
+  kind type;
+  // Of the vehicle, milliseconds since midnight
+  uint32_t time;
+  // The state, the perf stage or GGA/RMC
+  char label[16];
+  uint8_t count;
+  // values[i] / 10^decimals[i]
+  std::array<int32_t, MAX_VALUES> values;
+  std::array<uint8_t, MAX_VALUES> decimals;
+};
+
+namespace detail {
+
+// The sentences of farduino_utilities.h, after the time
+struct layout_t
+{
+  std::string_view address;
+  kind type;
+  bool label;
+  uint8_t min_values;
+  uint8_t max_values;
+  uint8_t decimals;
+};
+
+constexpr layout_t LAYOUTS[] = {
+  // Acceleration, angular rate, magnetic field
+  { "RQIMU0", kind::IMU, false, 9, 9, 2 },
+  // Pressure, temperature, altitude
+  { "RQMET0", kind::MET, false, 3, 3, 3 },
+  // The pressures depend on the state
+  { "RQSTATE", kind::STATE, true, 0, 2, 3 },
+  // Samples, mean, 99th percentile, max
+  { "RQPERF", kind::PERF, true, 4, 4, 0 },
+};
+
+inline void add(record_t& record, int32_t value, uint8_t decimals)
+{
+  record.values[record.count] = value;
+  record.decimals[record.count] = decimals;
+  ++record.count;
+}
+
+inline bool decode_gps(const deets::nmea::Sentence& sentence, record_t& record)
+{
+  deets::nmea::gps_fix_t fix = {};
+  if(!deets::nmea::decode(sentence, fix))
+  {
+    return false;
+  }
+  record.type = kind::GPS;
+  record.time = fix.time;
+  if(sentence.is("GGA"))
+  {
+    std::snprintf(record.label, sizeof(record.label), "GGA");
+    add(record, fix.latitude, 7);
+    add(record, fix.longitude, 7);
+    add(record, fix.altitude, 3);
+    add(record, fix.quality, 0);
+    add(record, fix.satellites, 0);
+    add(record, fix.hdop, 2);
+  }
+  else
+  {
+    std::snprintf(record.label, sizeof(record.label), "RMC");
+    add(record, fix.latitude, 7);
+    add(record, fix.longitude, 7);
+    add(record, fix.speed, 3);
+    add(record, fix.course, 2);
+    add(record, int32_t(fix.date), 0);
+    add(record, fix.valid, 0);
+  }
+  return true;
+}
+
+} // namespace detail
+
+// False for sentences we don't know or with fields
+// that don't parse
+inline bool decode(const sentence_t& received, record_t& record)
+{
+  record.vehicle = received.vehicle;
+  record.sequence = received.sequence;
+  record.received = received.received;
+  record.label[0] = 0;
+  record.count = 0;
+
+  const auto sentence = received.sentence();
+  std::string_view fields[2 + MAX_VALUES + 1];
+  const auto found = sentence.split(fields, std::size(fields));
+  for(const auto& layout : detail::LAYOUTS)
+  {
+    if(fields[0] != layout.address)
+    {
+      continue;
+    }
+    const size_t first = 2 + layout.label;
+    if(found < first || found - first < layout.min_values || found - first > layout.max_values)
+    {
+      return false;
+    }
+    record.type = layout.type;
+    if(!deets::nmea::parse_time(fields[1], record.time))
+    {
+      return false;
+    }
+    if(layout.label)
+    {
+      const auto& label = fields[2];
+      if(label.empty() || label.size() >= sizeof(record.label))
+      {
+        return false;
+      }
+      label.copy(record.label, label.size());
+      record.label[label.size()] = 0;
+    }
+    for(size_t i = first; i < found; ++i)
+    {
+      // dtostrf pads, and not every sentence removes it
+      auto field = fields[i];
+      field.remove_prefix(std::min(field.find_first_not_of(' '), field.size()));
+      int32_t value;
+      if(!deets::nmea::parse_decimal(field, layout.decimals, value))
+      {
+        return false;
+      }
+      detail::add(record, value, layout.decimals);
+    }
+    return true;
+  }
+  return detail::decode_gps(sentence, record);
+}
+
+inline const char* name(kind type)
+{
+  switch(type)
+  {
+  case kind::IMU:
+    return "IMU";
+  case kind::MET:
+    return "MET";
+  case kind::STATE:
+    return "STATE";
+  case kind::PERF:
+    return "PERF";
+  case kind::GPS:
+    return "GPS";
+  }
+  return "?";
+}
+
+// One CSV line: vehicle, sequence, kind, time of day,
+// label and the values. Returns its length like
+// snprintf.
+inline int format(const record_t& record, const char* vehicle, char* buffer, size_t size)
+{
+  int length = std::snprintf(buffer, size, "%s,%u,%s,%02u:%02u:%02u.%03u,%s", vehicle,
+                             unsigned(record.sequence), name(record.type), unsigned(record.time / 3600000),
+                             unsigned(record.time / 60000 % 60), unsigned(record.time / 1000 % 60),
+                             unsigned(record.time % 1000), record.label);
+  for(size_t i = 0; i < record.count && length >= 0 && size_t(length) < size; ++i)
+  {
+    const int32_t value = record.values[i];
+    const uint32_t magnitude = value < 0 ? 0u - uint32_t(value) : uint32_t(value);
+    uint32_t scale = 1;
+    for(uint8_t k = 0; k < record.decimals[i]; ++k)
+    {
+      scale *= 10;
+    }
+    char* rest = buffer + length;
+    const size_t left = size - size_t(length);
+    if(scale == 1)
+    {
+      length += std::snprintf(rest, left, ",%d", int(value));
+    }
+    else
+    {
+      length += std::snprintf(rest, left, ",%s%u.%0*u", value < 0 ? "-" : "", unsigned(magnitude / scale),
+                              int(record.decimals[i]), unsigned(magnitude % scale));
+    }
+  }
+  if(length >= 0 && size_t(length) + 1 < size)
+  {
+    buffer[length++] = '\n';
+    buffer[length] = 0;
+  }
+  return length;
+}
+
+} // namespace far::ground
@@ -0,0 +1,423 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Throughput and latency of the ground station on the
+// telemetry of several vehicles at once.
+//
+// Each vehicle builds its sentences with the constructors
+// of farduino_utilities.h and sends them through the ring
+// of send_sentence, LOSS of the payloads never arrive.
+// The frames go through a pty into the receiver and the
+// decoder pool, once as fast as they can and once paced
+// at the most the radios can deliver, a payload per
+// RADIO_PACKET from every vehicle.
+//
+// Exits non-zero if an intact sentence wasn't decoded or
+// decoded differently than on its own, the lost payloads
+// went unnoticed, or a paced sentence was dropped or took
+// longer than LATENCY_BOUND in 99% of the cases.
+#include <Arduino.h>
+#include "farduino_constants.h"
+#include "farduino_types.h"
+#include "farduino_utilities.h"
+#include "ring_buffer.h"
+#include "decoder-pool.hpp"
+#include "receiver.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace far::ground;
+using far::junior::timestamp_t;
+using far::junior::value_t;
+
+namespace {
+
+constexpr double LOSS = 0.02;
+// An acknowledged packet of the nRF24 at 1Mbps, see
+// host/emulator/board.hpp
+constexpr auto RADIO_PACKET = std::chrono::microseconds(662);
+constexpr auto LATENCY_BOUND = std::chrono::milliseconds(5);
+// The ring of send_sentence, Board::RADIO_BUFFER
+constexpr size_t RING = 256;
+
+struct frame_t
+{
+  // Of the vehicle, in payloads
+  size_t index;
+  uint8_t vehicle;
+  std::array<char, PAYLOAD> payload;
+};
+
+struct stream_t
+{
+  std::vector<frame_t> frames;
+  // What a sentence decodes to on its own, if none
+  // of its payloads got lost
+  std::vector<record_t> intact;
+  size_t damaged = 0;
+  size_t lost = 0;
+};
+
+// Identifies a record of a vehicle
+using key_t = std::tuple<uint8_t, kind, uint32_t, std::string>;
+
+key_t key(const record_t& record)
+{
+  return { record.vehicle, record.type, record.time, record.label };
+}
+
+bool same_values(const record_t& a, const record_t& b)
+{
+  return a.count == b.count && std::equal(a.values.begin(), a.values.begin() + a.count, b.values.begin())
+    && std::equal(a.decimals.begin(), a.decimals.begin() + a.count, b.decimals.begin());
+}
+
+void gga_sentence(uint32_t milliseconds, int altitude, char* sentence)
+{
+  char body[96];
+  const unsigned seconds = milliseconds / 1000;
+  std::snprintf(body, sizeof(body), "GPGGA,%02u%02u%02u.%02u,4807.03800,N,01131.00000,E,1,08,0.94,%d.0,M,47.0,M,,",
+                seconds / 3600 % 24, seconds / 60 % 60, seconds % 60, milliseconds % 1000 / 10, altitude);
+  uint8_t checksum = 0;
+  for(const char* c = body; *c; ++c)
+  {
+    checksum ^= uint8_t(*c);
+  }
+  std::sprintf(sentence, "$%s*%02X\r\n", body, checksum);
+}
+
+// The sentences of a flight of the given seconds, as
+// the firmware sends them
+stream_t telemetry(uint8_t vehicle, double duration, std::mt19937& rng)
+{
+  std::bernoulli_distribution lost(LOSS);
+  std::normal_distribution<float> noise(0, 1);
+  stream_t stream;
+  CircularBuffer ring(RING);
+  // Where each sentence starts and ends in the stream
+  std::vector<std::pair<size_t, size_t>> extents;
+  std::vector<std::string> sentences;
+  size_t written = 0;
+
+  const auto send = [&](const char* sentence) {
+    const size_t size = std::strlen(sentence);
+    extents.push_back({ written, written + size });
+    sentences.push_back(sentence);
+    written += size;
+    ring.write(sentence, size);
+    while(ring.filling() >= PAYLOAD)
+    {
+      frame_t frame;
+      frame.index = stream.frames.size();
+      frame.vehicle = vehicle;
+      ring.read(frame.payload.data(), PAYLOAD);
+      if(lost(rng))
+      {
+        ++stream.lost;
+        // The index marks where the hole is
+        stream.frames.push_back(frame);
+        stream.frames.back().vehicle = 0xff;
+      }
+      else
+      {
+        stream.frames.push_back(frame);
+      }
+    }
+  };
+
+  char sentence[128];
+  // Each vehicle's clock starts at its own time
+  const int64_t boot = int64_t(vehicle) * 3600000000ll;
+  for(int64_t t = 0; t < int64_t(duration * 1e6); t += IMU_TELEMETRY_PERIOD)
+  {
+    const timestamp_t now{ far::junior::duration_t(boot + t) };
+    value_t acc[3], omega[3], B[3];
+    for(int i = 0; i < 3; ++i)
+    {
+      acc[i] = value_t(9.81f * (i == 2) + noise(rng));
+      omega[i] = value_t(noise(rng) * 10);
+      B[i] = value_t(30 + noise(rng));
+    }
+    construct_IMU_sentence(now, acc, omega, B, sentence);
+    send(sentence);
+    if(t % MET_TELEMETRY_PERIOD == 0)
+    {
+      construct_MET_sentence(now, value_t(1013.25f + noise(rng)), value_t(21.5f), value_t(100 + noise(rng)),
+                             sentence);
+      send(sentence);
+    }
+    if(t % 1000000 == 0)
+    {
+      gga_sentence(uint32_t((boot + t) / 1000 % 86400000), 545 + int(t / 1000000), sentence);
+      send(sentence);
+      construct_state_sentence(now, value_t(1013.25f), value_t(1000.0f + noise(rng)), state_COASTING, sentence);
+      send(sentence);
+    }
+    if(t % PERF_PERIOD == 0)
+    {
+      for(int stage = 0; stage < perf_STAGES; ++stage)
+      {
+        construct_perf_sentence(now, perf_stage_t(stage), sentence);
+        send(sentence);
+      }
+    }
+  }
+
+  // The hole of a lost payload is in the middle of the
+  // frames with vehicle 0xff, take them out again
+  std::vector<bool> arrived(stream.frames.size());
+  for(size_t i = 0; i < stream.frames.size(); ++i)
+  {
+    arrived[i] = stream.frames[i].vehicle != 0xff;
+  }
+  stream.frames.erase(std::remove_if(stream.frames.begin(), stream.frames.end(),
+                                     [](const frame_t& frame) { return frame.vehicle == 0xff; }),
+                      stream.frames.end());
+
+  for(size_t i = 0; i < sentences.size(); ++i)
+  {
+    const auto [first, last] = extents[i];
+    // What is still in the ring is never sent
+    if(last > arrived.size() * PAYLOAD)
+    {
+      break;
+    }
+    bool intact = true;
+    for(size_t payload = first / PAYLOAD; payload <= (last - 1) / PAYLOAD; ++payload)
+    {
+      intact &= arrived[payload];
+    }
+    if(!intact)
+    {
+      ++stream.damaged;
+      continue;
+    }
+    sentence_t single = {};
+    single.vehicle = vehicle;
+    single.size = uint8_t(sentences[i].size());
+    single.body_size = uint8_t(sentences[i].find('*') - 1);
+    std::memcpy(single.text, sentences[i].c_str(), single.size + 1);
+    record_t record;
+    if(!decode(single, record))
+    {
+      std::printf("can't decode %s", sentences[i].c_str());
+      std::exit(EXIT_FAILURE);
+    }
+    stream.intact.push_back(record);
+  }
+  return stream;
+}
+
+struct result_t
+{
+  double seconds;
+  size_t bytes;
+  size_t sentences;
+  pool_statistics_t pool;
+  uint64_t gaps;
+  bool passed;
+};
+
+result_t run(const std::vector<stream_t>& streams, size_t workers, bool paced)
+{
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master < 0 || grantpt(master) || unlockpt(master))
+  {
+    std::perror("posix_openpt");
+    std::exit(EXIT_FAILURE);
+  }
+  const int slave = open(ptsname(master), O_RDONLY | O_NOCTTY);
+  termios tty;
+  tcgetattr(slave, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(slave, TCSANOW, &tty);
+
+  // Interleaved like the bridge would see them
+  std::vector<const frame_t*> order;
+  for(const auto& stream : streams)
+  {
+    for(const auto& frame : stream.frames)
+    {
+      order.push_back(&frame);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const frame_t* a, const frame_t* b) { return a->index < b->index; });
+  const size_t total = order.size() * (PAYLOAD + 1);
+
+  std::mutex mutex;
+  std::vector<record_t> records;
+  DecoderPool pool(workers, [&](const record_t& record) {
+    // What the daemon does with it
+    char line[256];
+    format(record, "vehicle", line, sizeof(line));
+    std::lock_guard<std::mutex> lock(mutex);
+    records.push_back(record);
+  });
+  Receiver receiver([&](const sentence_t& sentence) { pool.submit(sentence); });
+
+  const auto start = Clock::now();
+  std::thread bridge([&] {
+    std::vector<uint8_t> bytes;
+    for(size_t i = 0; i < order.size();)
+    {
+      // A round of payloads, one from each vehicle
+      const size_t index = order[i]->index;
+      bytes.clear();
+      for(; i < order.size() && (paced ? order[i]->index == index : bytes.size() < 4096); ++i)
+      {
+        bytes.push_back(FRAME_HEADER | order[i]->vehicle);
+        bytes.insert(bytes.end(), order[i]->payload.begin(), order[i]->payload.end());
+      }
+      if(paced)
+      {
+        std::this_thread::sleep_until(start + RADIO_PACKET * index);
+      }
+      for(size_t written = 0; written < bytes.size();)
+      {
+        const auto result = write(master, bytes.data() + written, bytes.size() - written);
+        if(result < 0 && errno != EINTR)
+        {
+          std::perror("write");
+          std::exit(EXIT_FAILURE);
+        }
+        written += result > 0 ? size_t(result) : 0;
+      }
+    }
+  });
+
+  std::array<uint8_t, 4096> buffer;
+  for(size_t received = 0; received < total;)
+  {
+    const auto size = read(slave, buffer.data(), buffer.size());
+    if(size <= 0)
+    {
+      if(size < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      std::perror("read");
+      std::exit(EXIT_FAILURE);
+    }
+    received += size_t(size);
+    receiver.feed(buffer.data(), size_t(size), Clock::now());
+    pool.flush();
+  }
+  bridge.join();
+  pool.stop();
+  const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  close(slave);
+  close(master);
+
+  result_t result = { seconds, total, 0, pool.statistics(), 0, true };
+  std::map<key_t, const record_t*> decoded;
+  for(const auto& record : records)
+  {
+    decoded[key(record)] = &record;
+  }
+  size_t damaged = 0;
+  size_t lost = 0;
+  for(size_t vehicle = 0; vehicle < streams.size(); ++vehicle)
+  {
+    const auto& stream = streams[vehicle];
+    result.sentences += stream.intact.size() + stream.damaged;
+    result.gaps += receiver.statistics(vehicle).gaps;
+    damaged += stream.damaged;
+    lost += stream.lost;
+    size_t missing = 0;
+    for(const auto& expected : stream.intact)
+    {
+      const auto found = decoded.find(key(expected));
+      missing += found == decoded.end() || !same_values(*found->second, expected);
+    }
+    // Bursts may overflow the queues, which is counted
+    if(missing > (paced ? 0 : result.pool.dropped))
+    {
+      std::printf("FAIL: vehicle %zu lost %zu of %zu intact sentences\n", vehicle, missing, stream.intact.size());
+      result.passed = false;
+    }
+  }
+  // Lost payloads always take sentences with them, a
+  // gap can span several though
+  if(lost && !result.gaps)
+  {
+    std::printf("FAIL: %zu payloads lost without a gap\n", lost);
+    result.passed = false;
+  }
+  if(result.gaps > damaged)
+  {
+    std::printf("FAIL: %llu gaps in %zu damaged sentences\n", (unsigned long long)result.gaps, damaged);
+    result.passed = false;
+  }
+  if(paced && result.pool.dropped)
+  {
+    std::printf("FAIL: %llu sentences dropped\n", (unsigned long long)result.pool.dropped);
+    result.passed = false;
+  }
+  const auto bound = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(LATENCY_BOUND).count());
+  if(paced && result.pool.latency.percentile(99) > bound)
+  {
+    std::printf("FAIL: 99%% of the sentences within %uus, more than %uus\n", result.pool.latency.percentile(99),
+                bound);
+    result.passed = false;
+  }
+  return result;
+}
+
+void report(const char* label, const result_t& result)
+{
+  std::printf("%-8s %8.2fs %8.2fMB/s %10.0f/s %9llu %6llu %8llu %9uus %7uus %7uus\n", label, result.seconds,
+              result.bytes / result.seconds / 1e6, result.pool.decoded / result.seconds,
+              (unsigned long long)result.sentences, (unsigned long long)result.gaps,
+              (unsigned long long)result.pool.dropped, result.pool.latency.mean(),
+              result.pool.latency.percentile(99), result.pool.latency.max());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const size_t vehicles = argc > 1 ? std::min<size_t>(std::atoi(argv[1]), PIPES) : PIPES;
+  const double duration = argc > 2 ? std::atof(argv[2]) : 60;
+  const size_t workers = argc > 3 ? std::max(1, std::atoi(argv[3])) : 2;
+
+  std::mt19937 rng(1);
+  std::vector<stream_t> streams;
+  size_t payloads = 0;
+  size_t lost = 0;
+  for(size_t vehicle = 0; vehicle < vehicles; ++vehicle)
+  {
+    streams.push_back(telemetry(uint8_t(vehicle), duration, rng));
+    payloads += streams.back().frames.size();
+    lost += streams.back().lost;
+  }
+  std::printf("%zu vehicles, %.0fs of telemetry each, %zu payloads, %zu lost, %zu workers\n\n", vehicles, duration,
+              payloads, lost, workers);
+  std::printf("%-8s %9s %12s %12s %9s %6s %8s %11s %9s %9s\n", "run", "time", "throughput", "decoded", "sentences",
+              "gaps", "dropped", "latency", "p99", "max");
+  const auto burst = run(streams, workers, false);
+  report("burst", burst);
+  const auto paced = run(streams, workers, true);
+  report("paced", paced);
+  if(!burst.passed || !paced.passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
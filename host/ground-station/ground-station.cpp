@@ -0,0 +1,329 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Receives the telemetry of several vehicles at once.
+//
+// A bridge, e.g. a microcontroller with an nRF24 listening
+// on a pipe per vehicle, forwards each payload on a serial
+// line, see receiver.hpp for the framing. A pty from socat
+// or a file stands in for it. The sentences of each
+// vehicle are reassembled and checked on the reading
+// thread and decoded by a pool of workers. One CSV line
+// per record goes to the output, statistics to stderr.
+// With --bus the records are published in shared memory
+// as well, see telemetry-bus.hpp.
+#include "decoder-pool.hpp"
+#include "receiver.hpp"
+#include "telemetry-bus.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace far::ground;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+struct options_t
+{
+  const char* device = nullptr;
+  const char* output = nullptr;
+  const char* bus = nullptr;
+  std::array<std::string, PIPES> vehicles;
+  unsigned workers = 2;
+  unsigned baud = 115200;
+  int raw_pipe = -1;
+  double stats = 10;
+};
+
+void usage(const char* program)
+{
+  std::fprintf(stderr,
+               "usage: %s [options] DEVICE\n"
+               "  DEVICE               the serial line of the bridge, a pty or a file, - for stdin\n"
+               "  --vehicle PIPE=NAME  name the vehicle on a pipe, e.g. 1=lower (pipeN)\n"
+               "  --workers N          decoding threads (2)\n"
+               "  --baud N             of a serial line (115200)\n"
+               "  --raw PIPE           DEVICE has the payloads of one pipe without framing,\n"
+               "                       like the emulator writes them with --radio\n"
+               "  --output FILE        for the records (stdout)\n"
+               "  --bus [NAME]         publish the records in shared memory (/farduino-telemetry)\n"
+               "  --stats S            print statistics every S seconds, 0 only at the end (10)\n",
+               program);
+}
+
+bool parse(int argc, char** argv, options_t& options)
+{
+  for(size_t pipe = 0; pipe < PIPES; ++pipe)
+  {
+    options.vehicles[pipe] = "pipe" + std::to_string(pipe);
+  }
+  for(int i = 1; i < argc; ++i)
+  {
+    const std::string option = argv[i];
+    const auto value = [&]() -> const char* {
+      if(i + 1 >= argc)
+      {
+        std::fprintf(stderr, "%s needs a value\n", option.c_str());
+        std::exit(EXIT_FAILURE);
+      }
+      return argv[++i];
+    };
+    if(option == "--vehicle")
+    {
+      const std::string vehicle = value();
+      const auto equals = vehicle.find('=');
+      const int pipe = std::atoi(vehicle.c_str());
+      if(equals == std::string::npos || pipe < 0 || size_t(pipe) >= PIPES)
+      {
+        usage(argv[0]);
+        return false;
+      }
+      options.vehicles[pipe] = vehicle.substr(equals + 1);
+    }
+    else if(option == "--workers")
+    {
+      options.workers = unsigned(std::max(1, std::atoi(value())));
+    }
+    else if(option == "--baud")
+    {
+      options.baud = unsigned(std::atoi(value()));
+    }
+    else if(option == "--raw")
+    {
+      options.raw_pipe = std::atoi(value());
+      if(options.raw_pipe < 0 || size_t(options.raw_pipe) >= PIPES)
+      {
+        usage(argv[0]);
+        return false;
+      }
+    }
+    else if(option == "--output")
+    {
+      options.output = value();
+    }
+    else if(option == "--bus")
+    {
+      // The name is optional, the device isn't
+      options.bus = i + 2 < argc && argv[i + 1][0] == '/' ? argv[++i] : bus::DEFAULT_NAME;
+    }
+    else if(option == "--stats")
+    {
+      options.stats = std::atof(value());
+    }
+    else if(!options.device && (option == "-" || option[0] != '-'))
+    {
+      options.device = argv[i];
+    }
+    else
+    {
+      usage(argv[0]);
+      return false;
+    }
+  }
+  if(!options.device)
+  {
+    usage(argv[0]);
+    return false;
+  }
+  return true;
+}
+
+speed_t speed(unsigned baud)
+{
+  switch(baud)
+  {
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  case 230400:
+    return B230400;
+  case 460800:
+    return B460800;
+  case 921600:
+    return B921600;
+  default:
+    return B0;
+  }
+}
+
+int open_bridge(const options_t& options)
+{
+  if(std::strcmp(options.device, "-") == 0)
+  {
+    return STDIN_FILENO;
+  }
+  const int fd = open(options.device, O_RDONLY | O_NOCTTY);
+  if(fd < 0)
+  {
+    std::perror(options.device);
+    return -1;
+  }
+  termios tty;
+  if(tcgetattr(fd, &tty) == 0)
+  {
+    // The payloads are binary as far as the line
+    // discipline is concerned
+    cfmakeraw(&tty);
+    const auto rate = speed(options.baud);
+    if(rate == B0)
+    {
+      std::fprintf(stderr, "unsupported baud rate %u\n", options.baud);
+      close(fd);
+      return -1;
+    }
+    cfsetispeed(&tty, rate);
+    cfsetospeed(&tty, rate);
+    tcsetattr(fd, TCSANOW, &tty);
+  }
+  return fd;
+}
+
+template<typename Receiver, typename Pool>
+void print_statistics(const options_t& options, const Receiver& receiver, const Pool& pool)
+{
+  std::fprintf(stderr, "%-12s %10s %10s %10s %8s %9s\n", "vehicle", "payloads", "bytes", "sentences", "gaps",
+               "overflows");
+  for(size_t pipe = 0; pipe < PIPES; ++pipe)
+  {
+    const auto& link = receiver.statistics(pipe);
+    if(link.bytes)
+    {
+      std::fprintf(stderr, "%-12s %10llu %10llu %10llu %8llu %9llu\n", options.vehicles[pipe].c_str(),
+                   (unsigned long long)link.payloads, (unsigned long long)link.bytes,
+                   (unsigned long long)link.sentences, (unsigned long long)link.gaps,
+                   (unsigned long long)link.overflows);
+    }
+  }
+  const auto stats = pool.statistics();
+  std::fprintf(stderr,
+               "short frames %llu, decoded %llu, undecodable %llu, dropped %llu, "
+               "latency mean %uus p99 <%uus max %uus\n",
+               (unsigned long long)receiver.short_frames(), (unsigned long long)stats.decoded,
+               (unsigned long long)stats.undecodable, (unsigned long long)stats.dropped, stats.latency.mean(),
+               stats.latency.percentile(99), stats.latency.max());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  options_t options;
+  if(!parse(argc, argv, options))
+  {
+    return EXIT_FAILURE;
+  }
+  const int fd = open_bridge(options);
+  if(fd < 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::FILE* output = options.output ? std::fopen(options.output, "w") : stdout;
+  if(!output)
+  {
+    std::perror(options.output);
+    return EXIT_FAILURE;
+  }
+  // Whoever reads the records wants them as they come
+  std::setvbuf(output, nullptr, _IOLBF, 0);
+  TelemetryWriter bus;
+  std::mutex bus_mutex;
+  if(options.bus)
+  {
+    if(!bus.create(options.bus))
+    {
+      return EXIT_FAILURE;
+    }
+    for(size_t pipe = 0; pipe < PIPES; ++pipe)
+    {
+      bus.name_vehicle(uint8_t(pipe), options.vehicles[pipe].c_str());
+    }
+  }
+
+  std::signal(SIGINT, [](int) { stop_requested = 1; });
+  std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+  // stdio locks the stream for each call, so a line
+  // never mixes with one of another worker. A file or
+  // pipe is replayed without dropping sentences.
+  DecoderPool pool(options.workers, [&](const record_t& record) {
+    char line[256];
+    const int length = format(record, options.vehicles[record.vehicle].c_str(), line, sizeof(line));
+    if(length > 0)
+    {
+      std::fwrite(line, 1, std::min(size_t(length), sizeof(line) - 1), output);
+    }
+    if(options.bus)
+    {
+      std::lock_guard<std::mutex> lock(bus_mutex);
+      bus.publish(record);
+    }
+  }, !isatty(fd));
+  Receiver receiver([&](const sentence_t& sentence) { pool.submit(sentence); });
+
+  auto next_stats = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(options.stats));
+  std::array<uint8_t, 4096> buffer;
+  while(!stop_requested)
+  {
+    pollfd poll_fd = { fd, POLLIN, 0 };
+    const int ready = poll(&poll_fd, 1, 200);
+    if(ready < 0 && errno != EINTR)
+    {
+      std::perror("poll");
+      break;
+    }
+    if(ready > 0)
+    {
+      const auto size = read(fd, buffer.data(), buffer.size());
+      // A pty gives EIO once the other side is closed
+      if(size <= 0 && !(size < 0 && errno == EINTR))
+      {
+        break;
+      }
+      if(size > 0)
+      {
+        const auto received = Clock::now();
+        if(options.raw_pipe >= 0)
+        {
+          receiver.feed_raw(uint8_t(options.raw_pipe), buffer.data(), size_t(size), received);
+        }
+        else
+        {
+          receiver.feed(buffer.data(), size_t(size), received);
+        }
+        pool.flush();
+      }
+    }
+    if(options.stats > 0 && Clock::now() >= next_stats)
+    {
+      print_statistics(options, receiver, pool);
+      next_stats += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.stats));
+    }
+  }
+  pool.stop();
+  std::fflush(output);
+  print_statistics(options, receiver, pool);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "nmea-parser.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace far::ground {
+
+using Clock = std::chrono::steady_clock;
+
+// The nRF24 listens on up to six pipes, each vehicle
+// sends to the ground address of one of them.
+constexpr size_t PIPES = 6;
+// send_sentence always fills the payload, what doesn't
+// fit waits in the ring for the next sentence.
+constexpr size_t PAYLOAD = 32;
+// The bridge forwards a payload as FRAME_HEADER | pipe
+// and the 32 bytes. Sentences are ASCII, so a header
+// can't be part of a payload, and after lost bytes on
+// the serial line the next one resynchronizes.
+constexpr uint8_t FRAME_HEADER = 0x80;
+// The IMU sentence is the longest, with about 90
+constexpr size_t SENTENCE_CAPACITY = 128;
+
+// A sentence with a valid checksum, copied out of the
+// parser to be decoded on another thread
+struct sentence_t
+{
+  uint8_t vehicle;
+  // Per vehicle, without gaps
+  uint32_t sequence;
+  // When the payload completing it came in
+  Clock::time_point received;
+  uint8_t size;
+  uint8_t body_size;
+  char text[SENTENCE_CAPACITY];
+
+  deets::nmea::Sentence sentence() const
+  {
+    return deets::nmea::Sentence(text, size, body_size);
+  }
+};
+
+struct link_statistics_t
+{
+  // Framed by the bridge, not counted in raw mode
+  uint64_t payloads = 0;
+  uint64_t bytes = 0;
+  uint64_t sentences = 0;
+  // Sentences the radio lost payloads of: cut short by
+  // the next $ or with a wrong checksum
+  uint64_t gaps = 0;
+  uint64_t overflows = 0;
+};
+
+// Splits what the bridge sends into the payloads of the
+// pipes and reassembles the sentences of each vehicle.
+// sink(const sentence_t&) gets the valid ones, on the
+// thread feeding the receiver.
+template<typename Sink>
+class Receiver
+{
+public:
+  explicit Receiver(Sink sink)
+    : _sink(sink)
+  {}
+
+  // Bytes as read from the bridge, in any portions
+  void feed(const uint8_t* data, size_t size, Clock::time_point received)
+  {
+    for(size_t i = 0; i < size; ++i)
+    {
+      const uint8_t c = data[i];
+      if(c & FRAME_HEADER)
+      {
+        if(_pipe >= 0)
+        {
+          ++_short_frames;
+        }
+        _pipe = (c & ~FRAME_HEADER) < PIPES ? c & ~FRAME_HEADER : -1;
+        _filled = 0;
+        continue;
+      }
+      if(_pipe < 0)
+      {
+        continue;
+      }
+      _frame[_filled++] = char(c);
+      if(_filled == PAYLOAD)
+      {
+        ++_links[_pipe].statistics.payloads;
+        payload(uint8_t(_pipe), _frame.data(), PAYLOAD, received);
+        _pipe = -1;
+      }
+    }
+  }
+
+  // The payloads of one pipe without the framing, as the
+  // emulator writes them with --radio
+  void feed_raw(uint8_t pipe, const uint8_t* data, size_t size, Clock::time_point received)
+  {
+    payload(pipe, reinterpret_cast<const char*>(data), size, received);
+  }
+
+  const link_statistics_t& statistics(size_t pipe) const
+  {
+    return _links[pipe].statistics;
+  }
+
+  // Frames the serial line lost bytes of
+  uint64_t short_frames() const { return _short_frames; }
+
+private:
+  struct link_t
+  {
+    deets::nmea::Parser<SENTENCE_CAPACITY> parser;
+    link_statistics_t statistics;
+  };
+
+  void payload(uint8_t pipe, const char* data, size_t size, Clock::time_point received)
+  {
+    auto& link = _links[pipe];
+    auto& parser = link.parser;
+    link.statistics.bytes += size;
+    for(size_t i = 0; i < size; ++i)
+    {
+      if(parser.feed(data[i]))
+      {
+        const auto sentence = parser.sentence();
+        sentence_t copy;
+        copy.vehicle = pipe;
+        copy.sequence = uint32_t(link.statistics.sentences++);
+        copy.received = received;
+        copy.size = uint8_t(sentence.size());
+        copy.body_size = uint8_t(sentence.body().size());
+        std::memcpy(copy.text, sentence.c_str(), sentence.size() + 1);
+        _sink(copy);
+      }
+    }
+    link.statistics.gaps = parser.malformed + parser.checksum_errors;
+    link.statistics.overflows = parser.overflows;
+  }
+
+  Sink _sink;
+  std::array<link_t, PIPES> _links;
+  std::array<char, PAYLOAD> _frame;
+  size_t _filled = 0;
+  int _pipe = -1;
+  uint64_t _short_frames = 0;
+};
+
+} // namespace far::ground
@@ -0,0 +1,218 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Fan-out latency of the telemetry bus to N readers.
+//
+// The writer publishes records at RATE, each reader
+// attaches by name, polls and takes the time from the
+// record being published to it having been read. Then
+// the writer publishes as fast as it can into a small
+// ring, so the readers fall behind and have to skip.
+//
+// Exits non-zero if a reader saw a torn record, or what
+// it read and what it counted as missed doesn't add up
+// to what was published.
+#include "telemetry-bus.hpp"
+#include "profiling.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace far::ground;
+
+namespace {
+
+constexpr double RATE = 20000;
+constexpr auto DURATION = std::chrono::seconds(1);
+constexpr uint32_t BURST_CAPACITY = 256;
+constexpr uint64_t BURST_RECORDS = 2000000;
+
+// The writer fills every value with the sequence, so a
+// reader can tell a record written over while read
+record_t record(uint64_t sequence)
+{
+  record_t result = {};
+  result.vehicle = uint8_t(sequence % PIPES);
+  result.sequence = uint32_t(sequence);
+  result.type = kind::IMU;
+  result.time = uint32_t(sequence);
+  result.count = MAX_VALUES;
+  result.values.fill(int32_t(sequence));
+  return result;
+}
+
+struct reader_result_t
+{
+  uint64_t read = 0;
+  uint64_t missed = 0;
+  uint64_t torn = 0;
+  uint64_t out_of_order = 0;
+  // Nanoseconds
+  deets::profiling::Histogram<32> latency;
+};
+
+struct run_t
+{
+  uint64_t published = 0;
+  reader_result_t total;
+  bool passed = true;
+};
+
+run_t run(size_t readers, uint32_t capacity, bool paced)
+{
+  const std::string name = "/farduino-bus-bench-" + std::to_string(getpid());
+  TelemetryWriter writer;
+  if(!writer.create(name.c_str(), capacity))
+  {
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::atomic<size_t> attached{0};
+  std::atomic<bool> done{false};
+  std::vector<reader_result_t> results(readers);
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < readers; ++i)
+  {
+    threads.emplace_back([&, i] {
+      auto& result = results[i];
+      TelemetryReader reader;
+      if(!reader.attach(name.c_str()))
+      {
+        std::printf("can't attach to %s\n", name.c_str());
+        std::exit(EXIT_FAILURE);
+      }
+      ++attached;
+      int64_t published = 0;
+      bool consistent = true;
+      uint64_t last = 0;
+      while(true)
+      {
+        // Done is checked before, so nothing published
+        // before it was set is left behind
+        const bool finished = done.load(std::memory_order_acquire);
+        const auto read = reader.next([&](const record_t& record, int64_t at) {
+          published = at;
+          consistent = std::all_of(record.values.begin(), record.values.end(),
+                                   [&](int32_t value) { return value == int32_t(record.sequence); })
+            && record.time == record.sequence;
+        });
+        if(read == bus_read::RECORD)
+        {
+          result.latency.record(uint32_t(std::min<int64_t>(bus::now() - published, UINT32_MAX)));
+          ++result.read;
+          result.torn += !consistent;
+          result.out_of_order += result.read > 1 && reader.sequence() <= last;
+          last = reader.sequence();
+        }
+        else if(read == bus_read::EMPTY)
+        {
+          if(finished)
+          {
+            break;
+          }
+          std::this_thread::yield();
+        }
+      }
+      result.missed = reader.missed();
+    });
+  }
+  while(attached < readers)
+  {
+    std::this_thread::yield();
+  }
+
+  const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / RATE));
+  const auto start = Clock::now();
+  run_t run;
+  for(uint64_t sequence = 0;; ++sequence)
+  {
+    if(paced)
+    {
+      const auto due = start + period * sequence;
+      if(due >= start + DURATION)
+      {
+        break;
+      }
+      while(Clock::now() < due)
+      {
+      }
+    }
+    else if(sequence == BURST_RECORDS)
+    {
+      break;
+    }
+    writer.publish(record(sequence));
+  }
+  run.published = writer.published();
+  done.store(true, std::memory_order_release);
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  for(size_t i = 0; i < readers; ++i)
+  {
+    const auto& result = results[i];
+    run.total.read += result.read;
+    run.total.missed += result.missed;
+    run.total.torn += result.torn;
+    run.total.out_of_order += result.out_of_order;
+    run.total.latency.merge(result.latency);
+    if(result.torn || result.out_of_order || result.read + result.missed != run.published)
+    {
+      std::printf("FAIL: reader %zu read %llu, missed %llu of %llu, %llu torn, %llu out of order\n", i,
+                  (unsigned long long)result.read, (unsigned long long)result.missed,
+                  (unsigned long long)run.published, (unsigned long long)result.torn,
+                  (unsigned long long)result.out_of_order);
+      run.passed = false;
+    }
+  }
+  return run;
+}
+
+void report(const char* label, size_t readers, const run_t& run)
+{
+  const auto& latency = run.total.latency;
+  std::printf("%-7s %7zu %10llu %10llu %10llu %9uns %9uns %9uns\n", label, readers,
+              (unsigned long long)run.published, (unsigned long long)run.total.read,
+              (unsigned long long)run.total.missed, latency.mean(), latency.percentile(99), latency.max());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const size_t max_readers = argc > 1 ? size_t(std::max(1, std::atoi(argv[1]))) : 8;
+
+  std::printf("%zu byte records in %zu byte slots, %u cores\n\n", sizeof(record_t), sizeof(bus::slot_t),
+              std::thread::hardware_concurrency());
+  std::printf("%-7s %7s %10s %10s %10s %11s %11s %11s\n", "run", "readers", "published", "read", "missed", "latency",
+              "p99", "max");
+  bool passed = true;
+  for(size_t readers = 1; readers <= max_readers; readers *= 2)
+  {
+    const auto paced = run(readers, 4096, true);
+    report("paced", readers, paced);
+    passed &= paced.passed;
+  }
+  for(size_t readers = 1; readers <= max_readers; readers *= 2)
+  {
+    const auto burst = run(readers, BURST_CAPACITY, false);
+    report("burst", readers, burst);
+    passed &= burst.passed;
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
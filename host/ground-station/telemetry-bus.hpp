@@ -0,0 +1,299 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "decoder.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace far::ground {
+
+// The decoded records of the ground station in POSIX
+// shared memory, for any number of local readers.
+//
+// A ring of slots, each guarded by a sequence lock: the
+// writer never waits for the readers, a reader that
+// falls behind by more than the ring finds its records
+// overwritten, skips ahead and counts what it missed.
+// Readers only map the memory for reading, so they can't
+// disturb the writer or each other.
+namespace bus {
+
+constexpr uint32_t MAGIC = 0x46415242; // "FARB"
+constexpr uint32_t VERSION = 1;
+constexpr const char* DEFAULT_NAME = "/farduino-telemetry";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequences are shared between processes");
+static_assert(std::is_trivially_copyable_v<record_t>, "records are copied into shared memory");
+
+struct header_t
+{
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;
+  // What the ground station calls the vehicle on a pipe
+  char vehicles[PIPES][16];
+  // The sequence the next record gets
+  alignas(64) std::atomic<uint64_t> head;
+};
+
+struct alignas(64) slot_t
+{
+  // 2s + 1 while record s is written, 2s + 2 once it is
+  std::atomic<uint64_t> sequence;
+  // steady_clock, which is CLOCK_MONOTONIC and the same
+  // in every process
+  int64_t published;
+  record_t record;
+};
+
+inline size_t mapping_size(uint32_t capacity)
+{
+  return sizeof(header_t) + size_t(capacity) * sizeof(slot_t);
+}
+
+inline int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+} // namespace bus
+
+enum class bus_read : uint8_t
+{
+  // Nothing new
+  EMPTY,
+  RECORD,
+  // The writer overwrote the record while it was read,
+  // what the visitor saw is garbage
+  LAPPED,
+};
+
+// The one process publishing, see bus above
+class TelemetryWriter
+{
+public:
+  TelemetryWriter() = default;
+  TelemetryWriter(const TelemetryWriter&) = delete;
+  TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+  ~TelemetryWriter()
+  {
+    close();
+  }
+
+  // Replaces a bus of that name left behind. Capacity is
+  // a power of two, false if the memory can't be had.
+  bool create(const char* name, uint32_t capacity = 4096)
+  {
+    close();
+    if(!capacity || (capacity & (capacity - 1)))
+    {
+      return false;
+    }
+    shm_unlink(name);
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+    {
+      std::perror(name);
+      return false;
+    }
+    const auto size = bus::mapping_size(capacity);
+    void* memory = ftruncate(fd, off_t(size)) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                                                   : MAP_FAILED;
+    ::close(fd);
+    if(memory == MAP_FAILED)
+    {
+      std::perror(name);
+      shm_unlink(name);
+      return false;
+    }
+    _name = name;
+    _size = size;
+    _header = new(memory) bus::header_t{};
+    _slots = reinterpret_cast<bus::slot_t*>(_header + 1);
+    for(uint32_t i = 0; i < capacity; ++i)
+    {
+      new(&_slots[i]) bus::slot_t{};
+    }
+    _mask = capacity - 1;
+    _header->version = bus::VERSION;
+    _header->record_size = sizeof(record_t);
+    _header->capacity = capacity;
+    _header->head.store(0, std::memory_order_relaxed);
+    // Readers check this last
+    _header->magic.store(bus::MAGIC, std::memory_order_release);
+    return true;
+  }
+
+  // Also takes the name away, readers attached keep
+  // what they have mapped
+  void close()
+  {
+    if(_header)
+    {
+      munmap(_header, _size);
+      shm_unlink(_name.c_str());
+      _header = nullptr;
+    }
+  }
+
+  // Before publishing its records
+  void name_vehicle(uint8_t pipe, const char* name)
+  {
+    std::snprintf(_header->vehicles[pipe], sizeof(_header->vehicles[pipe]), "%s", name);
+  }
+
+  // From one thread at a time
+  void publish(const record_t& record)
+  {
+    const uint64_t sequence = _next++;
+    auto& slot = _slots[sequence & _mask];
+    slot.sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.published = bus::now();
+    slot.record = record;
+    slot.sequence.store(2 * sequence + 2, std::memory_order_release);
+    _header->head.store(sequence + 1, std::memory_order_release);
+  }
+
+  uint64_t published() const { return _next; }
+
+private:
+  std::string _name;
+  size_t _size = 0;
+  bus::header_t* _header = nullptr;
+  bus::slot_t* _slots = nullptr;
+  uint64_t _mask = 0;
+  uint64_t _next = 0;
+};
+
+// One of the processes reading, see bus above
+class TelemetryReader
+{
+public:
+  TelemetryReader() = default;
+  TelemetryReader(const TelemetryReader&) = delete;
+  TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+  ~TelemetryReader()
+  {
+    detach();
+  }
+
+  // Starts with the records published from now on, or
+  // with the oldest one still in the ring. False if there
+  // is no bus of that name or it is of another version.
+  bool attach(const char* name, bool oldest = false)
+  {
+    detach();
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0)
+    {
+      return false;
+    }
+    struct stat status;
+    void* memory = MAP_FAILED;
+    if(fstat(fd, &status) == 0 && size_t(status.st_size) >= sizeof(bus::header_t))
+    {
+      memory = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(memory == MAP_FAILED)
+    {
+      return false;
+    }
+    _size = size_t(status.st_size);
+    _header = static_cast<const bus::header_t*>(memory);
+    const auto capacity = _header->capacity;
+    if(_header->magic.load(std::memory_order_acquire) != bus::MAGIC || _header->version != bus::VERSION
+       || _header->record_size != sizeof(record_t) || _size < bus::mapping_size(capacity))
+    {
+      detach();
+      return false;
+    }
+    _slots = reinterpret_cast<const bus::slot_t*>(_header + 1);
+    _capacity = capacity;
+    const auto head = _header->head.load(std::memory_order_acquire);
+    _next = oldest && head > capacity ? head - capacity : oldest ? 0 : head;
+    _missed = 0;
+    return true;
+  }
+
+  void detach()
+  {
+    if(_header)
+    {
+      munmap(const_cast<bus::header_t*>(_header), _size);
+      _header = nullptr;
+    }
+  }
+
+  // Zero copy: visit(const record_t&, int64_t published)
+  // gets the record where it is in the shared memory.
+  // Records overwritten before we got to them are skipped
+  // and counted as missed.
+  template<typename Visitor>
+  bus_read next(Visitor visit)
+  {
+    const auto head = _header->head.load(std::memory_order_acquire);
+    if(_next == head)
+    {
+      return bus_read::EMPTY;
+    }
+    if(head - _next > _capacity)
+    {
+      _missed += head - _capacity - _next;
+      _next = head - _capacity;
+    }
+    const auto& slot = _slots[_next % _capacity];
+    const auto expected = 2 * _next + 2;
+    const auto sequence = _next++;
+    if(slot.sequence.load(std::memory_order_acquire) != expected)
+    {
+      ++_missed;
+      return bus_read::LAPPED;
+    }
+    visit(slot.record, slot.published);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot.sequence.load(std::memory_order_relaxed) != expected)
+    {
+      ++_missed;
+      return bus_read::LAPPED;
+    }
+    _sequence = sequence;
+    return bus_read::RECORD;
+  }
+
+  const char* vehicle(uint8_t pipe) const
+  {
+    return pipe < PIPES ? _header->vehicles[pipe] : "?";
+  }
+
+  // Of the last record read
+  uint64_t sequence() const { return _sequence; }
+  // Records that were overwritten before we read them
+  uint64_t missed() const { return _missed; }
+
+private:
+  size_t _size = 0;
+  const bus::header_t* _header = nullptr;
+  const bus::slot_t* _slots = nullptr;
+  uint64_t _capacity = 0;
+  uint64_t _next = 0;
+  uint64_t _sequence = 0;
+  uint64_t _missed = 0;
+};
+
+} // namespace far::ground
@@ -0,0 +1,84 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Prints the records the ground station publishes with
+// --bus, the way any other local consumer would read
+// them. Waits for the bus to show up.
+#include "telemetry-bus.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace far::ground;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const char* name = bus::DEFAULT_NAME;
+  bool oldest = false;
+  for(int i = 1; i < argc; ++i)
+  {
+    const std::string option = argv[i];
+    if(option == "--oldest")
+    {
+      oldest = true;
+    }
+    else if(option[0] == '/')
+    {
+      name = argv[i];
+    }
+    else
+    {
+      std::fprintf(stderr,
+                   "usage: %s [--oldest] [NAME]\n"
+                   "  NAME      of the bus (/farduino-telemetry)\n"
+                   "  --oldest  start with the oldest record still there\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  std::signal(SIGINT, [](int) { stop_requested = 1; });
+  std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+  TelemetryReader reader;
+  while(!stop_requested && !reader.attach(name, oldest))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  uint64_t missed = 0;
+  char line[256];
+  while(!stop_requested)
+  {
+    const auto result = reader.next([&](const record_t& record, int64_t) {
+      format(record, reader.vehicle(record.vehicle), line, sizeof(line));
+    });
+    switch(result)
+    {
+    case bus_read::RECORD:
+      std::fputs(line, stdout);
+      break;
+    case bus_read::LAPPED:
+      break;
+    case bus_read::EMPTY:
+      std::fflush(stdout);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      break;
+    }
+    if(reader.missed() != missed)
+    {
+      std::fprintf(stderr, "missed %llu records\n", (unsigned long long)(reader.missed() - missed));
+      missed = reader.missed();
+    }
+  }
+  return EXIT_SUCCESS;
+}
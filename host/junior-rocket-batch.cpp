@@ -0,0 +1,450 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#include "junior-rocket-batch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace far::junior::host {
+
+namespace {
+
+constexpr uint32_t bit(event e)
+{
+  return uint32_t(1) << uint32_t(e);
+}
+
+// As JuniorRocketState::produce_events feeds them
+constexpr event FEED_ORDER[] = {
+  event::GROUND_PRESSURE_ESTABLISHED,
+  event::PRESSURE_BELOW_LAUNCH_THRESHOLD,
+  event::PRESSURE_ABOVE_LAUNCH_THRESHOLD,
+  event::ACCELERATION_ABOVE_THRESHOLD,
+  event::ACCELERATION_BELOW_THRESHOLD,
+  event::ACCELERATION_AROUND_ZERO,
+  event::TILT_BEYOND_SEPARATION_LIMIT,
+  event::PRESSURE_PEAK_REACHED,
+  event::VELOCITY_BELOW_ZERO,
+  event::EXPECTED_APOGEE_TIME_REACHED,
+  event::PRESSURE_LINEAR,
+  event::PRESSURE_QUADRATIC,
+  event::RESTART_PRESSURE_MEASUREMENT,
+};
+static_assert(std::size(FEED_ORDER) == JuniorRocketBatch::EVENTS, "every event is fed");
+
+int64_t microseconds(timestamp_t timestamp)
+{
+  return timestamp.time_since_epoch().count();
+}
+
+} // namespace
+
+JuniorRocketBatch::JuniorRocketBatch(size_t lanes)
+  : _lanes(lanes)
+  , _state(lanes, uint8_t(state::IDLE))
+  , _changed(lanes, 0)
+  , _state_change(lanes, 0)
+  , _events(lanes, 0)
+  , _phase(lanes, NONE)
+  , _pad_seeded(lanes, 0)
+  , _pad_average(lanes)
+  , _pad_variance(lanes)
+  , _pad_updates(lanes, 0)
+  , _peak_updates(lanes, 0)
+  , _peaked(lanes, 0)
+  , _peaked_since(lanes, 0)
+  , _fitting(lanes, 0)
+  , _fit(lanes)
+  , _fit_start(lanes, 0)
+  , _drouge_failed(lanes, 0)
+  , _drouge_failed_at(lanes, 0)
+  , _has_ground_pressure(lanes, 0)
+  , _ground_pressure(lanes)
+  , _has_liftoff(lanes, 0)
+  , _liftoff(lanes, 0)
+  , _has_peak_pressure(lanes, 0)
+  , _peak_pressure(lanes)
+  , _assessment(lanes, UNASSESSED)
+  , _estimating(lanes, 0)
+  , _estimator(lanes, altitude_estimator_t(
+                 BAROMETRIC_ALTITUDE_VARIANCE, ACCELERATION_MEASUREMENT_VARIANCE, JERK_SPECTRAL_DENSITY))
+  , _velocity(lanes, 0)
+{
+  for(auto& slot : _peak_window)
+  {
+    slot.resize(lanes);
+  }
+  for(size_t s = 0; s < STATES; ++s)
+  {
+    std::fill(std::begin(_on_event[s]), std::end(_on_event[s]), NO_TRANSITION);
+    _timeout_after[s] = std::numeric_limits<int64_t>::max();
+    _timeout_to[s] = NO_TRANSITION;
+  }
+  // Later ones win, as in TimedFiniteAutomaton
+  for(const auto& transition : TRANSITIONS)
+  {
+    if(transition.timed)
+    {
+      _timeout_after[size_t(transition.from)] = transition.after.count();
+      _timeout_to[size_t(transition.from)] = uint8_t(transition.to);
+    }
+    else
+    {
+      _on_event[size_t(transition.from)][size_t(transition.what)] = uint8_t(transition.to);
+    }
+  }
+}
+
+void JuniorRocketBatch::drive(timestamp_t timestamp, const value_t* pressure, const value_t* acceleration,
+                              const value_t* cos_tilt, const value_t* temperature)
+{
+  if(!_last_timestamp)
+  {
+    _last_timestamp = timestamp;
+    std::fill(_changed.begin(), _changed.end(), 1);
+    return;
+  }
+  const auto elapsed = timestamp - *_last_timestamp;
+  _last_timestamp = timestamp;
+  process_pressure(pressure, temperature);
+  estimate_altitude(elapsed, pressure, acceleration);
+  assess_pressure_drop(timestamp, pressure);
+
+  // The old states go into _changed until compared
+  std::copy(_state.begin(), _state.end(), _changed.begin());
+  elapse(elapsed);
+  produce_events(timestamp, pressure, acceleration, cos_tilt);
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    _changed[lane] = _changed[lane] != _state[lane];
+    if(_changed[lane])
+    {
+      handle_state_transition(lane, timestamp);
+    }
+  }
+}
+
+void JuniorRocketBatch::process_pressure(const value_t* pressure, const value_t* temperature)
+{
+  // The pad, RollingStatistics unrolled into the lanes
+  constexpr auto n = static_cast<value_t>(GROUND_PRESSURE_WINDOW);
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    const auto current = state(_state[lane]);
+    if(_phase[lane] != PAD || (current != state::ESTABLISH_GROUND_PRESSURE && current != state::WAIT_FOR_LAUNCH))
+    {
+      continue;
+    }
+    const auto offset = PRESSURE_TEMPERATURE_COEFFICIENT * (temperature[lane] - REFERENCE_TEMPERATURE);
+    const auto compensated = pressure[lane] - offset;
+    if(!_pad_seeded[lane])
+    {
+      _pad_seeded[lane] = 1;
+      _pad_average[lane] = compensated;
+      _pad_variance[lane] = INITIAL_PRESSURE_VARIANCE;
+    }
+    ++_pad_updates[lane];
+    const auto deviation = compensated - _pad_average[lane];
+    const auto increment = deviation / n;
+    _pad_average[lane] += increment;
+    _pad_variance[lane] = (_pad_variance[lane] + deviation * increment)
+      * (static_cast<value_t>(1) - static_cast<value_t>(1) / n);
+    if(_pad_updates[lane] >= GROUND_PRESSURE_CONFIDENCE && _pad_variance[lane] < PRESSURE_VARIANCE_THRESHOLD)
+    {
+      _has_ground_pressure[lane] = 1;
+      _ground_pressure[lane] = _pad_average[lane] + offset;
+    }
+  }
+
+  // The ascent, ArrayStatistics::median sorts the window
+  // in place, and so does this
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    if(_phase[lane] != ASCENT)
+    {
+      continue;
+    }
+    _peak_window[_peak_updates[lane]++ % PEAK_PRESSURE_WINDOW][lane] = pressure[lane];
+    if(_peak_updates[lane] < PEAK_PRESSURE_WINDOW)
+    {
+      continue;
+    }
+    std::array<value_t, PEAK_PRESSURE_WINDOW> window;
+    for(int slot = 0; slot < PEAK_PRESSURE_WINDOW; ++slot)
+    {
+      window[slot] = _peak_window[slot][lane];
+    }
+    std::sort(window.begin(), window.end());
+    for(int slot = 0; slot < PEAK_PRESSURE_WINDOW; ++slot)
+    {
+      _peak_window[slot][lane] = window[slot];
+    }
+    const auto median = window[PEAK_PRESSURE_WINDOW / 2];
+    _peak_pressure[lane] = _has_peak_pressure[lane] ? std::min(median, _peak_pressure[lane]) : median;
+    _has_peak_pressure[lane] = 1;
+  }
+}
+
+void JuniorRocketBatch::estimate_altitude(duration_t elapsed, const value_t* pressure, const value_t* acceleration)
+{
+  const auto dt = std::chrono::duration<float>(elapsed).count();
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    if(!_estimating[lane])
+    {
+      continue;
+    }
+    auto& estimator = _estimator[lane];
+    estimator.predict(dt);
+    estimator.update_altitude(
+      deets::estimation::fast_barometric_altitude(float(pressure[lane]), float(_ground_pressure[lane])));
+    estimator.update_acceleration(float(acceleration[lane]) - GRAVITY);
+    _velocity[lane] = estimator.estimate().velocity;
+  }
+}
+
+void JuniorRocketBatch::assess_pressure_drop(timestamp_t timestamp, const value_t* pressure)
+{
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    if(_phase[lane] != DESCENT || !_fitting[lane])
+    {
+      continue;
+    }
+    const auto since_start = duration_t(microseconds(timestamp) - _fit_start[lane]);
+    auto& pressure_drop_fit = _fit[lane];
+    pressure_drop_fit.update(std::chrono::duration<double>(since_start).count(), double(pressure[lane]));
+    const auto fit = pressure_drop_fit.quadratic();
+    if(!fit)
+    {
+      continue;
+    }
+    const auto coefficient = fit->coefficients[2];
+    const auto margin = PRESSURE_DROP_CONFIDENCE * std::sqrt(fit->variances[2] * PRESSURE_AVERAGE_WINDOW);
+    if(state(_state[lane]) == state::MEASURE_FALLING_PRESSURE3)
+    {
+      _assessment[lane] = coefficient > QUADRATIC_PRESSURE_DROP_COEFFICIENT ? QUADRATIC : LINEAR;
+    }
+    else if(since_start >= PRESSURE_DROP_MIN_DURATION)
+    {
+      if(coefficient - margin > QUADRATIC_PRESSURE_DROP_COEFFICIENT)
+      {
+        _assessment[lane] = QUADRATIC;
+      }
+      else if(coefficient + margin < QUADRATIC_PRESSURE_DROP_COEFFICIENT)
+      {
+        _assessment[lane] = LINEAR;
+      }
+    }
+  }
+}
+
+void JuniorRocketBatch::elapse(duration_t elapsed)
+{
+  _now += elapsed.count();
+  const auto now = _now;
+  uint8_t* const states = _state.data();
+  int64_t* const changes = _state_change.data();
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    const auto from = states[lane];
+    const bool due = now - changes[lane] >= _timeout_after[from];
+    states[lane] = due ? _timeout_to[from] : from;
+    changes[lane] = due ? now : changes[lane];
+  }
+}
+
+void JuniorRocketBatch::produce_events(timestamp_t timestamp, const value_t* pressure, const value_t* acceleration,
+                                       const value_t* cos_tilt)
+{
+  // The thresholds of all lanes, branch free
+  uint32_t* const events = _events.data();
+  const uint8_t* const has_ground_pressure = _has_ground_pressure.data();
+  const value_t* const ground_pressure = _ground_pressure.data();
+  const uint8_t* const has_peak_pressure = _has_peak_pressure.data();
+  const value_t* const peak_pressure = _peak_pressure.data();
+  const int64_t now = microseconds(timestamp);
+  const int64_t fallback = PEAK_PRESSURE_FALLBACK.count();
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    const bool below = ground_pressure[lane] - pressure[lane] >= LAUNCH_PRESSURE_DIFFERENTIAL;
+    const uint32_t pressure_events = bit(event::GROUND_PRESSURE_ESTABLISHED)
+      | (below ? bit(event::PRESSURE_BELOW_LAUNCH_THRESHOLD) : bit(event::PRESSURE_ABOVE_LAUNCH_THRESHOLD));
+    const bool above = acceleration[lane] > LAUNCH_ACCELERATION_THRESHOLD;
+    const bool freefall = acceleration[lane] < FREEFALL_ACCELERATION_THRESHOLD;
+    const bool peaked = _phase[lane] == ASCENT && has_peak_pressure[lane]
+      && pressure[lane] > peak_pressure[lane] + PEAK_PRESSURE_MARGIN;
+    _peaked_since[lane] = peaked && !_peaked[lane] ? now : _peaked_since[lane];
+    _peaked[lane] = peaked;
+    const bool peak_held = peaked && now - _peaked_since[lane] >= fallback;
+    events[lane] = (has_ground_pressure[lane] ? pressure_events : 0)
+      | (above ? bit(event::ACCELERATION_ABOVE_THRESHOLD) : bit(event::ACCELERATION_BELOW_THRESHOLD))
+      | (!above && freefall ? bit(event::ACCELERATION_AROUND_ZERO) : 0)
+      | (cos_tilt[lane] < SEPARATION_TILT_COSINE ? bit(event::TILT_BEYOND_SEPARATION_LIMIT) : 0)
+      | (peak_held ? bit(event::PRESSURE_PEAK_REACHED) : 0);
+  }
+
+  // And of the clocks
+  const int64_t apogee = (APOGEE_TIME + APOGEE_DETECTION_MARGIN).count();
+  const int64_t retry = timeouts::DROUGE_RETRY.count();
+  const uint8_t* const estimating = _estimating.data();
+  const float* const velocity = _velocity.data();
+  const uint8_t* const has_liftoff = _has_liftoff.data();
+  const int64_t* const liftoff = _liftoff.data();
+  const uint8_t* const phase = _phase.data();
+  const uint8_t* const drouge_failed = _drouge_failed.data();
+  const int64_t* const drouge_failed_at = _drouge_failed_at.data();
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    const bool falling = estimating[lane] && velocity[lane] < APOGEE_VELOCITY_THRESHOLD;
+    const bool overdue = has_liftoff[lane] && now - liftoff[lane] >= apogee;
+    const bool restart = phase[lane] == DESCENT && drouge_failed[lane] && now - drouge_failed_at[lane] >= retry;
+    events[lane] |= (falling ? bit(event::VELOCITY_BELOW_ZERO) : 0)
+      | (overdue ? bit(event::EXPECTED_APOGEE_TIME_REACHED) : 0)
+      | (restart ? bit(event::RESTART_PRESSURE_MEASUREMENT) : 0);
+  }
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    switch(_assessment[lane])
+    {
+    case LINEAR:
+      events[lane] |= bit(event::PRESSURE_LINEAR);
+      break;
+    case QUADRATIC:
+      events[lane] |= bit(event::PRESSURE_QUADRATIC);
+      break;
+    }
+    _assessment[lane] = UNASSESSED;
+  }
+
+  for(size_t lane = 0; lane < _lanes; ++lane)
+  {
+    feed(lane, events[lane]);
+  }
+}
+
+void JuniorRocketBatch::feed(size_t lane, uint32_t events)
+{
+  auto current = _state[lane];
+  for(const auto what : FEED_ORDER)
+  {
+    if(events & bit(what))
+    {
+      const auto to = _on_event[current][size_t(what)];
+      if(to != NO_TRANSITION)
+      {
+        current = to;
+        _state_change[lane] = _now;
+      }
+    }
+  }
+  _state[lane] = current;
+}
+
+void JuniorRocketBatch::handle_state_transition(size_t lane, timestamp_t timestamp)
+{
+  switch(state(_state[lane]))
+  {
+  case state::ESTABLISH_GROUND_PRESSURE:
+    _phase[lane] = PAD;
+    _pad_seeded[lane] = 0;
+    _pad_updates[lane] = 0;
+    break;
+  case state::WAIT_FOR_LAUNCH:
+    _has_liftoff[lane] = 0;
+    if(!_estimating[lane])
+    {
+      _estimating[lane] = 1;
+      _estimator[lane] = altitude_estimator_t(
+        BAROMETRIC_ALTITUDE_VARIANCE, ACCELERATION_MEASUREMENT_VARIANCE, JERK_SPECTRAL_DENSITY);
+    }
+    break;
+  case state::ACCELERATION_DETECTED:
+    _has_liftoff[lane] = 1;
+    _liftoff[lane] = microseconds(timestamp);
+    break;
+  case state::LAUNCHED:
+    _phase[lane] = ASCENT;
+    _peak_updates[lane] = 0;
+    _peaked[lane] = 0;
+    for(auto& slot : _peak_window)
+    {
+      slot[lane] = value_t{};
+    }
+    break;
+  case state::FALLING_:
+    _phase[lane] = DESCENT;
+    _fitting[lane] = 0;
+    _fit_start[lane] = 0;
+    _drouge_failed[lane] = 0;
+    break;
+  case state::MEASURE_FALLING_PRESSURE1:
+    if(_phase[lane] == DESCENT)
+    {
+      _fitting[lane] = 1;
+      _fit[lane] = fit_t{};
+      _fit_start[lane] = microseconds(timestamp);
+    }
+    break;
+  case state::DROUGE_OPENED:
+    if(_phase[lane] == DESCENT)
+    {
+      _fitting[lane] = 0;
+    }
+    break;
+  case state::DROUGE_FAILED:
+    if(_phase[lane] == DESCENT)
+    {
+      _fitting[lane] = 0;
+      _drouge_failed[lane] = 1;
+      _drouge_failed_at[lane] = microseconds(timestamp);
+    }
+    break;
+  case state::LANDED:
+    _phase[lane] = NONE;
+    break;
+  default:
+    break;
+  }
+}
+
+std::optional<value_t> JuniorRocketBatch::ground_pressure(size_t lane) const
+{
+  if(_has_ground_pressure[lane])
+  {
+    return _ground_pressure[lane];
+  }
+  return std::nullopt;
+}
+
+std::optional<duration_t> JuniorRocketBatch::flighttime(size_t lane) const
+{
+  if(_has_liftoff[lane])
+  {
+    return duration_t(microseconds(*_last_timestamp) - _liftoff[lane]);
+  }
+  return std::nullopt;
+}
+
+std::optional<value_t> JuniorRocketBatch::peak_pressure(size_t lane) const
+{
+  if(_has_peak_pressure[lane])
+  {
+    return _peak_pressure[lane];
+  }
+  return std::nullopt;
+}
+
+std::optional<JuniorRocketBatch::altitude_estimator_t::estimate_t> JuniorRocketBatch::altitude_estimate(
+  size_t lane) const
+{
+  if(_estimating[lane])
+  {
+    return _estimator[lane].estimate();
+  }
+  return std::nullopt;
+}
+
+} // namespace far::junior::host
@@ -0,0 +1,130 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "junior-rocket-state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace far::junior::host {
+
+// Many JuniorRocketStates at once, for sweeps and Monte
+// Carlo runs on the host. Each lane behaves exactly like
+// a JuniorRocketState driven with the same samples, but
+// they are all driven in lockstep, with one timestamp.
+//
+// Everything a lane has is kept in one array per member,
+// so the thresholds of all lanes are compared in loops
+// the compiler vectorizes, and the automaton runs off
+// dense tables built from TRANSITIONS instead of hash
+// maps. Only the altitude estimator and the pressure drop
+// fit stay objects per lane, they are the firmware's own
+// and only run in flight.
+//
+// The order of things in drive() mirrors
+// JuniorRocketState::drive, and has to follow it.
+class JuniorRocketBatch
+{
+public:
+  using altitude_estimator_t = deets::estimation::AltitudeKalmanFilter<float>;
+
+  static constexpr size_t STATES = size_t(state::LANDED) + 1;
+  static constexpr size_t EVENTS = size_t(event::TILT_BEYOND_SEPARATION_LIMIT) + 1;
+
+  explicit JuniorRocketBatch(size_t lanes);
+
+  size_t lanes() const { return _lanes; }
+
+  // One sample per lane in each array, see
+  // JuniorRocketState::drive. Every sample has a fresh
+  // pressure.
+  void drive(timestamp_t timestamp, const value_t* pressure, const value_t* acceleration,
+             const value_t* cos_tilt, const value_t* temperature);
+
+  state current(size_t lane) const { return state(_state[lane]); }
+  // Whether the last drive() changed the state, what
+  // StateObserver::state_changed would have been told
+  bool changed(size_t lane) const { return _changed[lane]; }
+  std::optional<value_t> ground_pressure(size_t lane) const;
+  std::optional<duration_t> flighttime(size_t lane) const;
+  std::optional<value_t> peak_pressure(size_t lane) const;
+  std::optional<altitude_estimator_t::estimate_t> altitude_estimate(size_t lane) const;
+
+private:
+  enum phase : uint8_t
+  {
+    NONE,
+    PAD,
+    ASCENT,
+    DESCENT,
+  };
+
+  enum assessment : int8_t
+  {
+    UNASSESSED = -1,
+    LINEAR,
+    QUADRATIC,
+  };
+
+  using fit_t = deets::statistics::LeastSquaresFit<double>;
+
+  void process_pressure(const value_t* pressure, const value_t* temperature);
+  void estimate_altitude(duration_t elapsed, const value_t* pressure, const value_t* acceleration);
+  void assess_pressure_drop(timestamp_t timestamp, const value_t* pressure);
+  void elapse(duration_t elapsed);
+  void produce_events(timestamp_t timestamp, const value_t* pressure, const value_t* acceleration,
+                      const value_t* cos_tilt);
+  void feed(size_t lane, uint32_t events);
+  void handle_state_transition(size_t lane, timestamp_t timestamp);
+
+  size_t _lanes;
+
+  // TRANSITIONS, NO_TRANSITION where there is none
+  static constexpr uint8_t NO_TRANSITION = 0xff;
+  uint8_t _on_event[STATES][EVENTS];
+  int64_t _timeout_after[STATES];
+  uint8_t _timeout_to[STATES];
+
+  // The automata, in microseconds. Lockstep gives them
+  // all the same clock.
+  std::optional<timestamp_t> _last_timestamp;
+  int64_t _now = 0;
+  std::vector<uint8_t> _state;
+  std::vector<uint8_t> _changed;
+  std::vector<int64_t> _state_change;
+  // Bits by event, fed in the order of produce_events
+  std::vector<uint32_t> _events;
+
+  std::vector<uint8_t> _phase;
+  // The pad, see phases::pad_t
+  std::vector<uint8_t> _pad_seeded;
+  std::vector<value_t> _pad_average;
+  std::vector<value_t> _pad_variance;
+  std::vector<uint32_t> _pad_updates;
+  // The ascent, the window one array per slot
+  std::vector<value_t> _peak_window[PEAK_PRESSURE_WINDOW];
+  std::vector<uint32_t> _peak_updates;
+  std::vector<uint8_t> _peaked;
+  std::vector<int64_t> _peaked_since;
+  // The descent
+  std::vector<uint8_t> _fitting;
+  std::vector<fit_t> _fit;
+  std::vector<int64_t> _fit_start;
+  std::vector<uint8_t> _drouge_failed;
+  std::vector<int64_t> _drouge_failed_at;
+
+  std::vector<uint8_t> _has_ground_pressure;
+  std::vector<value_t> _ground_pressure;
+  std::vector<uint8_t> _has_liftoff;
+  std::vector<int64_t> _liftoff;
+  std::vector<uint8_t> _has_peak_pressure;
+  std::vector<value_t> _peak_pressure;
+  std::vector<int8_t> _assessment;
+  std::vector<uint8_t> _estimating;
+  std::vector<altitude_estimator_t> _estimator;
+  std::vector<float> _velocity;
+};
+
+} // namespace far::junior::host
@@ -0,0 +1,185 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Microbenchmarks of the hot paths of the portable core.
+// Prints JSON, an optional argument restricts the run to
+// benchmarks containing it in their name.
+#include <Arduino.h>
+#include "farduino_types.h"
+#include "farduino_utilities.h"
+#include "ring_buffer.h"
+#include "junior-rocket-state.hpp"
+#include "microbench.hpp"
+
+#include <array>
+#include <iostream>
+#include <random>
+
+using namespace far::junior;
+using deets::bench::do_not_optimize;
+
+#ifndef FARDUINO_REVISION
+#define FARDUINO_REVISION "unknown"
+#endif
+
+namespace {
+
+using automaton_t = tfa::TimedFiniteAutomaton<state, event, timestamp_t>;
+
+// The automaton of the firmware, in the given state
+automaton_t junior_automaton()
+{
+  StateObserver observer;
+  JuniorRocketState junior(observer);
+  automaton_t automaton(state::IDLE);
+  junior.each_transition([&](state from, auto trigger, state to) {
+    automaton.add_transition(from, trigger, to);
+  });
+  automaton.elapsed(duration_t::zero());
+  automaton.feed(event::GROUND_PRESSURE_ESTABLISHED);
+  return automaton;
+}
+
+// Plausible pressures, to not benchmark a constant
+std::array<value_t, 64> pressures()
+{
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0, 0.5);
+  std::array<value_t, 64> result;
+  for(auto& pressure : result)
+  {
+    pressure = value_t(1013.25f + noise(rng));
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  deets::bench::Suite suite("farduino", argc > 1 ? argv[1] : "");
+  suite.context("revision", FARDUINO_REVISION);
+#ifdef FARDUINO_FIXED_POINT
+  suite.context("value_t", "Q15.16");
+#else
+  suite.context("value_t", "float");
+#endif
+  suite.context("compiler", __VERSION__);
+
+  const auto samples = pressures();
+  size_t i = 0;
+
+  {
+    auto automaton = junior_automaton();
+    suite.run("tfa/feed_ignored", [&] {
+      do_not_optimize(automaton.feed(event::PRESSURE_LINEAR));
+    });
+    bool above = false;
+    suite.run("tfa/feed_transition", [&] {
+      above = !above;
+      do_not_optimize(automaton.feed(above ? event::ACCELERATION_ABOVE_THRESHOLD : event::ACCELERATION_BELOW_THRESHOLD));
+    });
+  }
+  {
+    // Rejections are only recorded the first time in a
+    // state, this is what the repeats cost
+    tfa::TraceBuffer<64> trace;
+    auto automaton = junior_automaton();
+    automaton.trace(&trace);
+    suite.run("tfa/feed_ignored_traced", [&] {
+      do_not_optimize(automaton.feed(event::PRESSURE_LINEAR));
+    });
+    bool above = false;
+    suite.run("tfa/feed_transition_traced", [&] {
+      above = !above;
+      do_not_optimize(automaton.feed(above ? event::ACCELERATION_ABOVE_THRESHOLD : event::ACCELERATION_BELOW_THRESHOLD));
+    });
+  }
+  {
+    auto automaton = junior_automaton();
+    suite.run("tfa/elapsed_no_timeout", [&] {
+      do_not_optimize(automaton.elapsed(8ms));
+    });
+    automaton.feed(event::ACCELERATION_ABOVE_THRESHOLD);
+    suite.run("tfa/elapsed_timeout_pending", [&] {
+      do_not_optimize(automaton.elapsed(duration_t::zero()));
+    });
+  }
+
+  {
+    deets::statistics::ArrayStatistics<value_t, 10> statistics{};
+    suite.run("statistics/array_update", [&] {
+      do_not_optimize(statistics.update(samples[i++ % samples.size()]));
+    });
+    const auto unsorted = statistics;
+    suite.run("statistics/array_median", [&] {
+      statistics = unsorted;
+      do_not_optimize(statistics.median());
+    });
+  }
+
+  {
+    auto pressure_filter = make_pressure_filter();
+    suite.run("statistics/pressure_filter", [&] {
+      do_not_optimize(pressure_filter.update(samples[i++ % samples.size()]));
+    });
+    auto acceleration_filter = make_acceleration_filter(125.0f);
+    suite.run("statistics/acceleration_filter", [&] {
+      do_not_optimize(acceleration_filter.update(samples[i++ % samples.size()]));
+    });
+  }
+
+  {
+    CircularBuffer ring(256);
+    char message[32] = "$RQMET0,123456.1234,1013.250,2";
+    char response[32];
+    suite.run("ring/write_read_32", [&] {
+      ring.write(message, sizeof(message));
+      ring.read(response, sizeof(response));
+      do_not_optimize(response);
+    });
+  }
+
+  {
+    char sentence[100];
+    const value_t acc[3] = { value_t(0.01f), value_t(-0.02f), value_t(1.0f) };
+    const value_t omega[3] = { value_t(1.5f), value_t(-0.25f), value_t(0.125f) };
+    const value_t B[3] = { value_t(21.0f), value_t(-4.5f), value_t(40.25f) };
+    timestamp_t timestamp{};
+    const auto advance = [&] {
+      timestamp += 8ms;
+      return timestamp;
+    };
+
+    suite.run("sentence/time_of_day", [&] {
+      time_of_day(advance(), sentence);
+      do_not_optimize(sentence);
+    });
+    suite.run("sentence/imu", [&] {
+      construct_IMU_sentence(advance(), acc, omega, B, sentence);
+      do_not_optimize(sentence);
+    });
+    suite.run("sentence/met", [&] {
+      construct_MET_sentence(advance(), samples[i++ % samples.size()], value_t(21.5f), value_t(123.4f), sentence);
+      do_not_optimize(sentence);
+    });
+    suite.run("sentence/state_idle", [&] {
+      construct_state_sentence(advance(), value_t(1013.25f), samples[i++ % samples.size()], state_IDLE, sentence);
+      do_not_optimize(sentence);
+    });
+    suite.run("sentence/state_coasting", [&] {
+      construct_state_sentence(advance(), value_t(1013.25f), samples[i++ % samples.size()], state_COASTING, sentence);
+      do_not_optimize(sentence);
+    });
+#ifdef USE_PERF_COUNTERS
+    perf_histograms[perf_DRIVE].record(42);
+    suite.run("sentence/perf", [&] {
+      construct_perf_sentence(advance(), perf_DRIVE, sentence);
+      do_not_optimize(sentence);
+    });
+#endif
+  }
+
+  suite.json(std::cout);
+  return 0;
+}
@@ -0,0 +1,121 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace deets::bench {
+
+// Keeps the compiler from optimizing a value away
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct result_t
+{
+  std::string name;
+  uint64_t iterations;
+  // Per operation, over all samples
+  double min_ns;
+  double median_ns;
+  double mean_ns;
+};
+
+// Runs each benchmark body in batches long enough for
+// the clock resolution not to matter, takes a number of
+// such samples and reports per operation times.
+class Suite
+{
+  using clock = std::chrono::steady_clock;
+
+public:
+  Suite(std::string name, std::string filter="", size_t samples=15)
+    : _name(std::move(name))
+    , _filter(std::move(filter))
+    , _samples(samples)
+  {}
+
+  // Body performs one operation per call
+  template<typename Body>
+  void run(const std::string& name, Body body)
+  {
+    if(!_filter.empty() && name.find(_filter) == std::string::npos)
+    {
+      return;
+    }
+    // Calibrate to about a millisecond per sample
+    uint64_t iterations = 1;
+    while(batch(body, iterations) < std::chrono::milliseconds(1) && iterations < (uint64_t(1) << 30))
+    {
+      iterations *= 2;
+    }
+    std::vector<double> per_operation;
+    for(size_t i = 0; i < _samples; ++i)
+    {
+      const auto elapsed = std::chrono::duration<double, std::nano>(batch(body, iterations));
+      per_operation.push_back(elapsed.count() / iterations);
+    }
+    std::sort(per_operation.begin(), per_operation.end());
+    double sum = 0;
+    for(const auto value : per_operation)
+    {
+      sum += value;
+    }
+    _results.push_back({
+        name, iterations * _samples,
+        per_operation.front(), per_operation[per_operation.size() / 2], sum / per_operation.size()
+      });
+  }
+
+  const std::vector<result_t>& results() const { return _results; }
+
+  // Free form information about the build, e.g. the revision
+  void context(const std::string& key, const std::string& value)
+  {
+    _context.emplace_back(key, value);
+  }
+
+  void json(std::ostream& os) const
+  {
+    os << "{\n  \"suite\": \"" << _name << "\",\n";
+    for(const auto& [key, value] : _context)
+    {
+      os << "  \"" << key << "\": \"" << value << "\",\n";
+    }
+    os << "  \"results\": [\n";
+    for(size_t i = 0; i < _results.size(); ++i)
+    {
+      const auto& result = _results[i];
+      os << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+         << ", \"min_ns\": " << result.min_ns << ", \"median_ns\": " << result.median_ns
+         << ", \"mean_ns\": " << result.mean_ns << "}" << (i + 1 < _results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+  }
+
+private:
+  template<typename Body>
+  clock::duration batch(Body& body, uint64_t iterations)
+  {
+    const auto start = clock::now();
+    for(uint64_t i = 0; i < iterations; ++i)
+    {
+      body();
+    }
+    return clock::now() - start;
+  }
+
+  std::string _name;
+  std::string _filter;
+  size_t _samples;
+  std::vector<std::pair<std::string, std::string>> _context;
+  std::vector<result_t> _results;
+};
+
+} // namespace deets::bench
@@ -0,0 +1,340 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Feeds a long NMEA capture through nmea-parser.hpp and
+// through the byte loop the sketch used before, followed
+// by strtok and atof, and reports the time per byte.
+//
+// Without a capture file an hour of a GPS sending GGA,
+// GSA, GSV, RMC and VTG once a second is made up, with
+// corrupted, cut short and overlong sentences mixed in.
+// The fixes decoded from it have to match what was sent.
+#include "nmea-parser.hpp"
+#include "microbench.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using deets::bench::do_not_optimize;
+using deets::nmea::gps_fix_t;
+
+namespace {
+
+constexpr int CAPTURE_SECONDS = 3600;
+
+struct capture_t
+{
+  std::string bytes;
+  // The GGA fixes that made it through unharmed
+  std::vector<gps_fix_t> fixes;
+};
+
+std::string with_checksum(const std::string& body)
+{
+  uint8_t checksum = 0;
+  for(const char c : body)
+  {
+    checksum ^= uint8_t(c);
+  }
+  char tail[8];
+  std::snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+  return "$" + body + tail;
+}
+
+// ddmm.mmmmm and the hemisphere, from 1e-5 minutes
+std::string coordinate(int64_t minutes, int degree_digits, const char* hemispheres)
+{
+  const char hemisphere = hemispheres[minutes < 0 ? 1 : 0];
+  minutes = std::abs(minutes);
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%0*d%02d.%05d,%c", degree_digits, int(minutes / 6000000),
+                int(minutes / 100000 % 60), int(minutes % 100000), hemisphere);
+  return buffer;
+}
+
+// 1e-5 minutes to the nearest 1e-7 degree
+int32_t degrees(int64_t minutes)
+{
+  return int32_t(std::llround(double(minutes) / 6 * 10));
+}
+
+capture_t simulated_capture()
+{
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  capture_t capture;
+  // In 1e-5 minutes
+  int64_t latitude = 48 * 6000000 + 703800;
+  int64_t longitude = 11 * 6000000 + 3100000;
+  int32_t altitude = 520000;
+  for(int second = 0; second < CAPTURE_SECONDS; ++second)
+  {
+    const uint32_t time = uint32_t((12 * 3600 + second) * 1000);
+    char clock[16];
+    std::snprintf(clock, sizeof(clock), "%02u%02u%02u.00", time / 3600000, time / 60000 % 60, time / 1000 % 60);
+    latitude += int64_t(rng() % 201) - 100;
+    longitude += int64_t(rng() % 201) - 100;
+    altitude += int32_t(rng() % 2001) - 1000;
+
+    const auto lat = coordinate(latitude, 2, "NS");
+    const auto lon = coordinate(longitude, 3, "EW");
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "GPGGA,%s,%s,%s,1,08,0.94,%d.%d,M,47.0,M,,", clock, lat.c_str(),
+                  lon.c_str(), altitude / 1000, altitude % 1000 / 100);
+    std::vector<std::string> sentences = {
+      with_checksum(buffer),
+      with_checksum("GPGSA,A,3,04,05,09,12,17,24,25,29,,,,,1.8,0.94,1.5"),
+      with_checksum("GPGSV,3,1,11,04,39,052,42,05,22,246,38,09,71,282,45,12,11,321,33"),
+      with_checksum("GPGSV,3,2,11,17,51,104,44,24,14,176,31,25,34,305,40,29,07,034,28"),
+      with_checksum("GPGSV,3,3,11,31,03,140,,32,18,069,36,46,31,199,"),
+    };
+    std::snprintf(buffer, sizeof(buffer), "GPRMC,%s,A,%s,%s,0.042,12.30,190623,,,A", clock, lat.c_str(), lon.c_str());
+    sentences.push_back(with_checksum(buffer));
+    sentences.push_back(with_checksum("GPVTG,12.30,T,,M,0.042,N,0.078,K,A"));
+
+    bool gga_intact = true;
+    for(size_t i = 0; i < sentences.size(); ++i)
+    {
+      auto sentence = sentences[i];
+      const int roll = percent(rng);
+      if(roll == 0)
+      {
+        // A flipped bit on the line
+        sentence[sentence.size() / 2] ^= 0x04;
+        gga_intact &= i != 0;
+      }
+      else if(roll == 1)
+      {
+        // Lost the tail, the next $ starts over
+        sentence.resize(sentence.size() / 2);
+        gga_intact &= i != 0;
+      }
+      capture.bytes += sentence;
+    }
+    if(second % 600 == 599)
+    {
+      // Some proprietary chatter nobody limits to 82 characters
+      capture.bytes += with_checksum("PUBX,00," + std::string(200, 'x'));
+    }
+    if(gga_intact)
+    {
+      gps_fix_t fix = {};
+      fix.time = time;
+      fix.latitude = degrees(latitude);
+      fix.longitude = degrees(longitude);
+      fix.altitude = altitude / 100 * 100;
+      fix.quality = 1;
+      fix.satellites = 8;
+      fix.hdop = 94;
+      capture.fixes.push_back(fix);
+    }
+  }
+  return capture;
+}
+
+// get_GPS_data as it was, minus writing past the buffer
+class LegacyParser
+{
+public:
+  bool feed(char cipher)
+  {
+    if(cipher == '$')
+    {
+      _checksum = 0;
+      _pointer = 0;
+      _receiving = true;
+    }
+    _sentence[_pointer] = cipher;
+    if(_pointer < sizeof(_sentence) - 1)
+    {
+      _pointer++;
+    }
+    if(cipher == '*')
+    {
+      _receiving = false;
+    }
+    else if(cipher != '$' && _receiving)
+    {
+      _checksum ^= cipher;
+    }
+    else if(cipher == 0x0A && _pointer >= 4)
+    {
+      const auto digit = [](char c) { return c > '9' ? c - 'A' + 10 : c - '0'; };
+      const unsigned char received = uint8_t((digit(_sentence[_pointer - 4]) << 4) + digit(_sentence[_pointer - 3]));
+      if(_checksum == received)
+      {
+        _sentence[_pointer] = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Tokenizes a copy and converts with atof, as one would
+  bool decode(gps_fix_t& fix) const
+  {
+    char copy[sizeof(_sentence)];
+    std::strcpy(copy, _sentence);
+    char* save = nullptr;
+    const char* fields[10] = {};
+    size_t count = 0;
+    // strtok_r skips empty fields, GGA has none up front
+    for(char* field = strtok_r(copy, ",", &save); field && count < 10; field = strtok_r(nullptr, ",", &save))
+    {
+      fields[count++] = field;
+    }
+    if(count < 10 || std::strcmp(fields[0] + 3, "GGA") != 0)
+    {
+      return false;
+    }
+    const double time = std::atof(fields[1]);
+    const int hms = int(time);
+    fix.time = uint32_t((hms / 10000 * 3600 + hms / 100 % 100 * 60 + hms % 100) * 1000 + std::lround((time - hms) * 1000));
+    const auto degrees = [](const char* text, const char* hemisphere) {
+      const double value = std::atof(text);
+      const double result = int(value / 100) + std::fmod(value, 100) / 60;
+      return int32_t(std::lround((*hemisphere == 'S' || *hemisphere == 'W' ? -result : result) * 1e7));
+    };
+    fix.latitude = degrees(fields[2], fields[3]);
+    fix.longitude = degrees(fields[4], fields[5]);
+    fix.quality = uint8_t(std::atoi(fields[6]));
+    fix.satellites = uint8_t(std::atoi(fields[7]));
+    fix.hdop = uint16_t(std::lround(std::atof(fields[8]) * 100));
+    fix.altitude = int32_t(std::lround(std::atof(fields[9]) * 1000));
+    return true;
+  }
+
+private:
+  char _sentence[128] = {};
+  size_t _pointer = 0;
+  unsigned char _checksum = 0;
+  bool _receiving = false;
+};
+
+bool same(const gps_fix_t& a, const gps_fix_t& b)
+{
+  return a.time == b.time && a.latitude == b.latitude && a.longitude == b.longitude && a.altitude == b.altitude
+    && a.quality == b.quality && a.satellites == b.satellites && a.hdop == b.hdop;
+}
+
+void print_fix(const char* label, const gps_fix_t& fix)
+{
+  std::fprintf(stderr, "  %s: time %u, %d %d, %dmm, quality %u, %u satellites, hdop %u\n", label, fix.time,
+               fix.latitude, fix.longitude, fix.altitude, fix.quality, fix.satellites, fix.hdop);
+}
+
+// The GGA fixes of the capture, through the new parser
+bool verify(const capture_t& capture)
+{
+  deets::nmea::Parser<> parser;
+  size_t index = 0;
+  for(const char c : capture.bytes)
+  {
+    if(!parser.feed(c))
+    {
+      continue;
+    }
+    gps_fix_t fix = {};
+    const auto sentence = parser.sentence();
+    if(!sentence.is("GGA") || !deets::nmea::decode(sentence, fix))
+    {
+      continue;
+    }
+    if(index == capture.fixes.size() || !same(fix, capture.fixes[index]))
+    {
+      std::fprintf(stderr, "GGA %zu decoded wrong\n", index);
+      print_fix("got", fix);
+      if(index < capture.fixes.size())
+      {
+        print_fix("sent", capture.fixes[index]);
+      }
+      return false;
+    }
+    ++index;
+  }
+  if(index != capture.fixes.size())
+  {
+    std::fprintf(stderr, "decoded %zu of %zu intact GGA sentences\n", index, capture.fixes.size());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  capture_t capture;
+  if(argc > 1)
+  {
+    std::ifstream file(argv[1], std::ios::binary);
+    if(!file)
+    {
+      std::fprintf(stderr, "can't read %s\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+    capture.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  else
+  {
+    capture = simulated_capture();
+    if(!verify(capture))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  deets::nmea::Parser<> parser;
+  gps_fix_t fix = {};
+  uint32_t fixes = 0;
+  const auto parse = [&](bool decode) {
+    parser = {};
+    fixes = 0;
+    for(const char c : capture.bytes)
+    {
+      if(parser.feed(c) && decode)
+      {
+        fixes += deets::nmea::decode(parser.sentence(), fix);
+      }
+    }
+    do_not_optimize(fix);
+  };
+  LegacyParser legacy;
+  uint32_t legacy_sentences = 0;
+  const auto parse_legacy = [&] {
+    legacy = {};
+    legacy_sentences = 0;
+    for(const char c : capture.bytes)
+    {
+      if(legacy.feed(c))
+      {
+        ++legacy_sentences;
+        legacy.decode(fix);
+      }
+    }
+    do_not_optimize(fix);
+  };
+
+  deets::bench::Suite suite("nmea", "", 5);
+  suite.run("feed", [&] { parse(false); });
+  suite.run("feed+decode", [&] { parse(true); });
+  suite.run("legacy+atof", parse_legacy);
+
+  std::printf("%zu bytes, %u sentences, %u checksum errors, %u overlong, %u malformed, %u GGA/RMC decoded\n",
+              capture.bytes.size(), parser.sentences, parser.checksum_errors, parser.overflows, parser.malformed, fixes);
+  std::printf("the legacy loop accepted %u sentences\n\n", legacy_sentences);
+  std::printf("%-12s %10s %10s\n", "parser", "capture", "per byte");
+  for(const auto& result : suite.results())
+  {
+    std::printf("%-12s %8.2fms %8.2fns\n", result.name.c_str(), result.median_ns / 1e6,
+                result.median_ns / double(capture.bytes.size()));
+  }
+  return EXIT_SUCCESS;
+}
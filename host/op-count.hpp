@@ -0,0 +1,88 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+// A number type that counts the arithmetic done with it,
+// and what that arithmetic costs on the Cortex-M3 of the
+// F103: libgcc's soft-float for float and double, SMULL
+// and 64 bit division for Q15.16.
+#include "fixed-point.hpp"
+
+#include <cmath>
+
+namespace far::junior::host {
+
+struct operations_t
+{
+  double additions;
+  double multiplications;
+  double divisions;
+  double comparisons;
+  double roots;
+};
+
+// What Counted computed since it was last reset
+inline operations_t counted;
+
+template<typename F>
+struct Counted
+{
+  constexpr Counted() = default;
+  constexpr explicit Counted(double v) : value(static_cast<F>(v)) {}
+
+  static Counted of(F v)
+  {
+    Counted result;
+    result.value = v;
+    return result;
+  }
+
+  explicit operator double() const { return double(value); }
+
+  Counted operator-() const { ++counted.additions; return of(-value); }
+  Counted& operator+=(Counted other) { ++counted.additions; value += other.value; return *this; }
+  Counted& operator-=(Counted other) { ++counted.additions; value -= other.value; return *this; }
+  Counted& operator*=(Counted other) { ++counted.multiplications; value *= other.value; return *this; }
+  Counted& operator/=(Counted other) { ++counted.divisions; value /= other.value; return *this; }
+
+  friend Counted operator+(Counted a, Counted b) { return a += b; }
+  friend Counted operator-(Counted a, Counted b) { return a -= b; }
+  friend Counted operator*(Counted a, Counted b) { return a *= b; }
+  friend Counted operator/(Counted a, Counted b) { return a /= b; }
+  friend bool operator<(Counted a, Counted b) { ++counted.comparisons; return a.value < b.value; }
+  friend bool operator>(Counted a, Counted b) { ++counted.comparisons; return a.value > b.value; }
+  friend bool operator<=(Counted a, Counted b) { ++counted.comparisons; return a.value <= b.value; }
+  friend bool operator>=(Counted a, Counted b) { ++counted.comparisons; return a.value >= b.value; }
+  friend bool operator==(Counted a, Counted b) { ++counted.comparisons; return a.value == b.value; }
+  friend bool operator!=(Counted a, Counted b) { ++counted.comparisons; return a.value != b.value; }
+
+  friend Counted sqrt(Counted a)
+  {
+    using std::sqrt;
+    using deets::fixed::sqrt;
+    ++counted.roots;
+    return of(sqrt(a.value));
+  }
+
+  F value = {};
+};
+
+// Cycles per operation on a Cortex-M3, loads and stores
+// included, rounded up
+constexpr operations_t SOFT_FLOAT_CYCLES = { 70, 60, 180, 35, 500 };
+constexpr operations_t SOFT_DOUBLE_CYCLES = { 110, 130, 500, 45, 1500 };
+constexpr operations_t Q15_16_CYCLES = { 3, 8, 140, 3, 450 };
+
+inline double cycles(const operations_t& operations, const operations_t& costs)
+{
+  return operations.additions * costs.additions + operations.multiplications * costs.multiplications
+    + operations.divisions * costs.divisions + operations.comparisons * costs.comparisons
+    + operations.roots * costs.roots;
+}
+
+inline double total(const operations_t& operations)
+{
+  return operations.additions + operations.multiplications + operations.divisions + operations.comparisons
+    + operations.roots;
+}
+
+} // namespace far::junior::host
@@ -0,0 +1,171 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Long holds on the pad.
+//
+// Sits on the pad for HOLD while the weather moves the
+// pressure and the sun warms the barometer, which then
+// reads high by PRESSURE_TEMPERATURE_COEFFICIENT, and
+// flies afterwards. The samples come at the rates of the
+// IMU and the barometer. Reports how far the ground
+// pressure is off at liftoff, and how far the one taken
+// at power on would be, and the heights LAUNCHED and
+// LANDED are detected at, which should be the height of
+// LAUNCH_PRESSURE_DIFFERENTIAL.
+//
+// Exits non-zero if the ground pressure is off by more
+// than TOLERANCE, or LAUNCHED or LANDED are more than
+// HEIGHT_TOLERANCE away from that height.
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "emulator/flight.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr double HOLD = 3600.0;
+// mbar
+constexpr double TOLERANCE = 0.1;
+// m
+constexpr double HEIGHT_TOLERANCE = 5.0;
+
+struct hold_t
+{
+  const char* name;
+  // mbar per hour
+  double drift;
+  // Degrees the barometer warms up over the hold
+  double warming;
+};
+
+const hold_t HOLDS[] = {
+  { "calm", 0, 0 },
+  { "falling weather", -3, 0 },
+  { "storm front", -8, 0 },
+  { "rising weather", 4, 0 },
+  { "sun on the pad", 0, 20 },
+  { "front and sun", -3, 20 },
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t, state to) override
+  {
+    current = to;
+    changed = true;
+  }
+
+  state current = state::IDLE;
+  bool changed = false;
+};
+
+struct result_t
+{
+  std::optional<double> ground_error;
+  double stale_error = 0;
+  std::optional<double> launched;
+  std::optional<double> landed;
+};
+
+result_t hold(const hold_t& hold)
+{
+  far::emulator::flight_profile_t profile;
+  profile.launch = HOLD;
+  far::emulator::SimulatedFlight flight(profile);
+  Recorder recorder;
+  JuniorRocketState machine(recorder);
+  const double coefficient = double(PRESSURE_TEMPERATURE_COEFFICIENT);
+
+  result_t result;
+  std::optional<double> power_on;
+  value_t pressure{}, temperature{}, acceleration{};
+  const int64_t step = 2000;
+  static_assert(IMU_PERIOD % step == 0 && MET_PERIOD % step == 0);
+  for(int64_t us = 0;; us += step)
+  {
+    const double t = us * 1e-6;
+    if(flight.over(t))
+    {
+      break;
+    }
+    const bool imu = us % IMU_PERIOD == 0;
+    const bool met = us % MET_PERIOD == 0;
+    if(!imu && !met)
+    {
+      continue;
+    }
+    const auto environment = flight.at(t);
+    const double pad = std::min(t, HOLD) / HOLD;
+    // The barometer as it reads
+    const double warming = hold.warming * pad;
+    const double offset = hold.drift * t / 3600.0 + coefficient * warming;
+    if(imu)
+    {
+      acceleration = value_t(environment.acceleration[2]);
+    }
+    if(met)
+    {
+      pressure = value_t(environment.pressure / 100.0 + offset);
+      temperature = value_t(environment.temperature + warming);
+      if(!power_on)
+      {
+        power_on = environment.pressure / 100.0 + offset;
+      }
+    }
+    recorder.changed = false;
+    machine.drive(timestamp_t(std::chrono::microseconds(us)), met ? std::optional(pressure) : std::nullopt,
+                  acceleration, value_t(1.0), temperature);
+    if(recorder.changed && recorder.current == state::LAUNCHED)
+    {
+      result.launched = environment.altitude;
+      // What the barometer reads on the pad right now
+      const double ground = 1013.25 + offset;
+      result.ground_error = double(*machine.ground_pressure()) - ground;
+      result.stale_error = *power_on - ground;
+    }
+    if(recorder.changed && recorder.current == state::LANDED)
+    {
+      result.landed = environment.altitude;
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+int main()
+{
+  // How high LAUNCH_PRESSURE_DIFFERENTIAL takes us
+  const double expected = far::emulator::altitude(101325.0 - 100.0 * double(LAUNCH_PRESSURE_DIFFERENTIAL), 101325.0);
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("Q15.16");
+#else
+  std::printf("float");
+#endif
+  std::printf(", %.0f minutes on the pad, the launch threshold is %.1fm up\n\n", HOLD / 60, expected);
+  std::printf("%-18s %12s %12s %10s %10s\n", "hold", "ground off", "at power on", "launched", "landed");
+  bool passed = true;
+  for(const auto& scenario : HOLDS)
+  {
+    const auto result = hold(scenario);
+    const auto height = [](const std::optional<double>& at) { return at ? *at : NAN; };
+    std::printf("%-18s %10.3fmb %10.3fmb %9.1fm %9.1fm\n", scenario.name,
+                result.ground_error ? *result.ground_error : NAN, result.stale_error, height(result.launched),
+                height(result.landed));
+    passed &= result.ground_error && std::abs(*result.ground_error) <= TOLERANCE;
+    passed &= result.launched && std::abs(*result.launched - expected) <= HEIGHT_TOLERANCE;
+    passed &= result.landed && std::abs(*result.landed - expected) <= HEIGHT_TOLERANCE;
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// What the sample pipeline of the sketch costs on the F103
+// in float and in Q15.16, and how much faster the latter
+// is.
+//
+// Flies a simulated flight through the stages control()
+// runs for each sample, as the Maple v0.1 reads them: the
+// MPU9250 counts scaled to g and deg/s, the attitude
+// update and vertical acceleration, the acceleration and
+// pressure filters and the altitude above the ground.
+// Then the arithmetic of drive(): the altitude Kalman
+// filter, in float in both builds, and the fit of the
+// pressure drop under the drouge, in double in both
+// builds. A number type that counts the arithmetic gives
+// the operations of each stage, op-count.hpp turns them
+// into cycles on a 72MHz Cortex-M3. Reports the worst
+// sample of each stage, and the share of the CPU the
+// pipeline takes at the IMU and barometer rates. The
+// rest of drive(), the state machine, is in wcet-drive.
+//
+// Exits non-zero if the Q15.16 pipeline isn't faster than
+// the float one.
+#include "altitude-estimator.hpp"
+#include "attitude-estimator.hpp"
+#include "farduino_constants.h"
+#include "junior-rocket-state.hpp"
+#include "op-count.hpp"
+#include "statistics.hpp"
+#include "emulator/flight.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace far::junior;
+using far::junior::host::Counted;
+using far::junior::host::counted;
+using far::junior::host::cycles;
+using far::junior::host::operations_t;
+using far::junior::host::Q15_16_CYCLES;
+using far::junior::host::SOFT_DOUBLE_CYCLES;
+using far::junior::host::SOFT_FLOAT_CYCLES;
+using far::junior::host::total;
+
+namespace {
+
+constexpr double CPU_HZ = 72e6;
+// The LSBs of the MPU9250 on the Maple v0.1, see
+// board-traits.hpp
+constexpr double ONE_G = 2048.0;
+constexpr double ONE_DEG_PER_SECOND = 16.4;
+constexpr double GROUND_PRESSURE = 1013.25;
+
+enum stage_t
+{
+  SCALING,
+  ATTITUDE,
+  ACCELERATION_FILTER,
+  PRESSURE_FILTER,
+  ALTITUDE,
+  KALMAN_IMU,
+  KALMAN_MET,
+  DROUGE_FIT,
+  STAGES,
+};
+
+const char* STAGE_NAMES[STAGES] = {
+  "scaling",
+  "attitude",
+  "acceleration filter",
+  "pressure filter",
+  "altitude",
+  "drive: Kalman, IMU",
+  "drive: Kalman, MET",
+  "drive: drouge fit",
+};
+
+// The IMU stages run for every IMU sample, the others
+// for every barometer sample. The drouge fit only while
+// measuring the pressure drop, it is counted for all.
+constexpr bool IMU_STAGE[STAGES] = { true, true, true, false, false, true, false, false };
+
+enum number_t
+{
+  VALUE,
+  FLOAT,
+  DOUBLE,
+};
+
+// What each stage computes in, value_t is what the build
+// picks
+constexpr number_t STAGE_NUMBER[STAGES] = { VALUE, VALUE, VALUE, VALUE, VALUE, FLOAT, FLOAT, DOUBLE };
+
+const operations_t& stage_costs(size_t stage, const operations_t& value_costs)
+{
+  switch(STAGE_NUMBER[stage])
+  {
+  case FLOAT:
+    return SOFT_FLOAT_CYCLES;
+  case DOUBLE:
+    return SOFT_DOUBLE_CYCLES;
+  default:
+    return value_costs;
+  }
+}
+
+// The worst sample of each stage
+template<typename F>
+std::array<operations_t, STAGES> count_operations(const operations_t& costs)
+{
+  using counted_t = Counted<F>;
+  using counted_float = Counted<float>;
+  using counted_double = Counted<double>;
+  using namespace deets::statistics;
+
+  deets::estimation::MahonyFilter<counted_t> attitude{ counted_t(ATTITUDE_KP), counted_t(ATTITUDE_KI),
+                                                      counted_t(ATTITUDE_GRAVITY_TOLERANCE) };
+  FilterChain<Hampel<counted_t, ACCELERATION_OUTLIER_WINDOW>, Biquad<counted_t>> acceleration_filter(
+    { counted_t(OUTLIER_SIGMAS), counted_t(ACCELERATION_OUTLIER_FLOOR) },
+    Biquad<counted_t>::low_pass(ACCELERATION_CUTOFF, 1e6f / IMU_PERIOD));
+  FilterChain<Hampel<counted_t, PRESSURE_OUTLIER_WINDOW>, MovingAverage<counted_t, PRESSURE_AVERAGE_WINDOW>>
+    pressure_filter({ counted_t(OUTLIER_SIGMAS), counted_t(PRESSURE_OUTLIER_FLOOR) }, {});
+  const counted_t one_g(ONE_G), one_deg_per_second(ONE_DEG_PER_SECOND), gravity(GRAVITY),
+    radians_per_degree(0.0174533), ground_pressure(GROUND_PRESSURE);
+  // As JuniorRocketState has them
+  deets::estimation::AltitudeKalmanFilter<counted_float> kalman{ counted_float(BAROMETRIC_ALTITUDE_VARIANCE),
+                                                                 counted_float(ACCELERATION_MEASUREMENT_VARIANCE),
+                                                                 counted_float(JERK_SPECTRAL_DENSITY) };
+  LeastSquaresFit<counted_double> fit;
+  const counted_float kalman_dt(IMU_PERIOD * 1e-6), kalman_gravity(GRAVITY), float_ground_pressure(GROUND_PRESSURE);
+  const counted_double confidence(PRESSURE_DROP_CONFIDENCE), window(PRESSURE_AVERAGE_WINDOW),
+    threshold(QUADRATIC_PRESSURE_DROP_COEFFICIENT);
+
+  std::array<operations_t, STAGES> worst = {};
+  const auto measure = [&](stage_t stage, auto&& work) {
+    counted = {};
+    work();
+    const auto& of_stage = stage_costs(stage, costs);
+    if(cycles(counted, of_stage) > cycles(worst[stage], of_stage))
+    {
+      worst[stage] = counted;
+    }
+  };
+
+  far::emulator::flight_profile_t profile;
+  profile.launch = 10.0;
+  far::emulator::SimulatedFlight flight(profile);
+  counted_t acc[3], omega[3];
+  for(int64_t us = 0; !flight.over(us * 1e-6); us += IMU_PERIOD)
+  {
+    const auto environment = flight.at(us * 1e-6);
+    counted_t raw_acc[3], raw_omega[3];
+    for(int i = 0; i < 3; ++i)
+    {
+      raw_acc[i] = counted_t(std::round(environment.acceleration[i] / GRAVITY * ONE_G));
+      raw_omega[i] = counted_t(std::round(environment.angular_velocity[i] * ONE_DEG_PER_SECOND));
+    }
+
+    counted_t dt, omega_radians[3];
+    measure(SCALING, [&] {
+      for(int i = 0; i < 3; ++i)
+      {
+        acc[i] = raw_acc[i] / one_g;
+        omega[i] = raw_omega[i] / one_deg_per_second;
+      }
+      // As update_attitude does it, through milliseconds
+      const int32_t elapsed = IMU_PERIOD;
+      dt = (counted_t(elapsed / 1000) + counted_t(elapsed % 1000) / counted_t(1000)) / counted_t(1000);
+      for(int i = 0; i < 3; ++i)
+      {
+        omega_radians[i] = omega[i] * radians_per_degree;
+      }
+    });
+    counted_t vertical;
+    measure(ATTITUDE, [&] {
+      attitude.update(acc, omega_radians, dt);
+      vertical = attitude.vertical_acceleration(acc) * gravity;
+      attitude.cos_tilt();
+    });
+    counted_t filtered;
+    measure(ACCELERATION_FILTER, [&] { filtered = acceleration_filter.update(vertical); });
+    // drive() takes the samples one by one, the IMU ones
+    // without a pressure
+    const counted_float acceleration{ double(filtered) };
+    measure(KALMAN_IMU, [&] {
+      kalman.predict(kalman_dt);
+      kalman.update_acceleration(acceleration - kalman_gravity);
+    });
+
+    if(us % MET_PERIOD < IMU_PERIOD)
+    {
+      const counted_t pressure(environment.pressure / 100.0);
+      measure(PRESSURE_FILTER, [&] { pressure_filter.update(pressure); });
+      measure(ALTITUDE, [&] { deets::estimation::fast_barometric_altitude(pressure, ground_pressure); });
+      const counted_float float_pressure(environment.pressure / 100.0);
+      measure(KALMAN_MET, [&] {
+        kalman.predict(kalman_dt);
+        kalman.update_altitude(deets::estimation::fast_barometric_altitude(float_pressure, float_ground_pressure));
+        kalman.update_acceleration(acceleration - kalman_gravity);
+      });
+      const counted_double since_start(us * 1e-6), fit_pressure(environment.pressure / 100.0);
+      measure(DROUGE_FIT, [&] {
+        fit.update(since_start, fit_pressure);
+        if(const auto quadratic = fit.quadratic())
+        {
+          const auto margin = confidence * sqrt(quadratic->variances[2] * window);
+          // Decided either way
+          (void)(quadratic->coefficients[2] > threshold + margin || quadratic->coefficients[2] < threshold - margin);
+        }
+      });
+    }
+  }
+  return worst;
+}
+
+} // namespace
+
+int main()
+{
+  const std::array<operations_t, STAGES> operations[2] = {
+    count_operations<float>(SOFT_FLOAT_CYCLES),
+    count_operations<deets::fixed::Fixed<16>>(Q15_16_CYCLES),
+  };
+  const operations_t costs[2] = { SOFT_FLOAT_CYCLES, Q15_16_CYCLES };
+
+  std::printf("%-20s %8s %9s %8s %9s %8s\n", "stage", "ops", "float", "ops", "Q15.16", "speedup");
+  double per_second[2] = {}, per_imu[2] = {}, per_met[2] = {}, not_fixed[2] = {};
+  for(size_t stage = 0; stage < STAGES; ++stage)
+  {
+    double stage_cycles[2];
+    for(size_t i = 0; i < 2; ++i)
+    {
+      stage_cycles[i] = cycles(operations[i][stage], stage_costs(stage, costs[i]));
+      (IMU_STAGE[stage] ? per_imu : per_met)[i] += stage_cycles[i];
+      if(STAGE_NUMBER[stage] != VALUE)
+      {
+        not_fixed[i] += stage_cycles[i] * 1e6 / (IMU_STAGE[stage] ? IMU_PERIOD : MET_PERIOD);
+      }
+    }
+    std::printf("%-20s %8.0f %9.0f %8.0f %9.0f %7.1fx\n", STAGE_NAMES[stage], total(operations[0][stage]),
+                stage_cycles[0], total(operations[1][stage]), stage_cycles[1], stage_cycles[0] / stage_cycles[1]);
+  }
+  for(size_t i = 0; i < 2; ++i)
+  {
+    per_second[i] = per_imu[i] * 1e6 / IMU_PERIOD + per_met[i] * 1e6 / MET_PERIOD;
+  }
+  std::printf("\n%-20s %18.0f %18.0f %7.1fx\n", "per IMU sample", per_imu[0], per_imu[1], per_imu[0] / per_imu[1]);
+  std::printf("%-20s %18.0f %18.0f %7.1fx\n", "per MET sample", per_met[0], per_met[1], per_met[0] / per_met[1]);
+  std::printf("%-20s %17.2f%% %17.2f%%\n", "of the CPU", 100 * per_second[0] / CPU_HZ, 100 * per_second[1] / CPU_HZ);
+  std::printf("\ncycles on a %.0fMHz Cortex-M3 in the worst sample of each stage\n", CPU_HZ / 1e6);
+  std::printf("drive() keeps the Kalman filter in float and the drouge fit in double in both builds,\n"
+              "soft-float on the F103: %.2f%% of the CPU, %.0f%% of the Q15.16 pipeline\n",
+              100 * not_fixed[1] / CPU_HZ, 100 * not_fixed[1] / per_second[1]);
+  if(per_second[1] >= per_second[0])
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Runs the pyro sequencer against a mock GPIO that
+// timestamps every edge and a mock timer whose interrupt
+// comes up to MAX_ISR_LATENCY late.
+//
+// Each scenario is a sequence of states, entered at the
+// time of a sample and learned about a bit later, with the
+// loop blocked in between for as long as a stalled bus or
+// an SD card sync take. The edges have to come at the expected
+// time, give or take the interrupt latency, and never in a
+// state the channel isn't armed in.
+//
+// The clock starts right before the 32 bit ticks wrap.
+// Exits non-zero on any deviation.
+#include "pyro-sequencer.hpp"
+#include "state-names.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace far::junior;
+using far::junior::host::name;
+
+namespace {
+
+constexpr uint32_t MAX_ISR_LATENCY = 5;
+constexpr size_t RANDOM_RUNS = 2000;
+
+struct edge_t
+{
+  uint32_t at;
+  uint8_t channel;
+  bool on;
+};
+
+class MockHardware
+{
+public:
+  void write(uint8_t channel, bool on)
+  {
+    edges.push_back({ MonotonicClock::ticks(), channel, on });
+    levels[channel] = on;
+  }
+
+  void schedule(uint32_t ticks)
+  {
+    deadline = ticks;
+    armed = true;
+  }
+
+  void cancel()
+  {
+    armed = false;
+  }
+
+  void disable_interrupts()
+  {
+    masked = true;
+  }
+
+  void enable_interrupts()
+  {
+    masked = false;
+  }
+
+  std::vector<edge_t> edges;
+  std::array<bool, PYRO_CHANNELS> levels = {};
+  uint32_t deadline = 0;
+  bool armed = false;
+  bool masked = false;
+};
+
+using sequencer_t = PyroSequencer<MockHardware>;
+
+// Lets time pass, with the timer interrupt coming
+// when it is due plus some latency
+class Simulation
+{
+public:
+  Simulation(MockHardware& hardware, sequencer_t& sequencer, unsigned seed)
+    : _hardware(hardware)
+    , _sequencer(sequencer)
+    , _rng(seed)
+    , _latency(0, MAX_ISR_LATENCY)
+  {}
+
+  uint32_t now() const
+  {
+    return MonotonicClock::ticks();
+  }
+
+  void pass(uint32_t duration)
+  {
+    const uint32_t until = now() + duration;
+    while(_hardware.armed && !_hardware.masked)
+    {
+      const uint32_t at = _hardware.deadline + _latency(_rng);
+      if(int32_t(at - until) > 0)
+      {
+        break;
+      }
+      if(int32_t(at - now()) > 0)
+      {
+        MonotonicClock::advance(duration_t(at - now()));
+      }
+      _hardware.armed = false;
+      _sequencer.run(now());
+    }
+    MonotonicClock::advance(duration_t(int32_t(until - now())));
+  }
+
+private:
+  MockHardware& _hardware;
+  sequencer_t& _sequencer;
+  std::mt19937 _rng;
+  std::uniform_int_distribution<uint32_t> _latency;
+};
+
+struct step_t
+{
+  state to;
+  // Between the sample and drive() telling the sequencer
+  uint32_t lag;
+  // The loop is busy this long afterwards
+  uint32_t blocked;
+};
+
+struct expected_t
+{
+  uint8_t channel;
+  bool on;
+  // From the start of the scenario
+  uint32_t at;
+};
+
+struct scenario_t
+{
+  const char* name;
+  // TEST_RULES instead of the flight's PYRO_RULES
+  bool test_rules;
+  std::array<pyro_arming_t, PYRO_CHANNELS> arming;
+  std::vector<step_t> steps;
+  std::vector<expected_t> expected;
+};
+
+// A delayed window on channel 1 while coasting, channel 2
+// set up for a state it isn't armed in
+constexpr pyro_rule_t TEST_RULES[] = {
+  { state::COASTING, 1, std::chrono::milliseconds(250), std::chrono::milliseconds(100) },
+  { state::LAUNCHED, 2, duration_t::zero(), std::chrono::milliseconds(100) },
+};
+constexpr std::array<pyro_arming_t, PYRO_CHANNELS> TEST_ARMING = {
+  0,
+  armed_in({ state::COASTING }),
+  armed_in({ state::COASTING }),
+  0,
+};
+
+std::vector<scenario_t> scenarios(uint32_t lag)
+{
+  return {
+    {
+      "separation, stall afterwards", false, PYRO_ARMING,
+      { { state::BURNOUT, lag, 8000 }, { state::SEPARATION, lag, 8000 }, { state::COASTING, lag, 1500000 },
+        { state::FALLING_, lag, 600000 }, },
+      // Entered lag + 8ms in, on as soon as we know,
+      // off 500ms after it was entered
+      { { 0, true, 8000 + 2 * lag }, { 0, false, 508000 + lag } },
+    },
+    {
+      "separation inhibited", false, PYRO_ARMING,
+      { { state::BURNOUT, lag, 8000 }, { state::SEPARATION_INHIBITED, lag, 8000 }, { state::COASTING, lag, 1000000 } },
+      {},
+    },
+    {
+      "disarmed while on", false, PYRO_ARMING,
+      { { state::SEPARATION, lag, 8000 }, { state::COASTING, lag, 92000 }, { state::FALLING_, lag, 600000 } },
+      { { 0, true, lag }, { 0, false, 100000 + 3 * lag } },
+    },
+    {
+      "delayed window, SD sync", true, TEST_ARMING,
+      { { state::COASTING, lag, 2000000 } },
+      { { 1, true, 250000 }, { 1, false, 350000 } },
+    },
+    {
+      "disarmed before the window", true, TEST_ARMING,
+      { { state::COASTING, lag, 100000 }, { state::FALLING_, lag, 1000000 } },
+      {},
+    },
+    {
+      "rule in an unarmed state", true, TEST_ARMING,
+      { { state::LAUNCHED, lag, 1000000 } },
+      {},
+    },
+  };
+}
+
+struct result_t
+{
+  bool passed = true;
+  uint32_t worst_deviation = 0;
+  size_t edges = 0;
+};
+
+result_t fly(const scenario_t& scenario, unsigned seed, bool verbose)
+{
+  MockHardware hardware;
+  sequencer_t sequencer = scenario.test_rules ? sequencer_t(hardware, TEST_RULES, scenario.arming)
+                                              : sequencer_t(hardware, PYRO_RULES, scenario.arming);
+  Simulation simulation(hardware, sequencer, seed);
+
+  result_t result;
+  const uint32_t start = simulation.now();
+  state current = state::IDLE;
+  // Where each state was current, to check the arming
+  std::vector<std::pair<uint32_t, state>> states = { { start, current } };
+  for(const auto& step : scenario.steps)
+  {
+    const uint32_t entered = simulation.now();
+    simulation.pass(step.lag);
+    sequencer.state_changed(entered, simulation.now(), step.to);
+    current = step.to;
+    states.push_back({ simulation.now(), current });
+    simulation.pass(step.blocked);
+  }
+
+  const auto state_at = [&](uint32_t at) {
+    state s = states.front().second;
+    for(const auto& change : states)
+    {
+      if(int32_t(at - change.first) >= 0)
+      {
+        s = change.second;
+      }
+    }
+    return s;
+  };
+
+  result.edges = hardware.edges.size();
+  if(hardware.edges.size() != scenario.expected.size())
+  {
+    std::printf("  %s: %zu edges instead of %zu\n", scenario.name, hardware.edges.size(), scenario.expected.size());
+    result.passed = false;
+  }
+  for(size_t i = 0; i < std::min(hardware.edges.size(), scenario.expected.size()); ++i)
+  {
+    const auto& edge = hardware.edges[i];
+    const auto& expected = scenario.expected[i];
+    const uint32_t at = edge.at - start;
+    const int32_t deviation = int32_t(at - expected.at);
+    result.worst_deviation = std::max(result.worst_deviation, uint32_t(std::abs(deviation)));
+    if(edge.channel != expected.channel || edge.on != expected.on || deviation < 0
+       || uint32_t(deviation) > MAX_ISR_LATENCY)
+    {
+      std::printf("  %s: channel %u %s at %uus, expected channel %u %s at %uus\n", scenario.name, edge.channel,
+                  edge.on ? "on" : "off", at, expected.channel, expected.on ? "on" : "off", expected.at);
+      result.passed = false;
+    }
+    if(edge.on && !(scenario.arming[edge.channel] & (pyro_arming_t(1) << unsigned(state_at(edge.at)))))
+    {
+      std::printf("  %s: channel %u on in %s\n", scenario.name, edge.channel, name(state_at(edge.at)));
+      result.passed = false;
+    }
+  }
+  if(std::any_of(hardware.levels.begin(), hardware.levels.end(), [](bool on) { return on; }))
+  {
+    std::printf("  %s: a channel is still on\n", scenario.name);
+    result.passed = false;
+  }
+  if(verbose)
+  {
+    std::printf("%-30s", scenario.name);
+    for(const auto& edge : hardware.edges)
+    {
+      std::printf(" %u:%s@%.3fms", edge.channel, edge.on ? "on" : "off", (edge.at - start) / 1000.0);
+    }
+    std::printf("%s\n", hardware.edges.empty() ? " no edges" : "");
+  }
+  return result;
+}
+
+} // namespace
+
+int main()
+{
+  // Right before the 32 bit ticks wrap
+  MonotonicClock::advance(duration_t((int64_t(1) << 32) - 300000));
+
+  bool passed = true;
+  uint32_t worst = 0;
+  size_t edges = 0;
+  std::printf("lag 2ms, the interrupt up to %uus late:\n", MAX_ISR_LATENCY);
+  for(const auto& scenario : scenarios(2000))
+  {
+    const auto result = fly(scenario, 1, true);
+    passed &= result.passed;
+    worst = std::max(worst, result.worst_deviation);
+    edges += result.edges;
+  }
+
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<uint32_t> lag(0, 7999);
+  for(size_t run = 0; run < RANDOM_RUNS; ++run)
+  {
+    MonotonicClock::advance(duration_t(rng() % 1000000));
+    for(const auto& scenario : scenarios(lag(rng)))
+    {
+      const auto result = fly(scenario, unsigned(run), false);
+      passed &= result.passed;
+      worst = std::max(worst, result.worst_deviation);
+      edges += result.edges;
+    }
+  }
+  std::printf("\n%zu runs with random lags, %zu edges, at most %uus off\n", RANDOM_RUNS + 1, edges, worst);
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Whether the optional tasks of the Scheduler come back
+// after the loop blocked once.
+//
+// Runs the tasks of the sketch with their periods and
+// typical execution times against the simulated
+// MonotonicClock, polled or with the control task of the
+// data ready interrupts and the dual core build. Once a
+// required task blocks, for a stall on the bus or a sensor
+// that hangs. After that every pass is normal again.
+// Reports the runs and sheds of each task before and after
+// the overrun, the deadline misses of the required tasks,
+// and how long each optional task took to run again.
+//
+// Exits non-zero if an optional task doesn't run within
+// RECOVERY after its first release past the overrun, or
+// then doesn't run for most of its releases, or if a
+// required task misses a deadline after the recovery.
+#include "farduino_constants.h"
+#include "monotonic-clock.hpp"
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace far::junior;
+using deets::scheduling::task_kind;
+using duration_t = MonotonicClock::duration;
+using scheduler_t = deets::scheduling::Scheduler<MonotonicClock, 8>;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr duration_t OVERRUN_AT = 20s;
+constexpr duration_t DURATION = 60s;
+constexpr duration_t RECOVERY = 2s;
+// A pass without a due task still takes a bit
+constexpr duration_t IDLE_PASS = 100us;
+// Of the releases after the recovery
+constexpr double MIN_RUNS = 0.9;
+
+enum task_t
+{
+  IMU,
+  MET,
+  CONTROL,
+  IMU_TELEMETRY,
+  MET_TELEMETRY,
+  GPS,
+  SD,
+  PERF,
+  SONG,
+  TASKS,
+};
+
+struct task_setup_t
+{
+  const char* name;
+  duration_t period;
+  task_kind kind;
+  duration_t execution;
+};
+
+const task_setup_t TASK_SETUP[TASKS] = {
+  { "imu", std::chrono::microseconds(IMU_PERIOD), task_kind::REQUIRED, 700us },
+  { "met", std::chrono::microseconds(MET_PERIOD), task_kind::REQUIRED, 500us },
+  // Reads and processes the samples that arrived
+  { "control", std::chrono::microseconds(IMU_PERIOD), task_kind::REQUIRED, 1200us },
+  { "imu telemetry", std::chrono::microseconds(IMU_TELEMETRY_PERIOD), task_kind::OPTIONAL, 2300us },
+  { "met telemetry", std::chrono::microseconds(MET_TELEMETRY_PERIOD), task_kind::REQUIRED, 1600us },
+  { "gps", std::chrono::microseconds(GPS_PERIOD), task_kind::REQUIRED, 400us },
+  { "sd", std::chrono::microseconds(SD_SYNC_PERIOD), task_kind::OPTIONAL, 3000us },
+  { "perf", std::chrono::microseconds(PERF_PERIOD), task_kind::OPTIONAL, 1500us },
+  { "song", std::chrono::microseconds(SONG_PERIOD), task_kind::OPTIONAL, 20us },
+};
+
+struct overrun_t
+{
+  const char* name;
+  task_t task;
+  duration_t length;
+};
+
+const overrun_t OVERRUNS[] = {
+  { "hung sensor", MET, 15s },
+  { "stalled bus", IMU, 400ms },
+  { "hung sensor", CONTROL, 15s },
+  { "stalled bus", CONTROL, 400ms },
+};
+
+struct configuration_t
+{
+  const char* name;
+  std::vector<task_t> tasks;
+};
+
+// See setup_tasks() in the sketch
+const configuration_t CONFIGURATIONS[] = {
+  { "polled", { IMU, MET, IMU_TELEMETRY, MET_TELEMETRY, GPS, SD, PERF, SONG } },
+  { "data ready", { CONTROL, IMU_TELEMETRY, MET_TELEMETRY, GPS, SD, PERF, SONG } },
+};
+
+// What the task functions see, they can't capture
+const overrun_t* current_overrun = nullptr;
+MonotonicClock::time_point overrun_at;
+bool overran = false;
+// The first run after the overrun
+MonotonicClock::time_point back[TASKS];
+
+template<task_t Task>
+void work()
+{
+  const auto now = MonotonicClock::now();
+  if(overran && back[Task] == MonotonicClock::time_point{})
+  {
+    back[Task] = now;
+  }
+  if(!overran && current_overrun->task == Task && now >= overrun_at)
+  {
+    overran = true;
+    MonotonicClock::advance(current_overrun->length);
+    return;
+  }
+  MonotonicClock::advance(TASK_SETUP[Task].execution);
+}
+
+using function_t = void (*)();
+const function_t FUNCTIONS[TASKS] = {
+  work<IMU>, work<MET>, work<CONTROL>, work<IMU_TELEMETRY>, work<MET_TELEMETRY>, work<GPS>, work<SD>, work<PERF>, work<SONG>,
+};
+
+void pass(scheduler_t& scheduler)
+{
+  if(!scheduler.run_once())
+  {
+    MonotonicClock::advance(IDLE_PASS);
+  }
+}
+
+// Drives the scheduler until the given time
+void run_until(scheduler_t& scheduler, MonotonicClock::time_point until)
+{
+  while(MonotonicClock::now() < until)
+  {
+    pass(scheduler);
+  }
+}
+
+// In the order the scheduler keeps them
+const task_setup_t& setup_of(const scheduler_t& scheduler, size_t i)
+{
+  return *std::find_if(TASK_SETUP, TASK_SETUP + TASKS,
+                       [&](const task_setup_t& setup) { return setup.name == scheduler.name(i); });
+}
+
+} // namespace
+
+int main()
+{
+  bool passed = true;
+  for(const auto& configuration : CONFIGURATIONS)
+  for(const auto& overrun : OVERRUNS)
+  {
+    const auto& tasks = configuration.tasks;
+    if(std::find(tasks.begin(), tasks.end(), overrun.task) == tasks.end())
+    {
+      continue;
+    }
+    scheduler_t scheduler;
+    for(const auto task : tasks)
+    {
+      scheduler.add(TASK_SETUP[task].name, FUNCTIONS[task], TASK_SETUP[task].period, TASK_SETUP[task].kind);
+    }
+    const auto start = MonotonicClock::now();
+    current_overrun = &overrun;
+    overrun_at = start + OVERRUN_AT;
+    overran = false;
+    std::fill(back, back + TASKS, MonotonicClock::time_point{});
+
+    run_until(scheduler, overrun_at);
+    scheduler_t::statistics_t before[TASKS], recovered[TASKS];
+    for(size_t i = 0; i < scheduler.size(); ++i)
+    {
+      before[i] = scheduler.statistics(i);
+    }
+    while(!overran)
+    {
+      pass(scheduler);
+    }
+    const auto overrun_end = MonotonicClock::now();
+    run_until(scheduler, overrun_end + RECOVERY);
+    // Not reset_statistics(), the longest executions have
+    // to stay what they are
+    for(size_t i = 0; i < scheduler.size(); ++i)
+    {
+      recovered[i] = scheduler.statistics(i);
+    }
+    run_until(scheduler, start + DURATION);
+    const auto after = std::chrono::duration<double>(start + DURATION - (overrun_end + RECOVERY)).count();
+
+    std::printf("%s: %s, %.1fs in %s at %.0fs\n\n", configuration.name, overrun.name,
+                std::chrono::duration<double>(overrun.length).count(), TASK_SETUP[overrun.task].name,
+                std::chrono::duration<double>(OVERRUN_AT).count());
+    std::printf("%-14s %8s %8s %8s %8s %8s %8s %10s\n", "task", "runs", "shed", "runs", "expected", "shed", "missed",
+                "back");
+    for(size_t i = 0; i < scheduler.size(); ++i)
+    {
+      const auto& setup = setup_of(scheduler, i);
+      const auto runs = scheduler.statistics(i).runs - recovered[i].runs;
+      const auto shed = scheduler.statistics(i).shed - recovered[i].shed;
+      const auto missed = scheduler.statistics(i).deadline_misses - recovered[i].deadline_misses;
+      const auto task = size_t(&setup - TASK_SETUP);
+      const double expected = std::floor(after / std::chrono::duration<double>(setup.period).count());
+      std::printf("%-14s %8lu %8lu %8lu %8.0f %8lu %8lu", setup.name, (unsigned long)before[i].runs,
+                  (unsigned long)before[i].shed, (unsigned long)runs, expected, (unsigned long)shed,
+                  (unsigned long)missed);
+      if(setup.kind == task_kind::REQUIRED)
+      {
+        std::printf(" %10s\n", "-");
+        passed &= missed == 0;
+        continue;
+      }
+      const bool is_back = back[task] != MonotonicClock::time_point{}
+        && back[task] - overrun_end <= setup.period + RECOVERY;
+      if(back[task] != MonotonicClock::time_point{})
+      {
+        std::printf(" %8.0fms\n", std::chrono::duration<double, std::milli>(back[task] - overrun_end).count());
+      }
+      else
+      {
+        std::printf(" %10s\n", "never");
+      }
+      passed &= is_back && runs >= MIN_RUNS * expected;
+    }
+    std::printf("\n");
+  }
+  std::printf("runs and shed before the overrun, and from %.0fs after it\n",
+              std::chrono::duration<double>(RECOVERY).count());
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The sensor reads of a pass through loop(), once the way
+// the Adafruit drivers do them and once with the bursts of
+// sensor-drivers.hpp, against a mock bus that counts the
+// transactions and bytes. Prints what that costs on the
+// bus at 100kHz and 400kHz and on the CPU of the host.
+//
+// Fails if the compensation doesn't reproduce the example
+// of the BMP280 datasheet.
+#include "junior-rocket-state.hpp"
+#include "sensor-drivers.hpp"
+#include "microbench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using far::junior::value_t;
+using deets::bench::do_not_optimize;
+
+namespace {
+
+constexpr uint8_t BMP280_ADDRESS = 0x76;
+constexpr uint8_t BNO055_ADDRESS = 0x28;
+constexpr value_t GROUND_PRESSURE = static_cast<value_t>(1013.25);
+
+// The register file of each address. Reads and writes
+// are counted the way they go over the wire: START, the
+// address, the data, a repeated START or STOP.
+class MockBus
+{
+public:
+  bool write(uint8_t address, const uint8_t* data, size_t size)
+  {
+    ++transactions;
+    bytes += 1 + size;
+    bits += 1 + 9 * (1 + size) + 1;
+    if(size)
+    {
+      std::memcpy(&_registers[address][data[0]], data + 1, std::min<size_t>(size - 1, 255 - data[0]));
+    }
+    return true;
+  }
+
+  bool read(uint8_t address, uint8_t reg, uint8_t* data, size_t size)
+  {
+    ++transactions;
+    bytes += 3 + size;
+    bits += 1 + 9 * 2 + 1 + 9 * (1 + size) + 1;
+    std::memcpy(data, &_registers[address][reg], size);
+    return true;
+  }
+
+  void set(uint8_t address, uint8_t reg, const uint8_t* data, size_t size)
+  {
+    std::memcpy(&_registers[address][reg], data, size);
+  }
+
+  void reset_counters()
+  {
+    transactions = bytes = bits = 0;
+  }
+
+  uint64_t transactions = 0;
+  uint64_t bytes = 0;
+  uint64_t bits = 0;
+
+private:
+  std::array<std::array<uint8_t, 256>, 128> _registers{};
+};
+
+// The example of the datasheet, section 3.12: the
+// calibration, the readings and what the integer
+// compensation turns them into, 25.08 degrees and
+// 100653.25Pa. The floating point one gets 100653.26Pa.
+const uint16_t EXAMPLE_CALIBRATION[12] = {
+  27504, 26435, uint16_t(-1000), 36477, uint16_t(-10685), 3024, 2855, 140, uint16_t(-7), 15500, uint16_t(-14600), 6000,
+};
+constexpr int32_t EXAMPLE_ADC_T = 519888;
+constexpr int32_t EXAMPLE_ADC_P = 415148;
+constexpr int32_t EXAMPLE_TEMPERATURE = 2508;
+constexpr uint32_t EXAMPLE_PRESSURE = 25767233;
+
+void load_example(MockBus& bus)
+{
+  uint8_t calibration[24];
+  for(size_t i = 0; i < 12; ++i)
+  {
+    calibration[2 * i] = uint8_t(EXAMPLE_CALIBRATION[i]);
+    calibration[2 * i + 1] = uint8_t(EXAMPLE_CALIBRATION[i] >> 8);
+  }
+  bus.set(BMP280_ADDRESS, 0x88, calibration, sizeof(calibration));
+  const uint8_t chip_id = 0x58;
+  bus.set(BMP280_ADDRESS, 0xD0, &chip_id, 1);
+  const uint8_t data[6] = {
+    uint8_t(EXAMPLE_ADC_P >> 12), uint8_t(EXAMPLE_ADC_P >> 4), uint8_t(EXAMPLE_ADC_P << 4),
+    uint8_t(EXAMPLE_ADC_T >> 12), uint8_t(EXAMPLE_ADC_T >> 4), uint8_t(EXAMPLE_ADC_T << 4),
+  };
+  bus.set(BMP280_ADDRESS, 0xF7, data, sizeof(data));
+  // 9.81m/s^2 up, a bit of rotation and the earth's field
+  const int16_t vectors[9] = { 3, -7, 981, 350, -80, 640, 16, -8, 4 };
+  uint8_t imu[18];
+  for(size_t i = 0; i < 9; ++i)
+  {
+    imu[2 * i] = uint8_t(vectors[i]);
+    imu[2 * i + 1] = uint8_t(uint16_t(vectors[i]) >> 8);
+  }
+  bus.set(BNO055_ADDRESS, 0x08, imu, sizeof(imu));
+}
+
+// How the Adafruit drivers go about it: a transaction per
+// quantity, the temperature again for every pressure and
+// floats all the way.
+class AdafruitStyle
+{
+public:
+  AdafruitStyle(MockBus& bus, const deets::sensors::Bmp280Calibration& calibration)
+    : _bus(bus)
+    , _calibration(calibration)
+  {}
+
+  float readTemperature()
+  {
+    _t_fine = _calibration.t_fine(read24(0xFA) >> 4);
+    return float(deets::sensors::Bmp280Calibration::temperature(_t_fine)) / 100;
+  }
+
+  float readPressure()
+  {
+    readTemperature();
+    return float(_calibration.pressure(read24(0xF7) >> 4, _t_fine)) / 256;
+  }
+
+  float readAltitude(float sea_level_hpa)
+  {
+    const float pressure = readPressure() / 100;
+    return 44330 * (1.0f - std::pow(pressure / sea_level_hpa, 0.1903f));
+  }
+
+  // One of the three vectors, m/s^2, uT or deg/s
+  void getEvent(uint8_t reg, float scale, float* vector)
+  {
+    uint8_t data[6];
+    _bus.read(BNO055_ADDRESS, reg, data, sizeof(data));
+    for(size_t i = 0; i < 3; ++i)
+    {
+      vector[i] = float(int16_t(data[2 * i] | (data[2 * i + 1] << 8))) / scale;
+    }
+  }
+
+private:
+  int32_t read24(uint8_t reg)
+  {
+    uint8_t data[3];
+    _bus.read(BMP280_ADDRESS, reg, data, sizeof(data));
+    return (int32_t(data[0]) << 16) | (int32_t(data[1]) << 8) | data[2];
+  }
+
+  MockBus& _bus;
+  deets::sensors::Bmp280Calibration _calibration;
+  int32_t _t_fine = 0;
+};
+
+struct sample_t
+{
+  value_t temperature;
+  value_t pressure;
+  value_t altitude;
+  value_t vectors[9];
+};
+
+bool check_example(deets::sensors::Bmp280<MockBus>& bmp280)
+{
+  deets::sensors::bmp280_measurement_t measurement;
+  if(!bmp280.read(measurement))
+  {
+    std::fprintf(stderr, "reading the example failed\n");
+    return false;
+  }
+  if(measurement.temperature != EXAMPLE_TEMPERATURE || measurement.pressure != EXAMPLE_PRESSURE)
+  {
+    std::fprintf(stderr, "example compensated to %d and %u instead of %d and %u\n",
+                 measurement.temperature, measurement.pressure, EXAMPLE_TEMPERATURE, EXAMPLE_PRESSURE);
+    return false;
+  }
+  return true;
+}
+
+// Worst deviation of fast_barometric_altitude from
+// barometric_altitude up to the given height
+double altitude_error(double height)
+{
+  double worst = 0;
+  for(double h = 0; h <= height; h += 10)
+  {
+    const double pressure = 1013.25 * std::pow(1 - h / 44330, 5.255);
+    const double fast = double(deets::estimation::fast_barometric_altitude(
+      static_cast<value_t>(pressure), GROUND_PRESSURE));
+    worst = std::max(worst, std::abs(fast - deets::estimation::barometric_altitude(pressure, 1013.25)));
+  }
+  return worst;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  MockBus bus;
+  load_example(bus);
+
+  deets::sensors::Bmp280<MockBus> bmp280(bus, BMP280_ADDRESS);
+  deets::sensors::Bno055<MockBus> bno055(bus, BNO055_ADDRESS);
+  if(!bmp280.begin() || !check_example(bmp280))
+  {
+    return EXIT_FAILURE;
+  }
+  AdafruitStyle adafruit(bus, bmp280.calibration());
+
+  deets::bench::Suite suite("sensors", argc > 1 ? argv[1] : "");
+  sample_t sample{};
+  struct layer_t
+  {
+    const char* name;
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t bits;
+  };
+  std::vector<layer_t> layers;
+  const auto measure = [&](const char* name, auto body) {
+    const auto before = suite.results().size();
+    suite.run(name, body);
+    if(suite.results().size() == before)
+    {
+      return;
+    }
+    bus.reset_counters();
+    body();
+    layers.push_back({ name, bus.transactions, bus.bytes, bus.bits });
+  };
+
+  const auto bmp280_adafruit = [&] {
+    sample.temperature = value_t(adafruit.readTemperature());
+    sample.pressure = value_t(adafruit.readPressure() / 100.0f);
+    sample.altitude = value_t(adafruit.readAltitude(float(GROUND_PRESSURE)));
+    do_not_optimize(sample);
+  };
+  const auto bmp280_burst = [&] {
+    deets::sensors::bmp280_measurement_t measurement;
+    if(!bmp280.read(measurement))
+    {
+      return;
+    }
+    sample.temperature = deets::sensors::scaled<value_t>(measurement.temperature, 100);
+    sample.pressure = deets::sensors::scaled<value_t>(int32_t(measurement.pressure), 25600);
+    sample.altitude = deets::estimation::fast_barometric_altitude(sample.pressure, GROUND_PRESSURE);
+    do_not_optimize(sample);
+  };
+  const auto bno055_adafruit = [&] {
+    float vectors[9];
+    adafruit.getEvent(0x0E, 16, vectors + 3);
+    adafruit.getEvent(0x14, 16, vectors + 6);
+    adafruit.getEvent(0x08, 100, vectors);
+    for(size_t i = 0; i < 9; ++i)
+    {
+      sample.vectors[i] = value_t(vectors[i]);
+    }
+    do_not_optimize(sample);
+  };
+  const auto bno055_burst = [&] {
+    deets::sensors::bno055_vectors_t vectors;
+    bno055.read(vectors);
+    for(size_t i = 0; i < 3; ++i)
+    {
+      sample.vectors[i] = deets::sensors::scaled<value_t>(vectors.acceleration[i], 100);
+      sample.vectors[3 + i] = deets::sensors::scaled<value_t>(vectors.magnetic[i], 16);
+      sample.vectors[6 + i] = deets::sensors::scaled<value_t>(vectors.angular_velocity[i], 16);
+    }
+    do_not_optimize(sample);
+  };
+
+  measure("bmp280/adafruit", bmp280_adafruit);
+  measure("bmp280/burst", bmp280_burst);
+  measure("bno055/adafruit", bno055_adafruit);
+  measure("bno055/burst", bno055_burst);
+  measure("pass/adafruit", [&] { bmp280_adafruit(); bno055_adafruit(); });
+  measure("pass/burst", [&] { bmp280_burst(); bno055_burst(); });
+
+#ifdef FARDUINO_FIXED_POINT
+  std::printf("value_t: Q15.16\n\n");
+#else
+  std::printf("value_t: float\n\n");
+#endif
+  std::printf("%-16s %12s %6s %12s %12s %10s\n", "reads", "transactions", "bytes", "bus @100kHz", "bus @400kHz", "host cpu");
+  for(size_t i = 0; i < layers.size(); ++i)
+  {
+    const auto& layer = layers[i];
+    std::printf("%-16s %12llu %6llu %10lluus %10lluus %8.0fns\n", layer.name,
+                (unsigned long long)layer.transactions, (unsigned long long)layer.bytes,
+                (unsigned long long)(layer.bits * 10), (unsigned long long)(layer.bits * 10 / 4),
+                suite.results()[i].median_ns);
+  }
+  std::printf("\nfast_barometric_altitude is off by at most %.3fm up to 1000m, %.3fm up to 3000m\n",
+              altitude_error(1000), altitude_error(3000));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// SpscQueue between two threads, the way the sketch uses
+// it between the cores.
+//
+// A producer thread pushes numbered items through a small
+// queue, so it wraps and fills up all the time, while a
+// consumer thread pops them. Every item carries its number
+// twice, once inverted, so an item read before it was
+// completely written shows. Once the producer waits for
+// room, and every item has to arrive in order. Once it
+// drops what doesn't fit, as the ISR does, and what
+// arrives has to be in order, and with dropped() add up to
+// what was pushed. The consumer peeks now and then, and
+// has to pop what it peeked.
+//
+// Build with -fsanitize=thread to have the races looked
+// for as well.
+//
+// Exits non-zero if an item is lost, duplicated, out of
+// order or torn.
+#include "spsc-queue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+constexpr uint64_t ITEMS = 1000000;
+constexpr size_t QUEUE_SIZE = 8;
+
+struct item_t
+{
+  uint64_t number;
+  uint64_t inverted;
+};
+
+using queue_t = deets::concurrency::SpscQueue<item_t, QUEUE_SIZE>;
+
+struct outcome_t
+{
+  uint64_t received = 0;
+  uint64_t out_of_order = 0;
+  uint64_t torn = 0;
+  uint64_t peeked_other = 0;
+  uint64_t dropped = 0;
+};
+
+outcome_t run(bool wait_for_room)
+{
+  queue_t queue;
+  std::atomic<bool> done{ false };
+  outcome_t outcome;
+
+  std::thread producer([&] {
+    for(uint64_t number = 0; number < ITEMS; ++number)
+    {
+      const item_t item{ number, ~number };
+      while(!queue.push(item) && wait_for_room)
+      {
+        std::this_thread::yield();
+      }
+      // An ISR comes at a rate, give the consumer a
+      // chance to keep up, also on a single core
+      if(!wait_for_room && number % 5 == 0)
+      {
+        std::this_thread::yield();
+      }
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&] {
+    uint64_t next = 0;
+    for(;;)
+    {
+      // Seen before the last pop, so nothing can come
+      // in between
+      const bool finished = done.load(std::memory_order_acquire);
+      item_t peeked{}, item{};
+      const bool peek = outcome.received % 7 == 0 && queue.peek(peeked);
+      if(!queue.pop(item))
+      {
+        if(finished)
+        {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      ++outcome.received;
+      outcome.torn += item.inverted != ~item.number;
+      outcome.peeked_other += peek && (peeked.number != item.number || peeked.inverted != item.inverted);
+      // Without waiting items may be missing, but never
+      // come twice or backwards
+      outcome.out_of_order += wait_for_room ? item.number != next : item.number < next;
+      next = item.number + 1;
+    }
+  });
+
+  producer.join();
+  consumer.join();
+  outcome.dropped = queue.dropped();
+  return outcome;
+}
+
+} // namespace
+
+int main()
+{
+  bool passed = true;
+  std::printf("%u items through a queue of %zu\n\n", unsigned(ITEMS), QUEUE_SIZE);
+  std::printf("%-10s %10s %10s %8s %6s %8s\n", "producer", "received", "full", "order", "torn", "peeked");
+  for(const bool wait_for_room : { true, false })
+  {
+    const auto outcome = run(wait_for_room);
+    std::printf("%-10s %10llu %10llu %8llu %6llu %8llu\n", wait_for_room ? "waits" : "drops",
+                (unsigned long long)outcome.received, (unsigned long long)outcome.dropped,
+                (unsigned long long)outcome.out_of_order, (unsigned long long)outcome.torn,
+                (unsigned long long)outcome.peeked_other);
+    // Waiting, dropped() counts the pushes that found the
+    // queue full and were repeated
+    passed &= !outcome.out_of_order && !outcome.torn && !outcome.peeked_other
+      && outcome.received + (wait_for_room ? 0 : outcome.dropped) == ITEMS;
+  }
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "junior-rocket-state.hpp"
+
+#include <cstddef>
+
+namespace far::junior::host {
+
+constexpr size_t STATES = size_t(state::LANDED) + 1;
+
+inline const char* name(state s)
+{
+  static const char* names[STATES] = {
+    "IDLE", "ESTABLISH_GROUND_PRESSURE", "WAIT_FOR_LAUNCH", "ACCELERATION_DETECTED",
+    "ACCELERATING", "LAUNCHED", "BURNOUT", "SEPARATION", "SEPARATION_INHIBITED",
+    "COASTING", "PEAK_REACHED", "FALLING_", "MEASURE_FALLING_PRESSURE1",
+    "MEASURE_FALLING_PRESSURE2", "MEASURE_FALLING_PRESSURE3", "DROUGE_OPENED", "DROUGE_FAILED", "LANDED",
+  };
+  return names[size_t(s)];
+}
+
+} // namespace far::junior::host
@@ -0,0 +1,177 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// The TimeOfDayFormatter of the sentences against the
+// time_of_day() it replaced, which formatted the 32 bit
+// micros() with sprintf and counted the wraps itself.
+//
+// Both format every microsecond of a window around boot,
+// the first hour, the first wrap of micros(), ten hours,
+// the twentieth wrap and the first day. In between the
+// clock moves on a second at a time, so the old code sees
+// every wrap and the formatter counts its seconds up.
+// Every string is also compared with one computed from the
+// 64 bit time directly.
+//
+// The old code added 4294.967295s per wrap, a microsecond
+// short, so after the n-th wrap it shows the time n
+// microseconds earlier. Where that changes the digits the
+// two differ, and the table counts it separately.
+//
+// Exits non-zero if the formatter is off anywhere, or the
+// old code differs for any other reason.
+#include "monotonic-clock.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr int64_t SECOND = 1000000;
+constexpr int64_t WRAP = int64_t(1) << 32;
+// Before and after each point
+constexpr int64_t WINDOW = SECOND;
+// The 11 characters, and room for any int sprintf writes
+constexpr size_t TEXT = 48;
+
+struct point_t
+{
+  const char* name;
+  int64_t at;
+};
+
+// In the order they come
+const point_t POINTS[] = {
+  { "boot", 0 },
+  { "first hour", 3600 * SECOND },
+  { "first wrap", WRAP },
+  { "ten hours", 36000 * SECOND },
+  { "twentieth wrap", 20 * WRAP },
+  { "first day", 86400 * SECOND },
+};
+
+// time_of_day() and its wrap bookkeeping as they were
+class OldTimeOfDay
+{
+public:
+  unsigned long get_timestamp(uint32_t current_micros)
+  {
+    if(current_micros < last_micros)
+    {
+      base_seconds += 4294;
+      base_fraction += 967295;
+    }
+    last_micros = current_micros;
+    return current_micros;
+  }
+
+  void time_of_day(uint32_t timestamp, char* destination)
+  {
+    unsigned long timestamp_seconds = timestamp / 1000000;
+    unsigned long timestamp_fraction = timestamp % 1000000;
+
+    unsigned long current_fraction = base_fraction + timestamp_fraction;
+    unsigned long current_second = base_seconds + timestamp_seconds + current_fraction / 1000000;
+    current_fraction = (current_fraction % 1000000) / 100;
+
+    const unsigned long current_hour = current_second / 3600;
+    current_second = current_second % 3600;
+    const unsigned long current_minute = current_second / 60;
+    current_second %= 60;
+
+    std::snprintf(destination, TEXT, "%02i%02i%02i.%04i", int(current_hour), int(current_minute),
+                  int(current_second), int(current_fraction));
+  }
+
+private:
+  uint32_t base_seconds = 0;
+  uint32_t base_fraction = 0;
+  uint32_t last_micros = 0;
+};
+
+void reference(int64_t now, char* destination)
+{
+  const auto seconds = now / SECOND;
+  std::snprintf(destination, TEXT, "%02i%02i%02i.%04i", int(seconds / 3600), int(seconds / 60 % 60),
+                int(seconds % 60), int(now % SECOND / 100));
+}
+
+MonotonicClock::time_point at(int64_t now)
+{
+  return MonotonicClock::time_point(MonotonicClock::duration(now));
+}
+
+struct outcome_t
+{
+  uint64_t compared = 0;
+  uint64_t formatter_off = 0;
+  uint64_t short_wraps = 0;
+  uint64_t old_off = 0;
+};
+
+} // namespace
+
+int main()
+{
+  OldTimeOfDay old;
+  TimeOfDayFormatter formatter;
+  char formatted[TEXT], expected[TEXT], previous[TEXT], behind[TEXT], around[TEXT];
+  bool passed = true;
+  int64_t now = 0;
+
+  std::printf("%-16s %14s %10s %14s %8s %8s\n", "around", "at", "compared", "formatter off", "wraps", "old off");
+  for(const auto& point : POINTS)
+  {
+    const auto start = point.at > WINDOW ? point.at - WINDOW : 0;
+    for(; now < start; now += SECOND)
+    {
+      old.get_timestamp(uint32_t(now));
+      formatter.format(at(now), formatted);
+    }
+    outcome_t outcome;
+    for(now = start; now < point.at + WINDOW; ++now)
+    {
+      const auto micros = uint32_t(now);
+      old.time_of_day(old.get_timestamp(micros), previous);
+      formatter.format(at(now), formatted);
+      reference(now, expected);
+      ++outcome.compared;
+      if(std::strcmp(formatted, expected) != 0)
+      {
+        if(outcome.formatter_off++ == 0)
+        {
+          std::printf("formatter at %lldus: %s, expected %s\n", (long long)now, formatted, expected);
+        }
+      }
+      if(std::strcmp(previous, formatted) != 0)
+      {
+        reference(now - now / WRAP, behind);
+        if(std::strcmp(previous, behind) == 0)
+        {
+          ++outcome.short_wraps;
+        }
+        else if(outcome.old_off++ == 0)
+        {
+          std::printf("old code at %lldus: %s, formatter %s\n", (long long)now, previous, formatted);
+        }
+      }
+    }
+    reference(point.at, around);
+    std::printf("%-16s %14s %10llu %14llu %8llu %8llu\n", point.name, around, (unsigned long long)outcome.compared,
+                (unsigned long long)outcome.formatter_off, (unsigned long long)outcome.short_wraps,
+                (unsigned long long)outcome.old_off);
+    passed &= outcome.formatter_off == 0 && outcome.old_off == 0;
+  }
+  std::printf("\nwraps: the old code a microsecond behind per wrap of micros()\n");
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Decodes the $RQTRACE sentences the firmware logs on
+// landing, see dump_transition_trace in the sketch, from
+// the given files, or - for stdin:
+//
+//   trace-decode data0042.txt
+//
+// Without arguments it flies a simulated flight with the
+// trace of the sketch attached, dumps it the way the sketch
+// does and decodes that instead. The transitions decoded
+// have to be the ones the flight took. microbench has what
+// the trace costs.
+//
+// Exits non-zero if a sentence fails its checksum, or the
+// trace of the simulated flight doesn't match its
+// transitions or lost records.
+#include <Arduino.h>
+#include "farduino_constants.h"
+#include "farduino_types.h"
+#include "farduino_utilities.h"
+#include "junior-rocket-state.hpp"
+#include "emulator/flight.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace far::junior;
+
+namespace {
+
+constexpr double SAMPLE_PERIOD = 0.01;
+
+struct decoded_t
+{
+  size_t index;
+  uint32_t recorded;
+  tfa::trace_record_t record;
+};
+
+uint8_t hex_byte(const char* digits)
+{
+  return uint8_t(std::strtoul(std::string(digits, 2).c_str(), nullptr, 16));
+}
+
+// A line of the log, if it is an intact $RQTRACE sentence.
+// Counts those that are not intact in corrupt.
+std::optional<decoded_t> decode(const std::string& line, size_t& corrupt)
+{
+  const auto start = line.find("$RQTRACE,");
+  if(start == std::string::npos)
+  {
+    return std::nullopt;
+  }
+  const auto star = line.find('*', start);
+  if(star == std::string::npos || star + 3 > line.size())
+  {
+    ++corrupt;
+    return std::nullopt;
+  }
+  unsigned char checksum = 0;
+  for(auto i = start + 1; i < star; ++i)
+  {
+    checksum ^= line[i];
+  }
+  char fields[3][24] = {};
+  unsigned long index = 0, recorded = 0;
+  const auto body = line.substr(start, star - start);
+  if(checksum != hex_byte(line.c_str() + star + 1)
+     || std::sscanf(body.c_str(), "$RQTRACE,%23[^,],%lu,%lu,%23s", fields[0], &index, &recorded, fields[1]) != 4
+     || std::strlen(fields[1]) != 16)
+  {
+    ++corrupt;
+    return std::nullopt;
+  }
+  const char* hex = fields[1];
+  decoded_t decoded{ size_t(index), uint32_t(recorded), {} };
+  decoded.record.at = uint32_t(std::strtoul(std::string(hex, 8).c_str(), nullptr, 16));
+  decoded.record.from = hex_byte(hex + 8);
+  decoded.record.to = hex_byte(hex + 10);
+  decoded.record.trigger = hex_byte(hex + 12);
+  decoded.record.kind = tfa::trace_record_t::kind_t(hex_byte(hex + 14));
+  return decoded;
+}
+
+void print(const decoded_t& decoded)
+{
+  const auto& record = decoded.record;
+  std::cout << decoded.index << "\t" << record.at / 1000 << "." << std::to_string(1000 + record.at % 1000).substr(1)
+            << "s\t" << state(record.from);
+  switch(record.kind)
+  {
+  case tfa::trace_record_t::EVENT:
+    std::cout << " -" << event(record.trigger) << "-> " << state(record.to);
+    break;
+  case tfa::trace_record_t::TIMEOUT:
+    std::cout << " -timeout-> " << state(record.to);
+    break;
+  case tfa::trace_record_t::REJECTED:
+    std::cout << " rejected " << event(record.trigger);
+    break;
+  }
+  std::cout << "\n";
+}
+
+// Prints the dumps in the stream, a new one starting
+// with index 0. Returns the records decoded.
+std::vector<decoded_t> decode_stream(std::istream& in, size_t& corrupt)
+{
+  std::vector<decoded_t> result;
+  std::string line;
+  while(std::getline(in, line))
+  {
+    if(const auto decoded = decode(line, corrupt))
+    {
+      if(decoded->index == 0)
+      {
+        std::cout << "trace of " << decoded->recorded << " records";
+        if(decoded->recorded > TRANSITION_TRACE_RECORDS)
+        {
+          std::cout << ", the first " << decoded->recorded - TRANSITION_TRACE_RECORDS << " lost";
+        }
+        std::cout << "\n";
+      }
+      print(*decoded);
+      result.push_back(*decoded);
+    }
+  }
+  return result;
+}
+
+struct transition_t
+{
+  state from;
+  state to;
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t, state to) override
+  {
+    if(started)
+    {
+      transitions.push_back({ current, to });
+    }
+    started = true;
+    current = to;
+  }
+
+  bool started = false;
+  state current = state::IDLE;
+  std::vector<transition_t> transitions;
+};
+
+int self_check()
+{
+  tfa::TraceBuffer<TRANSITION_TRACE_RECORDS> trace;
+  Recorder recorder;
+  {
+    far::emulator::flight_profile_t profile;
+    far::emulator::SimulatedFlight flight(profile);
+    JuniorRocketState machine(recorder);
+    machine.trace(&trace);
+    // USE_IOSTREAM also has the firmware talk about
+    // what it does
+    std::cout.setstate(std::ios::badbit);
+    for(double t = 0; !flight.over(t); t += SAMPLE_PERIOD)
+    {
+      const auto environment = flight.at(t);
+      machine.drive(timestamp_t(duration_t(int64_t(t * 1e6 + 0.5))), value_t(environment.pressure / 100.0),
+                    value_t(environment.acceleration[2]), value_t(1.0), value_t(environment.temperature));
+    }
+    std::cout.clear();
+  }
+
+  // As dump_transition_trace does it
+  std::string log;
+  char sentence[64];
+  for(size_t i = 0; i < trace.size(); ++i)
+  {
+    construct_trace_sentence(timestamp_t{}, i, trace.recorded(), trace[i], &sentence[0]);
+    log += sentence;
+  }
+  std::istringstream in(log);
+  size_t corrupt = 0;
+  const auto decoded = decode_stream(in, corrupt);
+
+  std::vector<transition_t> taken;
+  for(const auto& entry : decoded)
+  {
+    if(entry.record.kind != tfa::trace_record_t::REJECTED)
+    {
+      taken.push_back({ state(entry.record.from), state(entry.record.to) });
+    }
+  }
+  bool passed = corrupt == 0 && decoded.size() == trace.size() && trace.recorded() <= TRANSITION_TRACE_RECORDS
+    && taken.size() == recorder.transitions.size();
+  for(size_t i = 0; passed && i < taken.size(); ++i)
+  {
+    passed = taken[i].from == recorder.transitions[i].from && taken[i].to == recorder.transitions[i].to;
+  }
+
+  std::cout.flush();
+  std::printf("\n%u of %d records, %zu transitions, the flight took %zu\n", unsigned(trace.recorded()),
+              TRANSITION_TRACE_RECORDS, taken.size(), recorder.transitions.size());
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if(argc < 2)
+  {
+    return self_check();
+  }
+  size_t corrupt = 0;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(std::strcmp(argv[i], "-") == 0)
+    {
+      decode_stream(std::cin, corrupt);
+      continue;
+    }
+    std::ifstream in(argv[i]);
+    if(!in)
+    {
+      std::fprintf(stderr, "can't open %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    decode_stream(in, corrupt);
+  }
+  if(corrupt)
+  {
+    std::printf("%zu corrupt sentences\nFAIL\n", corrupt);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,270 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Resets the flight computer in the middle of simulated
+// flights and lets it carry on from the checkpoint.
+//
+// Each flight is flown once without a reset. Then again
+// with a reset every RESET_STEP seconds from liftoff to
+// touchdown: OUTAGE seconds without samples, timestamps
+// starting over from zero, a fresh JuniorRocketState
+// restored from what the last sample checkpointed.
+//
+// Exits non-zero if a restored flight doesn't take the
+// same transitions as the uninterrupted one up to the
+// apogee, within TOLERANCE seconds each, or doesn't land
+// within LANDING_TOLERANCE. How the drouge is judged may
+// differ, the verdicts column counts those resets.
+#include "checkpoint.hpp"
+#include "junior-rocket-state.hpp"
+#include "state-names.hpp"
+#include "emulator/flight.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace far::junior;
+using far::junior::host::name;
+using far::junior::host::STATES;
+
+namespace {
+
+constexpr double SAMPLE_PERIOD = 0.01;
+constexpr double RESET_STEP = 0.1;
+constexpr double OUTAGE = 0.05;
+constexpr double TOLERANCE = 0.2;
+// A different drouge verdict can cost a retry
+constexpr double LANDING_TOLERANCE = 1.0;
+
+struct transition_t
+{
+  double at;
+  state to;
+};
+
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    transitions.push_back({ boot + seconds(timestamp), to });
+  }
+
+  void state_restored(timestamp_t entered, state to) override
+  {
+    restored = to;
+    restored_entered = boot + seconds(entered);
+  }
+
+  static double seconds(timestamp_t timestamp)
+  {
+    return std::chrono::duration<double>(timestamp.time_since_epoch()).count();
+  }
+
+  // When the clock started, in flight time
+  double boot = 0;
+  std::vector<transition_t> transitions;
+  state restored = state::IDLE;
+  double restored_entered = 0;
+};
+
+struct run_t
+{
+  std::vector<transition_t> transitions;
+  // The state the reset happened in
+  state restored = state::IDLE;
+  double restored_entered = 0;
+  double restore_us = 0;
+};
+
+run_t fly(const far::emulator::flight_profile_t& profile, double reset_at)
+{
+  far::emulator::SimulatedFlight flight(profile);
+  Recorder recorder;
+  auto machine = std::make_unique<JuniorRocketState>(recorder);
+  // Where the firmware keeps it, DEETS_NOINIT
+  deets::checkpoint::Checkpoint<flight_snapshot_t> checkpoint;
+  bool reset = false;
+  run_t run;
+
+  for(double t = 0; !flight.over(t); t += SAMPLE_PERIOD)
+  {
+    const auto environment = flight.at(t);
+    if(reset_at >= 0 && t >= reset_at && t < reset_at + OUTAGE)
+    {
+      continue;
+    }
+    if(reset_at >= 0 && t >= reset_at && !reset)
+    {
+      reset = true;
+      recorder.boot = t;
+      // The constructor runs before setup()
+      machine = std::make_unique<JuniorRocketState>(recorder);
+      const auto start = std::chrono::steady_clock::now();
+      flight_snapshot_t snapshot;
+      if(checkpoint.load(snapshot) && in_flight(snapshot.current))
+      {
+        machine->restore(timestamp_t{}, snapshot);
+      }
+      run.restore_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      run.restored = recorder.restored;
+      run.restored_entered = recorder.restored_entered;
+    }
+    const auto timestamp = timestamp_t(duration_t(int64_t(std::llround((t - recorder.boot) * 1e6))));
+    const auto pressure = value_t(environment.pressure / 100.0);
+    const auto acceleration = value_t(environment.acceleration[2]);
+    machine->drive(timestamp, pressure, acceleration);
+    checkpoint.save(machine->snapshot());
+  }
+  run.transitions = recorder.transitions;
+  return run;
+}
+
+struct per_state_t
+{
+  size_t resets = 0;
+  double worst = 0;
+  // The drouge was judged differently
+  size_t verdicts = 0;
+  size_t failures = 0;
+};
+
+bool check_flight(const char* label, const far::emulator::flight_profile_t& profile, double& worst_restore_us)
+{
+  const auto reference = fly(profile, -1);
+  std::printf("%s:", label);
+  for(const auto& transition : reference.transitions)
+  {
+    std::printf(" %s@%.2f", name(transition.to), transition.at);
+  }
+  std::printf("\n");
+
+  const auto landed = std::find_if(reference.transitions.begin(), reference.transitions.end(),
+                                   [](const transition_t& t) { return t.to == state::LANDED; });
+  if(landed == reference.transitions.end())
+  {
+    std::printf("  the reference flight didn't land\n");
+    return false;
+  }
+
+  const auto apogee = std::find_if(reference.transitions.begin(), reference.transitions.end(),
+                                   [](const transition_t& t) { return t.to == state::FALLING_; });
+
+  bool passed = true;
+  std::vector<per_state_t> states(STATES);
+  for(double reset_at = profile.launch; reset_at < landed->at; reset_at += RESET_STEP)
+  {
+    const auto run = fly(profile, reset_at);
+    worst_restore_us = std::max(worst_restore_us, run.restore_us);
+    // Where the reference was when the last sample
+    // before the reset was checkpointed
+    auto current = std::find_if(reference.transitions.rbegin(), reference.transitions.rend(),
+                                [&](const transition_t& t) { return t.at < reset_at; });
+    if(!in_flight(current->to))
+    {
+      continue;
+    }
+    auto& stats = states[size_t(current->to)];
+    ++stats.resets;
+
+    std::vector<transition_t> expected;
+    std::vector<transition_t> taken;
+    for(const auto& transition : reference.transitions)
+    {
+      if(transition.at >= reset_at)
+      {
+        expected.push_back(transition);
+      }
+    }
+    for(const auto& transition : run.transitions)
+    {
+      if(transition.at >= reset_at)
+      {
+        taken.push_back(transition);
+      }
+    }
+
+    // The outage is lost, the state seems entered later
+    bool matches = run.restored == current->to
+      && std::abs(run.restored_entered - current->at) <= OUTAGE + 2 * SAMPLE_PERIOD;
+    // Up to the apogee everything has to be the same
+    size_t i = 0;
+    for(; matches && i < expected.size() && expected[i].at <= apogee->at; ++i)
+    {
+      const double deviation = i < taken.size() ? std::abs(taken[i].at - expected[i].at) : TOLERANCE + 1;
+      stats.worst = std::max(stats.worst, deviation);
+      matches = deviation <= TOLERANCE && taken[i].to == expected[i].to;
+    }
+    // The drouge verdict is a statistical decision at a
+    // timeout, which the lost time can tip. We still
+    // have to land, and never go back to the ground states.
+    if(matches && i < expected.size())
+    {
+      const bool same = std::equal(expected.begin() + i, expected.end(), taken.begin() + i, taken.end(),
+                                   [](const transition_t& a, const transition_t& b) { return a.to == b.to; });
+      stats.verdicts += !same;
+      const double deviation = std::abs(taken.back().at - expected.back().at);
+      matches = taken.back().to == state::LANDED && deviation <= LANDING_TOLERANCE;
+    }
+    for(const auto& transition : taken)
+    {
+      matches &= in_flight(transition.to) || transition.to == state::LANDED;
+    }
+    if(!matches)
+    {
+      ++stats.failures;
+      passed = false;
+      std::printf("  reset at %.2fs in %s, restored %s entered at %.2fs, then:", reset_at, name(current->to),
+                  name(run.restored), run.restored_entered);
+      for(const auto& transition : taken)
+      {
+        std::printf(" %s@%.2f", name(transition.to), transition.at);
+      }
+      std::printf("\n");
+    }
+  }
+
+  std::printf("  %-28s %8s %10s %9s %9s\n", "reset in", "resets", "worst", "verdicts", "failures");
+  for(size_t i = 0; i < STATES; ++i)
+  {
+    if(states[i].resets)
+    {
+      std::printf("  %-28s %8zu %9.2fs %9zu %9zu\n", name(state(i)), states[i].resets, states[i].worst,
+                  states[i].verdicts, states[i].failures);
+    }
+  }
+  return passed;
+}
+
+} // namespace
+
+int main()
+{
+  const char check[] = "123456789";
+  if(deets::checkpoint::crc32(check, 9) != 0xcbf43926)
+  {
+    std::printf("CRC-32 is off\n");
+    return EXIT_FAILURE;
+  }
+
+  far::emulator::flight_profile_t drouge;
+  drouge.launch = 5.0;
+  far::emulator::flight_profile_t ballistic = drouge;
+  ballistic.drouge_delay = -1;
+
+  double worst_restore_us = 0;
+  bool passed = check_flight("drouge", drouge, worst_restore_us);
+  passed &= check_flight("no drouge", ballistic, worst_restore_us);
+  std::printf("\nsnapshot %zu bytes, restored within %.1fus on the host\n", sizeof(flight_snapshot_t),
+              worst_restore_us);
+  if(!passed)
+  {
+    std::printf("FAIL\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
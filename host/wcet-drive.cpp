@@ -0,0 +1,424 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+//
+// Worst case execution time of JuniorRocketState::drive.
+//
+// Flies a set of simulated flights that together take
+// every transition of the automaton, times each drive()
+// call and attributes it to the state it started in.
+// Every flight is repeated with the same input and the
+// fastest run of each call is kept, which removes the
+// preemptions and cache misses of the host OS.
+// Any heap allocation inside drive() is counted by the
+// replaced global allocator. Also reports the RAM the
+// working data of each phase of the flight takes.
+//
+// Exits non-zero if drive() allocated or a transition
+// was never taken.
+#include "junior-rocket-state.hpp"
+#include "state-names.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace far::junior;
+using far::junior::host::name;
+using far::junior::host::STATES;
+
+namespace {
+
+// The allocator only counts while this is set
+bool hot_path = false;
+size_t hot_allocations = 0;
+size_t hot_allocated_bytes = 0;
+
+uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t value;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+  return value;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct flight_t
+{
+  const char* name;
+  // m/s^2 above gravity while the motor burns
+  double thrust;
+  double burntime;
+  // A drouge that opens this many seconds after
+  // apogee, negative for none
+  double drouge_delay;
+  // mbar
+  double pressure_noise;
+  // Acceleration spikes before the launch: seconds
+  // of thrust that don't get us off the pad
+  std::array<double, 2> false_starts;
+  // An ejection charge pressure spike in mbar,
+  // one sample while coasting up
+  double coasting_spike;
+  // Degrees per second the axis turns away from
+  // the vertical after launch
+  double tilt_rate;
+  // m/s^2 the accelerometer reads too much after the
+  // burnout. It holds up the velocity estimate, so only
+  // the pressure peak finds the apogee.
+  double acceleration_bias;
+};
+
+const flight_t FLIGHTS[] = {
+  { "nominal", 15, 2.5, 0.0, 0.05, {}, 0, 0, 0 },
+  { "false starts", 15, 2.5, 0.0, 0.05, { 0.2, 0.8 }, 0, 0, 0 },
+  { "ejection spike", 15, 2.5, 0.0, 0.05, {}, 2.0, 0, 0 },
+  { "long burn, high apogee", 30, 4.0, 0.0, 0.05, {}, 0, 0, 0 },
+  { "backup chute", 15, 2.5, 5.0, 0.05, {}, 0, 0, 0 },
+  { "no chute", 15, 2.5, -1.0, 0.05, {}, 0, 0, 0 },
+  { "no chute, quiet barometer", 15, 2.5, -1.0, 0.02, {}, 0, 0, 0 },
+  { "noisy barometer", 15, 2.5, 0.0, 0.8, {}, 0, 0, 0 },
+  { "noisy barometer, no chute", 15, 2.5, -1.0, 0.8, {}, 0, 0, 0 },
+  { "noisy barometer, late chute", 15, 2.5, 2.5, 0.8, {}, 0, 0, 0 },
+  { "weathercocking", 15, 2.5, 0.0, 0.05, {}, 0, 10.0, 0 },
+  { "drifting accelerometer", 15, 2.5, 0.0, 0.05, {}, 0, 0, 20.0 },
+};
+
+struct transition_t
+{
+  state from;
+  state to;
+  // Set for event transitions
+  bool has_event;
+  event what;
+  size_t taken;
+};
+
+struct call_t
+{
+  state from;
+  uint64_t cycles;
+  size_t allocations;
+  size_t allocated_bytes;
+};
+
+struct per_state_t
+{
+  size_t calls = 0;
+  uint64_t total = 0;
+  uint64_t worst = 0;
+  const char* worst_flight = nullptr;
+  size_t allocations = 0;
+  size_t allocated_bytes = 0;
+};
+
+// Knows which state we're in and which events the
+// current drive() produced, to tell the transitions apart.
+struct Recorder : StateObserver
+{
+  void state_changed(timestamp_t, state to) override
+  {
+    if(started)
+    {
+      mark(current, to);
+    }
+    started = true;
+    current = to;
+  }
+
+  void event_produced(timestamp_t, event e) override
+  {
+    events.push_back(e);
+  }
+
+  void mark(state from, state to)
+  {
+    if(mark_event(from, to))
+    {
+      return;
+    }
+    // A timeout and an event within the same drive()
+    for(auto& transition : *transitions)
+    {
+      if(!transition.has_event && transition.from == from)
+      {
+        if(transition.to == to || mark_event(transition.to, to))
+        {
+          ++transition.taken;
+          return;
+        }
+      }
+    }
+    std::printf("unexpected transition %s -> %s\n", name(from), name(to));
+  }
+
+  bool mark_event(state from, state to)
+  {
+    for(const auto e : events)
+    {
+      for(auto& transition : *transitions)
+      {
+        if(transition.has_event && transition.from == from && transition.to == to && transition.what == e)
+        {
+          ++transition.taken;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  std::vector<transition_t>* transitions;
+  std::vector<event> events;
+  state current = state::IDLE;
+  bool started = false;
+};
+
+// Appends the calls on the first repetition and
+// keeps the fastest afterwards
+void fly(const flight_t& flight, unsigned seed, Recorder& recorder, std::vector<call_t>& calls, bool first)
+{
+  recorder.started = false;
+  recorder.current = state::IDLE;
+  recorder.events.reserve(32);
+  JuniorRocketState machine(recorder);
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> pressure_noise(0, flight.pressure_noise), acceleration_noise(0, 0.5);
+  const double dt = 0.008, p0 = 1013.25, launch = 30.0;
+  double h = 0, v = 0, apogee = -1;
+  const timestamp_t t0{};
+
+  for(size_t i = 0; ; ++i)
+  {
+    const double t = i * dt;
+    double a = 0, measured = 9.81;
+    for(size_t k = 0; k < flight.false_starts.size(); ++k)
+    {
+      const double start = 10.0 + 5.0 * k;
+      if(t >= start && t < start + flight.false_starts[k])
+      {
+        measured = 9.81 + 8;
+      }
+    }
+    if(t >= launch && t < launch + flight.burntime)
+    {
+      a = flight.thrust;
+      measured = 9.81 + flight.thrust;
+    }
+    else if(t >= launch)
+    {
+      const double drag = 0.0005 * v * v;
+      a = -9.81 - (v > 0 ? drag : -drag);
+      // Drag works against the motion, the
+      // accelerometer sees all but gravity
+      measured = a + 9.81 + flight.acceleration_bias;
+      if(apogee >= 0 && flight.drouge_delay >= 0 && t >= apogee + flight.drouge_delay)
+      {
+        // Terminal velocity of 15m/s under the drouge
+        const double chute = 9.81 / (15.0 * 15.0) * v * v;
+        a = -9.81 + chute;
+        measured = chute + flight.acceleration_bias;
+      }
+    }
+    if(apogee < 0 && t > launch + flight.burntime && v + a * dt < 0)
+    {
+      apogee = t;
+    }
+    v += a * dt;
+    h += v * dt;
+    if(t > launch && h <= 0)
+    {
+      break;
+    }
+
+    double p = p0 * std::pow(1 - h / 44330.0, 5.255) + pressure_noise(rng);
+    if(flight.coasting_spike != 0 && t >= launch + flight.burntime + 1.5 && t < launch + flight.burntime + 1.5 + dt)
+    {
+      p += flight.coasting_spike;
+    }
+    const auto timestamp = t0 + std::chrono::microseconds(int64_t(std::llround(t * 1e6)));
+    const auto pressure = value_t(p);
+    const auto acceleration = value_t(measured + acceleration_noise(rng));
+    const auto cos_tilt = value_t(std::cos(std::max(0.0, t - launch) * flight.tilt_rate * M_PI / 180));
+
+    const auto from = recorder.current;
+    recorder.events.clear();
+    const auto allocations = hot_allocations;
+    const auto allocated_bytes = hot_allocated_bytes;
+
+    hot_path = true;
+    const auto start = read_cycles();
+    machine.drive(timestamp, pressure, acceleration, cos_tilt);
+    const auto cycles = read_cycles() - start;
+    hot_path = false;
+
+    if(first)
+    {
+      calls.push_back({ from, cycles, hot_allocations - allocations, hot_allocated_bytes - allocated_bytes });
+    }
+    else
+    {
+      calls[i].cycles = std::min(calls[i].cycles, cycles);
+    }
+  }
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+  if(hot_path)
+  {
+    ++hot_allocations;
+    hot_allocated_bytes += size;
+  }
+  if(void* p = std::malloc(size ? size : 1))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+int main(int argc, char** argv)
+{
+  const int repetitions = argc > 1 ? std::atoi(argv[1]) : 10;
+  // Which way the pressure drop assessment goes
+  // depends on the noise, so we fly each profile
+  // with a few different ones.
+  const unsigned seeds = argc > 2 ? std::atoi(argv[2]) : 8;
+
+  std::vector<transition_t> transitions;
+  Recorder recorder;
+  recorder.transitions = &transitions;
+  {
+    JuniorRocketState machine(recorder);
+    machine.each_transition([&](state from, auto trigger, state to) {
+      if constexpr (std::is_same_v<decltype(trigger), event>)
+      {
+        transitions.push_back({ from, to, true, trigger, 0 });
+      }
+      else
+      {
+        transitions.push_back({ from, to, false, event{}, 0 });
+      }
+    });
+  }
+
+  std::array<per_state_t, STATES> states = {};
+  std::vector<call_t> calls;
+  for(const auto& flight : FLIGHTS)
+  {
+    for(unsigned seed = 1; seed <= seeds; ++seed)
+    {
+      calls.clear();
+      for(int repetition = 0; repetition < repetitions; ++repetition)
+      {
+        fly(flight, seed, recorder, calls, repetition == 0);
+      }
+      for(const auto& call : calls)
+      {
+        auto& stats = states[size_t(call.from)];
+        ++stats.calls;
+        stats.total += call.cycles;
+        stats.allocations += call.allocations;
+        stats.allocated_bytes += call.allocated_bytes;
+        if(call.cycles > stats.worst)
+        {
+          stats.worst = call.cycles;
+          stats.worst_flight = flight.name;
+        }
+      }
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  const char* unit = "cycles";
+#else
+  const char* unit = "ns";
+#endif
+  std::printf("drive() per state in %s, best of %d repetitions, %zu flights with %u seeds each\n\n",
+              unit, repetitions, std::size(FLIGHTS), seeds);
+  std::printf("%-27s %8s %8s %8s %7s  %s\n", "state", "calls", "mean", "worst", "allocs", "worst in");
+  uint64_t worst = 0;
+  for(size_t i = 0; i < STATES; ++i)
+  {
+    const auto& stats = states[i];
+    if(!stats.calls)
+    {
+      continue;
+    }
+    worst = std::max(worst, stats.worst);
+    std::printf("%-27s %8zu %8llu %8llu %7zu  %s\n", name(state(i)), stats.calls,
+                (unsigned long long)(stats.total / stats.calls), (unsigned long long)stats.worst,
+                stats.allocations, stats.worst_flight);
+  }
+  std::printf("\nworst case: %llu %s\n", (unsigned long long)worst, unit);
+
+  std::printf("\n%-27s %8s\n", "phase data", "bytes");
+  for(const auto& phase : PHASE_MEMORY)
+  {
+    std::printf("%-27s %8zu\n", phase.name, phase.bytes);
+  }
+  std::printf("%-27s %8zu (%zu apart)\n", "shared", sizeof(phase_data_t), PHASE_MEMORY_SEPARATE);
+  std::printf("JuniorRocketState: %zu bytes\n", sizeof(JuniorRocketState));
+
+  int result = EXIT_SUCCESS;
+  for(size_t i = 0; i < STATES; ++i)
+  {
+    if(states[i].allocations)
+    {
+      std::printf("FAIL: %zu heap allocations (%zu bytes) in drive() from %s\n",
+                  states[i].allocations, states[i].allocated_bytes, name(state(i)));
+      result = EXIT_FAILURE;
+    }
+  }
+  for(const auto& transition : transitions)
+  {
+    if(!transition.taken)
+    {
+      std::printf("FAIL: never took %s -> %s\n", name(transition.from), name(transition.to));
+      result = EXIT_FAILURE;
+    }
+  }
+  return result;
+}
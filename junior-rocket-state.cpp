@@ -13,41 +13,40 @@ JuniorRocketState::JuniorRocketState(StateObserver& state_observer)
   : _state_machine(state::IDLE)
   , _state_observer(state_observer)
 {
-  auto& sm = _state_machine; // Just a convenient alias
-  sm.add_transition(state::IDLE, duration_t::zero(), state::ESTABLISH_GROUND_PRESSURE);
-  sm.add_transition(state::ESTABLISH_GROUND_PRESSURE, event::GROUND_PRESSURE_ESTABLISHED, state::WAIT_FOR_LAUNCH);
-  sm.add_transition(state::WAIT_FOR_LAUNCH, event::ACCELERATION_ABOVE_THRESHOLD, state::ACCELERATION_DETECTED);
-  sm.add_transition(state::ACCELERATION_DETECTED, event::ACCELERATION_BELOW_THRESHOLD, state::WAIT_FOR_LAUNCH);
-  sm.add_transition(state::ACCELERATION_DETECTED, timeouts::ACCELERATION, state::ACCELERATING);
-  sm.add_transition(state::ACCELERATING, event::ACCELERATION_BELOW_THRESHOLD, state::WAIT_FOR_LAUNCH);
-  sm.add_transition(state::ACCELERATING, event::PRESSURE_BELOW_LAUNCH_THRESHOLD, state::LAUNCHED);
-  sm.add_transition(state::LAUNCHED, event::ACCELERATION_AROUND_ZERO, state::BURNOUT);
-  sm.add_transition(state::LAUNCHED, timeouts::MOTOR_BURNTIME - timeouts::ACCELERATION, state::BURNOUT);
-  sm.add_transition(state::BURNOUT, timeouts::SEPARATION_TIMEOUT, state::SEPARATION);
-  sm.add_transition(state::SEPARATION, duration_t::zero(), state::COASTING);
-  sm.add_transition(state::COASTING, event::PRESSURE_PEAK_REACHED, state::FALLING_);
-  sm.add_transition(state::COASTING, event::EXPECTED_APOGEE_TIME_REACHED, state::FALLING_);
-  sm.add_transition(state::FALLING_, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE1);
-  sm.add_transition(state::MEASURE_FALLING_PRESSURE1, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE2);
-  sm.add_transition(state::MEASURE_FALLING_PRESSURE2, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE3);
-  sm.add_transition(state::MEASURE_FALLING_PRESSURE3, event::PRESSURE_LINEAR, state::DROUGE_OPENED);
-  sm.add_transition(state::MEASURE_FALLING_PRESSURE3, event::PRESSURE_QUADRATIC, state::DROUGE_FAILED);
-  sm.add_transition(state::DROUGE_OPENED, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD, state::LANDED);
-  sm.add_transition(state::DROUGE_FAILED, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD, state::LANDED);
-  sm.add_transition(state::DROUGE_FAILED, event::RESTART_PRESSURE_MEASUREMENT, state::FALLING_);
+  for(const auto& transition : TRANSITIONS)
+  {
+    if(transition.timed)
+    {
+      _state_machine.add_transition(transition.from, transition.after, transition.to);
+    }
+    else
+    {
+      _state_machine.add_transition(transition.from, transition.what, transition.to);
+    }
+  }
 }
 
 
-std::optional<float> JuniorRocketState::ground_pressure() const
+std::optional<value_t> JuniorRocketState::ground_pressure() const
 {
   return _ground_pressure;
 }
 
-void JuniorRocketState::process_pressure(float pressure)
+void JuniorRocketState::process_pressure(value_t pressure, value_t temperature)
 {
-  if(_ground_pressure_stats)
+  const auto pad = std::get_if<phases::pad_t>(&_phase);
+  const auto current = _state_machine.state();
+  // Frozen while the acceleration is above the threshold,
+  // picked up again after a false alarm
+  if(pad && (current == state::ESTABLISH_GROUND_PRESSURE || current == state::WAIT_FOR_LAUNCH))
   {
-    const auto stats = _ground_pressure_stats->update(pressure);
+    const auto offset = PRESSURE_TEMPERATURE_COEFFICIENT * (temperature - REFERENCE_TEMPERATURE);
+    const auto compensated = pressure - offset;
+    if(!pad->ground_pressure_stats)
+    {
+      pad->ground_pressure_stats.emplace(compensated, INITIAL_PRESSURE_VARIANCE);
+    }
+    const auto stats = pad->ground_pressure_stats->update(compensated);
     if(stats)
     {
       #ifdef USE_IOSTREAM
@@ -55,17 +54,17 @@ void JuniorRocketState::process_pressure(float pressure)
       #endif
       if(stats->variance < PRESSURE_VARIANCE_THRESHOLD)
       {
-        _ground_pressure = stats->average;
+        _ground_pressure = stats->average + offset;
       }
     }
   }
-  if(_peak_pressure_stats)
+  if(auto ascent = std::get_if<phases::ascent_t>(&_phase))
   {
-    if(_peak_pressure_stats->update(pressure))
+    if(ascent->peak_pressure_stats.update(pressure))
     {
       if(_peak_pressure)
       {
-        const auto median = *_peak_pressure_stats->median();
+        const auto median = *ascent->peak_pressure_stats.median();
         #ifdef USE_IOSTREAM
         std::cout << "median: " << *_peak_pressure << "\n";
         #endif
@@ -73,7 +72,7 @@ void JuniorRocketState::process_pressure(float pressure)
       }
       else
       {
-        _peak_pressure = *_peak_pressure_stats->median();
+        _peak_pressure = *ascent->peak_pressure_stats.median();
       }
       #ifdef USE_IOSTREAM
       std::cout << "peak pressure: " << *_peak_pressure << "\n";
@@ -82,17 +81,49 @@ void JuniorRocketState::process_pressure(float pressure)
   }
 }
 
-void JuniorRocketState::produce_events(timestamp_t timestamp, float pressure, float acceleration)
+std::optional<JuniorRocketState::altitude_estimator_t::estimate_t> JuniorRocketState::altitude_estimate() const
+{
+  if(_altitude_estimator)
+  {
+    return _altitude_estimator->estimate();
+  }
+  return std::nullopt;
+}
+
+void JuniorRocketState::estimate_altitude(duration_t elapsed, std::optional<value_t> pressure, value_t acceleration)
+{
+  if(!_altitude_estimator)
+  {
+    return;
+  }
+  _altitude_estimator->predict(std::chrono::duration<float>(elapsed).count());
+  if(pressure)
+  {
+    _altitude_estimator->update_altitude(
+      deets::estimation::fast_barometric_altitude(float(*pressure), float(*_ground_pressure))
+      );
+  }
+  // The acceleration is already projected onto the vertical,
+  // so it is good for the whole flight.
+  _altitude_estimator->update_acceleration(float(acceleration) - GRAVITY);
+}
+
+void JuniorRocketState::produce_events(timestamp_t timestamp, value_t acceleration, value_t cos_tilt)
 {
   if(_ground_pressure) {
     feed(timestamp, event::GROUND_PRESSURE_ESTABLISHED);
-    if(*_ground_pressure - pressure >= LAUNCH_PRESSURE_DIFFERENTIAL)
+    // After a restore there is none until the barometer
+    // was read again
+    if(_pressure)
     {
-      feed(timestamp, event::PRESSURE_BELOW_LAUNCH_THRESHOLD);
-    }
-    else
-    {
-      feed(timestamp, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD);
+      if(*_ground_pressure - *_pressure >= LAUNCH_PRESSURE_DIFFERENTIAL)
+      {
+        feed(timestamp, event::PRESSURE_BELOW_LAUNCH_THRESHOLD);
+      }
+      else
+      {
+        feed(timestamp, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD);
+      }
     }
   }
 
@@ -109,9 +140,33 @@ void JuniorRocketState::produce_events(timestamp_t timestamp, float pressure, fl
     }
   }
 
-  if(_peak_pressure && pressure > *_peak_pressure + PEAK_PRESSURE_MARGIN)
+  if(cos_tilt < SEPARATION_TILT_COSINE)
   {
-    feed(timestamp, event::PRESSURE_PEAK_REACHED);
+    feed(timestamp, event::TILT_BEYOND_SEPARATION_LIMIT);
+  }
+
+  if(auto ascent = std::get_if<phases::ascent_t>(&_phase))
+  {
+    if(_peak_pressure && _pressure && *_pressure > *_peak_pressure + PEAK_PRESSURE_MARGIN)
+    {
+      if(!ascent->peaked_since)
+      {
+        ascent->peaked_since = timestamp;
+      }
+      if(timestamp - *ascent->peaked_since >= PEAK_PRESSURE_FALLBACK)
+      {
+        feed(timestamp, event::PRESSURE_PEAK_REACHED);
+      }
+    }
+    else
+    {
+      ascent->peaked_since.reset();
+    }
+  }
+
+  if(_altitude_estimator && _altitude_estimator->estimate().velocity < APOGEE_VELOCITY_THRESHOLD)
+  {
+    feed(timestamp, event::VELOCITY_BELOW_ZERO);
   }
 
   if(flighttime() && *flighttime() >= (APOGEE_TIME + APOGEE_DETECTION_MARGIN))
@@ -133,6 +188,13 @@ void JuniorRocketState::produce_events(timestamp_t timestamp, float pressure, fl
     // We need to re-measure
     _pressure_drop_assessment = std::nullopt;
   }
+
+  const auto descent = std::get_if<phases::descent_t>(&_phase);
+  if(descent && descent->drouge_failed_timestamp
+     && timestamp - *descent->drouge_failed_timestamp >= timeouts::DROUGE_RETRY)
+  {
+    feed(timestamp, event::RESTART_PRESSURE_MEASUREMENT);
+  }
 }
 
 void JuniorRocketState::feed(timestamp_t timestamp, event e)
@@ -141,51 +203,115 @@ void JuniorRocketState::feed(timestamp_t timestamp, event e)
   _state_observer.event_produced(timestamp, e);
 }
 
-void JuniorRocketState::handle_state_transition(state to, float pressure)
+void JuniorRocketState::handle_state_transition(state to)
 {
   switch(to)
   {
   case state::ESTABLISH_GROUND_PRESSURE:
     // This kicks of the statistics of the ground pressure calibration
-    _ground_pressure_stats = decltype(_ground_pressure_stats)::value_type();
+    _phase.emplace<phases::pad_t>();
     break;
   case state::WAIT_FOR_LAUNCH:
     _liftoff_timestamp = std::nullopt;
-    // no need to feed the machine again
-    _ground_pressure_stats = std::nullopt;
+    // The pad phase goes on, the ground pressure keeps
+    // following the weather until the launch
+    // We might come back here after a false launch
+    // detection, the estimator just keeps running then.
+    if(!_altitude_estimator)
+    {
+      _altitude_estimator = altitude_estimator_t(
+        BAROMETRIC_ALTITUDE_VARIANCE,
+        ACCELERATION_MEASUREMENT_VARIANCE,
+        JERK_SPECTRAL_DENSITY
+        );
+    }
     break;
   case state::ACCELERATION_DETECTED:
     _liftoff_timestamp = *_last_timestamp;
     break;
   case state::LAUNCHED:
-    _peak_pressure_stats = decltype(_peak_pressure_stats)::value_type();
+    _phase.emplace<phases::ascent_t>();
     break;
   case state::FALLING_:
-    // We don't need to keep track anymore
-    _peak_pressure_stats = std::nullopt;
+    // We don't need to keep track of the peak anymore,
+    // and start over after a failed drouge
+    _phase.emplace<phases::descent_t>();
     break;
   case state::MEASURE_FALLING_PRESSURE1:
-    _pressure_measurements[0] = pressure;
+    // Only reachable through FALLING_, which
+    // set up the descent
+    if(auto descent = std::get_if<phases::descent_t>(&_phase))
+    {
+      descent->pressure_drop_fit.emplace();
+      descent->pressure_drop_fit_start = *_last_timestamp;
+    }
     break;
-  case state::MEASURE_FALLING_PRESSURE2:
-    _pressure_measurements[1] = pressure;
+  case state::DROUGE_OPENED:
+    if(auto descent = std::get_if<phases::descent_t>(&_phase))
+    {
+      descent->pressure_drop_fit = std::nullopt;
+    }
     break;
-  case state::MEASURE_FALLING_PRESSURE3:
-    _pressure_measurements[2] = pressure;
-    assess_pressure_drop();
+  case state::DROUGE_FAILED:
+    if(auto descent = std::get_if<phases::descent_t>(&_phase))
+    {
+      descent->pressure_drop_fit = std::nullopt;
+      descent->drouge_failed_timestamp = *_last_timestamp;
+    }
+    break;
+  case state::LANDED:
+    _phase.emplace<std::monostate>();
     break;
   default:
     break;
   }
 }
 
-void JuniorRocketState::assess_pressure_drop()
+void JuniorRocketState::assess_pressure_drop(timestamp_t timestamp, value_t pressure)
 {
-  // TOOD: actually implement
-  _pressure_drop_assessment = pressure_drop::LINEAR;
+  const auto descent = std::get_if<phases::descent_t>(&_phase);
+  if(!descent || !descent->pressure_drop_fit)
+  {
+    return;
+  }
+  const auto since_start = timestamp - descent->pressure_drop_fit_start;
+  descent->pressure_drop_fit->update(std::chrono::duration<double>(since_start).count(), double(pressure));
+  const auto fit = descent->pressure_drop_fit->quadratic();
+  if(!fit)
+  {
+    return;
+  }
+  const auto coefficient = fit->coefficients[2];
+  // The moving average correlates neighbouring samples, the
+  // fit takes them as independent and underestimates its
+  // variance by about the length of the window.
+  const auto margin = PRESSURE_DROP_CONFIDENCE * std::sqrt(fit->variances[2] * PRESSURE_AVERAGE_WINDOW);
+
+  #ifdef USE_IOSTREAM
+  std::cout << "pressure drop: " << coefficient << " +/- " << margin << "\n";
+  #endif
+  // When we reached the last measurement state, we
+  // have to go with what we got.
+  if(_state_machine.state() == state::MEASURE_FALLING_PRESSURE3)
+  {
+    _pressure_drop_assessment = coefficient > QUADRATIC_PRESSURE_DROP_COEFFICIENT ?
+      pressure_drop::QUADRATIC : pressure_drop::LINEAR;
+  }
+  else if(since_start >= PRESSURE_DROP_MIN_DURATION)
+  {
+    if(coefficient - margin > QUADRATIC_PRESSURE_DROP_COEFFICIENT)
+    {
+      _pressure_drop_assessment = pressure_drop::QUADRATIC;
+    }
+    else if(coefficient + margin < QUADRATIC_PRESSURE_DROP_COEFFICIENT)
+    {
+      _pressure_drop_assessment = pressure_drop::LINEAR;
+    }
+  }
 }
 
-void JuniorRocketState::drive(timestamp_t timestamp, float pressure, float acceleration)
+void JuniorRocketState::drive(timestamp_t timestamp, std::optional<value_t> pressure, value_t acceleration,
+                              value_t cos_tilt, value_t temperature)
 {
   _state_observer.data(timestamp, pressure, acceleration);
   if(!_last_timestamp)
@@ -198,7 +324,16 @@ void JuniorRocketState::drive(timestamp_t timestamp, float pressure, float accel
   // TODO: timediff!
   const auto elapsed = timestamp - *_last_timestamp;
   _last_timestamp = timestamp;
-  process_pressure(pressure);
+  if(pressure)
+  {
+    _pressure = pressure;
+    process_pressure(*pressure, temperature);
+  }
+  estimate_altitude(elapsed, pressure, acceleration);
+  if(pressure)
+  {
+    assess_pressure_drop(timestamp, *pressure);
+  }
 
   const auto old = _state_machine.state();
 
@@ -206,12 +341,12 @@ void JuniorRocketState::drive(timestamp_t timestamp, float pressure, float accel
   _state_machine.elapsed(elapsed);
   _state_observer.elapsed(timestamp, elapsed);
 
-  produce_events(timestamp, pressure, acceleration);
+  produce_events(timestamp, acceleration, cos_tilt);
 
   const auto to = _state_machine.state();
   if(old != to)
   {
-    handle_state_transition(to, pressure);
+    handle_state_transition(to);
     _state_observer.state_changed(timestamp, to);
   }
 
@@ -228,6 +363,85 @@ std::optional<duration_t> JuniorRocketState::flighttime() const
   return std::nullopt;
 }
 
+flight_snapshot_t JuniorRocketState::snapshot() const
+{
+  flight_snapshot_t snapshot;
+  snapshot.current = _state_machine.state();
+  snapshot.time_in_state = _state_machine.time_in_state();
+  snapshot.ground_pressure = _ground_pressure;
+  snapshot.flight_time = flighttime();
+  snapshot.peak_pressure = _peak_pressure;
+  snapshot.altitude = altitude_estimate();
+  snapshot.pressure_drop_fit_time = duration_t::zero();
+  if(const auto descent = std::get_if<phases::descent_t>(&_phase); descent && descent->pressure_drop_fit)
+  {
+    snapshot.pressure_drop_fit = descent->pressure_drop_fit;
+    snapshot.pressure_drop_fit_time = *_last_timestamp - descent->pressure_drop_fit_start;
+  }
+  return snapshot;
+}
+
+void JuniorRocketState::restore(timestamp_t timestamp, const flight_snapshot_t& snapshot)
+{
+  _last_timestamp = timestamp;
+  _state_machine.restore(snapshot.current, snapshot.time_in_state);
+  _ground_pressure = snapshot.ground_pressure;
+  if(snapshot.flight_time)
+  {
+    _liftoff_timestamp = timestamp - *snapshot.flight_time;
+  }
+  _peak_pressure = snapshot.peak_pressure;
+  if(snapshot.altitude)
+  {
+    _altitude_estimator = altitude_estimator_t(
+      BAROMETRIC_ALTITUDE_VARIANCE,
+      ACCELERATION_MEASUREMENT_VARIANCE,
+      JERK_SPECTRAL_DENSITY
+      );
+    _altitude_estimator->restore(*snapshot.altitude);
+  }
+
+  const auto entered = timestamp - snapshot.time_in_state;
+  // What else handle_state_transition set up on the way
+  // here. The statistics start over.
+  switch(snapshot.current)
+  {
+  case state::ESTABLISH_GROUND_PRESSURE:
+  case state::ACCELERATION_DETECTED:
+  case state::ACCELERATING:
+    // Back in WAIT_FOR_LAUNCH the tracking starts over
+    // from the next sample
+    _phase.emplace<phases::pad_t>();
+    break;
+  case state::LAUNCHED:
+  case state::BURNOUT:
+  case state::SEPARATION:
+  case state::SEPARATION_INHIBITED:
+  case state::COASTING:
+    _phase.emplace<phases::ascent_t>();
+    break;
+  case state::FALLING_:
+  case state::MEASURE_FALLING_PRESSURE1:
+  case state::MEASURE_FALLING_PRESSURE2:
+  case state::MEASURE_FALLING_PRESSURE3:
+  case state::DROUGE_OPENED:
+  case state::DROUGE_FAILED:
+  {
+    auto& descent = _phase.emplace<phases::descent_t>();
+    descent.pressure_drop_fit = snapshot.pressure_drop_fit;
+    descent.pressure_drop_fit_start = timestamp - snapshot.pressure_drop_fit_time;
+    if(snapshot.current == state::DROUGE_FAILED)
+    {
+      descent.drouge_failed_timestamp = entered;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  _state_observer.state_restored(entered, snapshot.current);
+}
+
 #ifdef USE_IOSTREAM
 void JuniorRocketState::dot(std::ostream &os)
 {
@@ -256,6 +470,7 @@ std::ostream& operator<<(std::ostream& os, const state& state)
     M_STATE(LAUNCHED)
     M_STATE(BURNOUT)
     M_STATE(SEPARATION)
+    M_STATE(SEPARATION_INHIBITED)
     M_STATE(COASTING)
     M_STATE(PEAK_REACHED)
     M_STATE(FALLING_)
@@ -285,9 +500,11 @@ std::ostream& operator<<(std::ostream& os, const event& event)
     M_EVENT(ACCELERATION_BELOW_THRESHOLD)
     M_EVENT(ACCELERATION_ABOVE_THRESHOLD)
     M_EVENT(ACCELERATION_AROUND_ZERO)
+    M_EVENT(VELOCITY_BELOW_ZERO)
     M_EVENT(PRESSURE_LINEAR)
     M_EVENT(PRESSURE_QUADRATIC)
     M_EVENT(RESTART_PRESSURE_MEASUREMENT)
+    M_EVENT(TILT_BEYOND_SEPARATION_LIMIT)
     M_EVENT(EXPECTED_APOGEE_TIME_REACHED);
   }
   return os;
@@ -2,13 +2,14 @@
 // SPDX-License-Identifier: MIT
 #pragma once
 
+#include "monotonic-clock.hpp"
 #include <chrono>
 #include <ostream>
 
 namespace far::junior {
 
-using timestamp_t = std::chrono::steady_clock::time_point;
-using duration_t = std::chrono::steady_clock::duration;
+using timestamp_t = MonotonicClock::time_point;
+using duration_t = MonotonicClock::duration;
 
 }
 
@@ -21,13 +22,30 @@ std::ostream& operator<<(std::ostream&, const far::junior::duration_t&);
 
 #include "timed-finite-automaton.hpp"
 #include "statistics.hpp"
+#include "altitude-estimator.hpp"
+#include "fixed-point.hpp"
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <variant>
+
+// The F103 has no FPU, so the sample pipeline runs in
+// fixed point there. Define FARDUINO_FLOAT to override.
+#if defined(STM32F1xx) && !defined(FARDUINO_FLOAT)
+#define FARDUINO_FIXED_POINT
+#endif
 
 namespace far::junior {
 
-using timestamp_t = std::chrono::steady_clock::time_point;
-using duration_t = std::chrono::steady_clock::duration;
+#ifdef FARDUINO_FIXED_POINT
+// Q15.16, enough headroom for pressures in mbar
+// and accelerations in m/s^2
+using value_t = deets::fixed::Fixed<16>;
+#else
+using value_t = float;
+#endif
+
 using namespace std::chrono_literals;
 
 
@@ -53,6 +71,8 @@ enum class state
   BURNOUT,
   // after a second, separate
   SEPARATION,
+  // unless we tilted too far from the vertical meanwhile
+  SEPARATION_INHIBITED,
   // shortly after the separation, we are in coasting
   COASTING,
   // We detected a pressure drop, and thus reached
@@ -72,6 +92,9 @@ struct timeouts {
   static constexpr duration_t SEPARATION_TIMEOUT = 1s;
   static constexpr duration_t MOTOR_BURNTIME = 2500ms;
   static constexpr duration_t FALLING_PRESSURE_TIMEOUT = 1s;
+  // After a failed drouge we give a backup chute this
+  // long before assessing the fall again
+  static constexpr duration_t DROUGE_RETRY = 1s;
 };
 
 enum class pressure_drop {
@@ -81,23 +104,114 @@ enum class pressure_drop {
 
 // We seem to reach a shoulder of ~20m/s^2, so
 // this looks safe
-constexpr float LAUNCH_ACCELERATION_THRESHOLD = 15.0;
-// We only get an absolute acceleration, so it is never
-// below zero, instead we need to
-constexpr float FREEFALL_ACCELERATION_THRESHOLD = 3.0;
+constexpr value_t LAUNCH_ACCELERATION_THRESHOLD = value_t(15.0);
+// The vertical acceleration drops below this after
+// burnout, drag makes it negative.
+constexpr value_t FREEFALL_ACCELERATION_THRESHOLD = value_t(3.0);
+// The cosine of the largest angle from the vertical we
+// separate at, 20 degrees.
+constexpr value_t SEPARATION_TILT_COSINE = value_t(0.9397);
 // mbar difference between our ground pressure and
 // the height we consider safely as "launched".
-constexpr float LAUNCH_PRESSURE_DIFFERENTIAL = 5.0;
+constexpr value_t LAUNCH_PRESSURE_DIFFERENTIAL = value_t(5.0);
 // The drop in pressure from the minimum we
 // accept to say "we've peaked"
-constexpr float PEAK_PRESSURE_MARGIN = .6;
+constexpr value_t PEAK_PRESSURE_MARGIN = value_t(.6);
+// The altitude estimator decides apogee. The peak only
+// counts once it held this long without the estimator
+// seeing the velocity cross zero, noise has it come
+// more than a second early.
+constexpr duration_t PEAK_PRESSURE_FALLBACK = 2s;
 // Apogee according to simulation
 constexpr duration_t APOGEE_TIME = 6565ms;
 // Together with APOGEE_TIME used to trigger
 // chute ejection.
 constexpr duration_t APOGEE_DETECTION_MARGIN = 5s;
-constexpr float INITIAL_PRESSURE_VARIANCE = 1.0;
-constexpr float PRESSURE_VARIANCE_THRESHOLD = 3.0;
+constexpr value_t INITIAL_PRESSURE_VARIANCE = value_t(1.0);
+constexpr value_t PRESSURE_VARIANCE_THRESHOLD = value_t(3.0);
+// m/s^2, the accelerometer reads this when
+// sitting on the pad.
+constexpr float GRAVITY = 9.81;
+// Tuning of the altitude estimator. The variances
+// are in m^2 and (m/s^2)^2, the jerk spectral
+// density in (m/s^3)^2/Hz.
+constexpr float BAROMETRIC_ALTITUDE_VARIANCE = 1.0;
+constexpr float ACCELERATION_MEASUREMENT_VARIANCE = 4.0;
+constexpr float JERK_SPECTRAL_DENSITY = 100.0;
+// Tuning of the attitude estimator: the gains pulling
+// it towards the measured gravity in 1/s and 1/s^2, and
+// how far (in g) the acceleration may be from 1g to be
+// taken as gravity.
+constexpr float ATTITUDE_KP = 1.0;
+constexpr float ATTITUDE_KI = 0.05;
+constexpr float ATTITUDE_GRAVITY_TOLERANCE = 0.1;
+// The ground pressure is an exponentially weighted
+// average over about this many samples, established after
+// the confidence many. It follows the weather while we
+// wait for the launch and freezes once the acceleration
+// says we might be off.
+constexpr int GROUND_PRESSURE_WINDOW = 256;
+constexpr int GROUND_PRESSURE_CONFIDENCE = 16;
+// mbar/K the barometer reads high when warm, up to 0.015
+// for the BMP280, measure it for the board. The ground
+// pressure is tracked as if at the reference temperature
+// (in degrees Celsius), so the sun coming out on the pad
+// doesn't look like weather.
+constexpr value_t PRESSURE_TEMPERATURE_COEFFICIENT = value_t(0.015);
+constexpr value_t REFERENCE_TEMPERATURE = value_t(15.0);
+// Samples of which the median tracks the peak. They share
+// their RAM with the pressure drop fit, see phase_data_t,
+// so the window can grow up to its size for free.
+constexpr int PEAK_PRESSURE_WINDOW = 10;
+// How long (at least) we fit the falling pressure
+// before deciding if the drouge opened.
+constexpr duration_t PRESSURE_DROP_MIN_DURATION = 1s;
+// mbar/s^2, the quadratic coefficient of the pressure
+// increase we expect when falling without a drouge is
+// about 0.6, a working drouge gives roughly 0 once open,
+// up to 0.25 while it still inflates in the fit window.
+constexpr float QUADRATIC_PRESSURE_DROP_COEFFICIENT = 0.35;
+// The number of standard deviations the quadratic
+// coefficient has to be away from the above to
+// decide early.
+constexpr float PRESSURE_DROP_CONFIDENCE = 3.0;
+// Estimated vertical velocity (m/s) below which
+// we consider apogee passed.
+constexpr float APOGEE_VELOCITY_THRESHOLD = 0.0;
+// The filters between the sensors and drive(). Going
+// transonic and the pyro charges spike the pressure for
+// a sample or two, the Hampel filters take such outliers
+// out: more than OUTLIER_SIGMAS and the floor (in mbar
+// and m/s^2) away from the median of the window. The
+// motor shakes the accelerometer, the low-pass (in Hz)
+// keeps that away from the launch and burnout thresholds.
+constexpr float OUTLIER_SIGMAS = 3.0;
+constexpr int PRESSURE_OUTLIER_WINDOW = 5;
+constexpr float PRESSURE_OUTLIER_FLOOR = 1.0;
+constexpr int PRESSURE_AVERAGE_WINDOW = 3;
+constexpr int ACCELERATION_OUTLIER_WINDOW = 5;
+constexpr float ACCELERATION_OUTLIER_FLOOR = 5.0;
+constexpr float ACCELERATION_CUTOFF = 8.0;
+
+using pressure_filter_t = deets::statistics::FilterChain<
+  deets::statistics::Hampel<value_t, PRESSURE_OUTLIER_WINDOW>,
+  deets::statistics::MovingAverage<value_t, PRESSURE_AVERAGE_WINDOW>>;
+using acceleration_filter_t = deets::statistics::FilterChain<
+  deets::statistics::Hampel<value_t, ACCELERATION_OUTLIER_WINDOW>,
+  deets::statistics::Biquad<value_t>>;
+
+inline pressure_filter_t make_pressure_filter()
+{
+  return pressure_filter_t({ value_t(OUTLIER_SIGMAS), value_t(PRESSURE_OUTLIER_FLOOR) }, {});
+}
+
+// For samples coming in at sample_rate Hz
+inline acceleration_filter_t make_acceleration_filter(float sample_rate)
+{
+  return acceleration_filter_t(
+    { value_t(OUTLIER_SIGMAS), value_t(ACCELERATION_OUTLIER_FLOOR) },
+    deets::statistics::Biquad<value_t>::low_pass(ACCELERATION_CUTOFF, sample_rate));
+}
 
 enum class event {
   GROUND_PRESSURE_ESTABLISHED,
@@ -112,15 +226,152 @@ enum class event {
   ACCELERATION_ABOVE_THRESHOLD,
   ACCELERATION_AROUND_ZERO,
   EXPECTED_APOGEE_TIME_REACHED,
+  // The altitude estimator says we are going down
+  VELOCITY_BELOW_ZERO,
   PRESSURE_LINEAR,
   PRESSURE_QUADRATIC,
+  // DROUGE_RETRY passed since the drouge failed
   RESTART_PRESSURE_MEASUREMENT,
+  // The rocket axis is further from the vertical
+  // than SEPARATION_TILT_COSINE allows
+  TILT_BEYOND_SEPARATION_LIMIT,
+};
+
+// A transition of the automaton of JuniorRocketState,
+// taken on an event or once the state lasted a while
+struct transition_rule_t
+{
+  state from;
+  state to;
+  bool timed;
+  event what;
+  duration_t after;
+
+  static constexpr transition_rule_t on(state from, event what, state to)
+  {
+    return { from, to, false, what, duration_t::zero() };
+  }
+
+  static constexpr transition_rule_t timeout(state from, duration_t after, state to)
+  {
+    return { from, to, true, event::GROUND_PRESSURE_ESTABLISHED, after };
+  }
+};
+
+// The one definition of the automaton, which the host
+// also compiles into the tables of its batch runs
+constexpr transition_rule_t TRANSITIONS[] = {
+  transition_rule_t::timeout(state::IDLE, duration_t::zero(), state::ESTABLISH_GROUND_PRESSURE),
+  transition_rule_t::on(state::ESTABLISH_GROUND_PRESSURE, event::GROUND_PRESSURE_ESTABLISHED, state::WAIT_FOR_LAUNCH),
+  transition_rule_t::on(state::WAIT_FOR_LAUNCH, event::ACCELERATION_ABOVE_THRESHOLD, state::ACCELERATION_DETECTED),
+  transition_rule_t::on(state::ACCELERATION_DETECTED, event::ACCELERATION_BELOW_THRESHOLD, state::WAIT_FOR_LAUNCH),
+  transition_rule_t::timeout(state::ACCELERATION_DETECTED, timeouts::ACCELERATION, state::ACCELERATING),
+  transition_rule_t::on(state::ACCELERATING, event::ACCELERATION_BELOW_THRESHOLD, state::WAIT_FOR_LAUNCH),
+  transition_rule_t::on(state::ACCELERATING, event::PRESSURE_BELOW_LAUNCH_THRESHOLD, state::LAUNCHED),
+  transition_rule_t::on(state::LAUNCHED, event::ACCELERATION_AROUND_ZERO, state::BURNOUT),
+  transition_rule_t::timeout(state::LAUNCHED, timeouts::MOTOR_BURNTIME - timeouts::ACCELERATION, state::BURNOUT),
+  transition_rule_t::timeout(state::BURNOUT, timeouts::SEPARATION_TIMEOUT, state::SEPARATION),
+  transition_rule_t::on(state::BURNOUT, event::TILT_BEYOND_SEPARATION_LIMIT, state::SEPARATION_INHIBITED),
+  transition_rule_t::timeout(state::SEPARATION, duration_t::zero(), state::COASTING),
+  transition_rule_t::timeout(state::SEPARATION_INHIBITED, duration_t::zero(), state::COASTING),
+  transition_rule_t::on(state::COASTING, event::PRESSURE_PEAK_REACHED, state::FALLING_),
+  transition_rule_t::on(state::COASTING, event::EXPECTED_APOGEE_TIME_REACHED, state::FALLING_),
+  transition_rule_t::on(state::COASTING, event::VELOCITY_BELOW_ZERO, state::FALLING_),
+  transition_rule_t::timeout(state::FALLING_, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE1),
+  transition_rule_t::timeout(state::MEASURE_FALLING_PRESSURE1, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE2),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE1, event::PRESSURE_LINEAR, state::DROUGE_OPENED),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE1, event::PRESSURE_QUADRATIC, state::DROUGE_FAILED),
+  transition_rule_t::timeout(state::MEASURE_FALLING_PRESSURE2, timeouts::FALLING_PRESSURE_TIMEOUT, state::MEASURE_FALLING_PRESSURE3),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE2, event::PRESSURE_LINEAR, state::DROUGE_OPENED),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE2, event::PRESSURE_QUADRATIC, state::DROUGE_FAILED),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE3, event::PRESSURE_LINEAR, state::DROUGE_OPENED),
+  transition_rule_t::on(state::MEASURE_FALLING_PRESSURE3, event::PRESSURE_QUADRATIC, state::DROUGE_FAILED),
+  transition_rule_t::on(state::DROUGE_OPENED, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD, state::LANDED),
+  transition_rule_t::on(state::DROUGE_FAILED, event::PRESSURE_ABOVE_LAUNCH_THRESHOLD, state::LANDED),
+  transition_rule_t::on(state::DROUGE_FAILED, event::RESTART_PRESSURE_MEASUREMENT, state::FALLING_),
+};
+
+// The states a reset has to carry on from, instead
+// of starting over on the ground
+constexpr bool in_flight(state s)
+{
+  return s >= state::ACCELERATION_DETECTED && s < state::LANDED;
+}
+
+// What it takes to pick up a flight after a reset, see
+// JuniorRocketState::snapshot and restore. Timestamps
+// don't survive a reset, so the times are relative to
+// when the snapshot was taken.
+struct flight_snapshot_t
+{
+  state current;
+  duration_t time_in_state;
+  std::optional<value_t> ground_pressure;
+  // Since liftoff
+  std::optional<duration_t> flight_time;
+  std::optional<value_t> peak_pressure;
+  std::optional<deets::estimation::altitude_estimate_t<float>> altitude;
+  std::optional<deets::statistics::LeastSquaresFit<double>> pressure_drop_fit;
+  // Since the fit started
+  duration_t pressure_drop_fit_time;
 };
 
+// The working data of a phase of the flight. Only one
+// phase is alive at a time, so they share their storage.
+namespace phases {
+
+// ESTABLISH_GROUND_PRESSURE up to ACCELERATING
+struct pad_t
+{
+  // Of the pressure at REFERENCE_TEMPERATURE, from the
+  // first sample on
+  std::optional<deets::statistics::RollingStatistics<
+    value_t, GROUND_PRESSURE_WINDOW, GROUND_PRESSURE_CONFIDENCE>> ground_pressure_stats;
+};
+
+// LAUNCHED up to COASTING
+struct ascent_t
+{
+  deets::statistics::ArrayStatistics<value_t, PEAK_PRESSURE_WINDOW> peak_pressure_stats{};
+  // Since the pressure is above the peak, see
+  // PEAK_PRESSURE_FALLBACK
+  std::optional<timestamp_t> peaked_since;
+};
+
+// FALLING_ up to DROUGE_FAILED
+struct descent_t
+{
+  // While a MEASURE_FALLING_PRESSURE state is active
+  std::optional<deets::statistics::LeastSquaresFit<double>> pressure_drop_fit;
+  timestamp_t pressure_drop_fit_start{};
+  std::optional<timestamp_t> drouge_failed_timestamp;
+};
+
+} // namespace phases
+
+using phase_data_t = std::variant<std::monostate, phases::pad_t, phases::ascent_t, phases::descent_t>;
+
+struct phase_memory_t
+{
+  const char* name;
+  size_t bytes;
+};
+
+// What each phase needs, and what it used to take with
+// a std::optional of its own each
+constexpr std::array<phase_memory_t, 3> PHASE_MEMORY = {{
+  { "pad", sizeof(phases::pad_t) },
+  { "ascent", sizeof(phases::ascent_t) },
+  { "descent", sizeof(phases::descent_t) },
+}};
+constexpr size_t PHASE_MEMORY_SEPARATE = sizeof(std::optional<phases::pad_t>)
+  + sizeof(std::optional<phases::ascent_t>) + sizeof(phases::descent_t);
+
 #define M_UNUSED(variable) (void)variable;
 
 struct StateObserver {
-  virtual void data(timestamp_t timestamp, float pressure, float acceleration)
+  // pressure is empty when the sample has no fresh one
+  virtual void data(timestamp_t timestamp, std::optional<value_t> pressure, value_t acceleration)
   {
     M_UNUSED(timestamp);
     M_UNUSED(pressure);
@@ -131,6 +382,13 @@ struct StateObserver {
   {
     M_UNUSED(timestamp);
   }
+  // Instead of state_changed after a reset, for
+  // a state entered before it
+  virtual void state_restored(timestamp_t entered, state s)
+  {
+    state_changed(entered, s);
+  }
+
   virtual void event_produced(timestamp_t timestamp, event)
   {
     M_UNUSED(timestamp);
@@ -146,6 +404,7 @@ struct StateObserver {
 
 class JuniorRocketState {
   using state_machine_t = tfa::TimedFiniteAutomaton<state, event, timestamp_t>;
+  using altitude_estimator_t = deets::estimation::AltitudeKalmanFilter<float>;
 
 public:
 
@@ -155,30 +414,61 @@ public:
   JuniorRocketState(JuniorRocketState&&) = delete;
 
   void dot(std::ostream& os);
-  void drive(timestamp_t, float, float);
+  // The pressure in mbar, the acceleration in m/s^2 projected
+  // onto the vertical, the cosine of the tilt of the rocket
+  // axis, see deets::estimation::MahonyFilter, and the
+  // temperature of the barometer in degrees Celsius.
+  // Without a pressure the sample only carries the IMU, the
+  // barometer wasn't read since the last one. The statistics,
+  // the altitude estimate and the pressure drop fit then
+  // don't see the last pressure again.
+  void drive(timestamp_t, std::optional<value_t> pressure, value_t acceleration, value_t cos_tilt = value_t(1.0),
+             value_t temperature = REFERENCE_TEMPERATURE);
   std::optional<duration_t> flighttime() const;
-  std::optional<float> ground_pressure() const;
+  flight_snapshot_t snapshot() const;
+  // Instead of the first drive(), which would start over in
+  // IDLE. The time between the snapshot and timestamp is
+  // lost, the timeouts of the state carry on from there.
+  void restore(timestamp_t, const flight_snapshot_t&);
+  std::optional<value_t> ground_pressure() const;
+  std::optional<altitude_estimator_t::estimate_t> altitude_estimate() const;
+
+  // See tfa::TimedFiniteAutomaton::trace
+  void trace(tfa::Trace* trace)
+  {
+    _state_machine.trace(trace);
+  }
+
+  // See tfa::TimedFiniteAutomaton::each_transition
+  template<typename Visitor>
+  void each_transition(Visitor visitor) const
+  {
+    _state_machine.each_transition(visitor);
+  }
 
 private:
-  void process_pressure(float pressure);
-  void produce_events(timestamp_t timestamp, float pressure, float acceleration);
-  void handle_state_transition(state to, float pressure);
+  void process_pressure(value_t pressure, value_t temperature);
+  void estimate_altitude(duration_t elapsed, std::optional<value_t> pressure, value_t acceleration);
+  void produce_events(timestamp_t timestamp, value_t acceleration, value_t cos_tilt);
+  void handle_state_transition(state to);
   void feed(timestamp_t timestamp, event);
-  void assess_pressure_drop();
+  void assess_pressure_drop(timestamp_t timestamp, value_t pressure);
 
   state_machine_t _state_machine;
 
   std::optional<timestamp_t> _last_timestamp;
-  std::optional<float> _ground_pressure;
+  // The last fresh one
+  std::optional<value_t> _pressure;
+  std::optional<value_t> _ground_pressure;
   std::optional<timestamp_t> _liftoff_timestamp;
 
   StateObserver& _state_observer;
 
-  std::optional<deets::statistics::ArrayStatistics<float, 2>> _ground_pressure_stats;
-  std::optional<deets::statistics::ArrayStatistics<float, 10>> _peak_pressure_stats;
-  float _pressure_measurements[3];
+  // Switched by handle_state_transition
+  phase_data_t _phase;
   std::optional<pressure_drop> _pressure_drop_assessment;
-  std::optional<float> _peak_pressure;
+  std::optional<value_t> _peak_pressure;
+  std::optional<altitude_estimator_t> _altitude_estimator;
 };
 
 #ifdef USE_IOSTREAM
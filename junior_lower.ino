@@ -1,5 +1,5 @@
 #include "farduino_constants.h"
-// Must come after farduino_constants.h !
+#include "board-traits.hpp"
 #include "rtttl_songs.h"
 #include "farduino_types.h"
 #include "farduino_utilities.h"
@@ -7,14 +7,21 @@
 
 #include "junior-rocket-state.hpp"
 #include "state-reactions.hpp"
+#include "spsc-queue.hpp"
+#include "sensor-interrupts.hpp"
+#include "scheduler.hpp"
+#include "sensor-drivers.hpp"
+#include "nmea-parser.hpp"
+#include "attitude-estimator.hpp"
+#include "pyro-sequencer.hpp"
+#include "checkpoint.hpp"
+#include "boot-sequence.hpp"
 
 #include <I2Cdev.h>
 #include <Wire.h>
+#ifdef FARDUINO_MPU9250
 #include <MPU9250.h>
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BMP280.h>
-#include <Adafruit_BNO055.h>
-#include <utility/imumaths.h>
+#endif
 
 #ifdef USE_SD_CARD
 #define USE_STANDARD_SPI_LIBRARY 2  // See SdFatConfig.h
@@ -25,12 +32,11 @@
 #include <RF24.h>
 
 #include <chrono>
+#include <iterator>
 
-//#define farduino_maple_v1 1
-#define farduino_maple_v2 1
-//#define farduino_maple_v3 1
-
-
+#ifdef FARDUINO_DUAL_CORE
+#include <pico/multicore.h>
+#endif
 
 #define isdigit(n) (n >= '0' && n <= '9')
 
@@ -46,34 +52,52 @@ char response[64];
 unsigned int sample_count = 0;
 unsigned int file_count = 0;
 
-double temperature;
-double pressure;
-double altitude;
-
-double raw_acc[3];
-double raw_omega[3];
-double raw_B[3];
-
-double acc[3];
-double omega[3];
-double omega_0[3] = { 0.0, 0.0, 0.0 };
-double B[3];
-
-double norm_acc;
-double norm_omega;
-
-unsigned char GPS_checksum = 0;
-byte unsigned GPS_pointer = 0;
-bool receiving_GPS;
-char GPS_sentence[128];
+//value_t is fixed point on boards without FPU
+value_t altitude;
+
+value_t acc[3];
+value_t omega[3];
+value_t omega_0[3] = {};
+value_t B[3];
+
+//acceleration along the vertical in m/s^2 and pressure in mbar,
+//filtered for the state machine, see far::junior::make_pressure_filter
+value_t vertical_acc;
+value_t filtered_pressure;
+far::junior::acceleration_filter_t acceleration_filter = far::junior::make_acceleration_filter(1e6f / IMU_PERIOD);
+far::junior::pressure_filter_t pressure_filter = far::junior::make_pressure_filter();
+
+//scaling constants in the sample type
+constexpr value_t one_g = value_t(Board::ONE_G);
+constexpr value_t one_deg_per_second = value_t(Board::ONE_DEG_PER_SECOND);
+constexpr value_t gravity = value_t(far::junior::GRAVITY);
+constexpr value_t radians_per_degree = value_t(0.0174533);
+
+//the tilt of the rocket, integrated from the gyro and
+//corrected by gravity while sitting on the pad
+deets::estimation::MahonyFilter<value_t> attitude(
+  value_t(far::junior::ATTITUDE_KP),
+  value_t(far::junior::ATTITUDE_KI),
+  value_t(far::junior::ATTITUDE_GRAVITY_TOLERANCE));
+timestamp_t last_imu_timestamp;
+bool attitude_started = false;
+
+//sentences are checked and decoded in place, the last fix is kept
+deets::nmea::Parser<Board::GPS_SENTENCE> gps_parser;
+deets::nmea::gps_fix_t gps_fix = {};
+
+//the sensor data is read in bursts, one transaction per sensor
+deets::sensors::WireBus<decltype(Wire)> i2c_bus(Wire);
 
 //the pressure sensor is necessary
-Adafruit_BMP280 met;
+deets::sensors::Bmp280<decltype(i2c_bus)> met(i2c_bus, 0x76);
 
+#ifdef FARDUINO_MPU9250
 MPU9250 imu_mpu9250;
+#endif
 bool mpu9250_present = false;
 
-Adafruit_BNO055 imu_bno055 = Adafruit_BNO055(-1, 0x28);
+deets::sensors::Bno055<decltype(i2c_bus)> imu_bno055(i2c_bus, BNO055_ADDRESS);
 bool bno055_present = false;
 
 byte flight_address[6] = "LOWER";
@@ -81,26 +105,143 @@ byte ground_address[6] = "GRND1";
 
 char request[32] = "abcdefghijklmnopqrstuvwxyz01234";
 
-CircularBuffer ring(256);
-RF24 radio_nrf24(NRF24_CE_PIN, NRF24_CS_PIN);
+CircularBuffer ring(Board::RADIO_BUFFER);
+RF24 radio_nrf24(Board::NRF24_CE_PIN, Board::NRF24_CS_PIN);
 
 bool nrf24l01_present = false;
 
+#ifdef USE_DATA_READY_INTERRUPTS
+#ifdef RASPBERRYPI_PICO
+mbed::Ticker met_ticker;
+#else
+HardwareTimer met_timer(TIM2);
+#endif
+#endif
+
 
 #ifdef USE_SD_CARD
 //SD constants and variables
-const uint8_t chipSelect = PB12;
+static_assert(Board::SD_CARD, "the board has no SD card slot");
+const uint8_t chipSelect = Board::SD_CS_PIN;
 SPIClass spi2;
 SdFat sd(&spi2);
 
 bool SD_present = false;
 SdFile dataFile;
-bool file_exists;
+//the number of the next dataXXXX.txt
+const char log_counter_name[] = "counter.txt";
 #endif
 
-StateReactions state_reactions(radio_nrf24);
+//the pyro channels are switched from a one shot timer
+//interrupt, the sequencer says when
+#ifdef RASPBERRYPI_PICO
+mbed::Timeout pyro_timeout;
+#else
+HardwareTimer pyro_timer(TIM4);
+#endif
+void pyro_timer_isr();
+
+struct PyroHardware {
+  static_assert(std::size(Board::PYRO_PINS) == far::junior::PYRO_CHANNELS);
+
+  void write(uint8_t channel, bool on) {
+    digitalWrite(Board::PYRO_PINS[channel], on ? HIGH : LOW);
+  }
+
+  void schedule(uint32_t ticks) {
+    const int32_t remaining = int32_t(ticks - far::junior::MonotonicClock::ticks());
+    const uint32_t us = remaining > 1 ? uint32_t(remaining) : 1;
+    #ifdef RASPBERRYPI_PICO
+    pyro_timeout.attach(&pyro_timer_isr, std::chrono::microseconds(us));
+    #else
+    pyro_timer.pause();
+    pyro_timer.setOverflow(us, MICROSEC_FORMAT);
+    pyro_timer.refresh();
+    pyro_timer.resume();
+    #endif
+  }
+
+  void cancel() {
+    #ifdef RASPBERRYPI_PICO
+    pyro_timeout.detach();
+    #else
+    pyro_timer.pause();
+    #endif
+  }
+
+  void disable_interrupts() {
+    noInterrupts();
+  }
+
+  void enable_interrupts() {
+    interrupts();
+  }
+};
+
+PyroHardware pyro_hardware;
+far::junior::PyroSequencer<PyroHardware> pyro(pyro_hardware, far::junior::PYRO_RULES, far::junior::PYRO_ARMING);
+
+//the ready song and the state tunes, played by the song task
+RtttlPlayer songs;
+
+StateReactions state_reactions(radio_nrf24, pyro, songs);
 far::junior::JuniorRocketState state_machine(state_reactions);
 
+#ifdef USE_TRANSITION_TRACE
+//what the state machine did, see dump_transition_trace. Lost
+//with a reset, the flight goes on with a fresh one.
+tfa::TraceBuffer<TRANSITION_TRACE_RECORDS> transition_trace;
+bool transition_trace_dumped = false;
+#endif
+
+//sensor readings, see acquire_imu_sample and acquire_met_sample
+struct sensor_sample_t {
+  //when the freshest reading in here was taken
+  timestamp_t timestamp;
+  timestamp_t imu_timestamp;
+  timestamp_t met_timestamp;
+  bool imu_fresh;
+  bool met_fresh;
+  value_t raw_acc[3];
+  value_t raw_omega[3];
+  value_t raw_B[3];
+  value_t temperature;
+  value_t pressure;
+};
+
+//written by the sensor tasks, on core 1 if we have one
+sensor_sample_t latest_sample;
+//the readings the telemetry tasks haven't sent yet
+sensor_sample_t telemetry_sample;
+
+#ifdef FARDUINO_DUAL_CORE
+//core 1 produces, core 0 consumes
+deets::concurrency::SpscQueue<sensor_sample_t, 16> sample_queue;
+deets::scheduling::Scheduler<far::junior::MonotonicClock, 2> acquisition_scheduler;
+#endif
+
+deets::scheduling::Scheduler<far::junior::MonotonicClock, 8> scheduler;
+
+//the devices are brought up side by side, see setup()
+deets::boot::BootSequence<far::junior::MonotonicClock, 5> boot_sequence;
+
+//what a reset in flight needs to carry on, in RAM that
+//survives it. Saved after every sample, see save_checkpoint.
+struct warm_boot_t {
+  far::junior::flight_snapshot_t flight;
+  deets::estimation::MahonyFilter<value_t>::snapshot_t tilt;
+  bool mpu9250_present;
+  bool bno055_present;
+  bool nrf24l01_present;
+};
+deets::checkpoint::Checkpoint<warm_boot_t> warm_boot DEETS_NOINIT;
+
+#ifdef USE_DATA_READY_INTERRUPTS
+static_assert(Board::IMU == far::junior::imu::BNO055, "the MPU9250 data ready interrupt is not supported");
+static_assert(far::junior::has_imu_int_pin<Board>::value, "the IMU of this board has no data ready line");
+far::junior::DataReadyQueue<8> data_ready;
+#endif
+
 void setup() {
 
   double altitude;
@@ -112,18 +253,17 @@ void setup() {
   inertial_measurement_t imu_data;
 
   //set all pyro pins as outputs and inactive
-  pinMode(PYRO0, OUTPUT);
-  digitalWrite(PYRO0, LOW);
-  pinMode(PYRO1, OUTPUT);
-  digitalWrite(PYRO1, LOW);
-  pinMode(PYRO2, OUTPUT);
-  digitalWrite(PYRO2, LOW);
-  pinMode(PYRO3, OUTPUT);
-  digitalWrite(PYRO3, LOW);
+  for (const auto pin : Board::PYRO_PINS) {
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+  }
+  #ifndef RASPBERRYPI_PICO
+  pyro_timer.attachInterrupt(pyro_timer_isr);
+  #endif
 
   //join I2C bus
   Wire.begin();
-  Wire.setClock(100000);
+  Wire.setClock(I2C_CLOCK);
 
   //open USB com port
   #ifndef RASPBERRYPI_PICO
@@ -135,157 +275,588 @@ void setup() {
   //serial port #1 set to 9600 8n1 for GPS data stream
   Serial1.begin(9600);
 
-  delay(2000);
-  Serial.println(F("FARduino Maple v0.2"));
+  #ifdef USE_TRANSITION_TRACE
+  state_machine.trace(&transition_trace);
+  #endif
 
+  //a reset in flight carries on where it left off
+  warm_boot_t checkpoint;
+  if (warm_boot.load(checkpoint) && far::junior::in_flight(checkpoint.flight.current)) {
+    warm_setup(checkpoint);
+    return;
+  }
 
-  nrf24l01_present = radio_nrf24.begin();
-  if (nrf24l01_present) {
-    Serial.print(F("Initializing nrf24L01+..."));
+  Serial.println(Board::NAME);
+
+  //the BNO055 takes longest to reset, the others come
+  //up meanwhile. Only the IMU the board has is set up.
+  if constexpr (Board::IMU == far::junior::imu::BNO055) {
+    #ifdef USE_DATA_READY_INTERRUPTS
+    imu_bno055.route_data_ready(true);
+    #endif
+    boot_sequence.add("bno055", setup_bno055);
+  }
+  boot_sequence.add("nrf24l01", setup_radio);
+  #ifdef FARDUINO_MPU9250
+  boot_sequence.add("mpu9250", setup_mpu9250);
+  #endif
+  #ifdef USE_SD_CARD
+  boot_sequence.add("sd card", setup_sd_card);
+  #endif
+  boot_sequence.add("bmp280", setup_bmp280);
+  boot_sequence.run(boot_wait);
+  report_boot();
 
-    radio_nrf24.setPayloadSize(32);
-    radio_nrf24.setAutoAck(true);
-    radio_nrf24.setPALevel(RF24_PA_LOW);
-    radio_nrf24.openWritingPipe(ground_address);
-    radio_nrf24.openReadingPipe(1, flight_address);
-    radio_nrf24.startListening();
+  start();
 
-    Serial.println(F("done."));
-  } else {
-    Serial.println(F("<!> nrf24L01+ not detected"));
+  //indicate readiness for operator, without holding up the loop
+  songs.play(never_song);
+}
+
+
+//the boot phases, see deets::boot::BootSequence
+
+deets::boot::step_t setup_bno055(uint8_t step) {
+  const auto result = imu_bno055.setup(step);
+  bno055_present = result.status == deets::boot::step_t::DONE;
+  return result;
+}
+
+
+deets::boot::step_t setup_radio(uint8_t) {
+  nrf24l01_present = radio_nrf24.begin();
+  if (!nrf24l01_present) {
+    return deets::boot::step_t::failed();
   }
+  configure_radio();
+  return deets::boot::step_t::done();
+}
 
-  //initialize I2C devices
 
+#ifdef FARDUINO_MPU9250
+deets::boot::step_t setup_mpu9250(uint8_t) {
   mpu9250_present = imu_mpu9250.testConnection();
-  if (mpu9250_present) {
-    Serial.print(F("Initializing MPU9250..."));
-    imu_mpu9250.initialize();
-    //set gyroscope scale to +/-2000°/s
-    imu_mpu9250.setFullScaleGyroRange(MPU9250_GYRO_FS_2000);
-    //set acceleration scale to +/-16g
-    imu_mpu9250.setFullScaleAccelRange(MPU9250_ACCEL_FS_16);
-    Serial.println(F("done."));
-  } else {
-    Serial.println("<!> MPU9250 not detected");
+  if (!mpu9250_present) {
+    return deets::boot::step_t::failed();
   }
+  imu_mpu9250.initialize();
+  //set gyroscope scale to +/-2000°/s
+  imu_mpu9250.setFullScaleGyroRange(MPU9250_GYRO_FS_2000);
+  //set acceleration scale to +/-16g
+  imu_mpu9250.setFullScaleAccelRange(MPU9250_ACCEL_FS_16);
+  return deets::boot::step_t::done();
+}
+#endif
 
-  bno055_present = imu_bno055.begin();
-  if (bno055_present) {
-    Serial.print(F("Initializing BNO055..."));
-    imu_bno055.setExtCrystalUse(true);
-    Serial.println("ready.");
-  } else {
-    Serial.println("<!> BNO055 not detected");
-  }
 
+#ifdef USE_SD_CARD
+deets::boot::step_t setup_sd_card(uint8_t) {
   // Initialize the SD card at SPI_HALF_SPEED to avoid bus errors with
   // breadboards.  use SPI_FULL_SPEED for better performance.
-  #ifdef USE_SD_CARD
   SD_present = sd.begin(chipSelect, SPI_FULL_SPEED);
   if (!SD_present) {
-    Serial.println("<!> no SD card found");
-  } else {
-    Serial.println("SD card initialized");
-    //search for next free file dataXXXX.txt
-    do {
-      sprintf(my_name, "data%04d.txt", file_count++);
-      Serial.print("checking ");
-      Serial.println(my_name);
-
-      file_exists = !dataFile.open(my_name, O_CREAT | O_WRITE | O_EXCL);
-      if (!file_exists) {
-        Serial.print("file ");
-        Serial.print(my_name);
-        Serial.println(" created");
-      }
-    } while (file_exists);
+    return deets::boot::step_t::failed();
   }
-  #endif
-  
+  open_next_log_file();
+  return deets::boot::step_t::done();
+}
+#endif
+
+
+//halts if there is no pressure sensor
+deets::boot::step_t setup_bmp280(uint8_t) {
+  setup_met();
+  return deets::boot::step_t::done();
+}
+
+
+void boot_wait(duration_t wait) {
+  delayMicroseconds(unsigned(wait.count()));
+}
+
 
-  if (!met.begin(0x76)) {
+//when each device was up, and how long it kept us busy
+void report_boot() {
+  for (size_t i = 0; i < boot_sequence.size(); ++i) {
+    const auto& statistics = boot_sequence.statistics(i);
+    snprintf(my_line, sizeof(my_line), "%-9.9s %-6s after %5ums, busy %5ums",
+             boot_sequence.name(i),
+             statistics.status == deets::boot::step_t::DONE ? "ok" : "absent",
+             unsigned(statistics.end.count() / 1000),
+             unsigned(statistics.busy.count() / 1000));
+    Serial.println(my_line);
+  }
+  sprintf(my_line, "ready %ldms after reset", long(millis()));
+  Serial.println(my_line);
+}
+
+
+//after a reset in flight: the sensors kept running, only
+//what we knew about them and the flight is gone. No
+//probing, no waiting, no song, and no SD card.
+void warm_setup(const warm_boot_t& checkpoint) {
+
+  Serial.print(Board::NAME);
+  Serial.println(F(", warm boot"));
+
+  mpu9250_present = checkpoint.mpu9250_present;
+  bno055_present = checkpoint.bno055_present;
+  nrf24l01_present = checkpoint.nrf24l01_present && radio_nrf24.begin();
+  if (nrf24l01_present) {
+    configure_radio();
+  }
+
+  setup_met();
+
+  attitude.restore(checkpoint.tilt);
+  state_machine.restore(far::junior::MonotonicClock::now(), checkpoint.flight);
+
+  start();
+}
+
+
+void configure_radio() {
+  radio_nrf24.setPayloadSize(32);
+  radio_nrf24.setAutoAck(true);
+  radio_nrf24.setPALevel(RF24_PA_LOW);
+  radio_nrf24.openWritingPipe(ground_address);
+  radio_nrf24.openReadingPipe(1, flight_address);
+  radio_nrf24.startListening();
+}
+
+
+void setup_met() {
+  if (!met.begin()) {
     Serial.println(F("<!> BMP280 not detected"));
     //halt program if no pressure sensor is detected
     exit(-1);
   }
-  
-  //indicate readiness for operator
-  play_rtttl(never_song);
+  //fix the BMP280 sampling, so we know its output data rate
+  met.configure(deets::sensors::bmp280_mode::NORMAL,
+                deets::sensors::bmp280_oversampling::X2,
+                deets::sensors::bmp280_oversampling::X8,
+                deets::sensors::bmp280_filter::X4,
+                deets::sensors::bmp280_standby::MS_0_5);
+}
 
+
+//the same for cold and warm boots
+void start() {
+
+  #ifdef USE_DATA_READY_INTERRUPTS
+  setup_data_ready_interrupts();
+  #endif
+
+  #ifdef FARDUINO_DUAL_CORE
+  //from now on only core 1 touches the I2C bus
+  multicore_launch_core1(acquisition_loop);
+  #endif
+
+  #ifdef USE_PERF_COUNTERS
+  deets::profiling::CycleCounter::enable();
+  #endif
+
+  setup_tasks();
 }
 
 
+void setup_tasks() {
 
-//central LOOP
+#if defined(FARDUINO_DUAL_CORE) || defined(USE_DATA_READY_INTERRUPTS)
+  //at the IMU rate, so fits() keeps room for it
+  scheduler.add("control", process_pending_samples, std::chrono::microseconds(IMU_PERIOD));
+#else
+  scheduler.add("imu", read_imu, std::chrono::microseconds(IMU_PERIOD));
+  scheduler.add("met", read_met, std::chrono::microseconds(MET_PERIOD));
+#endif
+  scheduler.add("imu telemetry", send_imu_telemetry, std::chrono::microseconds(IMU_TELEMETRY_PERIOD), deets::scheduling::task_kind::OPTIONAL);
+  scheduler.add("met telemetry", send_met_telemetry, std::chrono::microseconds(MET_TELEMETRY_PERIOD));
+  scheduler.add("gps", read_gps, std::chrono::microseconds(GPS_PERIOD));
+#ifdef USE_SD_CARD
+  scheduler.add("sd", sync_sd_card, std::chrono::microseconds(SD_SYNC_PERIOD), deets::scheduling::task_kind::OPTIONAL);
+#endif
+#ifdef USE_PERF_COUNTERS
+  scheduler.add("perf", send_perf_telemetry, std::chrono::microseconds(PERF_PERIOD), deets::scheduling::task_kind::OPTIONAL);
+#endif
+  scheduler.add("song", play_song, std::chrono::microseconds(SONG_PERIOD), deets::scheduling::task_kind::OPTIONAL);
+}
 
-void loop() {
 
-  char sentence[100];
 
-  unsigned long met_timestamp;
-  unsigned long flight_time;
-  unsigned long mean_count;
-  unsigned long delta_time;
-  double delta_pressure;
+//sensor acquisition, on core 1 if we have one
+
+//false if the IMU couldn't be read, the sample is stale then
+bool acquire_imu_sample(sensor_sample_t& sample) {
 
-  const auto imu_timestamp = std::chrono::steady_clock::now();
-#ifdef farduino_maple_v1
+  sample.timestamp = far::junior::MonotonicClock::now();
+  sample.imu_timestamp = sample.timestamp;
+  sample.imu_fresh = false;
+  sample.met_fresh = false;
+  #ifdef FARDUINO_MPU9250
   if (mpu9250_present) {
-    get_mpu9250_data(raw_acc[0], raw_acc[1], raw_acc[2], raw_omega[0], raw_omega[1], raw_omega[2], raw_B[0], raw_B[1], raw_B[2]);
-    
-    acc[0] = raw_acc[0]/ONE_G;
-    acc[1] = raw_acc[1]/ONE_G;
-    acc[2] = raw_acc[2]/ONE_G;
-  
-    //calculate norm of acceleration vector in g
-    norm_acc = sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
-  
-    omega[0] = raw_omega[0]/ONE_DEG_PER_SECOND;
-    omega[1] = raw_omega[1]/ONE_DEG_PER_SECOND;
-    omega[2] = raw_omega[2]/ONE_DEG_PER_SECOND;
-  
-    norm_omega = sqrt(raw_omega[0] * raw_omega[0] + raw_omega[1] * raw_omega[1] + raw_omega[2] * raw_omega[2]);
-  
-    construct_IMU_sentence(imu_timestamp, acc, omega, raw_B, &sentence[0]);
-    send_sentence_to_all(&sentence[0]);
+    get_mpu9250_data(sample.raw_acc[0], sample.raw_acc[1], sample.raw_acc[2], sample.raw_omega[0], sample.raw_omega[1], sample.raw_omega[2], sample.raw_B[0], sample.raw_B[1], sample.raw_B[2]);
+    sample.imu_fresh = true;
   }
-#elsif
+  #else
   if (bno055_present) {
-    get_bno055_data(raw_acc[0], raw_acc[1], raw_acc[2], raw_omega[0], raw_omega[1], raw_omega[2], raw_B[0], raw_B[1], raw_B[2]);
-    
-    acc[0] = raw_acc[0]/ONE_G;
-    acc[1] = raw_acc[1]/ONE_G;
-    acc[2] = raw_acc[2]/ONE_G;
-  
-    //calculate norm of acceleration vector in g
-    norm_acc = sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
-  
-    omega[0] = raw_omega[0]/ONE_DEG_PER_SECOND;
-    omega[1] = raw_omega[1]/ONE_DEG_PER_SECOND;
-    omega[2] = raw_omega[2]/ONE_DEG_PER_SECOND;
+    sample.imu_fresh = get_bno055_data(sample.raw_acc[0], sample.raw_acc[1], sample.raw_acc[2], sample.raw_omega[0], sample.raw_omega[1], sample.raw_omega[2], sample.raw_B[0], sample.raw_B[1], sample.raw_B[2]);
+  }
+  #endif
+  return sample.imu_fresh;
+}
+
+
+//false if the BMP280 couldn't be read, the sample is stale then
+bool acquire_met_sample(sensor_sample_t& sample) {
+
+  sample.met_fresh = get_MET_data(sample.met_timestamp, sample.temperature, sample.pressure);
+  sample.timestamp = sample.met_timestamp;
+  sample.imu_fresh = false;
+  return sample.met_fresh;
+}
+
+
+//to control on this core, or through the queue on the other
+void publish_sample(const sensor_sample_t& sample) {
+#ifdef FARDUINO_DUAL_CORE
+  sample_queue.push(sample);
+#else
+  control(sample);
+#endif
+}
+
+
+//the sensor tasks, at the output data rates
+void read_imu() {
+  if (acquire_imu_sample(latest_sample)) {
+    publish_sample(latest_sample);
+  }
+}
+
+
+void read_met() {
+  if (acquire_met_sample(latest_sample)) {
+    publish_sample(latest_sample);
+  }
+}
+
+
+//one shot, the sequencer sets the timer again if needed
+void pyro_timer_isr() {
+  #ifndef RASPBERRYPI_PICO
+  pyro_timer.pause();
+  #endif
+  pyro.run(far::junior::MonotonicClock::ticks());
+}
+
+
+#ifdef USE_DATA_READY_INTERRUPTS
+void imu_data_ready_isr() {
+  data_ready.signal(far::junior::sensor_channel::IMU, far::junior::MonotonicClock::ticks());
+}
+
+
+void met_data_ready_isr() {
+  data_ready.signal(far::junior::sensor_channel::MET, far::junior::MonotonicClock::ticks());
+}
+
+
+//reads the sensor that signalled first, false if none did
+bool acquire_pending_sample(sensor_sample_t& sample) {
+
+  far::junior::data_ready_t record;
+
+  if (!data_ready.next(record)) {
+    return false;
+  }
+
+  sample.timestamp = far::junior::MonotonicClock::from_ticks(record.timestamp);
+  sample.imu_fresh = false;
+  sample.met_fresh = false;
+
+  switch (record.channel) {
+    case far::junior::sensor_channel::IMU:
+      //nothing fresh if the read failed, control() skips it
+      sample.imu_fresh = get_bno055_data(sample.raw_acc[0], sample.raw_acc[1], sample.raw_acc[2], sample.raw_omega[0], sample.raw_omega[1], sample.raw_omega[2], sample.raw_B[0], sample.raw_B[1], sample.raw_B[2]);
+      //the INT pin is latched until we reset it, also after
+      //a failed read
+      bno055_write(BNO055_SYS_TRIGGER, BNO055_RST_INT | BNO055_CLK_SEL);
+      sample.imu_timestamp = sample.timestamp;
+      break;
+    case far::junior::sensor_channel::MET:
+      //nothing fresh if the read failed, control() skips it
+      sample.met_fresh = get_MET_data(sample.met_timestamp, sample.temperature, sample.pressure);
+      sample.met_timestamp = sample.timestamp;
+      break;
+  }
+  return true;
+}
+
+
+void bno055_write(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(BNO055_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+
+void setup_data_ready_interrupts() {
+
+  if (bno055_present) {
+    pinMode(Board::IMU_INT_PIN, INPUT);
+    attachInterrupt(digitalPinToInterrupt(Board::IMU_INT_PIN), imu_data_ready_isr, RISING);
+    //a sample that came before we listened latched INT,
+    //there won't be another rising edge until it's reset
+    bno055_write(BNO055_SYS_TRIGGER, BNO055_RST_INT | BNO055_CLK_SEL);
+  }
+
+  //the BMP280 has no interrupt line, but we know when
+  //a conversion is done and let a timer signal that.
+  #ifdef RASPBERRYPI_PICO
+  met_ticker.attach(&met_data_ready_isr, std::chrono::microseconds(MET_PERIOD));
+  #else
+  met_timer.setOverflow(MET_PERIOD, MICROSEC_FORMAT);
+  met_timer.attachInterrupt(met_data_ready_isr);
+  met_timer.resume();
+  #endif
+}
+#endif
+
+
+#ifdef FARDUINO_DUAL_CORE
+//runs forever on core 1, owns the I2C bus
+void acquisition_loop() {
+
+#ifdef USE_DATA_READY_INTERRUPTS
+  while (true) {
+    if (acquire_pending_sample(latest_sample)) {
+      publish_sample(latest_sample);
+    }
+  }
+#else
+  acquisition_scheduler.add("imu", read_imu, std::chrono::microseconds(IMU_PERIOD));
+  acquisition_scheduler.add("met", read_met, std::chrono::microseconds(MET_PERIOD));
+
+  while (true) {
+    acquisition_scheduler.run_once();
+  }
+#endif
+}
+#endif
+
+
+#if defined(FARDUINO_DUAL_CORE) || defined(USE_DATA_READY_INTERRUPTS)
+//runs at the IMU rate and controls with whatever arrived
+void process_pending_samples() {
+#ifdef FARDUINO_DUAL_CORE
+  sensor_sample_t sample;
+
+  while (sample_queue.pop(sample)) {
+    control(sample);
+  }
+#else
+  while (acquire_pending_sample(latest_sample)) {
+    control(latest_sample);
+  }
+#endif
+}
+#endif
+
+
+//control for each fresh sample
+
+void control(const sensor_sample_t& sample) {
+
+  if (sample.imu_fresh) {
+    acc[0] = sample.raw_acc[0]/one_g;
+    acc[1] = sample.raw_acc[1]/one_g;
+    acc[2] = sample.raw_acc[2]/one_g;
   
-    norm_omega = sqrt(raw_omega[0] * raw_omega[0] + raw_omega[1] * raw_omega[1] + raw_omega[2] * raw_omega[2]);
-    
-    construct_IMU_sentence(imu_timestamp, acc, omega, raw_B, &sentence[0]);
+    omega[0] = sample.raw_omega[0]/one_deg_per_second;
+    omega[1] = sample.raw_omega[1]/one_deg_per_second;
+    omega[2] = sample.raw_omega[2]/one_deg_per_second;
+
+    update_attitude(sample.imu_timestamp);
+    vertical_acc = acceleration_filter.update(attitude.vertical_acceleration(acc) * gravity);
+
+    telemetry_sample.imu_timestamp = sample.imu_timestamp;
+    for (int i = 0; i < 3; i++) {
+      telemetry_sample.raw_B[i] = sample.raw_B[i];
+    }
+    telemetry_sample.imu_fresh = true;
+  }
+
+  if (sample.met_fresh) {
+    filtered_pressure = pressure_filter.update(sample.pressure);
+    if(const auto ground_pressure = state_machine.ground_pressure())
+    {
+      altitude = deets::estimation::fast_barometric_altitude(sample.pressure, *ground_pressure);
+    }
+    else
+    {
+      altitude = value_t(-1.0);
+    }
+
+    telemetry_sample.met_timestamp = sample.met_timestamp;
+    telemetry_sample.pressure = sample.pressure;
+    telemetry_sample.temperature = sample.temperature;
+    telemetry_sample.met_fresh = true;
+  }
+
+  if (sample.imu_fresh || sample.met_fresh) {
+    PERF_PROBE(perf_DRIVE);
+    //the IMU comes three times as often as the barometer, its
+    //samples don't carry the last pressure along
+    std::optional<value_t> pressure;
+    if (sample.met_fresh) {
+      pressure = filtered_pressure;
+    }
+    state_machine.drive(sample.timestamp, pressure, vertical_acc, attitude.cos_tilt(), sample.temperature);
+    save_checkpoint();
+    #ifdef USE_SD_CARD
+    sample_count++;
+    #endif
+    #ifdef USE_TRANSITION_TRACE
+    if (!transition_trace_dumped && state_reactions.current_state() == far::junior::state::LANDED) {
+      dump_transition_trace();
+    }
+    #endif
+  }
+}
+
+
+#ifdef USE_TRANSITION_TRACE
+//once on landing, to the serial line and the card. The radio
+//is left to the GPS sentences for the recovery.
+void dump_transition_trace() {
+
+  char sentence[64];
+  const timestamp_t now = far::junior::MonotonicClock::now();
+
+  transition_trace_dumped = true;
+  for (size_t i = 0; i < transition_trace.size(); i++) {
+    construct_trace_sentence(now, i, transition_trace.recorded(), transition_trace[i], &sentence[0]);
+    Serial.print(sentence);
+    #ifdef USE_SD_CARD
+    if (SD_present) {
+      dataFile.print(sentence);
+    }
+    #endif
+  }
+}
+#endif
+
+
+//every sample, so a reset loses at most the time since the
+//last one. The CRC of the ~200 bytes is ~2500 cycles.
+void save_checkpoint() {
+
+  warm_boot_t checkpoint;
+  checkpoint.flight = state_machine.snapshot();
+  checkpoint.tilt = attitude.snapshot();
+  checkpoint.mpu9250_present = mpu9250_present;
+  checkpoint.bno055_present = bno055_present;
+  checkpoint.nrf24l01_present = nrf24l01_present;
+  warm_boot.save(checkpoint);
+}
+
+
+//integrates acc and omega since the last IMU sample. After
+//a gap, e.g. the calibration, we just start over from there.
+void update_attitude(timestamp_t imu_timestamp) {
+
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(imu_timestamp - last_imu_timestamp).count();
+  last_imu_timestamp = imu_timestamp;
+
+  if (!attitude_started || elapsed <= 0 || elapsed > 10 * IMU_PERIOD) {
+    attitude_started = true;
+    return;
+  }
+
+  //in seconds, through milliseconds to stay within Q15.16
+  const value_t dt = deets::sensors::scaled<value_t>(int32_t(elapsed), 1000) / value_t(1000);
+  const value_t omega_radians[3] = {
+    omega[0] * radians_per_degree,
+    omega[1] * radians_per_degree,
+    omega[2] * radians_per_degree,
+  };
+  attitude.update(acc, omega_radians, dt);
+}
+
+
+//telemetry of the latest readings, at lower rates
+
+void send_imu_telemetry() {
+
+  char sentence[100];
+
+  if (telemetry_sample.imu_fresh) {
+    telemetry_sample.imu_fresh = false;
+    {
+      PERF_PROBE(perf_ENCODE);
+      construct_IMU_sentence(telemetry_sample.imu_timestamp, acc, omega, telemetry_sample.raw_B, &sentence[0]);
+    }
+    send_sentence_to_all(&sentence[0]);
+  }
+}
+
+
+void send_met_telemetry() {
+
+  char sentence[100];
+
+  if (telemetry_sample.met_fresh) {
+    telemetry_sample.met_fresh = false;
+    {
+      PERF_PROBE(perf_ENCODE);
+      construct_MET_sentence(telemetry_sample.met_timestamp, telemetry_sample.pressure, telemetry_sample.temperature, altitude, &sentence[0]);
+    }
     send_sentence_to_all(&sentence[0]);
   }
+}
+
+
+#ifdef USE_PERF_COUNTERS
+void send_perf_telemetry() {
+
+  char sentence[100];
+  const timestamp_t now = far::junior::MonotonicClock::now();
+
+  for (int stage = 0; stage < perf_STAGES; stage++) {
+    construct_perf_sentence(now, perf_stage_t(stage), &sentence[0]);
+    send_sentence_to_all(&sentence[0]);
+  }
+}
 #endif
 
-  
-  get_MET_data(met_timestamp, temperature, pressure, altitude);
 
-  construct_MET_sentence(met_timestamp, pressure, temperature, altitude, &sentence[0]);
-  send_sentence_to_all(&sentence[0]);
-  
+void read_gps() {
+
   bool gps_available = get_GPS_data();
   if (gps_available) {
-    send_sentence_to_all(&GPS_sentence[0]);
+    send_sentence_to_all(gps_parser.sentence().c_str());
   }
+}
 
 
-  #ifdef USE_SD_CARD
-  sample_count++;
+//whatever state_reactions queued, one note at a time
+void play_song() {
+  songs.update();
+}
+
+
+//central LOOP
+
+void loop() {
+  scheduler.run_once();
+}
+
+
+#ifdef USE_SD_CARD
+void sync_sd_card() {
+
+  PERF_PROBE(perf_SD_SYNC);
 
   if (SD_present) {
     // Force data to SD and update the directory entry to avoid data loss.
@@ -295,29 +866,58 @@ void loop() {
 
     if (sample_count >= MAX_SAMPLE_COUNT && state_reactions.safe_to_flush_sd_card()) {
       dataFile.close();
+      open_next_log_file();
+      sample_count = 0;
+    }
+  }
+}
 
-      do {
-        sprintf(my_name, "data%04d.txt", file_count++);
-        Serial.print("creating file ");
-        Serial.println(my_name);
-        file_exists = !dataFile.open(my_name, O_CREAT | O_WRITE | O_EXCL);
-        if (file_exists) {
-          Serial.println("file exists.");
-        } else {
-          Serial.println("new file created");
-        }
-      } while (file_exists);
 
-      sample_count = 0;
+//the next free dataXXXX.txt, from the counter on the card
+//instead of checking each name from data0000.txt on. A
+//card without a counter, or one somebody else wrote logs
+//to, costs a scan from where the counter stands.
+void open_next_log_file() {
+
+  SdFile counter;
+  const bool counted = counter.open(log_counter_name, O_RDWR | O_CREAT);
+  if (counted) {
+    char number[8] = {};
+    counter.read(number, sizeof(number) - 1);
+    const unsigned int next = atoi(number);
+    if (next > file_count) {
+      file_count = next;
     }
   }
-  #endif
-  state_machine.drive(imu_timestamp, pressure, norm_acc);
+
+  bool created = false;
+  while (!created && file_count < 10000) {
+    sprintf(my_name, "data%04d.txt", file_count++);
+    created = dataFile.open(my_name, O_CREAT | O_WRITE | O_EXCL);
+  }
+
+  if (counted) {
+    //fixed width, so it always overwrites the last one
+    sprintf(my_line, "%04u\n", file_count);
+    counter.rewind();
+    counter.write(my_line, strlen(my_line));
+    counter.close();
+  }
+
+  if (created) {
+    Serial.print("logging to ");
+    Serial.println(my_name);
+  } else {
+    Serial.println("<!> no free log file");
+  }
 }
+#endif
 
 
 void send_sentence(const char* message) {
 
+  PERF_PROBE(perf_SEND);
+
   ring.write(message, strlen(message));
 
   radio_nrf24.stopListening();
@@ -333,56 +933,13 @@ void send_sentence(const char* message) {
 
 bool get_GPS_data(void) {
 
-  char cipher = 0;
-  char first_char;
-  char second_char;
-  unsigned char received_checksum;
+  PERF_PROBE(perf_GPS);
 
+  //one sentence at a time, the rest stays in the serial buffer
   while (Serial1.available()) {
-    cipher = Serial1.read();
-
-    if (cipher == '$') {
-      GPS_checksum = 0;
-      GPS_pointer = 0;
-      receiving_GPS = true;
-    }
-
-    GPS_sentence[GPS_pointer] = cipher;
-    if (GPS_pointer < 128) {
-      GPS_pointer++;
-    }
-
-    if (cipher == '*') {
-      receiving_GPS = false;
-    } else if ((cipher != '$') && receiving_GPS) {
-      GPS_checksum ^= cipher;
-    } else if (cipher == 0x0A) {
-      first_char = GPS_sentence[GPS_pointer - 4];
-      second_char = GPS_sentence[GPS_pointer - 3];
-
-      if (first_char > '9') {
-        first_char = first_char - 'A' + 10;
-      } else {
-        first_char = first_char - '0';
-      }
-
-      if (second_char > '9') {
-        second_char = second_char - 'A' + 10;
-      } else {
-        second_char = second_char - '0';
-      }
-
-      received_checksum = (first_char << 4) + second_char;
-
-      //Serial1.println(received_checksum,HEX);
-      //Serial1.println(GPS_checksum,HEX);
-
-      if (GPS_checksum == received_checksum) {
-        GPS_sentence[GPS_pointer] = 0;
-        return true;
-      } else {
-        return false;
-      }
+    if (gps_parser.feed(Serial1.read())) {
+      deets::nmea::decode(gps_parser.sentence(), gps_fix);
+      return true;
     }
   }
   return false;
@@ -391,7 +948,10 @@ bool get_GPS_data(void) {
 
 
 
-void get_mpu9250_data(double& acc_x, double& acc_y, double& acc_z, double& omega_x, double& omega_y, double& omega_z, double& mag_x, double& mag_y, double& mag_z) {
+#ifdef FARDUINO_MPU9250
+void get_mpu9250_data(value_t& acc_x, value_t& acc_y, value_t& acc_z, value_t& omega_x, value_t& omega_y, value_t& omega_z, value_t& mag_x, value_t& mag_y, value_t& mag_z) {
+
+  PERF_PROBE(perf_IMU_READ);
 
   int16_t ax, ay, az;
   int16_t wx, wy, wz;
@@ -399,58 +959,69 @@ void get_mpu9250_data(double& acc_x, double& acc_y, double& acc_z, double& omega
 
   imu_mpu9250.getMotion9(&ax, &ay, &az, &wx, &wy, &wz, &Bx, &By, &Bz);
 
-  acc_x = (double)ax;
-  acc_y = (double)ay;
-  acc_z = (double)az;
+  acc_x = value_t(ax);
+  acc_y = value_t(ay);
+  acc_z = value_t(az);
 
-  omega_x = (double)wx - omega_0[0];
-  omega_y = (double)wy - omega_0[1];
-  omega_z = (double)wz - omega_0[2];
+  omega_x = value_t(wx) - omega_0[0];
+  omega_y = value_t(wy) - omega_0[1];
+  omega_z = value_t(wz) - omega_0[2];
 
-  mag_x = (double)Bx;
-  mag_y = (double)By;
-  mag_z = (double)Bz;
+  mag_x = value_t(Bx);
+  mag_y = value_t(By);
+  mag_z = value_t(Bz);
 }
+#endif
 
 
-void get_bno055_data(double& acc_x, double& acc_y, double& acc_z, double& omega_x, double& omega_y, double& omega_z, double& mag_x, double& mag_y, double& mag_z) {
+//false if the read failed, the values are left alone then
+bool get_bno055_data(value_t& acc_x, value_t& acc_y, value_t& acc_z, value_t& omega_x, value_t& omega_y, value_t& omega_z, value_t& mag_x, value_t& mag_y, value_t& mag_z) {
 
-  sensors_event_t magneticData, angVelocityData, accelData;
+  PERF_PROBE(perf_IMU_READ);
 
-  imu_bno055.getEvent(&magneticData, Adafruit_BNO055::VECTOR_MAGNETOMETER);
-  imu_bno055.getEvent(&angVelocityData, Adafruit_BNO055::VECTOR_GYROSCOPE);
-  imu_bno055.getEvent(&accelData, Adafruit_BNO055::VECTOR_ACCELEROMETER);
+  using deets::sensors::scaled;
+  using bno055_t = decltype(imu_bno055);
+
+  //accelerometer, magnetometer and gyroscope in one burst
+  deets::sensors::bno055_vectors_t vectors;
+  if (!imu_bno055.read(vectors)) {
+    return false;
+  }
 
-  acc_x = accelData.acceleration.x;
-  acc_y = accelData.acceleration.y;
-  acc_z = accelData.acceleration.z;
+  acc_x = scaled<value_t>(vectors.acceleration[0], bno055_t::LSB_PER_METER_PER_SECOND2);
+  acc_y = scaled<value_t>(vectors.acceleration[1], bno055_t::LSB_PER_METER_PER_SECOND2);
+  acc_z = scaled<value_t>(vectors.acceleration[2], bno055_t::LSB_PER_METER_PER_SECOND2);
 
-  omega_x = angVelocityData.gyro.x;
-  omega_y = angVelocityData.gyro.y;
-  omega_z = angVelocityData.gyro.z;
+  omega_x = scaled<value_t>(vectors.angular_velocity[0], bno055_t::LSB_PER_DEGREE_PER_SECOND);
+  omega_y = scaled<value_t>(vectors.angular_velocity[1], bno055_t::LSB_PER_DEGREE_PER_SECOND);
+  omega_z = scaled<value_t>(vectors.angular_velocity[2], bno055_t::LSB_PER_DEGREE_PER_SECOND);
 
-  mag_x = magneticData.magnetic.x;
-  mag_y = magneticData.magnetic.y;
-  mag_z = magneticData.magnetic.z;
+  mag_x = scaled<value_t>(vectors.magnetic[0], bno055_t::LSB_PER_MICROTESLA);
+  mag_y = scaled<value_t>(vectors.magnetic[1], bno055_t::LSB_PER_MICROTESLA);
+  mag_z = scaled<value_t>(vectors.magnetic[2], bno055_t::LSB_PER_MICROTESLA);
+  return true;
 }
 
 
 
 
 
-void get_MET_data(unsigned long& timestamp, double& temperature, double& pressure, double& altitude) {
+//false if the read failed, temperature and pressure are
+//left alone then
+bool get_MET_data(timestamp_t& timestamp, value_t& temperature, value_t& pressure) {
 
-  timestamp = get_timestamp();
-  temperature = met.readTemperature();
-  pressure = met.readPressure() / 100.0;
-  if(const auto ground_pressure = state_machine.ground_pressure())
-  {
-    altitude = met.readAltitude(*ground_pressure);
-  }
-  else
-  {
-    altitude = -1.0;
+  PERF_PROBE(perf_MET_READ);
+
+  //pressure and temperature in one burst, compensated once
+  deets::sensors::bmp280_measurement_t measurement;
+  timestamp = far::junior::MonotonicClock::now();
+  if (!met.read(measurement)) {
+    return false;
   }
+  temperature = deets::sensors::scaled<value_t>(measurement.temperature, 100);
+  //Pa in Q24.8 to mbar
+  pressure = deets::sensors::scaled<value_t>(int32_t(measurement.pressure), 25600);
+  return true;
 }
 
 
@@ -459,23 +1030,28 @@ void mean_pressure(int n, double& mean_p, double& sigma_p) {
   double sum = 0.0;
   double sum2 = 0.0;
 
-  unsigned long timestamp;
-  double temp;
-  double p;
-  double h;
+  timestamp_t timestamp;
+  value_t temp;
+  value_t p;
+  int read = 0;
 
   for (int k = 0; k < n; k++) {
-    get_MET_data(timestamp, temp, p, h);
+    if (!get_MET_data(timestamp, temp, p)) {
+      continue;
+    }
+    read++;
 
-    sum += p;
-    sum2 += p * p;
+    sum += double(p);
+    sum2 += double(p) * double(p);
   }
 
+  n = read;
   mean_p = sum / n;
   sigma_p = sqrt((sum2 - n * mean_p * mean_p) / (n - 1));
 }
 
 
+#ifdef FARDUINO_MPU9250
 void mean_inertial(int n, inertial_measurement_t& data) {
 
   double sum_acc[3] = { 0.0, 0.0, 0.0 };
@@ -489,23 +1065,26 @@ void mean_inertial(int n, inertial_measurement_t& data) {
 
 
 
-  unsigned long timestamp;
-  double norm_acc[3];
-  double norm_omega[3];
-  double B[3];
+  value_t sample_acc[3];
+  value_t sample_omega[3];
+  value_t sample_B[3];
 
   for (int k = 0; k < n; k++) {
-    get_mpu9250_data(norm_acc[0], norm_acc[1], norm_acc[2], norm_omega[0], norm_omega[1], norm_omega[2], B[0], B[1], B[2]);
+    get_mpu9250_data(sample_acc[0], sample_acc[1], sample_acc[2], sample_omega[0], sample_omega[1], sample_omega[2], sample_B[0], sample_B[1], sample_B[2]);
 
     for (int j = 0; j < 3; j++) {
-      sum_acc[j] += norm_acc[j];
-      sum_acc2[j] += norm_acc[j] * norm_acc[j];
+      const double norm_acc = double(sample_acc[j]);
+      const double norm_omega = double(sample_omega[j]);
+      const double B = double(sample_B[j]);
 
-      sum_w[j] += norm_omega[j];
-      sum_w2[j] += norm_omega[j] * norm_omega[j];
+      sum_acc[j] += norm_acc;
+      sum_acc2[j] += norm_acc * norm_acc;
 
-      sum_B[j] += B[j];
-      sum_B2[j] += B[j] * B[j];
+      sum_w[j] += norm_omega;
+      sum_w2[j] += norm_omega * norm_omega;
+
+      sum_B[j] += B;
+      sum_B2[j] += B * B;
     }
   }
 
@@ -521,6 +1100,7 @@ void mean_inertial(int n, inertial_measurement_t& data) {
     data.sigma_B[j] = sqrt((sum_B2[j] - n * data.mean_B[j] * data.mean_B[j]) / (n - 1));
   }
 }
+#endif
 
 void send_sentence_to_all(const char* sentence)
 {
@@ -534,32 +1114,3 @@ void send_sentence_to_all(const char* sentence)
       send_sentence(sentence);
     }
 }
-
-#include <sys/time.h>
-#ifndef RASPBERRYPI_PICO
-extern "C" int gettimeofday( struct timeval *tv, void *tzvp )
-{
-  static bool initialized = false;
-  static uint64_t usec;
-  static uint64_t sec;
-  static uint64_t last_timestamp;  
-  if(!initialized)
-  {
-    initialized = true;
-    sec = usec = 0;
-    last_timestamp = micros();
-  }
-  else
-  {
-    uint64_t now = micros();
-    uint64_t diff = timestamp_difference(now, last_timestamp);
-    usec += diff;
-    sec += usec / 1000000;
-    usec %= 1000000;
-  }
-    
-  tv->tv_sec = sec;
-  tv->tv_usec = usec;
-  return 0;
-}
-#endif
@@ -0,0 +1,168 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#ifdef RASPBERRYPI_PICO
+#include <hardware/timer.h>
+#endif
+
+namespace far::junior {
+
+// The one clock of the firmware: microseconds since boot
+// in 64 bit, so it never wraps in practice.
+//
+// The RP2040 timer is 64 bit already. Everywhere else the
+// 32 bit micros() counter is extended by counting its
+// wraps, which only costs a comparison and an addition.
+// now() therefore has to be called at least once every
+// 71 minutes, and only from one context: interrupt
+// handlers take ticks() and convert later using
+// from_ticks().
+//
+// On the host the clock is simulated and advanced
+// explicitly.
+struct MonotonicClock
+{
+  using rep = int64_t;
+  using period = std::micro;
+  using duration = std::chrono::duration<rep, period>;
+  using time_point = std::chrono::time_point<MonotonicClock>;
+  static constexpr bool is_steady = true;
+
+  // The raw 32 bit counter, cheap enough for an ISR
+  static uint32_t ticks()
+  {
+#if defined(RASPBERRYPI_PICO)
+    return time_us_32();
+#elif defined(ARDUINO)
+    return micros();
+#else
+    return uint32_t(_simulated);
+#endif
+  }
+
+  static time_point now()
+  {
+#ifdef RASPBERRYPI_PICO
+    return time_point(duration(time_us_64()));
+#else
+    const auto low = ticks();
+    if(low < _last_ticks)
+    {
+      _wraps += uint64_t(1) << 32;
+    }
+    _last_ticks = low;
+    return time_point(duration(rep(_wraps + low)));
+#endif
+  }
+
+  // The time point of an earlier ticks() reading, which
+  // must not be older than one wrap.
+  static time_point from_ticks(uint32_t then)
+  {
+    const auto current = now();
+    const auto age = uint32_t(current.time_since_epoch().count()) - then;
+    return current - duration(age);
+  }
+
+#if !defined(ARDUINO)
+  static void advance(duration d)
+  {
+    _simulated += d.count();
+  }
+#endif
+
+private:
+#if !defined(RASPBERRYPI_PICO)
+  static inline uint32_t _last_ticks = 0;
+  static inline uint64_t _wraps = 0;
+#endif
+#if !defined(ARDUINO)
+  static inline uint64_t _simulated = 0;
+#endif
+};
+
+// Renders a time point as HHMMSS.ffff (fractions in 100us).
+//
+// The HHMMSS part is kept and only counted up when a new
+// second starts, so the usual case is one 32 bit division
+// for the fraction. Only jumps backwards or by more than a
+// minute compute the digits from scratch.
+class TimeOfDayFormatter
+{
+  static constexpr int64_t SECOND = 1000000;
+
+public:
+  TimeOfDayFormatter()
+  {
+    render(0);
+  }
+
+  // Writes 11 characters and a terminating zero
+  void format(MonotonicClock::time_point timestamp, char* destination)
+  {
+    const auto now = timestamp.time_since_epoch().count();
+    auto since = now - _second_start;
+    if(since < 0 || since >= 60 * SECOND)
+    {
+      render(now);
+      since = now - _second_start;
+    }
+    while(since >= SECOND)
+    {
+      next_second();
+      since -= SECOND;
+    }
+    for(int i = 0; i < 6; ++i)
+    {
+      destination[i] = _hhmmss[i];
+    }
+    destination[6] = '.';
+    uint32_t fraction = uint32_t(since) / 100;
+    for(int i = 10; i > 6; --i)
+    {
+      destination[i] = '0' + fraction % 10;
+      fraction /= 10;
+    }
+    destination[11] = 0;
+  }
+
+private:
+  void render(int64_t now)
+  {
+    const auto seconds = uint32_t(now / SECOND);
+    _second_start = int64_t(seconds) * SECOND;
+    const uint32_t values[3] = { (seconds / 3600) % 100, (seconds / 60) % 60, seconds % 60 };
+    for(int i = 0; i < 3; ++i)
+    {
+      _hhmmss[i * 2] = '0' + values[i] / 10;
+      _hhmmss[i * 2 + 1] = '0' + values[i] % 10;
+    }
+  }
+
+  void next_second()
+  {
+    _second_start += SECOND;
+    // Ripple the carry from the seconds to the hours,
+    // the tens of seconds and minutes wrap at 6.
+    for(int i = 5; i >= 0; --i)
+    {
+      const char limit = (i == 2 || i == 4) ? '6' : '9' + 1;
+      if(++_hhmmss[i] < limit)
+      {
+        return;
+      }
+      _hhmmss[i] = '0';
+    }
+  }
+
+  int64_t _second_start;
+  char _hhmmss[6];
+};
+
+} // namespace far::junior
@@ -0,0 +1,428 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace deets::nmea {
+
+// A sentence with a valid checksum, in the buffer of the
+// Parser that found it. Only valid until the next byte is
+// fed to the parser.
+class Sentence
+{
+public:
+  // Splits the body into its fields one at a time
+  class Fields
+  {
+  public:
+    explicit Fields(std::string_view body)
+      : _rest(body)
+      , _done(false)
+    {}
+
+    // The next field, false after the last one
+    bool next(std::string_view& field)
+    {
+      if(_done)
+      {
+        return false;
+      }
+      const auto comma = _rest.find(',');
+      field = _rest.substr(0, comma);
+      if(comma == std::string_view::npos)
+      {
+        _done = true;
+      }
+      else
+      {
+        _rest.remove_prefix(comma + 1);
+      }
+      return true;
+    }
+
+  private:
+    std::string_view _rest;
+    bool _done;
+  };
+
+  Sentence(const char* text, size_t size, size_t body_size)
+    : _text(text)
+    , _size(size)
+    , _body_size(body_size)
+  {}
+
+  // As received, from $ to the line feed, zero terminated
+  const char* c_str() const { return _text; }
+  size_t size() const { return _size; }
+
+  // Between $ and *, e.g. "GPGGA,123519,4807.038,N,..."
+  std::string_view body() const { return { _text + 1, _body_size }; }
+
+  Fields fields() const { return Fields(body()); }
+
+  // The first count fields, the address field being
+  // field 0. Returns how many there were.
+  size_t split(std::string_view* fields, size_t count) const
+  {
+    auto cursor = this->fields();
+    size_t found = 0;
+    while(found < count && cursor.next(fields[found]))
+    {
+      ++found;
+    }
+    return found;
+  }
+
+  // The sentence type regardless of the talker, so
+  // is("GGA") holds for GPGGA and GNGGA.
+  bool is(std::string_view type) const
+  {
+    const auto address = body().substr(0, body().find(','));
+    return address.size() == 2 + type.size() && address.substr(2) == type;
+  }
+
+private:
+  const char* _text;
+  size_t _size;
+  size_t _body_size;
+};
+
+// Assembles sentences from the bytes of a serial line
+// without ever writing past its buffer. Sentences longer
+// than the buffer, without or with a wrong checksum or
+// cut short by the next $ are dropped and counted.
+//
+// NMEA 0183 limits sentences to 82 characters, the
+// terminating zero needs one more.
+template<size_t Capacity = 83>
+class Parser
+{
+  enum class phase : uint8_t
+  {
+    IDLE,
+    BODY,
+    CHECKSUM_HIGH,
+    CHECKSUM_LOW,
+    END,
+  };
+
+public:
+  // True when the byte completed a valid sentence
+  bool feed(char c)
+  {
+    if(c == '$')
+    {
+      if(_phase != phase::IDLE)
+      {
+        ++malformed;
+      }
+      _phase = phase::BODY;
+      _size = 0;
+      _checksum = 0;
+      store(c);
+      return false;
+    }
+    if(_phase == phase::IDLE)
+    {
+      return false;
+    }
+    if(!store(c))
+    {
+      return false;
+    }
+    switch(_phase)
+    {
+    case phase::BODY:
+      if(c == '*')
+      {
+        _body_size = _size - 2;
+        _phase = phase::CHECKSUM_HIGH;
+      }
+      else if(c < ' ' || c > '~')
+      {
+        drop(malformed);
+      }
+      else
+      {
+        _checksum ^= uint8_t(c);
+      }
+      break;
+    case phase::CHECKSUM_HIGH:
+    case phase::CHECKSUM_LOW:
+    {
+      const int digit = hex(c);
+      if(digit < 0)
+      {
+        drop(malformed);
+        break;
+      }
+      _received = uint8_t((_phase == phase::CHECKSUM_HIGH ? 0 : _received << 4) | digit);
+      _phase = _phase == phase::CHECKSUM_HIGH ? phase::CHECKSUM_LOW : phase::END;
+      break;
+    }
+    case phase::END:
+      if(c == '\n')
+      {
+        _buffer[_size] = 0;
+        _phase = phase::IDLE;
+        if(_received != _checksum)
+        {
+          ++checksum_errors;
+          return false;
+        }
+        ++sentences;
+        return true;
+      }
+      if(c != '\r')
+      {
+        drop(malformed);
+      }
+      break;
+    case phase::IDLE:
+      break;
+    }
+    return false;
+  }
+
+  // The last sentence feed returned true for
+  Sentence sentence() const
+  {
+    return Sentence(_buffer, _size, _body_size);
+  }
+
+  uint32_t sentences = 0;
+  uint32_t checksum_errors = 0;
+  uint32_t overflows = 0;
+  uint32_t malformed = 0;
+
+private:
+  bool store(char c)
+  {
+    if(_size + 1 == Capacity)
+    {
+      drop(overflows);
+      return false;
+    }
+    _buffer[_size++] = c;
+    return true;
+  }
+
+  void drop(uint32_t& counter)
+  {
+    ++counter;
+    _phase = phase::IDLE;
+  }
+
+  static int hex(char c)
+  {
+    if(c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+      return c - 'A' + 10;
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+
+  char _buffer[Capacity] = {};
+  size_t _size = 0;
+  size_t _body_size = 0;
+  phase _phase = phase::IDLE;
+  uint8_t _checksum = 0;
+  uint8_t _received = 0;
+};
+
+// What GGA and RMC tell about the position, in integers
+// so neither parsing nor logging needs floating point.
+struct gps_fix_t
+{
+  // UTC, milliseconds since midnight
+  uint32_t time;
+  // ddmmyy as sent in RMC
+  uint32_t date;
+  // 1e-7 degrees, north and east positive
+  int32_t latitude;
+  int32_t longitude;
+  // Millimeters above mean sea level, from GGA
+  int32_t altitude;
+  // Millimeters per second over ground, from RMC
+  int32_t speed;
+  // 1/100 degree, from RMC
+  uint16_t course;
+  // 1/100, from GGA
+  uint16_t hdop;
+  // GGA fix quality, 0 is no fix
+  uint8_t quality;
+  uint8_t satellites;
+  // RMC status A
+  bool valid;
+};
+
+// A decimal number as an integer scaled by 10^decimals,
+// further places are cut off. False for anything that
+// isn't a number or doesn't fit.
+inline bool parse_decimal(std::string_view text, unsigned decimals, int32_t& value)
+{
+  size_t i = 0;
+  const bool negative = !text.empty() && text[0] == '-';
+  if(!text.empty() && (text[0] == '-' || text[0] == '+'))
+  {
+    ++i;
+  }
+  int32_t result = 0;
+  bool digits = false;
+  // Before the decimal point as long as negative
+  int places = -1;
+  for(; i < text.size(); ++i)
+  {
+    const char c = text[i];
+    if(c == '.' && places < 0)
+    {
+      places = 0;
+      continue;
+    }
+    if(c < '0' || c > '9')
+    {
+      return false;
+    }
+    digits = true;
+    if(places >= 0)
+    {
+      if(unsigned(places) == decimals)
+      {
+        continue;
+      }
+      ++places;
+    }
+    if(result > (INT32_MAX - 9) / 10)
+    {
+      return false;
+    }
+    result = result * 10 + (c - '0');
+  }
+  for(unsigned place = places < 0 ? 0 : unsigned(places); place < decimals; ++place)
+  {
+    if(result > INT32_MAX / 10)
+    {
+      return false;
+    }
+    result *= 10;
+  }
+  value = negative ? -result : result;
+  return digits;
+}
+
+// hhmmss.sss to milliseconds since midnight
+inline bool parse_time(std::string_view text, uint32_t& time)
+{
+  int32_t value;
+  if(!parse_decimal(text, 3, value) || value < 0)
+  {
+    return false;
+  }
+  const auto hours = value / 10000000;
+  const auto minutes = value / 100000 % 100;
+  time = uint32_t(hours * 3600000 + minutes * 60000 + value % 100000);
+  return true;
+}
+
+// ddmm.mmmm or dddmm.mmmm and the hemisphere to 1e-7
+// degrees
+inline bool parse_coordinate(std::string_view text, std::string_view hemisphere, int32_t& coordinate)
+{
+  int32_t value;
+  if(hemisphere.size() != 1 || !parse_decimal(text, 5, value) || value < 0)
+  {
+    return false;
+  }
+  // Minutes in 1e-5, to 1e-7 degrees
+  const auto degrees = value / 10000000;
+  const auto minutes = value % 10000000;
+  coordinate = degrees * 10000000 + (minutes * 10 + 3) / 6;
+  if(hemisphere[0] == 'S' || hemisphere[0] == 'W')
+  {
+    coordinate = -coordinate;
+  }
+  return true;
+}
+
+inline bool decode_gga(const Sentence& sentence, gps_fix_t& fix)
+{
+  // Address, time, latitude, N/S, longitude, E/W,
+  // quality, satellites, HDOP, altitude
+  std::string_view fields[10];
+  if(!sentence.is("GGA") || sentence.split(fields, 10) < 10)
+  {
+    return false;
+  }
+  int32_t value;
+  parse_time(fields[1], fix.time);
+  fix.quality = uint8_t(parse_decimal(fields[6], 0, value) ? value : 0);
+  if(fix.quality == 0)
+  {
+    return true;
+  }
+  parse_coordinate(fields[2], fields[3], fix.latitude);
+  parse_coordinate(fields[4], fields[5], fix.longitude);
+  if(parse_decimal(fields[7], 0, value))
+  {
+    fix.satellites = uint8_t(value);
+  }
+  if(parse_decimal(fields[8], 2, value))
+  {
+    fix.hdop = uint16_t(value);
+  }
+  parse_decimal(fields[9], 3, fix.altitude);
+  return true;
+}
+
+inline bool decode_rmc(const Sentence& sentence, gps_fix_t& fix)
+{
+  // Address, time, status, latitude, N/S, longitude,
+  // E/W, knots, course, date
+  std::string_view fields[10];
+  if(!sentence.is("RMC") || sentence.split(fields, 10) < 10)
+  {
+    return false;
+  }
+  int32_t value;
+  parse_time(fields[1], fix.time);
+  fix.valid = fields[2] == "A";
+  if(!fix.valid)
+  {
+    return true;
+  }
+  parse_coordinate(fields[3], fields[4], fix.latitude);
+  parse_coordinate(fields[5], fields[6], fix.longitude);
+  if(parse_decimal(fields[7], 3, value))
+  {
+    // A knot is 1852m per hour
+    fix.speed = int32_t((int64_t(value) * 1852 + 1800) / 3600);
+  }
+  if(parse_decimal(fields[8], 2, value))
+  {
+    fix.course = uint16_t(value);
+  }
+  if(parse_decimal(fields[9], 0, value))
+  {
+    fix.date = uint32_t(value);
+  }
+  return true;
+}
+
+// Updates the fix from a GGA or RMC sentence, false for
+// anything else
+inline bool decode(const Sentence& sentence, gps_fix_t& fix)
+{
+  return decode_gga(sentence, fix) || decode_rmc(sentence, fix);
+}
+
+} // namespace deets::nmea
@@ -0,0 +1,181 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define DEETS_PROFILING_DWT
+extern "C" uint32_t SystemCoreClock;
+#elif defined(RASPBERRYPI_PICO)
+#include <hardware/timer.h>
+#elif defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace deets::profiling {
+
+// The finest free running counter we have: the DWT cycle
+// counter on Cortex-M3/M4, the microsecond timer on the
+// Cortex-M0+ (which has no DWT) and a nanosecond clock on
+// the host. Differences are wrap safe as long as they
+// stay below 2^32 ticks, a minute at 72MHz.
+struct CycleCounter
+{
+  static void enable()
+  {
+#ifdef DEETS_PROFILING_DWT
+    volatile uint32_t& demcr = *reinterpret_cast<volatile uint32_t*>(0xE000EDFC);
+    volatile uint32_t& dwt_ctrl = *reinterpret_cast<volatile uint32_t*>(0xE0001000);
+    volatile uint32_t& dwt_cyccnt = *reinterpret_cast<volatile uint32_t*>(0xE0001004);
+    // TRCENA, then CYCCNTENA
+    demcr |= 1u << 24;
+    dwt_cyccnt = 0;
+    dwt_ctrl |= 1u;
+#endif
+  }
+
+  static uint32_t now()
+  {
+#if defined(DEETS_PROFILING_DWT)
+    return *reinterpret_cast<volatile uint32_t*>(0xE0001004);
+#elif defined(RASPBERRYPI_PICO)
+    return time_us_32();
+#elif defined(ARDUINO)
+    return micros();
+#else
+    return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  static uint32_t ticks_per_microsecond()
+  {
+#if defined(DEETS_PROFILING_DWT)
+    return SystemCoreClock / 1000000;
+#elif defined(RASPBERRYPI_PICO) || defined(ARDUINO)
+    return 1;
+#else
+    return 1000;
+#endif
+  }
+};
+
+// Durations in microseconds in power of two buckets:
+// bucket 0 holds everything below 1us, bucket k the
+// range [2^(k-1), 2^k) and the last one the rest.
+//
+// Recording is a handful of integer operations and
+// never allocates. There is exactly one writer, so on
+// a dual core chip another core may read, but only
+// the writer may reset.
+template<size_t Buckets=16>
+class Histogram
+{
+public:
+  void record(uint32_t microseconds)
+  {
+    ++_buckets[bucket(microseconds)];
+    ++_count;
+    _total += microseconds;
+    if(microseconds > _max)
+    {
+      _max = microseconds;
+    }
+  }
+
+  uint32_t count() const { return _count; }
+  uint32_t max() const { return _max; }
+
+  uint32_t mean() const
+  {
+    return _count ? uint32_t(_total / _count) : 0;
+  }
+
+  // Upper bound of the bucket the quantile falls into,
+  // given in percent to avoid floating point.
+  uint32_t percentile(uint32_t percent) const
+  {
+    const uint64_t threshold = (uint64_t(_count) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for(size_t k = 0; k < Buckets; ++k)
+    {
+      seen += _buckets[k];
+      if(seen >= threshold && seen)
+      {
+        const uint32_t upper = k + 1 < Buckets ? uint32_t(1) << k : _max;
+        return upper < _max ? upper : _max;
+      }
+    }
+    return _max;
+  }
+
+  uint32_t bucket_count(size_t k) const { return _buckets[k]; }
+
+  // Adds the samples of another one, e.g. of another thread
+  void merge(const Histogram& other)
+  {
+    for(size_t k = 0; k < Buckets; ++k)
+    {
+      _buckets[k] += other._buckets[k];
+    }
+    _count += other._count;
+    _total += other._total;
+    if(other._max > _max)
+    {
+      _max = other._max;
+    }
+  }
+
+  void reset()
+  {
+    _buckets = {};
+    _count = 0;
+    _total = 0;
+    _max = 0;
+  }
+
+private:
+  static size_t bucket(uint32_t microseconds)
+  {
+    if(microseconds == 0)
+    {
+      return 0;
+    }
+    const size_t k = 32 - __builtin_clz(microseconds);
+    return k < Buckets ? k : Buckets - 1;
+  }
+
+  std::array<uint32_t, Buckets> _buckets = {};
+  uint32_t _count = 0;
+  uint64_t _total = 0;
+  uint32_t _max = 0;
+};
+
+// Records the lifetime of the probe into a histogram
+template<typename Histogram>
+class ScopedProbe
+{
+public:
+  explicit ScopedProbe(Histogram& histogram)
+    : _histogram(histogram)
+    , _start(CycleCounter::now())
+  {}
+
+  ~ScopedProbe()
+  {
+    _histogram.record((CycleCounter::now() - _start) / CycleCounter::ticks_per_microsecond());
+  }
+
+  ScopedProbe(const ScopedProbe&) = delete;
+  ScopedProbe& operator=(const ScopedProbe&) = delete;
+
+private:
+  Histogram& _histogram;
+  uint32_t _start;
+};
+
+} // namespace deets::profiling
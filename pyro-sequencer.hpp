@@ -0,0 +1,234 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "junior-rocket-state.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+namespace far::junior {
+
+constexpr size_t PYRO_CHANNELS = 4;
+
+// Entering a state switches a channel on for a while,
+// after a delay.
+struct pyro_rule_t
+{
+  state on;
+  uint8_t channel;
+  duration_t delay;
+  duration_t duration;
+};
+
+// The states a channel may be on in, a bit per state
+using pyro_arming_t = uint32_t;
+static_assert(size_t(state::LANDED) < 32, "pyro_arming_t needs more bits");
+
+constexpr pyro_arming_t armed_in(std::initializer_list<state> states)
+{
+  pyro_arming_t arming = 0;
+  for(const auto s : states)
+  {
+    arming |= pyro_arming_t(1) << unsigned(s);
+  }
+  return arming;
+}
+
+// The separation charge of the lower stage. It may only be on
+// right after separation and while coasting up: anything else,
+// including SEPARATION_INHIBITED, switches it off for good.
+constexpr pyro_rule_t PYRO_RULES[] = {
+  { state::SEPARATION, 0, duration_t::zero(), std::chrono::milliseconds(500) },
+};
+constexpr std::array<pyro_arming_t, PYRO_CHANNELS> PYRO_ARMING = {
+  armed_in({ state::SEPARATION, state::COASTING }),
+  0,
+  0,
+  0,
+};
+
+// Switches the pyro channels from a timer interrupt, so
+// the edges don't wait for the loop, tones or the SD card.
+//
+// Each channel has at most one window, a later rule for it
+// replaces the earlier one. The windows are timed from the
+// sample that caused the transition, not from when drive()
+// got around to it. An edge that is due already happens
+// right away, in state_changed.
+//
+// The Hardware has
+//
+//   void write(uint8_t channel, bool on);
+//   // A one shot timer interrupt calling run() at ticks,
+//   // replacing the one set before
+//   void schedule(uint32_t ticks);
+//   void cancel();
+//   void disable_interrupts();
+//   void enable_interrupts();
+//
+// All times are MonotonicClock::ticks(), wrapping.
+template<typename Hardware>
+class PyroSequencer : public StateObserver
+{
+  enum class phase : uint8_t
+  {
+    IDLE,
+    WAITING,
+    ON,
+  };
+
+  struct window_t
+  {
+    uint32_t fire;
+    uint32_t clear;
+    phase current;
+  };
+
+public:
+  template<size_t N>
+  PyroSequencer(Hardware& hardware, const pyro_rule_t (&rules)[N],
+                const std::array<pyro_arming_t, PYRO_CHANNELS>& arming)
+    : _hardware(hardware)
+    , _rules(rules)
+    , _rule_count(N)
+    , _arming(arming)
+  {}
+
+  void state_changed(timestamp_t timestamp, state to) override
+  {
+    state_changed(uint32_t(timestamp.time_since_epoch().count()), MonotonicClock::ticks(), to);
+  }
+
+  // entered is when the sample leading to the state was
+  // taken, now is when we learned about it.
+  void state_changed(uint32_t entered, uint32_t now, state to)
+  {
+    _hardware.disable_interrupts();
+    _state = to;
+    for(size_t channel = 0; channel < PYRO_CHANNELS; ++channel)
+    {
+      if(!armed(channel))
+      {
+        switch_off(channel);
+      }
+    }
+    for(size_t i = 0; i < _rule_count; ++i)
+    {
+      const auto& rule = _rules[i];
+      if(rule.on != to || rule.channel >= PYRO_CHANNELS || !armed(rule.channel))
+      {
+        continue;
+      }
+      switch_off(rule.channel);
+      auto& window = _windows[rule.channel];
+      window.fire = entered + uint32_t(rule.delay.count());
+      window.clear = window.fire + uint32_t(rule.duration.count());
+      window.current = phase::WAITING;
+    }
+    process(now);
+    _hardware.enable_interrupts();
+  }
+
+  // From the timer interrupt
+  void run(uint32_t now)
+  {
+    process(now);
+  }
+
+  bool on(uint8_t channel) const
+  {
+    return _windows[channel].current == phase::ON;
+  }
+
+  // Microseconds the latest edge came after its time,
+  // because of the interrupt or a late transition
+  uint32_t worst_latency = 0;
+
+private:
+  static bool due(uint32_t at, uint32_t now)
+  {
+    return int32_t(now - at) >= 0;
+  }
+
+  bool armed(size_t channel) const
+  {
+    return _arming[channel] & (pyro_arming_t(1) << unsigned(_state));
+  }
+
+  void switch_off(size_t channel)
+  {
+    auto& window = _windows[channel];
+    if(window.current == phase::ON)
+    {
+      _hardware.write(uint8_t(channel), false);
+    }
+    window.current = phase::IDLE;
+  }
+
+  void edge(size_t channel, uint32_t at, uint32_t now, bool on)
+  {
+    _hardware.write(uint8_t(channel), on);
+    if(now - at > worst_latency)
+    {
+      worst_latency = now - at;
+    }
+  }
+
+  // Makes the due edges and sets the timer for the next
+  void process(uint32_t now)
+  {
+    bool pending = false;
+    uint32_t next = 0;
+    for(size_t channel = 0; channel < PYRO_CHANNELS; ++channel)
+    {
+      auto& window = _windows[channel];
+      if(window.current == phase::WAITING && due(window.fire, now))
+      {
+        // Checked again, the state might have changed
+        // since the window was set
+        if(armed(channel))
+        {
+          edge(channel, window.fire, now, true);
+          window.current = phase::ON;
+        }
+        else
+        {
+          window.current = phase::IDLE;
+        }
+      }
+      if(window.current == phase::ON && due(window.clear, now))
+      {
+        edge(channel, window.clear, now, false);
+        window.current = phase::IDLE;
+      }
+      if(window.current != phase::IDLE)
+      {
+        const auto at = window.current == phase::WAITING ? window.fire : window.clear;
+        if(!pending || int32_t(at - next) < 0)
+        {
+          next = at;
+        }
+        pending = true;
+      }
+    }
+    if(pending)
+    {
+      _hardware.schedule(next);
+    }
+    else
+    {
+      _hardware.cancel();
+    }
+  }
+
+  Hardware& _hardware;
+  const pyro_rule_t* _rules;
+  size_t _rule_count;
+  std::array<pyro_arming_t, PYRO_CHANNELS> _arming;
+  std::array<window_t, PYRO_CHANNELS> _windows = {};
+  state _state = state::IDLE;
+};
+
+} // namespace far::junior
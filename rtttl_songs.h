@@ -1,9 +1,11 @@
 #ifndef __RTTTL_SONGS_H__
 #define __RTTTL_SONGS_H__
 
+#include "board-traits.hpp"
+
 #define OCTAVE_OFFSET 0
 
-const int tonePin = TONE_PIN;
+const int tonePin = far::junior::Board::TONE_PIN;
 
 int notes[] = { 0,
 262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494,
@@ -34,89 +36,102 @@ char *jeopardy_song = "Jeopardy:d=4,o=6,b=125:c,f,c,f5,c,f,2c,c,f,c,f,a.,8g,8f,8
 //char *song = "MahnaMahna:d=16,o=6,b=125:c#,c.,b5,8a#.5,8f.,4g#,a#,g.,4d#,8p,c#,c.,b5,8a#.5,8f.,g#.,8a#.,4g,8p,c#,c.,b5,8a#.5,8f.,4g#,f,g.,8d#.,f,g.,8d#.,f,8g,8d#.,f,8g,d#,8c,a#5,8d#.,8d#.,4d#,8d#.";
 //char *song = "LeisureSuit:d=16,o=6,b=56:f.5,f#.5,g.5,g#5,32a#5,f5,g#.5,a#.5,32f5,g#5,32a#5,g#5,8c#.,a#5,32c#,a5,a#.5,c#.,32a5,a#5,32c#,d#,8e,c#.,f.,f.,f.,f.,f,32e,d#,8d,a#.5,e,32f,e,32f,c#,d#.,c#";
 char *impossible_song = "MissionImp:d=16,o=6,b=95:32d,32d#,32d,32d#,32d,32d#,32d,32d#,32d,32d,32d#,32e,32f,32f#,32g,g,8p,g,8p,a#,p,c7,p,g,8p,g,8p,f,p,f#,p,g,8p,g,8p,a#,p,c7,p,g,8p,g,8p,f,p,f#,p,a#,g,2d,32p,a#,g,2c#,32p,a#,g,2c,a#5,8c,2p,32p,a#5,g5,2f#,32p,a#5,g5,2f,32p,a#5,g5,2e,d#,8d";
+//the state tunes, 440Hz, 880Hz and 1760Hz for launch and three beeps at apogee
+char *launched_song = "Launched:d=4,o=5,b=120:a4,a,a6";
+char *falling_song = "Falling:d=16,o=6,b=150:f#,p,f#,p,f#";
 
 
-void play_rtttl(char *p)
+// One note of a song: its frequency, 0 for a pause, and
+// how long it lasts in milliseconds
+struct rtttl_note_t
 {
-  // Absolutely no error checking in here
-
-  byte default_dur = 4;
-  byte default_oct = 6;
-  int bpm = 63;
-  int num;
-  long wholenote;
+  int frequency;
   long duration;
-  byte note;
-  byte scale;
-
-  // format: d=N,o=N,b=NNN:
-  // find the start (skip name, etc)
-
-  while(*p != ':') p++;    // ignore name
-  p++;                     // skip ':'
+};
 
-  // get default duration
-  if(*p == 'd')
+// Walks through a song a note at a time, so it can be
+// played in a blocking loop or from a task
+class RtttlParser
+{
+public:
+  void begin(const char *p)
   {
-    p++; p++;              // skip "d="
-    num = 0;
-    while(isdigit(*p))
-    {
-      num = (num * 10) + (*p++ - '0');
-    }
-    if(num > 0) default_dur = num;
-    p++;                   // skip comma
-  }
+    // Absolutely no error checking in here
 
-  //Serial.print("ddur: "); Serial.println(default_dur, 10);
+    default_dur = 4;
+    default_oct = 6;
+    int bpm = 63;
+    int num;
 
-  // get default octave
-  if(*p == 'o')
-  {
-    p++; p++;              // skip "o="
-    num = *p++ - '0';
-    if(num >= 3 && num <=7) default_oct = num;
-    p++;                   // skip comma
-  }
+    // format: d=N,o=N,b=NNN:
+    // find the start (skip name, etc)
 
-  //Serial.print("doct: "); Serial.println(default_oct, 10);
+    while(*p != ':') p++;    // ignore name
+    p++;                     // skip ':'
 
-  // get BPM
-  if(*p == 'b')
-  {
-    p++; p++;              // skip "b="
-    num = 0;
-    while(isdigit(*p))
+    // get default duration
+    if(*p == 'd')
     {
-      num = (num * 10) + (*p++ - '0');
+      p++; p++;              // skip "d="
+      num = 0;
+      while(isdigit(*p))
+      {
+        num = (num * 10) + (*p++ - '0');
+      }
+      if(num > 0) default_dur = num;
+      p++;                   // skip comma
     }
-    bpm = num;
-    p++;                   // skip colon
-  }
 
-  //Serial.print("bpm: "); Serial.println(bpm, 10);
+    // get default octave
+    if(*p == 'o')
+    {
+      p++; p++;              // skip "o="
+      num = *p++ - '0';
+      if(num >= 3 && num <=7) default_oct = num;
+      p++;                   // skip comma
+    }
 
-  // BPM usually expresses the number of quarter notes per minute
-  wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
+    // get BPM
+    if(*p == 'b')
+    {
+      p++; p++;              // skip "b="
+      num = 0;
+      while(isdigit(*p))
+      {
+        num = (num * 10) + (*p++ - '0');
+      }
+      bpm = num;
+      p++;                   // skip colon
+    }
 
-  //Serial.print("wn: "); Serial.println(wholenote, 10);
+    // BPM usually expresses the number of quarter notes per minute
+    wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
 
+    _p = p;
+  }
 
-  // now begin note loop
-  while(*p)
+  // False at the end of the song
+  bool next(rtttl_note_t& result)
   {
+    const char *p = _p;
+    if(!p || !*p)
+    {
+      return false;
+    }
+
     // first, get note duration, if available
-    num = 0;
+    int num = 0;
     while(isdigit(*p))
     {
       num = (num * 10) + (*p++ - '0');
     }
 
+    long duration;
     if(num) duration = wholenote / num;
     else duration = wholenote / default_dur;  // we will need to check if we are a dotted note after
 
     // now get the note
-    note = 0;
+    byte note = 0;
 
     switch(*p)
     {
@@ -162,6 +177,7 @@ void play_rtttl(char *p)
     }
 
     // now, get scale
+    byte scale;
     if(isdigit(*p))
     {
       scale = *p - '0';
@@ -177,27 +193,104 @@ void play_rtttl(char *p)
     if(*p == ',')
       p++;       // skip comma for next note (or we may be at the end)
 
-    // now play the note
+    _p = p;
+    result.frequency = note ? notes[(scale - 4) * 12 + note] : 0;
+    result.duration = duration;
+    return true;
+  }
+
+  void end()
+  {
+    _p = nullptr;
+  }
 
-    if(note)
+private:
+  const char *_p = nullptr;
+  byte default_dur;
+  byte default_oct;
+  long wholenote;
+};
+
+
+void play_rtttl(char *p)
+{
+  RtttlParser song;
+  rtttl_note_t note;
+  song.begin(p);
+  while(song.next(note))
+  {
+    if(note.frequency)
     {
-      //Serial.print("Playing: ");
-      //Serial.print(scale, 10); Serial.print(' ');
-      //Serial.print(note, 10); Serial.print(" (");
-      //Serial.print(notes[(scale - 4) * 12 + note], 10);
-      //Serial.print(") ");
-      //Serial.println(duration, 10);
-      tone(tonePin, notes[(scale - 4) * 12 + note]);
-      delay(duration);
+      tone(tonePin, note.frequency);
+      delay(note.duration);
       noTone(tonePin);
     }
     else
     {
-      //Serial.print("Pausing: ");
-      //Serial.println(duration, 10);
-      delay(duration);
+      delay(note.duration);
     }
   }
 }
 
+
+// Plays a song without holding anything up. tone() runs
+// off a timer, update() only starts the next note when
+// the last one is over, so call it every few milliseconds.
+class RtttlPlayer
+{
+public:
+  void play(const char *p)
+  {
+    _song.begin(p);
+    _playing = true;
+    _note_end = millis();
+  }
+
+  void stop()
+  {
+    if(_playing)
+    {
+      _song.end();
+      _playing = false;
+      noTone(tonePin);
+    }
+  }
+
+  bool playing() const
+  {
+    return _playing;
+  }
+
+  void update()
+  {
+    const unsigned long now = millis();
+    if(!_playing || long(now - _note_end) < 0)
+    {
+      return;
+    }
+    rtttl_note_t note;
+    if(!_song.next(note))
+    {
+      stop();
+      return;
+    }
+    if(note.frequency)
+    {
+      tone(tonePin, note.frequency, note.duration);
+    }
+    // From when the last note should have ended, so a late
+    // update doesn't drag the song
+    _note_end += note.duration;
+    if(long(now - _note_end) > 0)
+    {
+      _note_end = now + note.duration;
+    }
+  }
+
+private:
+  RtttlParser _song;
+  bool _playing = false;
+  unsigned long _note_end = 0;
+};
+
 #endif
@@ -0,0 +1,184 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace deets::scheduling {
+
+enum class task_kind : uint8_t
+{
+  // Runs whenever it is due
+  REQUIRED,
+  // Skipped when it would make a required task miss its deadline
+  OPTIONAL,
+};
+
+template<typename Duration>
+struct task_statistics_t
+{
+  uint32_t runs = 0;
+  // Finished after the next release was due
+  uint32_t deadline_misses = 0;
+  // Releases skipped to make room for required tasks
+  uint32_t shed = 0;
+  Duration max_execution{};
+  // From the release to the start of the task
+  Duration max_lateness{};
+};
+
+// Cooperative rate-monotonic scheduler.
+//
+// Tasks run to completion, in the order of their periods,
+// shortest first. A period of zero means the task runs on
+// every pass. The deadline of a task is its next release,
+// so fits() keeps no room for a task without a period.
+//
+// Before an optional task runs, its estimated execution is
+// compared against the slack of the required tasks. If it
+// does not fit, this release is shed, so an overrunning
+// loop drops telemetry before control work.
+//
+// The estimate follows an overrun at once, but decays back
+// with every normal run, so one blocking pass (e.g. a
+// stalled bus) doesn't shed the optional tasks for good. A
+// shed task halves its own estimate, so it gets tried again.
+template<typename Clock, size_t N>
+class Scheduler
+{
+public:
+  using time_point = typename Clock::time_point;
+  using duration = typename Clock::duration;
+  using function_t = void (*)();
+  using statistics_t = task_statistics_t<duration>;
+
+  // An estimate above the execution closes 1/ESTIMATE_DECAY
+  // of the gap per run
+  static constexpr int ESTIMATE_DECAY = 4;
+
+  // False if all N slots are taken
+  bool add(const char* name, function_t function, duration period, task_kind kind=task_kind::REQUIRED)
+  {
+    if(_count == N)
+    {
+      return false;
+    }
+    // Keep the rate-monotonic order, equal periods in
+    // the order they were added.
+    size_t position = _count++;
+    for(; position > 0 && _tasks[position - 1].period > period; --position)
+    {
+      _tasks[position] = _tasks[position - 1];
+    }
+    _tasks[position] = { name, function, period, kind, Clock::now(), {}, {} };
+    return true;
+  }
+
+  // Runs each due task once, returns how many ran
+  size_t run_once()
+  {
+    size_t ran = 0;
+    for(auto& task : in_use())
+    {
+      const auto start = Clock::now();
+      if(start < task.release)
+      {
+        continue;
+      }
+      if(task.kind == task_kind::OPTIONAL && !fits(task, start))
+      {
+        ++task.statistics.shed;
+        task.estimate /= 2;
+        task.release = start + task.period;
+        continue;
+      }
+      task.function();
+      const auto end = Clock::now();
+
+      const auto execution = end - start;
+      task.estimate = execution > task.estimate ? execution
+                                                : task.estimate - (task.estimate - execution) / ESTIMATE_DECAY;
+      auto& statistics = task.statistics;
+      ++statistics.runs;
+      statistics.max_execution = std::max(statistics.max_execution, execution);
+      statistics.max_lateness = std::max(statistics.max_lateness, start - task.release);
+      const auto deadline = task.release + task.period;
+      if(task.period != duration::zero() && end > deadline)
+      {
+        ++statistics.deadline_misses;
+      }
+      // Don't try to catch up if we fell behind
+      task.release = end > deadline ? end : deadline;
+      ++ran;
+    }
+    return ran;
+  }
+
+  size_t size() const { return _count; }
+
+  // In rate-monotonic order
+  const char* name(size_t i) const { return _tasks[i].name; }
+  const statistics_t& statistics(size_t i) const { return _tasks[i].statistics; }
+
+  void reset_statistics()
+  {
+    for(auto& task : in_use())
+    {
+      task.statistics = {};
+    }
+  }
+
+private:
+  struct task_t
+  {
+    const char* name;
+    function_t function;
+    duration period;
+    task_kind kind;
+    time_point release;
+    // What fits() expects the next run to take
+    duration estimate;
+    statistics_t statistics;
+  };
+
+  struct range_t
+  {
+    task_t* first;
+    task_t* last;
+    task_t* begin() const { return first; }
+    task_t* end() const { return last; }
+  };
+
+  range_t in_use()
+  {
+    return { _tasks.data(), _tasks.data() + _count };
+  }
+
+  // Would the task finish before any pending required
+  // task has to start to meet its deadline?
+  bool fits(const task_t& candidate, time_point now) const
+  {
+    const auto finish = now + candidate.estimate;
+    for(size_t i = 0; i < _count; ++i)
+    {
+      const auto& task = _tasks[i];
+      if(task.kind != task_kind::REQUIRED || task.period == duration::zero())
+      {
+        continue;
+      }
+      const auto latest_start = task.release + task.period - task.estimate;
+      if(finish > latest_start)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::array<task_t, N> _tasks;
+  size_t _count = 0;
+};
+
+} // namespace deets::scheduling
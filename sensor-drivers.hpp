@@ -0,0 +1,378 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "boot-sequence.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deets::sensors {
+
+// The drivers talk to a Bus with
+//
+//   bool write(uint8_t address, const uint8_t* data, size_t size);
+//   // The register address, a repeated start, then a burst
+//   bool read(uint8_t address, uint8_t reg, uint8_t* data, size_t size);
+//
+// WireBus adapts the Arduino TwoWire, the host tools
+// use a mock that counts the transactions.
+template<typename Wire>
+class WireBus
+{
+public:
+  explicit WireBus(Wire& wire)
+    : _wire(wire)
+  {}
+
+  bool write(uint8_t address, const uint8_t* data, size_t size)
+  {
+    _wire.beginTransmission(address);
+    _wire.write(data, size);
+    return _wire.endTransmission() == 0;
+  }
+
+  bool read(uint8_t address, uint8_t reg, uint8_t* data, size_t size)
+  {
+    _wire.beginTransmission(address);
+    _wire.write(reg);
+    if(_wire.endTransmission(false) != 0)
+    {
+      return false;
+    }
+    if(_wire.requestFrom(address, uint8_t(size)) != size)
+    {
+      return false;
+    }
+    for(size_t i = 0; i < size; ++i)
+    {
+      data[i] = uint8_t(_wire.read());
+    }
+    return true;
+  }
+
+private:
+  Wire& _wire;
+};
+
+// Integers as the sensors deliver them, so the conversion
+// to the sample type happens once and without floats.
+struct bmp280_measurement_t
+{
+  // 1/100 degree Celsius
+  int32_t temperature;
+  // Pa in Q24.8
+  uint32_t pressure;
+};
+
+enum class bmp280_mode : uint8_t { SLEEP = 0, FORCED = 1, NORMAL = 3 };
+enum class bmp280_oversampling : uint8_t { SKIPPED, X1, X2, X4, X8, X16 };
+enum class bmp280_filter : uint8_t { OFF, X2, X4, X8, X16 };
+// t_sb of the datasheet, the standby between conversions
+enum class bmp280_standby : uint8_t { MS_0_5, MS_62_5, MS_125, MS_250, MS_500, MS_1000, MS_2000, MS_4000 };
+
+// The trimming parameters of a BMP280 and the integer
+// compensation of the datasheet (section 3.11.3), with
+// the 64 bit variant for the pressure.
+class Bmp280Calibration
+{
+public:
+  static constexpr size_t SIZE = 24;
+
+  // From the SIZE registers starting at 0x88
+  static Bmp280Calibration from_registers(const uint8_t* registers)
+  {
+    const auto u16 = [registers](size_t i) {
+      return uint16_t(registers[2 * i] | (registers[2 * i + 1] << 8));
+    };
+    Bmp280Calibration result;
+    result.T1 = u16(0);
+    result.T2 = int16_t(u16(1));
+    result.T3 = int16_t(u16(2));
+    result.P1 = u16(3);
+    for(size_t i = 0; i < 8; ++i)
+    {
+      result.P[i] = int16_t(u16(4 + i));
+    }
+    return result;
+  }
+
+  // Fine resolution temperature, needed for the pressure
+  int32_t t_fine(int32_t adc_T) const
+  {
+    const int32_t var1 = (((adc_T >> 3) - (int32_t(T1) << 1)) * int32_t(T2)) >> 11;
+    const int32_t delta = (adc_T >> 4) - int32_t(T1);
+    const int32_t var2 = (((delta * delta) >> 12) * int32_t(T3)) >> 14;
+    return var1 + var2;
+  }
+
+  // 1/100 degree Celsius
+  static int32_t temperature(int32_t t_fine)
+  {
+    return (t_fine * 5 + 128) >> 8;
+  }
+
+  // Pa in Q24.8, 0 for a broken calibration
+  uint32_t pressure(int32_t adc_P, int32_t t_fine) const
+  {
+    const auto P2 = P[0], P3 = P[1], P4 = P[2], P5 = P[3], P6 = P[4], P7 = P[5], P8 = P[6], P9 = P[7];
+    int64_t var1 = int64_t(t_fine) - 128000;
+    int64_t var2 = var1 * var1 * P6;
+    var2 += var1 * P5 * (int64_t(1) << 17);
+    var2 += int64_t(P4) * (int64_t(1) << 35);
+    var1 = ((var1 * var1 * P3) >> 8) + var1 * P2 * (int64_t(1) << 12);
+    var1 = (((int64_t(1) << 47) + var1) * P1) >> 33;
+    if(var1 == 0)
+    {
+      return 0;
+    }
+    int64_t p = 1048576 - adc_P;
+    p = ((p * (int64_t(1) << 31)) - var2) * 3125 / var1;
+    var1 = (int64_t(P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (int64_t(P8) * p) >> 19;
+    return uint32_t(((p + var1 + var2) >> 8) + (int64_t(P7) << 4));
+  }
+
+  uint16_t T1;
+  int16_t T2;
+  int16_t T3;
+  uint16_t P1;
+  // P2 to P9
+  int16_t P[8];
+};
+
+// BMP280 driver that reads pressure and temperature in
+// one burst of six bytes and compensates both once.
+template<typename Bus>
+class Bmp280
+{
+  static constexpr uint8_t CHIP_ID_REGISTER = 0xD0;
+  static constexpr uint8_t CALIBRATION_REGISTER = 0x88;
+  static constexpr uint8_t CTRL_MEAS_REGISTER = 0xF4;
+  static constexpr uint8_t CONFIG_REGISTER = 0xF5;
+  // press_msb to temp_xlsb
+  static constexpr uint8_t DATA_REGISTER = 0xF7;
+  // What the ADC registers hold without a measurement
+  static constexpr int32_t SKIPPED = 0x80000;
+
+public:
+  static constexpr uint8_t CHIP_ID = 0x58;
+
+  explicit Bmp280(Bus& bus, uint8_t address = 0x77)
+    : _bus(bus)
+    , _address(address)
+  {}
+
+  // Checks the chip and reads the calibration in one burst
+  bool begin()
+  {
+    uint8_t id;
+    if(!_bus.read(_address, CHIP_ID_REGISTER, &id, 1) || id != CHIP_ID)
+    {
+      return false;
+    }
+    uint8_t registers[Bmp280Calibration::SIZE];
+    if(!_bus.read(_address, CALIBRATION_REGISTER, registers, sizeof(registers)))
+    {
+      return false;
+    }
+    _calibration = Bmp280Calibration::from_registers(registers);
+    return true;
+  }
+
+  bool configure(bmp280_mode mode, bmp280_oversampling temperature, bmp280_oversampling pressure,
+                 bmp280_filter filter, bmp280_standby standby)
+  {
+    const uint8_t config[2] = {
+      CONFIG_REGISTER, uint8_t((uint8_t(standby) << 5) | (uint8_t(filter) << 2))
+    };
+    const uint8_t ctrl_meas[2] = {
+      CTRL_MEAS_REGISTER, uint8_t((uint8_t(temperature) << 5) | (uint8_t(pressure) << 2) | uint8_t(mode))
+    };
+    return _bus.write(_address, config, sizeof(config)) && _bus.write(_address, ctrl_meas, sizeof(ctrl_meas));
+  }
+
+  // One transaction. False if the bus failed or there
+  // was no measurement yet.
+  bool read(bmp280_measurement_t& measurement)
+  {
+    uint8_t data[6];
+    if(!_bus.read(_address, DATA_REGISTER, data, sizeof(data)))
+    {
+      return false;
+    }
+    const int32_t adc_P = (int32_t(data[0]) << 12) | (int32_t(data[1]) << 4) | (data[2] >> 4);
+    const int32_t adc_T = (int32_t(data[3]) << 12) | (int32_t(data[4]) << 4) | (data[5] >> 4);
+    if(adc_T == SKIPPED || adc_P == SKIPPED)
+    {
+      return false;
+    }
+    const auto t_fine = _calibration.t_fine(adc_T);
+    measurement.temperature = Bmp280Calibration::temperature(t_fine);
+    measurement.pressure = _calibration.pressure(adc_P, t_fine);
+    return true;
+  }
+
+  const Bmp280Calibration& calibration() const { return _calibration; }
+
+private:
+  Bus& _bus;
+  uint8_t _address;
+  Bmp280Calibration _calibration = {};
+};
+
+// The sensor data of a BNO055 in the default units
+struct bno055_vectors_t
+{
+  int16_t acceleration[3];
+  int16_t magnetic[3];
+  int16_t angular_velocity[3];
+};
+
+// Reads accelerometer, magnetometer and gyroscope in one
+// burst of 18 bytes.
+template<typename Bus>
+class Bno055
+{
+  static constexpr uint8_t CHIP_ID_REGISTER = 0x00;
+  // ACC_DATA_X_LSB, followed by MAG_DATA and GYR_DATA
+  static constexpr uint8_t DATA_REGISTER = 0x08;
+  static constexpr uint8_t PAGE_ID_REGISTER = 0x07;
+  static constexpr uint8_t OPR_MODE_REGISTER = 0x3D;
+  static constexpr uint8_t PWR_MODE_REGISTER = 0x3E;
+  static constexpr uint8_t SYS_TRIGGER_REGISTER = 0x3F;
+  // On page 1
+  static constexpr uint8_t INT_MSK_REGISTER = 0x0F;
+  static constexpr uint8_t INT_EN_REGISTER = 0x10;
+
+  static constexpr uint8_t NDOF = 0x0C;
+  static constexpr uint8_t RST_SYS = 0x20;
+  static constexpr uint8_t CLK_SEL = 0x80;
+  static constexpr uint8_t ACC_BSX_DRDY = 0x01;
+
+  // The datasheet's power on reset time, then polls of
+  // the chip id for up to a second
+  static constexpr uint16_t RESET_MS = 650;
+  static constexpr uint16_t POLL_MS = 10;
+  static constexpr uint8_t MAX_POLLS = 100;
+
+public:
+  static constexpr uint8_t CHIP_ID = 0xA0;
+  static constexpr int16_t LSB_PER_METER_PER_SECOND2 = 100;
+  static constexpr int16_t LSB_PER_MICROTESLA = 16;
+  static constexpr int16_t LSB_PER_DEGREE_PER_SECOND = 16;
+
+  enum setup_step : uint8_t { PROBE, BOOTED, CONFIGURE, START, RUNNING };
+
+  explicit Bno055(Bus& bus, uint8_t address = 0x28)
+    : _bus(bus)
+    , _address(address)
+  {}
+
+  // Routes the accelerometer data ready to INT, if set
+  // before setup
+  void route_data_ready(bool route) { _route_data_ready = route; }
+
+  // Resets the chip and brings it up in NDOF with the
+  // external crystal, like the Adafruit driver, but a
+  // step at a time instead of delay()ing. See
+  // deets::boot::BootSequence.
+  deets::boot::step_t setup(uint8_t step)
+  {
+    using deets::boot::step_t;
+    switch(step)
+    {
+    case PROBE:
+      // Might still be booting after power on
+      if(!chip_ready())
+      {
+        return poll(PROBE);
+      }
+      _polls = 0;
+      write(PAGE_ID_REGISTER, 0);
+      write(SYS_TRIGGER_REGISTER, RST_SYS);
+      return step_t::wait(BOOTED, RESET_MS);
+    case BOOTED:
+      if(!chip_ready())
+      {
+        return poll(BOOTED);
+      }
+      return step_t::wait(CONFIGURE, 50);
+    case CONFIGURE:
+      // Normal power, and after a reset we are on
+      // page 0 in config mode
+      write(PWR_MODE_REGISTER, 0);
+      write(SYS_TRIGGER_REGISTER, CLK_SEL);
+      return step_t::wait(START, 10);
+    case START:
+      if(_route_data_ready)
+      {
+        write(PAGE_ID_REGISTER, 1);
+        write(INT_MSK_REGISTER, ACC_BSX_DRDY);
+        write(INT_EN_REGISTER, ACC_BSX_DRDY);
+        write(PAGE_ID_REGISTER, 0);
+      }
+      // From config to a fusion mode takes 7ms
+      if(!write(OPR_MODE_REGISTER, NDOF))
+      {
+        return step_t::failed();
+      }
+      return step_t::wait(RUNNING, 20);
+    default:
+      return step_t::done();
+    }
+  }
+
+  bool read(bno055_vectors_t& vectors)
+  {
+    uint8_t data[18];
+    if(!_bus.read(_address, DATA_REGISTER, data, sizeof(data)))
+    {
+      return false;
+    }
+    int16_t* destinations[3] = { vectors.acceleration, vectors.magnetic, vectors.angular_velocity };
+    for(size_t v = 0; v < 3; ++v)
+    {
+      for(size_t i = 0; i < 3; ++i)
+      {
+        const size_t offset = 6 * v + 2 * i;
+        destinations[v][i] = int16_t(data[offset] | (data[offset + 1] << 8));
+      }
+    }
+    return true;
+  }
+
+private:
+  bool chip_ready()
+  {
+    uint8_t id;
+    return _bus.read(_address, CHIP_ID_REGISTER, &id, 1) && id == CHIP_ID;
+  }
+
+  deets::boot::step_t poll(uint8_t step)
+  {
+    using deets::boot::step_t;
+    return ++_polls < MAX_POLLS ? step_t::wait(step, POLL_MS) : step_t::failed();
+  }
+
+  bool write(uint8_t reg, uint8_t value)
+  {
+    const uint8_t data[2] = { reg, value };
+    return _bus.write(_address, data, sizeof(data));
+  }
+
+  Bus& _bus;
+  uint8_t _address;
+  bool _route_data_ready = false;
+  uint8_t _polls = 0;
+};
+
+// A fixed point reading as a number, without going
+// through floating point: the integral part and the
+// remainder are converted separately.
+template<typename T>
+T scaled(int32_t value, int32_t divisor)
+{
+  return T(int(value / divisor)) + T(int(value % divisor)) / T(int(divisor));
+}
+
+} // namespace deets::sensors
@@ -0,0 +1,102 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include "spsc-queue.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace far::junior {
+
+enum class sensor_channel : uint8_t
+{
+  IMU,
+  MET,
+};
+
+constexpr size_t SENSOR_CHANNELS = 2;
+
+struct data_ready_t
+{
+  // MonotonicClock::ticks() when the interrupt fired
+  uint32_t timestamp;
+  sensor_channel channel;
+};
+
+// Collects the data ready records of the sensor interrupts.
+//
+// Each channel gets its own queue: the handlers might run
+// at different priorities and preempt each other, and a
+// SpscQueue must only ever have one producer.
+template<size_t N>
+class DataReadyQueue
+{
+public:
+  // Call from the interrupt handler of the channel
+  void signal(sensor_channel channel, uint32_t timestamp)
+  {
+    _queues[size_t(channel)].push({ timestamp, channel });
+  }
+
+  // The oldest pending record over all channels
+  bool next(data_ready_t& record)
+  {
+    size_t oldest = SENSOR_CHANNELS;
+    for(size_t i = 0; i < SENSOR_CHANNELS; ++i)
+    {
+      data_ready_t candidate;
+      if(_queues[i].peek(candidate))
+      {
+        // Wrap safe comparison of the timestamps
+        if(oldest == SENSOR_CHANNELS || int32_t(candidate.timestamp - record.timestamp) < 0)
+        {
+          oldest = i;
+          record = candidate;
+        }
+      }
+    }
+    return oldest != SENSOR_CHANNELS && _queues[oldest].pop(record);
+  }
+
+  // Interrupts we lost because nobody picked them up in time
+  uint32_t dropped(sensor_channel channel) const
+  {
+    return _queues[size_t(channel)].dropped();
+  }
+
+private:
+  std::array<deets::concurrency::SpscQueue<data_ready_t, N>, SENSOR_CHANNELS> _queues;
+};
+
+// Stands in for the sensor interrupts on the host, firing
+// each channel at its period as simulated time advances.
+template<size_t N>
+class MockInterruptSource
+{
+public:
+  MockInterruptSource(DataReadyQueue<N>& queue, const std::array<uint32_t, SENSOR_CHANNELS>& periods, uint32_t now=0)
+    : _queue(queue)
+    , _periods(periods)
+  {
+    _next.fill(now);
+  }
+
+  void advance_to(uint32_t now)
+  {
+    for(size_t i = 0; i < SENSOR_CHANNELS; ++i)
+    {
+      while(int32_t(now - _next[i]) >= 0)
+      {
+        _queue.signal(sensor_channel(i), _next[i]);
+        _next[i] += _periods[i];
+      }
+    }
+  }
+
+private:
+  DataReadyQueue<N>& _queue;
+  std::array<uint32_t, SENSOR_CHANNELS> _periods;
+  std::array<uint32_t, SENSOR_CHANNELS> _next;
+};
+
+} // namespace far::junior
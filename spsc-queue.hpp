@@ -0,0 +1,82 @@
+// (c) Diez Roggisch, 2023
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace deets::concurrency {
+
+// Lock-free queue for exactly one producer and one
+// consumer, e.g. two cores or an ISR and the main loop.
+//
+// Only plain atomic loads and stores are used, no
+// read-modify-write operations, so this works on a
+// Cortex-M0+ without LDREX/STREX as well.
+template<typename T, size_t N>
+class SpscQueue
+{
+  static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  // Producer side. Returns false and counts the
+  // item as dropped when the queue is full.
+  bool push(const T& item)
+  {
+    const auto head = _head.load(std::memory_order_relaxed);
+    if(head - _tail.load(std::memory_order_acquire) == N)
+    {
+      _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    _items[head % N] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.
+  bool pop(T& item)
+  {
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    if(tail == _head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = _items[tail % N];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, leaves the item in the queue.
+  bool peek(T& item) const
+  {
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    if(tail == _head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = _items[tail % N];
+    return true;
+  }
+
+  size_t size() const
+  {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  uint32_t dropped() const
+  {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::array<T, N> _items;
+  // Free running counters, only ever written by
+  // the producer (_head) and consumer (_tail).
+  std::atomic<size_t> _head{0};
+  std::atomic<size_t> _tail{0};
+  std::atomic<uint32_t> _dropped{0};
+};
+
+} // namespace deets::concurrency
@@ -1,8 +1,7 @@
 #pragma once
 
 #include "junior-rocket-state.hpp"
-#include "farduino_constants.h"
-// Must come after farduino_constants.h !
+#include "board-traits.hpp"
 #include "rtttl_songs.h"
 
 #include <RF24.h>
@@ -12,10 +11,20 @@ using namespace far::junior;
 class StateReactions : public StateObserver
 {
 public:
-  StateReactions(RF24& radio_nrf24)
+  // The pyro sequencer learns about a new state first. The
+  // tunes go to the player, the song task plays them
+  // without holding up the loop.
+  StateReactions(RF24& radio_nrf24, StateObserver& pyro, RtttlPlayer& songs)
     : _radio_nrf24(radio_nrf24)
+    , _pyro(pyro)
+    , _songs(songs)
   {}
 
+  state current_state() const
+  {
+    return _current_state;
+  }
+
   bool safe_to_flush_sd_card() const
   {
     return _current_state == state::IDLE || _current_state == state::ESTABLISH_GROUND_PRESSURE;
@@ -23,32 +32,25 @@ public:
 
   void state_changed(timestamp_t timestamp, state state) override
   {
+    _pyro.state_changed(timestamp, state);
     _current_state = state;
     switch(state)
     {
+    case state::ACCELERATION_DETECTED:
+      // The ready song is over once the rocket moves
+      _songs.stop();
+      break;
     case state::ACCELERATING:
       break;
     case state::LAUNCHED:
       _radio_nrf24.setPALevel(RF24_PA_MAX);
-      tone(TONE_PIN, 440, 500);
-      delay(500);
-      tone(TONE_PIN, 880, 500);
-      delay(500);
-      tone(TONE_PIN, 1760, 500);
+      _songs.play(launched_song);
       break;
     case state::FALLING_:
-      tone(TONE_PIN, 1500, 100);
-      delay(200);
-      tone(TONE_PIN, 1500, 100);
-      delay(200);
-      tone(TONE_PIN, 1500, 100);
+      _songs.play(falling_song);
       break;
     case state::LANDED:
-      digitalWrite(PYRO0, LOW);
-      digitalWrite(PYRO1, LOW);
-      digitalWrite(PYRO2, LOW);
-      digitalWrite(PYRO3, LOW);
-      play_rtttl(indiana_song);
+      _songs.play(indiana_song);
       _radio_nrf24.setPALevel(RF24_PA_HIGH);
       break;
     default:
@@ -56,7 +58,25 @@ public:
     }
   }
 
+  // After a reset, without the tones. The pyro sequencer
+  // picks up the window of the state where it was.
+  void state_restored(timestamp_t entered, state state) override
+  {
+    _pyro.state_changed(entered, state);
+    _current_state = state;
+    if(state >= state::ACCELERATION_DETECTED)
+    {
+      _songs.stop();
+    }
+    if(state >= state::LAUNCHED && state < state::LANDED)
+    {
+      _radio_nrf24.setPALevel(RF24_PA_MAX);
+    }
+  }
+
 private:
   RF24& _radio_nrf24;
-  state _current_state;
+  StateObserver& _pyro;
+  RtttlPlayer& _songs;
+  state _current_state = state::IDLE;
 };
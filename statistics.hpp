@@ -6,6 +6,7 @@
 #include <numeric>
 #include <cmath>
 #include <array>
+#include <tuple>
 
 namespace deets::statistics {
 
@@ -50,22 +51,24 @@ struct statistics_t
 
 };
 
+// Exponentially weighted average and variance, each new
+// sample weighing 1/N. Follows a level that drifts in O(1)
+// time and memory, and reports once it saw Confidence
+// samples.
 template <typename F, int N, int Confidence=N>
 struct RollingStatistics
 {
-  static constexpr F n = F(N);
+  static constexpr F n = static_cast<F>(N);
   using result_t = statistics_t<F>;
 
   RollingStatistics(F average_, F variance_)
     : average(average_)
     , variance(variance_)
-    , previous(average_)
   {
   }
 
   F average;
   F variance;
-  F previous;
   size_t updates = 0;
 
 
@@ -73,16 +76,15 @@ struct RollingStatistics
   {
     std::optional<result_t> result;
     ++updates;
-    const auto oldavg = average;
-    const auto newavg = oldavg + (value - previous) / n;
-    average = newavg;
-    variance += (value - previous) * (value - newavg + previous - oldavg) / (n - 1.0);
+    const auto deviation = value - average;
+    const auto increment = deviation / n;
+    average += increment;
+    variance = (variance + deviation * increment) * (static_cast<F>(1) - static_cast<F>(1) / n);
     // We  only report back if we've done this long enough
     if(updates >= Confidence)
     {
       result = { average, variance };
     }
-    previous = value;
     return result;
   }
 };
@@ -91,7 +93,7 @@ template<typename F, int N>
 struct ArrayStatistics
 {
   using result_t = statistics_t<F>;
-  static constexpr F n = F(N);
+  static constexpr F n = static_cast<F>(N);
 
   std::array<F, N> values;
   size_t updates = 0;
@@ -106,11 +108,12 @@ struct ArrayStatistics
         ) / n;
       const F variance = reduce(
         values.begin(), values.end(),
-        0.0, [average](const F& previous, const F& current)
+        F{}, [average](const F& previous, const F& current)
         {
-          return previous + std::pow(average - current, 2);
+          const auto deviation = average - current;
+          return previous + deviation * deviation;
         }
-        ) / (n - 1); // Not sure exactly why, but that's the python version
+        ) / (n - static_cast<F>(1)); // Not sure exactly why, but that's the python version
       return result_t{ average, variance };
     }
     return std::nullopt;
@@ -127,4 +130,293 @@ struct ArrayStatistics
   }
 };
 
+template<typename F, int Degree>
+struct polynomial_fit_t
+{
+  // Lowest order first
+  std::array<F, Degree + 1> coefficients;
+  // The variances of the coefficients
+  std::array<F, Degree + 1> variances;
+  F residual_variance;
+  F r_squared;
+};
+
+// Incremental least squares fit of a line and a parabola
+// to a stream of samples. Only the sums of the normal
+// equations are kept, so updates are O(1) and no history
+// is stored.
+template<typename F>
+struct LeastSquaresFit
+{
+  using linear_t = polynomial_fit_t<F, 1>;
+  using quadratic_t = polynomial_fit_t<F, 2>;
+
+  size_t updates = 0;
+  // We subtract the first y value to keep the
+  // sums small, this helps precision a lot.
+  F y0{};
+  F sx{}, sx2{}, sx3{}, sx4{};
+  F sy{}, sxy{}, sx2y{}, syy{};
+
+  void update(F x, F y)
+  {
+    if(updates++ == 0)
+    {
+      y0 = y;
+    }
+    y -= y0;
+    const auto x2 = x * x;
+    sx += x;
+    sx2 += x2;
+    sx3 += x2 * x;
+    sx4 += x2 * x2;
+    sy += y;
+    sxy += x * y;
+    sx2y += x2 * y;
+    syy += y * y;
+  }
+
+  std::optional<linear_t> linear() const
+  {
+    if(updates < 3)
+    {
+      return std::nullopt;
+    }
+    const F n = static_cast<F>(updates);
+    const auto det = n * sx2 - sx * sx;
+    if(det == F{})
+    {
+      return std::nullopt;
+    }
+    const auto slope = (n * sxy - sx * sy) / det;
+    const auto offset = (sy - slope * sx) / n;
+    const auto sse = std::max(F{}, syy - offset * sy - slope * sxy);
+    const auto sigma2 = sse / (n - static_cast<F>(2));
+    return linear_t{
+      { offset + y0, slope },
+      { sigma2 * sx2 / det, sigma2 * n / det },
+      sigma2,
+      r_squared(sse)
+    };
+  }
+
+  std::optional<quadratic_t> quadratic() const
+  {
+    if(updates < 4)
+    {
+      return std::nullopt;
+    }
+    const F n = static_cast<F>(updates);
+    // The inverse of the symmetric normal matrix
+    //   | n   sx  sx2 |
+    //   | sx  sx2 sx3 |
+    //   | sx2 sx3 sx4 |
+    // through its adjugate.
+    const auto a00 = sx2 * sx4 - sx3 * sx3;
+    const auto a01 = sx2 * sx3 - sx * sx4;
+    const auto a02 = sx * sx3 - sx2 * sx2;
+    const auto a11 = n * sx4 - sx2 * sx2;
+    const auto a12 = sx * sx2 - n * sx3;
+    const auto a22 = n * sx2 - sx * sx;
+    const auto det = n * a00 + sx * a01 + sx2 * a02;
+    if(det == F{})
+    {
+      return std::nullopt;
+    }
+    const auto c0 = (a00 * sy + a01 * sxy + a02 * sx2y) / det;
+    const auto c1 = (a01 * sy + a11 * sxy + a12 * sx2y) / det;
+    const auto c2 = (a02 * sy + a12 * sxy + a22 * sx2y) / det;
+    const auto sse = std::max(F{}, syy - c0 * sy - c1 * sxy - c2 * sx2y);
+    const auto sigma2 = sse / (n - static_cast<F>(3));
+    return quadratic_t{
+      { c0 + y0, c1, c2 },
+      { sigma2 * a00 / det, sigma2 * a11 / det, sigma2 * a22 / det },
+      sigma2,
+      r_squared(sse)
+    };
+  }
+
+private:
+  F r_squared(F sse) const
+  {
+    const auto sst = syy - sy * sy / static_cast<F>(updates);
+    return sst > F{} ? static_cast<F>(1.0) - sse / sst : static_cast<F>(1.0);
+  }
+};
+
+// The filters below sit between a sensor and whatever
+// compares its samples against thresholds. They take and
+// return one sample per update(), keep their history in
+// fixed arrays and work with float and fixed point alike.
+// The first sample primes them, as if it had been there
+// forever, so nothing jumps from zero to ground pressure.
+
+template<typename F>
+F absolute(F value)
+{
+  return value < F{} ? -value : value;
+}
+
+// Second order IIR section in direct form I, which keeps
+// the state in the range of the samples and so suits
+// fixed point. The coefficients are normalized to a0 = 1.
+template<typename F>
+struct Biquad
+{
+  F b0, b1, b2, a1, a2;
+  F x1{}, x2{}, y1{}, y2{};
+  bool primed = false;
+
+  // Butterworth for the default Q, after the Audio EQ
+  // Cookbook by R. Bristow-Johnson. Computed once in
+  // floating point, also for fixed point F.
+  static Biquad low_pass(float cutoff, float sample_rate, float q = 0.7071f)
+  {
+    const auto w0 = 2.0f * 3.14159265f * cutoff / sample_rate;
+    const auto alpha = std::sin(w0) / (2.0f * q);
+    const auto cosine = std::cos(w0);
+    const auto a0 = 1.0f + alpha;
+    const auto b = (1.0f - cosine) / 2.0f / a0;
+    return Biquad{
+      static_cast<F>(b), static_cast<F>(2.0f * b), static_cast<F>(b),
+      static_cast<F>(-2.0f * cosine / a0), static_cast<F>((1.0f - alpha) / a0)
+    };
+  }
+
+  F update(F x)
+  {
+    if(!primed)
+    {
+      primed = true;
+      x1 = x2 = y1 = y2 = x;
+    }
+    const F y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    return y;
+  }
+};
+
+// The average of the last N samples. N times the largest
+// sample has to fit into F.
+template<typename F, int N>
+struct MovingAverage
+{
+  static constexpr F n = static_cast<F>(N);
+
+  std::array<F, N> values;
+  F sum{};
+  size_t updates = 0;
+
+  F update(F value)
+  {
+    if(updates == 0)
+    {
+      values.fill(value);
+      sum = value * n;
+    }
+    auto& oldest = values[updates++ % N];
+    sum += value - oldest;
+    oldest = value;
+    // The running sum picks up rounding errors in
+    // floating point, start over once per lap
+    if(updates % N == 0)
+    {
+      sum = reduce(values.begin(), values.end());
+    }
+    return sum / n;
+  }
+};
+
+// The median of the last N samples, N odd. Keeps them
+// sorted as well, so an update is one shift of at most N.
+template<typename F, int N>
+struct SlidingMedian
+{
+  static_assert(N % 2 == 1, "the median of an odd number of samples is one of them");
+
+  std::array<F, N> values;
+  std::array<F, N> sorted;
+  size_t updates = 0;
+
+  F update(F value)
+  {
+    if(updates == 0)
+    {
+      values.fill(value);
+      sorted.fill(value);
+    }
+    auto& oldest = values[updates++ % N];
+    // Take the oldest out, shift the rest over its place
+    // and the new one into its place
+    auto position = std::lower_bound(sorted.begin(), sorted.end(), oldest);
+    const auto insert = std::upper_bound(sorted.begin(), sorted.end(), value);
+    if(insert > position)
+    {
+      position = std::copy(position + 1, insert, position);
+    }
+    else
+    {
+      std::copy_backward(insert, position, position + 1);
+      position = insert;
+    }
+    *position = value;
+    oldest = value;
+    return median();
+  }
+
+  F median() const
+  {
+    return sorted[N / 2];
+  }
+};
+
+// Replaces outliers with the median of the last N
+// samples. An outlier is further from the median than
+// Sigmas times the median absolute deviation, scaled to
+// estimate the standard deviation, and than Floor, so a
+// quiet sensor doesn't make every change an outlier. A
+// step passes once it makes up half the window.
+template<typename F, int N>
+struct Hampel
+{
+  F sigmas;
+  F floor;
+  SlidingMedian<F, N> window{};
+
+  F update(F value)
+  {
+    const auto median = window.update(value);
+    std::array<F, N> deviations;
+    std::transform(window.sorted.begin(), window.sorted.end(), deviations.begin(),
+                   [median](F sample) { return absolute(sample - median); });
+    std::nth_element(deviations.begin(), deviations.begin() + N / 2, deviations.end());
+    const auto limit = std::max(floor, sigmas * static_cast<F>(1.4826) * deviations[N / 2]);
+    return absolute(value - median) > limit ? median : value;
+  }
+};
+
+// Stages applied one after the other, e.g.
+//
+//   FilterChain<Hampel<F, 5>, Biquad<F>>
+template<typename... Stages>
+struct FilterChain
+{
+  std::tuple<Stages...> stages;
+
+  FilterChain(Stages... stages_)
+    : stages(stages_...)
+  {
+  }
+
+  template<typename F>
+  F update(F value)
+  {
+    std::apply([&value](auto&... stage) { ((value = stage.update(value)), ...); }, stages);
+    return value;
+  }
+};
+
 } // namespace deets::statistics
@@ -4,10 +4,90 @@
 #ifdef USE_IOSTREAM
 #include <ostream>
 #endif
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <unordered_map>
 
 namespace tfa {
 
+// One entry of a Trace, 8 bytes
+struct trace_record_t
+{
+  enum kind_t : uint8_t
+  {
+    // trigger is the event
+    EVENT,
+    // The state timed out, trigger is meaningless
+    TIMEOUT,
+    // The event led nowhere, to is from
+    REJECTED,
+  };
+
+  // Milliseconds since the automaton started
+  uint32_t at;
+  uint8_t from;
+  uint8_t to;
+  uint8_t trigger;
+  kind_t kind;
+};
+static_assert(sizeof(trace_record_t) == 8, "trace records are meant to be small");
+
+// The last records of what an automaton did, in storage
+// the owner provides. See TraceBuffer.
+class Trace
+{
+public:
+  Trace(trace_record_t* records, size_t capacity)
+    : _records{records}
+    , _capacity{capacity}
+  {}
+  Trace(const Trace&) = delete;
+  Trace& operator=(const Trace&) = delete;
+
+  void record(const trace_record_t& record)
+  {
+    _records[_next] = record;
+    _next = _next + 1 == _capacity ? 0 : _next + 1;
+    ++_recorded;
+  }
+
+  // The records still there, the oldest first
+  size_t size() const { return _recorded < _capacity ? size_t(_recorded) : _capacity; }
+  const trace_record_t& operator[](size_t i) const
+  {
+    const auto oldest = _recorded < _capacity ? 0 : _next;
+    const auto at = oldest + i;
+    return _records[at < _capacity ? at : at - _capacity];
+  }
+  // Including those overwritten since
+  uint32_t recorded() const { return _recorded; }
+
+  void clear()
+  {
+    _next = 0;
+    _recorded = 0;
+  }
+
+private:
+  trace_record_t* _records;
+  size_t _capacity;
+  size_t _next = 0;
+  uint32_t _recorded = 0;
+};
+
+template<size_t N>
+class TraceBuffer : public Trace
+{
+public:
+  TraceBuffer()
+    : Trace(_storage, N)
+  {}
+
+private:
+  trace_record_t _storage[N];
+};
+
 template<typename State, typename Event, typename TimePoint>
 class TimedFiniteAutomaton {
 public:
@@ -20,7 +100,30 @@ public:
     , _now{}
   {}
 
-  State state() { return _state; }
+  State state() const { return _state; }
+
+  Duration time_in_state() const { return _now - _state_change; }
+
+  // Puts us back into a state we were in before a reset,
+  // entered in_state ago, so its timeout keeps counting
+  // from there.
+  void restore(State state, Duration in_state)
+  {
+    _state = state;
+    _state_change = _now - in_state;
+    _rejected = 0;
+  }
+
+  // Records every transition into trace from now on, and
+  // the first time an event was rejected in each state.
+  // Repeats of a rejection don't take up records, so a long
+  // wait leaves the transitions before it in there. Up to
+  // 32 events and 256 states. nullptr stops it.
+  void trace(Trace* trace)
+  {
+    _trace = trace;
+    _rejected = 0;
+  }
 
   void add_transition(State from, Event what, State to)
   {
@@ -42,8 +145,13 @@ public:
       auto[timeout, to] = _timeout_transitions[_state];
       if(elapsed >= timeout)
       {
+        if(_trace)
+        {
+          record(trace_record_t::TIMEOUT, 0, to);
+        }
         _state = to;
         _state_change = _now;
+        _rejected = 0;
         return true;
       }
     }
@@ -57,13 +165,46 @@ public:
       auto& candidate = _event_transitions[_state];
       if(candidate.count(what))
       {
-        _state = candidate[what];
+        const auto to = candidate[what];
+        if(_trace)
+        {
+          record(trace_record_t::EVENT, static_cast<uint8_t>(what), to);
+        }
+        _state = to;
         _state_change = _now;
+        _rejected = 0;
         return true;
       }
     }
+    if(_trace)
+    {
+      const auto bit = uint32_t(1) << (static_cast<unsigned>(what) & 31);
+      if(!(_rejected & bit))
+      {
+        _rejected |= bit;
+        record(trace_record_t::REJECTED, static_cast<uint8_t>(what), _state);
+      }
+    }
     return false;
   }
+  // Calls visitor(from, trigger, to) for every transition,
+  // the trigger being either an Event or a Duration.
+  template<typename Visitor>
+  void each_transition(Visitor visitor) const
+  {
+    for(const auto& [from, edge] : _timeout_transitions)
+    {
+      visitor(from, edge.first, edge.second);
+    }
+    for(const auto& [from, edges] : _event_transitions)
+    {
+      for(const auto& [what, to] : edges)
+      {
+        visitor(from, what, to);
+      }
+    }
+  }
+
 #ifdef USE_IOSTREAM
   void dot(std::ostream& os, const char* time_signature) {
     os << "digraph timed_finite_automaton {\n";
@@ -103,12 +244,23 @@ public:
   }
 #endif
 private:
+  void record(trace_record_t::kind_t kind, uint8_t trigger, State to)
+  {
+    const auto since_start = std::chrono::duration_cast<std::chrono::milliseconds>(_now - TimePoint{});
+    _trace->record({ uint32_t(since_start.count()), static_cast<uint8_t>(_state), static_cast<uint8_t>(to),
+                     trigger, kind });
+  }
+
   State _start_state, _state;
   TimePoint _state_change;
   TimePoint _now;
 
   std::unordered_map<State, std::unordered_map<Event, State>> _event_transitions;
   std::unordered_map<State, std::pair<Duration, State>> _timeout_transitions;
+
+  Trace* _trace = nullptr;
+  // Bits by event, rejected in this state already
+  uint32_t _rejected = 0;
 };
 
 } // namespace tfa